@@ -55,4 +55,5 @@ export 'src/ffi_bindings.dart'
         OnnxGenAIStreamer,
         OnnxGenAIException,
         HealthStatus,
+        GenerationStatus,
         OnnxGenAIConfig;
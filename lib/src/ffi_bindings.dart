@@ -13,6 +13,7 @@ import 'dart:io';
 import 'dart:isolate';
 import 'dart:async';
 import 'dart:convert';
+import 'dart:typed_data';
 
 import 'package:ffi/ffi.dart';
 
@@ -24,7 +25,7 @@ import 'package:ffi/ffi.dart';
 typedef CheckNativeHealthNative = Int32 Function(Pointer<Utf8> modelPath);
 typedef CheckNativeHealthDart = int Function(Pointer<Utf8> modelPath);
 
-/// Native function: const char* run_inference(const char* model_path, const char* prompt, const char* image_path)
+/// Native function: char* run_inference(const char* model_path, const char* prompt, const char* image_path)
 typedef RunInferenceNative =
     Pointer<Utf8> Function(
       Pointer<Utf8> modelPath,
@@ -38,7 +39,7 @@ typedef RunInferenceDart =
       Pointer<Utf8> imagePath,
     );
 
-/// Native function: const char* run_text_inference(const char* model_path, const char* prompt, int32_t max_length)
+/// Native function: char* run_text_inference(const char* model_path, const char* prompt, int32_t max_length)
 typedef RunTextInferenceNative =
     Pointer<Utf8> Function(
       Pointer<Utf8> modelPath,
@@ -52,7 +53,7 @@ typedef RunTextInferenceDart =
       int maxLength,
     );
 
-/// Native function: const char* run_inference_multi(const char* model_path, const char* prompt, const char** image_paths, int32_t image_count)
+/// Native function: char* run_inference_multi(const char* model_path, const char* prompt, const char** image_paths, int32_t image_count)
 typedef RunInferenceMultiNative =
     Pointer<Utf8> Function(
       Pointer<Utf8> modelPath,
@@ -114,7 +115,19 @@ typedef ConfigSetProviderOptionDart =
       Pointer<Utf8> value,
     );
 
-/// Native function: const char* run_inference_with_config(int64_t config_handle, const char* prompt, const char* image_path)
+/// Native function: int32_t config_set_optimized_model_cache_dir(int64_t config_handle, const char* cache_dir)
+typedef ConfigSetOptimizedModelCacheDirNative =
+    Int32 Function(Int64 configHandle, Pointer<Utf8> cacheDir);
+typedef ConfigSetOptimizedModelCacheDirDart =
+    int Function(int configHandle, Pointer<Utf8> cacheDir);
+
+/// Native function: int32_t config_set_lazy_encoder_sessions(int64_t config_handle, int32_t idle_timeout_ms)
+typedef ConfigSetLazyEncoderSessionsNative =
+    Int32 Function(Int64 configHandle, Int32 idleTimeoutMs);
+typedef ConfigSetLazyEncoderSessionsDart =
+    int Function(int configHandle, int idleTimeoutMs);
+
+/// Native function: char* run_inference_with_config(int64_t config_handle, const char* prompt, const char* image_path)
 typedef RunInferenceWithConfigNative =
     Pointer<Utf8> Function(
       Int64 configHandle,
@@ -128,7 +141,7 @@ typedef RunInferenceWithConfigDart =
       Pointer<Utf8> imagePath,
     );
 
-/// Native function: const char* run_inference_multi_with_config(int64_t config_handle, const char* prompt, const char** image_paths, int32_t image_count)
+/// Native function: char* run_inference_multi_with_config(int64_t config_handle, const char* prompt, const char** image_paths, int32_t image_count)
 typedef RunInferenceMultiWithConfigNative =
     Pointer<Utf8> Function(
       Int64 configHandle,
@@ -148,6 +161,282 @@ typedef RunInferenceMultiWithConfigDart =
 typedef GetLastErrorNative = Pointer<Utf8> Function();
 typedef GetLastErrorDart = Pointer<Utf8> Function();
 
+/// Native function: void free_result(char* result)
+typedef FreeResultNative = Void Function(Pointer<Utf8> result);
+typedef FreeResultDart = void Function(Pointer<Utf8> result);
+
+// =============================================================================
+// Model Handle API Native Function Types
+// =============================================================================
+
+/// Native function: int64_t load_model(int64_t config_handle)
+typedef LoadModelNative = Int64 Function(Int64 configHandle);
+typedef LoadModelDart = int Function(int configHandle);
+
+/// Native function: int32_t unload_model(int64_t model_handle)
+typedef UnloadModelNative = Int32 Function(Int64 modelHandle);
+typedef UnloadModelDart = int Function(int modelHandle);
+
+/// Native function: int32_t set_prefix_cache_size(int64_t model_handle, int64_t max_bytes)
+typedef SetPrefixCacheSizeNative =
+    Int32 Function(Int64 modelHandle, Int64 maxBytes);
+typedef SetPrefixCacheSizeDart = int Function(int modelHandle, int maxBytes);
+
+/// Native function: int32_t set_image_cache_size(int64_t model_handle, int64_t max_bytes)
+typedef SetImageCacheSizeNative =
+    Int32 Function(Int64 modelHandle, Int64 maxBytes);
+typedef SetImageCacheSizeDart = int Function(int modelHandle, int maxBytes);
+
+/// Native function: int32_t release_idle_sessions(int64_t model_handle)
+typedef ReleaseIdleSessionsNative = Int32 Function(Int64 modelHandle);
+typedef ReleaseIdleSessionsDart = int Function(int modelHandle);
+
+/// Native function: int32_t set_prompt_lookup(int64_t model_handle, int32_t ngram_size, int32_t num_speculative_tokens)
+typedef SetPromptLookupNative =
+    Int32 Function(
+      Int64 modelHandle,
+      Int32 ngramSize,
+      Int32 numSpeculativeTokens,
+    );
+typedef SetPromptLookupDart =
+    int Function(int modelHandle, int ngramSize, int numSpeculativeTokens);
+
+/// Native function: char* run_inference_with_model(int64_t model_handle, const char* prompt, const char* image_path, int32_t max_length)
+typedef RunInferenceWithModelNative =
+    Pointer<Utf8> Function(
+      Int64 modelHandle,
+      Pointer<Utf8> prompt,
+      Pointer<Utf8> imagePath,
+      Int32 maxLength,
+    );
+typedef RunInferenceWithModelDart =
+    Pointer<Utf8> Function(
+      int modelHandle,
+      Pointer<Utf8> prompt,
+      Pointer<Utf8> imagePath,
+      int maxLength,
+    );
+
+/// Native function: char* run_inference_multi_with_model(int64_t model_handle, const char* prompt, const char** image_paths, int32_t image_count, int32_t max_length)
+typedef RunInferenceMultiWithModelNative =
+    Pointer<Utf8> Function(
+      Int64 modelHandle,
+      Pointer<Utf8> prompt,
+      Pointer<Pointer<Utf8>> imagePaths,
+      Int32 imageCount,
+      Int32 maxLength,
+    );
+typedef RunInferenceMultiWithModelDart =
+    Pointer<Utf8> Function(
+      int modelHandle,
+      Pointer<Utf8> prompt,
+      Pointer<Pointer<Utf8>> imagePaths,
+      int imageCount,
+      int maxLength,
+    );
+
+/// Native function: char* run_inference_with_image_buffers(int64_t model_handle, const char* prompt, const uint8_t** image_data, const int64_t* image_sizes, int32_t image_count, int32_t max_length)
+typedef RunInferenceWithImageBuffersNative =
+    Pointer<Utf8> Function(
+      Int64 modelHandle,
+      Pointer<Utf8> prompt,
+      Pointer<Pointer<Uint8>> imageData,
+      Pointer<Int64> imageSizes,
+      Int32 imageCount,
+      Int32 maxLength,
+    );
+typedef RunInferenceWithImageBuffersDart =
+    Pointer<Utf8> Function(
+      int modelHandle,
+      Pointer<Utf8> prompt,
+      Pointer<Pointer<Uint8>> imageData,
+      Pointer<Int64> imageSizes,
+      int imageCount,
+      int maxLength,
+    );
+
+/// Native function: char* run_inference_with_rgba(int64_t model_handle, const char* prompt, const uint8_t* pixels, int32_t width, int32_t height, int32_t stride, int32_t max_length)
+typedef RunInferenceWithRgbaNative =
+    Pointer<Utf8> Function(
+      Int64 modelHandle,
+      Pointer<Utf8> prompt,
+      Pointer<Uint8> pixels,
+      Int32 width,
+      Int32 height,
+      Int32 stride,
+      Int32 maxLength,
+    );
+typedef RunInferenceWithRgbaDart =
+    Pointer<Utf8> Function(
+      int modelHandle,
+      Pointer<Utf8> prompt,
+      Pointer<Uint8> pixels,
+      int width,
+      int height,
+      int stride,
+      int maxLength,
+    );
+
+/// Native function: char* run_text_inference_with_model(int64_t model_handle, const char* prompt, int32_t max_length)
+typedef RunTextInferenceWithModelNative =
+    Pointer<Utf8> Function(
+      Int64 modelHandle,
+      Pointer<Utf8> prompt,
+      Int32 maxLength,
+    );
+typedef RunTextInferenceWithModelDart =
+    Pointer<Utf8> Function(
+      int modelHandle,
+      Pointer<Utf8> prompt,
+      int maxLength,
+    );
+
+// =============================================================================
+// Streaming API Native Function Types
+// =============================================================================
+
+/// Native function: intptr_t init_dart_api_dl(void* data)
+typedef InitDartApiDLNative = IntPtr Function(Pointer<Void> data);
+typedef InitDartApiDLDart = int Function(Pointer<Void> data);
+
+/// Native function: int64_t stream_inference_with_model(int64_t model_handle, const char* prompt, const char** image_paths, int32_t image_count, int32_t max_length, int64_t send_port)
+typedef StreamInferenceWithModelNative =
+    Int64 Function(
+      Int64 modelHandle,
+      Pointer<Utf8> prompt,
+      Pointer<Pointer<Utf8>> imagePaths,
+      Int32 imageCount,
+      Int32 maxLength,
+      Int64 sendPort,
+    );
+typedef StreamInferenceWithModelDart =
+    int Function(
+      int modelHandle,
+      Pointer<Utf8> prompt,
+      Pointer<Pointer<Utf8>> imagePaths,
+      int imageCount,
+      int maxLength,
+      int sendPort,
+    );
+
+/// Message kinds posted by the native streaming worker as `[kind, text]`.
+class _StreamMessage {
+  static const int text = 0;
+  static const int done = 1;
+  static const int error = 2;
+  static const int cancelled = 3;
+}
+
+// =============================================================================
+// Background Generation API Native Function Types
+// =============================================================================
+
+/// Native function: int64_t start_generation(int64_t model_handle, const char* prompt, const char** image_paths, int32_t image_count, int32_t max_length)
+typedef StartGenerationNative =
+    Int64 Function(
+      Int64 modelHandle,
+      Pointer<Utf8> prompt,
+      Pointer<Pointer<Utf8>> imagePaths,
+      Int32 imageCount,
+      Int32 maxLength,
+    );
+typedef StartGenerationDart =
+    int Function(
+      int modelHandle,
+      Pointer<Utf8> prompt,
+      Pointer<Pointer<Utf8>> imagePaths,
+      int imageCount,
+      int maxLength,
+    );
+
+/// Native function: int32_t cancel_generation(int64_t request_id)
+typedef CancelGenerationNative = Int32 Function(Int64 requestId);
+typedef CancelGenerationDart = int Function(int requestId);
+
+/// Native function: char* poll_generation(int64_t request_id, int32_t* out_status)
+typedef PollGenerationNative =
+    Pointer<Utf8> Function(Int64 requestId, Pointer<Int32> outStatus);
+typedef PollGenerationDart =
+    Pointer<Utf8> Function(int requestId, Pointer<Int32> outStatus);
+
+// =============================================================================
+// Chat Session API Native Function Types
+// =============================================================================
+
+/// Native function: int64_t chat_open(int64_t model_handle, int32_t max_length,
+///   int32_t attention_sink_size)
+typedef ChatOpenNative =
+    Int64 Function(Int64 modelHandle, Int32 maxLength, Int32 attentionSinkSize);
+typedef ChatOpenDart =
+    int Function(int modelHandle, int maxLength, int attentionSinkSize);
+
+/// Native function: char* chat_send(int64_t chat_id, const char* message, int32_t max_new_tokens)
+typedef ChatSendNative =
+    Pointer<Utf8> Function(
+      Int64 chatId,
+      Pointer<Utf8> message,
+      Int32 maxNewTokens,
+    );
+typedef ChatSendDart =
+    Pointer<Utf8> Function(int chatId, Pointer<Utf8> message, int maxNewTokens);
+
+/// Native function: int32_t chat_rewind(int64_t chat_id, int32_t turn)
+typedef ChatRewindNative = Int32 Function(Int64 chatId, Int32 turn);
+typedef ChatRewindDart = int Function(int chatId, int turn);
+
+/// Native function: int32_t chat_save(int64_t chat_id, const char* path)
+typedef ChatSaveNative = Int32 Function(Int64 chatId, Pointer<Utf8> path);
+typedef ChatSaveDart = int Function(int chatId, Pointer<Utf8> path);
+
+/// Native function: int64_t chat_restore(int64_t model_handle, const char* path,
+///   int32_t max_length, int32_t attention_sink_size)
+typedef ChatRestoreNative =
+    Int64 Function(
+      Int64 modelHandle,
+      Pointer<Utf8> path,
+      Int32 maxLength,
+      Int32 attentionSinkSize,
+    );
+typedef ChatRestoreDart =
+    int Function(
+      int modelHandle,
+      Pointer<Utf8> path,
+      int maxLength,
+      int attentionSinkSize,
+    );
+
+/// Native function: int32_t chat_close(int64_t chat_id)
+typedef ChatCloseNative = Int32 Function(Int64 chatId);
+typedef ChatCloseDart = int Function(int chatId);
+
+// =============================================================================
+// Generation Status Codes
+// =============================================================================
+
+/// Status of a background generation, as reported by [OnnxGenAI.pollGeneration].
+class GenerationStatus {
+  /// No such request, or its final status was already polled.
+  static const int unknown = -2;
+
+  /// Generation failed; the polled text is the error message.
+  static const int failed = -1;
+
+  /// Waiting for a free native worker.
+  static const int queued = 0;
+
+  /// Generating.
+  static const int running = 1;
+
+  /// Finished normally.
+  static const int done = 2;
+
+  /// Stopped by [OnnxGenAI.cancelGeneration].
+  static const int cancelled = 3;
+
+  /// Whether [status] is final (the request has been released).
+  static bool isFinal(int status) => status != queued && status != running;
+}
+
 // =============================================================================
 // Health Check Status Codes
 // =============================================================================
@@ -381,9 +670,44 @@ class OnnxGenAI {
   late final ConfigClearProvidersDart _configClearProviders;
   late final ConfigAppendProviderDart _configAppendProvider;
   late final ConfigSetProviderOptionDart _configSetProviderOption;
+  late final ConfigSetOptimizedModelCacheDirDart
+  _configSetOptimizedModelCacheDir;
+  late final ConfigSetLazyEncoderSessionsDart _configSetLazyEncoderSessions;
   late final RunInferenceWithConfigDart _runInferenceWithConfig;
   late final RunInferenceMultiWithConfigDart _runInferenceMultiWithConfig;
   late final GetLastErrorDart _getLastError;
+  late final FreeResultDart _freeResult;
+
+  // Model handle API functions
+  late final LoadModelDart _loadModel;
+  late final UnloadModelDart _unloadModel;
+  late final SetPrefixCacheSizeDart _setPrefixCacheSize;
+  late final SetImageCacheSizeDart _setImageCacheSize;
+  late final ReleaseIdleSessionsDart _releaseIdleSessions;
+  late final SetPromptLookupDart _setPromptLookup;
+  late final RunInferenceWithModelDart _runInferenceWithModel;
+  late final RunInferenceMultiWithModelDart _runInferenceMultiWithModel;
+  late final RunInferenceWithImageBuffersDart _runInferenceWithImageBuffers;
+  late final RunInferenceWithRgbaDart _runInferenceWithRgba;
+  late final RunTextInferenceWithModelDart _runTextInferenceWithModel;
+
+  // Streaming API functions
+  late final InitDartApiDLDart _initDartApiDL;
+  late final StreamInferenceWithModelDart _streamInferenceWithModel;
+  bool _dartApiInitialized = false;
+
+  // Background generation API functions
+  late final StartGenerationDart _startGeneration;
+  late final CancelGenerationDart _cancelGeneration;
+  late final PollGenerationDart _pollGeneration;
+
+  // Chat session API functions
+  late final ChatOpenDart _chatOpen;
+  late final ChatSendDart _chatSend;
+  late final ChatRewindDart _chatRewind;
+  late final ChatSaveDart _chatSave;
+  late final ChatRestoreDart _chatRestore;
+  late final ChatCloseDart _chatClose;
 
   // Track worker isolate for cleanup
   Isolate? _workerIsolate;
@@ -463,6 +787,18 @@ class OnnxGenAI {
         )
         .asFunction<ConfigSetProviderOptionDart>();
 
+    _configSetOptimizedModelCacheDir = _dylib
+        .lookup<NativeFunction<ConfigSetOptimizedModelCacheDirNative>>(
+          'config_set_optimized_model_cache_dir',
+        )
+        .asFunction<ConfigSetOptimizedModelCacheDirDart>();
+
+    _configSetLazyEncoderSessions = _dylib
+        .lookup<NativeFunction<ConfigSetLazyEncoderSessionsNative>>(
+          'config_set_lazy_encoder_sessions',
+        )
+        .asFunction<ConfigSetLazyEncoderSessionsDart>();
+
     _runInferenceWithConfig = _dylib
         .lookup<NativeFunction<RunInferenceWithConfigNative>>(
           'run_inference_with_config',
@@ -478,6 +814,120 @@ class OnnxGenAI {
     _getLastError = _dylib
         .lookup<NativeFunction<GetLastErrorNative>>('get_last_error')
         .asFunction<GetLastErrorDart>();
+
+    _freeResult = _dylib
+        .lookup<NativeFunction<FreeResultNative>>('free_result')
+        .asFunction<FreeResultDart>();
+
+    // Model handle API bindings
+    _loadModel = _dylib
+        .lookup<NativeFunction<LoadModelNative>>('load_model')
+        .asFunction<LoadModelDart>();
+
+    _unloadModel = _dylib
+        .lookup<NativeFunction<UnloadModelNative>>('unload_model')
+        .asFunction<UnloadModelDart>();
+
+    _setPrefixCacheSize = _dylib
+        .lookup<NativeFunction<SetPrefixCacheSizeNative>>(
+          'set_prefix_cache_size',
+        )
+        .asFunction<SetPrefixCacheSizeDart>();
+
+    _setImageCacheSize = _dylib
+        .lookup<NativeFunction<SetImageCacheSizeNative>>(
+          'set_image_cache_size',
+        )
+        .asFunction<SetImageCacheSizeDart>();
+
+    _releaseIdleSessions = _dylib
+        .lookup<NativeFunction<ReleaseIdleSessionsNative>>(
+          'release_idle_sessions',
+        )
+        .asFunction<ReleaseIdleSessionsDart>();
+
+    _setPromptLookup = _dylib
+        .lookup<NativeFunction<SetPromptLookupNative>>('set_prompt_lookup')
+        .asFunction<SetPromptLookupDart>();
+
+    _runInferenceWithModel = _dylib
+        .lookup<NativeFunction<RunInferenceWithModelNative>>(
+          'run_inference_with_model',
+        )
+        .asFunction<RunInferenceWithModelDart>();
+
+    _runInferenceMultiWithModel = _dylib
+        .lookup<NativeFunction<RunInferenceMultiWithModelNative>>(
+          'run_inference_multi_with_model',
+        )
+        .asFunction<RunInferenceMultiWithModelDart>();
+
+    _runInferenceWithImageBuffers = _dylib
+        .lookup<NativeFunction<RunInferenceWithImageBuffersNative>>(
+          'run_inference_with_image_buffers',
+        )
+        .asFunction<RunInferenceWithImageBuffersDart>();
+
+    _runInferenceWithRgba = _dylib
+        .lookup<NativeFunction<RunInferenceWithRgbaNative>>(
+          'run_inference_with_rgba',
+        )
+        .asFunction<RunInferenceWithRgbaDart>();
+
+    _runTextInferenceWithModel = _dylib
+        .lookup<NativeFunction<RunTextInferenceWithModelNative>>(
+          'run_text_inference_with_model',
+        )
+        .asFunction<RunTextInferenceWithModelDart>();
+
+    // Streaming API bindings
+    _initDartApiDL = _dylib
+        .lookup<NativeFunction<InitDartApiDLNative>>('init_dart_api_dl')
+        .asFunction<InitDartApiDLDart>();
+
+    _streamInferenceWithModel = _dylib
+        .lookup<NativeFunction<StreamInferenceWithModelNative>>(
+          'stream_inference_with_model',
+        )
+        .asFunction<StreamInferenceWithModelDart>();
+
+    // Background generation API bindings
+    _startGeneration = _dylib
+        .lookup<NativeFunction<StartGenerationNative>>('start_generation')
+        .asFunction<StartGenerationDart>();
+
+    _cancelGeneration = _dylib
+        .lookup<NativeFunction<CancelGenerationNative>>('cancel_generation')
+        .asFunction<CancelGenerationDart>();
+
+    _pollGeneration = _dylib
+        .lookup<NativeFunction<PollGenerationNative>>('poll_generation')
+        .asFunction<PollGenerationDart>();
+
+    // Chat session API bindings
+    _chatOpen = _dylib
+        .lookup<NativeFunction<ChatOpenNative>>('chat_open')
+        .asFunction<ChatOpenDart>();
+
+    _chatSend = _dylib
+        .lookup<NativeFunction<ChatSendNative>>('chat_send')
+        .asFunction<ChatSendDart>();
+
+    _chatRewind = _dylib
+        .lookup<NativeFunction<ChatRewindNative>>('chat_rewind')
+        .asFunction<ChatRewindDart>();
+
+    _chatSave = _dylib
+        .lookup<NativeFunction<ChatSaveNative>>('chat_save')
+        .asFunction<ChatSaveDart>();
+
+    _chatRestore = _dylib
+        .lookup<NativeFunction<ChatRestoreNative>>('chat_restore')
+        .asFunction<ChatRestoreDart>();
+
+    _chatClose = _dylib
+        .lookup<NativeFunction<ChatCloseNative>>('chat_close')
+        .asFunction<ChatCloseDart>();
   }
 
   // ===========================================================================
@@ -527,7 +977,7 @@ class OnnxGenAI {
 
     try {
       final resultPtr = _runInference(modelPathPtr, promptPtr, imagePathPtr);
-      final result = resultPtr.toDartString();
+      final result = _takeResult(resultPtr);
 
       // Check for error prefix
       if (result.startsWith('ERROR:')) {
@@ -576,7 +1026,7 @@ class OnnxGenAI {
         imagePathPtrs,
         imagePaths.length,
       );
-      final result = resultPtr.toDartString();
+      final result = _takeResult(resultPtr);
 
       // Check for error prefix
       if (result.startsWith('ERROR:')) {
@@ -617,7 +1067,7 @@ class OnnxGenAI {
 
     try {
       final resultPtr = _runTextInference(modelPathPtr, promptPtr, maxLength);
-      final result = resultPtr.toDartString();
+      final result = _takeResult(resultPtr);
 
       // Check for error prefix
       if (result.startsWith('ERROR:')) {
@@ -638,12 +1088,27 @@ class OnnxGenAI {
     _workerIsolate = null;
   }
 
-  /// Gets the last error message from the native library.
+  /// Gets the last error message set on the calling thread by the native library.
   String getLastError() {
     final ptr = _getLastError();
     return ptr.toDartString();
   }
 
+  /// Copies a native result string into Dart and releases the native copy.
+  ///
+  /// Every inference result is a separate caller-owned allocation, so
+  /// concurrent requests from different isolates never overwrite each other.
+  String _takeResult(Pointer<Utf8> resultPtr) {
+    if (resultPtr == nullptr) {
+      throw OnnxGenAIException('Failed to allocate native result');
+    }
+    try {
+      return resultPtr.toDartString();
+    } finally {
+      _freeResult(resultPtr);
+    }
+  }
+
   // ===========================================================================
   // Configuration API - Runtime Session Options
   // ===========================================================================
@@ -736,6 +1201,50 @@ class OnnxGenAI {
     }
   }
 
+  /// Caches the graphs ONNX Runtime optimizes when the model loads in
+  /// [cacheDir], which is created if needed (a relative [cacheDir] is
+  /// relative to the model directory and has to exist).
+  ///
+  /// The first [loadModel] writes the optimized decoder, embedding and vision
+  /// graphs with their prepacked weights there; later loads skip graph
+  /// optimization, a large part of a cold start. An entry is rewritten when
+  /// the model file, the providers or their options change. Providers that
+  /// compile the graph (QNN, NNAPI, CoreML) are not cached. The entries take
+  /// about as much space as the model, so use a cache directory the app may
+  /// lose. Pass an empty string to disable the cache.
+  ///
+  /// Returns 1 on success, negative value on failure.
+  int configSetOptimizedModelCacheDir(int configHandle, String cacheDir) {
+    if (Directory(cacheDir).isAbsolute) {
+      Directory(cacheDir).createSync(recursive: true);
+    }
+    final cacheDirPtr = cacheDir.toNativeUtf8();
+    try {
+      return _configSetOptimizedModelCacheDir(configHandle, cacheDirPtr);
+    } finally {
+      calloc.free(cacheDirPtr);
+    }
+  }
+
+  /// Loads the vision and speech encoders of a multimodal model only for
+  /// prompts with images or audio.
+  ///
+  /// The encoders are read once by [loadModel], to learn their inputs and
+  /// outputs, and then released, so a text-only chat doesn't keep their
+  /// weights in memory. The first prompt with images or audio loads them
+  /// again. They are released [idleTimeout] after their last use, as soon as
+  /// no request uses them with [Duration.zero], or only by
+  /// [releaseIdleSessions] when [idleTimeout] is null.
+  ///
+  /// Models without encoders ignore it.
+  /// Returns 1 on success, negative value on failure.
+  int configSetLazyEncoderSessions(int configHandle, {Duration? idleTimeout}) {
+    return _configSetLazyEncoderSessions(
+      configHandle,
+      idleTimeout?.inMilliseconds ?? -1,
+    );
+  }
+
   /// Runs inference using a pre-configured config.
   ///
   /// WARNING: This is a LONG-RUNNING, BLOCKING operation!
@@ -761,7 +1270,7 @@ class OnnxGenAI {
         promptPtr,
         imagePathPtr,
       );
-      final result = resultPtr.toDartString();
+      final result = _takeResult(resultPtr);
 
       if (result.startsWith('ERROR:')) {
         throw OnnxGenAIException(result.substring(6).trim());
@@ -807,7 +1316,7 @@ class OnnxGenAI {
         imagePathsPtr,
         imagePaths.length,
       );
-      final result = resultPtr.toDartString();
+      final result = _takeResult(resultPtr);
 
       if (result.startsWith('ERROR:')) {
         throw OnnxGenAIException(result.substring(6).trim());
@@ -824,86 +1333,746 @@ class OnnxGenAI {
   }
 
   // ===========================================================================
-  // Public API - Asynchronous (safe for main isolate)
+  // Model Handle API - Persistent Models
   // ===========================================================================
 
-  /// Runs multimodal inference asynchronously in a background isolate.
+  /// Loads the model described by a config and keeps it resident.
   ///
-  /// This is the recommended method for calling from the main UI isolate.
+  /// The model, tokenizer and multimodal processor are created once and
+  /// reused by every `run*WithModel` call, so only the first request pays the
+  /// session initialization cost. Loading an identical config again returns
+  /// the same handle with an extra reference. Release each handle with
+  /// [unloadModel].
   ///
-  /// Parameters:
-  /// - [modelPath]: Path to the ONNX GenAI model directory.
-  /// - [prompt]: Text prompt for generation.
-  /// - [imagePath]: Optional path to image file (null for text-only).
+  /// The config may be destroyed once the model is loaded.
   ///
-  /// Returns a [Future] that completes with the generated text.
-  Future<String> runInferenceAsync({
-    required String modelPath,
-    required String prompt,
-    String? imagePath,
-  }) async {
-    return Isolate.run(() {
-      final onnx = OnnxGenAI();
-      return onnx.runInference(
-        modelPath: modelPath,
-        prompt: prompt,
-        imagePath: imagePath,
-      );
-    });
+  /// WARNING: The first load is a LONG-RUNNING, BLOCKING operation!
+  /// DO NOT call from the main UI isolate. Use [loadModelAsync] instead.
+  ///
+  /// Returns a model handle (non-zero on success, 0 on failure).
+  int loadModel(int configHandle) {
+    return _loadModel(configHandle);
   }
 
-  /// Runs multimodal inference with multiple images asynchronously.
+  /// Releases a model handle returned by [loadModel].
   ///
-  /// This is the recommended method for calling from the main UI isolate.
+  /// The model is freed once its last reference is released.
+  /// Returns 1 on success, negative value on failure.
+  int unloadModel(int modelHandle) {
+    return _unloadModel(modelHandle);
+  }
+
+  /// Lets later requests on [modelHandle] reuse the KV cache of earlier ones.
   ///
-  /// Parameters:
-  /// - [modelPath]: Path to the ONNX GenAI model directory.
-  /// - [prompt]: Text prompt for generation (should contain <|image_N|> placeholders).
-  /// - [imagePaths]: List of paths to image files.
+  /// A finished generation leaves the KV cache of its prompt and reply with
+  /// the model. A later prompt that starts with the same tokens, like the next
+  /// turn of a chat that resends its history, only prefills the new tokens.
+  /// Entries are evicted least recently used first to stay within [maxBytes]
+  /// and are freed when the model is unloaded. Pass 0 to fall back to
+  /// `search.prefix_cache_bytes` in genai_config.json (off by default).
   ///
-  /// Returns a [Future] that completes with the generated text.
-  Future<String> runInferenceMultiAsync({
-    required String modelPath,
-    required String prompt,
-    required List<String> imagePaths,
-  }) async {
-    return Isolate.run(() {
-      final onnx = OnnxGenAI();
-      return onnx.runInferenceMulti(
-        modelPath: modelPath,
-        prompt: prompt,
-        imagePaths: imagePaths,
-      );
-    });
+  /// Applies to text-only decoder models on CPU and CUDA without a LoRA
+  /// adapter.
+  /// Returns 1 on success, negative value on failure.
+  int setPrefixCacheSize({required int modelHandle, required int maxBytes}) {
+    return _setPrefixCacheSize(modelHandle, maxBytes);
   }
 
-  /// Runs text-only inference asynchronously in a background isolate.
+  /// Lets later requests on [modelHandle] reuse the vision output of earlier
+  /// ones.
   ///
-  /// This is the recommended method for calling from the main UI isolate.
-  Future<String> runTextInferenceAsync({
-    required String modelPath,
-    required String prompt,
-    int maxLength = 0,
-  }) async {
-    return Isolate.run(() {
-      final onnx = OnnxGenAI();
-      return onnx.runTextInference(
-        modelPath: modelPath,
-        prompt: prompt,
-        maxLength: maxLength,
-      );
-    });
+  /// The model keeps the features the vision model computed for the images of
+  /// a prompt, keyed by a hash of the processed images. Asking about the same
+  /// images again, as in a multi-turn chat about one photo, skips the vision
+  /// model. Entries are evicted least recently used first to stay within
+  /// [maxBytes] and are freed when the model is unloaded. Pass 0 to fall back
+  /// to `search.image_features_cache_bytes` in genai_config.json (off by
+  /// default).
+  ///
+  /// Applies to multimodal models with a vision model.
+  /// Returns 1 on success, negative value on failure.
+  int setImageCacheSize({required int modelHandle, required int maxBytes}) {
+    return _setImageCacheSize(modelHandle, maxBytes);
   }
 
-  /// Checks model health asynchronously.
-  Future<int> checkNativeHealthAsync(String modelPath) async {
-    return Isolate.run(() {
-      final onnx = OnnxGenAI();
-      return onnx.checkNativeHealth(modelPath);
-    });
+  /// Frees the encoders of [modelHandle] that no request is using.
+  ///
+  /// Releases the vision and speech encoders of a model loaded with
+  /// [configSetLazyEncoderSessions]; the next prompt with images or audio
+  /// loads them again. Call it when the app is asked to reduce its memory
+  /// use.
+  ///
+  /// Returns the number of encoders released, negative value on failure.
+  int releaseIdleSessions(int modelHandle) {
+    return _releaseIdleSessions(modelHandle);
   }
 
-  /// Runs inference with custom execution provider configuration asynchronously.
+  /// Speeds up greedy generation on [modelHandle] by copying from the prompt.
+  ///
+  /// Before each step the last tokens of the sequence are looked up in the
+  /// prompt and the output so far, and the model checks the tokens that
+  /// followed the longest match (of up to [ngramSize] tokens) in one run.
+  /// Summaries, code edits and answers quoting the prompt generate several
+  /// tokens per run; the output doesn't change and no extra weights are
+  /// loaded. [numSpeculativeTokens] is the number of tokens checked per run.
+  /// Pass 0 to fall back to `search.prompt_lookup_ngram_size` (off by
+  /// default) or `search.num_speculative_tokens` in genai_config.json.
+  ///
+  /// Applies to greedy search without token penalties on text-only decoder
+  /// models on CPU.
+  /// Returns 1 on success, negative value on failure.
+  int setPromptLookup({
+    required int modelHandle,
+    required int ngramSize,
+    int numSpeculativeTokens = 0,
+  }) {
+    return _setPromptLookup(modelHandle, ngramSize, numSpeculativeTokens);
+  }
+
+  /// Runs inference on a loaded model with an optional image.
+  ///
+  /// WARNING: This is a LONG-RUNNING, BLOCKING operation!
+  /// DO NOT call from the main UI isolate. Use [runInferenceWithModelAsync] instead.
+  ///
+  /// Parameters:
+  /// - [modelHandle]: Handle returned by [loadModel]
+  /// - [prompt]: Text prompt for generation
+  /// - [imagePath]: Optional path to image file (null for text-only)
+  /// - [maxLength]: Maximum sequence length (0 for the genai_config.json value)
+  ///
+  /// Returns the generated text, or throws [OnnxGenAIException] on error.
+  String runInferenceWithModel({
+    required int modelHandle,
+    required String prompt,
+    String? imagePath,
+    int maxLength = 0,
+  }) {
+    final promptPtr = prompt.toNativeUtf8();
+    final imagePathPtr = imagePath != null ? imagePath.toNativeUtf8() : nullptr;
+
+    try {
+      final resultPtr = _runInferenceWithModel(
+        modelHandle,
+        promptPtr,
+        imagePathPtr,
+        maxLength,
+      );
+      final result = _takeResult(resultPtr);
+
+      if (result.startsWith('ERROR:')) {
+        throw OnnxGenAIException(result.substring(6).trim());
+      }
+
+      return result;
+    } finally {
+      calloc.free(promptPtr);
+      if (imagePath != null) {
+        calloc.free(imagePathPtr);
+      }
+    }
+  }
+
+  /// Runs multi-image inference on a loaded model.
+  ///
+  /// WARNING: This is a LONG-RUNNING, BLOCKING operation!
+  /// DO NOT call from the main UI isolate. Use [runInferenceMultiWithModelAsync] instead.
+  ///
+  /// Parameters:
+  /// - [modelHandle]: Handle returned by [loadModel]
+  /// - [prompt]: Text prompt for generation (with <|image_N|> placeholders)
+  /// - [imagePaths]: List of paths to image files
+  /// - [maxLength]: Maximum sequence length (0 for the genai_config.json value)
+  ///
+  /// Returns the generated text, or throws [OnnxGenAIException] on error.
+  String runInferenceMultiWithModel({
+    required int modelHandle,
+    required String prompt,
+    required List<String> imagePaths,
+    int maxLength = 0,
+  }) {
+    final promptPtr = prompt.toNativeUtf8();
+
+    // Allocate array of pointers for image paths
+    final imagePathsPtr = calloc<Pointer<Utf8>>(imagePaths.length);
+    for (var i = 0; i < imagePaths.length; i++) {
+      imagePathsPtr[i] = imagePaths[i].toNativeUtf8();
+    }
+
+    try {
+      final resultPtr = _runInferenceMultiWithModel(
+        modelHandle,
+        promptPtr,
+        imagePathsPtr,
+        imagePaths.length,
+        maxLength,
+      );
+      final result = _takeResult(resultPtr);
+
+      if (result.startsWith('ERROR:')) {
+        throw OnnxGenAIException(result.substring(6).trim());
+      }
+
+      return result;
+    } finally {
+      calloc.free(promptPtr);
+      for (var i = 0; i < imagePaths.length; i++) {
+        calloc.free(imagePathsPtr[i]);
+      }
+      calloc.free(imagePathsPtr);
+    }
+  }
+
+  /// Runs inference on a loaded model with encoded images held in memory.
+  ///
+  /// WARNING: This is a LONG-RUNNING, BLOCKING operation!
+  /// DO NOT call from the main UI isolate. Use [runInferenceWithImageBytesAsync] instead.
+  ///
+  /// Parameters:
+  /// - [modelHandle]: Handle returned by [loadModel]
+  /// - [prompt]: Text prompt for generation (with <|image_N|> placeholders)
+  /// - [images]: Encoded images (JPEG, PNG, ...), e.g. downloaded files or
+  ///   camera frames the platform already encoded
+  /// - [maxLength]: Maximum sequence length (0 for the genai_config.json value)
+  ///
+  /// Returns the generated text, or throws [OnnxGenAIException] on error.
+  String runInferenceWithImageBytes({
+    required int modelHandle,
+    required String prompt,
+    required List<Uint8List> images,
+    int maxLength = 0,
+  }) {
+    final promptPtr = prompt.toNativeUtf8();
+    final dataPtr = calloc<Pointer<Uint8>>(images.length);
+    final sizesPtr = calloc<Int64>(images.length);
+    for (var i = 0; i < images.length; i++) {
+      dataPtr[i] = calloc<Uint8>(images[i].length);
+      dataPtr[i].asTypedList(images[i].length).setAll(0, images[i]);
+      sizesPtr[i] = images[i].length;
+    }
+
+    try {
+      final resultPtr = _runInferenceWithImageBuffers(
+        modelHandle,
+        promptPtr,
+        dataPtr,
+        sizesPtr,
+        images.length,
+        maxLength,
+      );
+      final result = _takeResult(resultPtr);
+
+      if (result.startsWith('ERROR:')) {
+        throw OnnxGenAIException(result.substring(6).trim());
+      }
+
+      return result;
+    } finally {
+      calloc.free(promptPtr);
+      for (var i = 0; i < images.length; i++) {
+        calloc.free(dataPtr[i]);
+      }
+      calloc.free(dataPtr);
+      calloc.free(sizesPtr);
+    }
+  }
+
+  /// Runs inference on a loaded model with one image of raw RGBA pixels.
+  ///
+  /// For camera frames and decoded bitmaps: the pixels reach the image
+  /// processor losslessly, without encoding a JPEG, writing it to a file and
+  /// decoding it again. The alpha channel is ignored.
+  ///
+  /// WARNING: This is a LONG-RUNNING, BLOCKING operation!
+  /// DO NOT call from the main UI isolate. Use [runInferenceWithRgbaAsync] instead.
+  ///
+  /// Parameters:
+  /// - [modelHandle]: Handle returned by [loadModel]
+  /// - [prompt]: Text prompt for generation (with an <|image_1|> placeholder)
+  /// - [pixels]: Rows of RGBA pixels, 8 bits per channel
+  /// - [width], [height]: Image size in pixels
+  /// - [stride]: Bytes from one row to the next (0 for `width * 4`)
+  /// - [maxLength]: Maximum sequence length (0 for the genai_config.json value)
+  ///
+  /// Returns the generated text, or throws [OnnxGenAIException] on error.
+  String runInferenceWithRgba({
+    required int modelHandle,
+    required String prompt,
+    required Uint8List pixels,
+    required int width,
+    required int height,
+    int stride = 0,
+    int maxLength = 0,
+  }) {
+    final rowBytes = stride == 0 ? width * 4 : stride;
+    if (height > 0 && pixels.length < rowBytes * (height - 1) + width * 4) {
+      throw OnnxGenAIException(
+        'RGBA buffer of ${pixels.length} bytes is too small for '
+        '${width}x$height pixels with a stride of $rowBytes',
+      );
+    }
+
+    final promptPtr = prompt.toNativeUtf8();
+    final pixelsPtr = calloc<Uint8>(pixels.length);
+    pixelsPtr.asTypedList(pixels.length).setAll(0, pixels);
+
+    try {
+      final resultPtr = _runInferenceWithRgba(
+        modelHandle,
+        promptPtr,
+        pixelsPtr,
+        width,
+        height,
+        stride,
+        maxLength,
+      );
+      final result = _takeResult(resultPtr);
+
+      if (result.startsWith('ERROR:')) {
+        throw OnnxGenAIException(result.substring(6).trim());
+      }
+
+      return result;
+    } finally {
+      calloc.free(promptPtr);
+      calloc.free(pixelsPtr);
+    }
+  }
+
+  /// Runs text-only inference on a loaded model.
+  ///
+  /// WARNING: This is a LONG-RUNNING, BLOCKING operation!
+  /// DO NOT call from the main UI isolate. Use [runTextInferenceWithModelAsync] instead.
+  ///
+  /// Returns the generated text, or throws [OnnxGenAIException] on error.
+  String runTextInferenceWithModel({
+    required int modelHandle,
+    required String prompt,
+    int maxLength = 0,
+  }) {
+    final promptPtr = prompt.toNativeUtf8();
+
+    try {
+      final resultPtr = _runTextInferenceWithModel(
+        modelHandle,
+        promptPtr,
+        maxLength,
+      );
+      final result = _takeResult(resultPtr);
+
+      if (result.startsWith('ERROR:')) {
+        throw OnnxGenAIException(result.substring(6).trim());
+      }
+
+      return result;
+    } finally {
+      calloc.free(promptPtr);
+    }
+  }
+
+  // ===========================================================================
+  // Streaming API - Token-by-token output
+  // ===========================================================================
+
+  /// Streams inference on a loaded model as text is decoded.
+  ///
+  /// Generation runs on a native worker thread and posts decoded text to a
+  /// [ReceivePort], so this is safe to call from the main UI isolate and the
+  /// first fragment arrives as soon as the first token is generated.
+  /// Cancelling the subscription stops the native generation, aborting a
+  /// model run that is already in progress.
+  ///
+  /// Parameters:
+  /// - [modelHandle]: Handle returned by [loadModel] or [loadModelAsync]
+  /// - [prompt]: Text prompt for generation
+  /// - [imagePaths]: Paths to image files (empty for text-only)
+  /// - [maxLength]: Maximum sequence length (0 for the genai_config.json value)
+  ///
+  /// Example:
+  /// ```dart
+  /// final model = await onnx.loadModelAsync(modelPath: '/path/to/model');
+  /// await for (final text in onnx.streamInferenceWithModel(
+  ///   modelHandle: model,
+  ///   prompt: 'Tell me a story.',
+  /// )) {
+  ///   stdout.write(text);
+  /// }
+  /// ```
+  Stream<String> streamInferenceWithModel({
+    required int modelHandle,
+    required String prompt,
+    List<String> imagePaths = const [],
+    int maxLength = 0,
+  }) {
+    _ensureDartApiInitialized();
+
+    final receivePort = ReceivePort();
+    var requestId = 0;
+    final controller = StreamController<String>(
+      onCancel: () {
+        receivePort.close();
+        if (requestId > 0) _cancelGeneration(requestId);
+      },
+    );
+
+    receivePort.listen((message) {
+      final kind = (message as List)[0] as int;
+      final text = message[1] as String;
+      switch (kind) {
+        case _StreamMessage.text:
+          controller.add(text);
+        case _StreamMessage.done:
+        case _StreamMessage.cancelled:
+          receivePort.close();
+          controller.close();
+        default:
+          receivePort.close();
+          controller.addError(OnnxGenAIException(
+              text.startsWith('ERROR:') ? text.substring(6).trim() : text));
+          controller.close();
+      }
+    });
+
+    final promptPtr = prompt.toNativeUtf8();
+    final imagePathsPtr = calloc<Pointer<Utf8>>(imagePaths.length);
+    for (var i = 0; i < imagePaths.length; i++) {
+      imagePathsPtr[i] = imagePaths[i].toNativeUtf8();
+    }
+
+    try {
+      // The native side copies its inputs before returning
+      requestId = _streamInferenceWithModel(
+        modelHandle,
+        promptPtr,
+        imagePathsPtr,
+        imagePaths.length,
+        maxLength,
+        receivePort.sendPort.nativePort,
+      );
+      if (requestId < 0) {
+        receivePort.close();
+        controller.addError(
+          OnnxGenAIException('Failed to start stream: ${getLastError()}'),
+        );
+        controller.close();
+      }
+    } finally {
+      calloc.free(promptPtr);
+      for (var i = 0; i < imagePaths.length; i++) {
+        calloc.free(imagePathsPtr[i]);
+      }
+      calloc.free(imagePathsPtr);
+    }
+
+    return controller.stream;
+  }
+
+  // ===========================================================================
+  // Background Generation API - Non-blocking, cancellable
+  // ===========================================================================
+
+  /// Queues a generation on the native worker pool and returns its request id.
+  ///
+  /// Returns immediately, so this is safe to call from the main UI isolate.
+  /// Read progress with [pollGeneration] (or wait with [awaitGeneration]) and
+  /// abort with [cancelGeneration].
+  ///
+  /// Parameters:
+  /// - [modelHandle]: Handle returned by [loadModel] or [loadModelAsync]
+  /// - [prompt]: Text prompt for generation
+  /// - [imagePaths]: Paths to image files (empty for text-only)
+  /// - [maxLength]: Maximum sequence length (0 for the genai_config.json value)
+  int startGeneration({
+    required int modelHandle,
+    required String prompt,
+    List<String> imagePaths = const [],
+    int maxLength = 0,
+  }) {
+    final promptPtr = prompt.toNativeUtf8();
+    final imagePathsPtr = calloc<Pointer<Utf8>>(imagePaths.length);
+    for (var i = 0; i < imagePaths.length; i++) {
+      imagePathsPtr[i] = imagePaths[i].toNativeUtf8();
+    }
+
+    try {
+      final requestId = _startGeneration(
+        modelHandle,
+        promptPtr,
+        imagePathsPtr,
+        imagePaths.length,
+        maxLength,
+      );
+      if (requestId < 0) {
+        throw OnnxGenAIException(
+          'Failed to start generation: ${getLastError()}',
+        );
+      }
+      return requestId;
+    } finally {
+      calloc.free(promptPtr);
+      for (var i = 0; i < imagePaths.length; i++) {
+        calloc.free(imagePathsPtr[i]);
+      }
+      calloc.free(imagePathsPtr);
+    }
+  }
+
+  /// Cancels a generation started with [startGeneration].
+  ///
+  /// A model run already in progress (such as a long prompt prefill) is
+  /// terminated rather than waited for. Returns false if the request is
+  /// unknown or has already been released.
+  bool cancelGeneration(int requestId) => _cancelGeneration(requestId) == 1;
+
+  /// Returns the [GenerationStatus] and the text generated so far.
+  ///
+  /// For [GenerationStatus.failed] the text is the error message. Once a
+  /// final status has been returned the request is released.
+  ({int status, String text}) pollGeneration(int requestId) {
+    final statusPtr = calloc<Int32>();
+    try {
+      var text = _takeResult(_pollGeneration(requestId, statusPtr));
+      if (text.startsWith('ERROR:')) {
+        text = text.substring(6).trim();
+      }
+      return (status: statusPtr.value, text: text);
+    } finally {
+      calloc.free(statusPtr);
+    }
+  }
+
+  /// Polls [requestId] until it finishes and returns the generated text.
+  ///
+  /// Throws [OnnxGenAIException] if the generation fails or is cancelled.
+  Future<String> awaitGeneration(
+    int requestId, {
+    Duration pollInterval = const Duration(milliseconds: 50),
+  }) async {
+    while (true) {
+      final poll = pollGeneration(requestId);
+      switch (poll.status) {
+        case GenerationStatus.queued:
+        case GenerationStatus.running:
+          await Future<void>.delayed(pollInterval);
+        case GenerationStatus.done:
+          return poll.text;
+        case GenerationStatus.cancelled:
+          throw OnnxGenAIException('Generation $requestId was cancelled');
+        default:
+          throw OnnxGenAIException(poll.text);
+      }
+    }
+  }
+
+  // ===========================================================================
+  // Chat Session API - Multi-turn conversations
+  // ===========================================================================
+
+  /// Opens a chat on a loaded model and returns its id.
+  ///
+  /// The chat keeps its generator and KV cache between turns, so each
+  /// [chatSend] only processes the new message instead of the whole history.
+  /// [maxLength] bounds the whole conversation in tokens (0 for the
+  /// genai_config.json value). Close the chat with [chatClose].
+  ///
+  /// With [attentionSinkSize] > 0 the chat goes on past [maxLength]: the
+  /// first [attentionSinkSize] tokens (the system prompt) are kept and the
+  /// oldest tokens after them are evicted. Turns whose start was evicted can't
+  /// be rewound anymore. Attention sinks need a CPU model, and RoPE models
+  /// need `decoder.rotary_embedding` in genai_config.json.
+  ///
+  /// Text-only; needs a KV cache on CPU or CUDA.
+  int chatOpen({
+    required int modelHandle,
+    int maxLength = 0,
+    int attentionSinkSize = 0,
+  }) {
+    final chatId = _chatOpen(modelHandle, maxLength, attentionSinkSize);
+    if (chatId < 0) {
+      throw OnnxGenAIException('Failed to open chat: ${getLastError()}');
+    }
+    return chatId;
+  }
+
+  /// Appends [message] to a chat and returns the generated reply.
+  ///
+  /// [message] is tokenized as is, so format it with the model's chat template
+  /// (user turn followed by the assistant prefix). [maxNewTokens] limits the
+  /// reply (0 for no limit other than the chat's max length). A failed turn
+  /// leaves the chat unchanged.
+  ///
+  /// WARNING: This is a LONG-RUNNING, BLOCKING operation!
+  /// DO NOT call from the main UI isolate. Use [chatSendAsync] instead.
+  String chatSend({
+    required int chatId,
+    required String message,
+    int maxNewTokens = 0,
+  }) {
+    final messagePtr = message.toNativeUtf8();
+    try {
+      final result = _takeResult(_chatSend(chatId, messagePtr, maxNewTokens));
+      if (result.startsWith('ERROR:')) {
+        throw OnnxGenAIException(result.substring(6).trim());
+      }
+      return result;
+    } finally {
+      calloc.free(messagePtr);
+    }
+  }
+
+  /// Drops turn [turn] (the zero-based index of a [chatSend]) and every later
+  /// turn from a chat.
+  ///
+  /// Send the same message again to regenerate a reply, or a different one to
+  /// edit it; only the tokens from that turn on are processed.
+  void chatRewind({required int chatId, required int turn}) {
+    if (_chatRewind(chatId, turn) < 0) {
+      throw OnnxGenAIException('Failed to rewind chat: ${getLastError()}');
+    }
+  }
+
+  /// Saves a chat to [path] so [chatRestore] can continue it later, for
+  /// example after the app was killed.
+  ///
+  /// The file holds the tokens, the sampling state and the KV cache, so
+  /// restoring doesn't prefill the history again; the turns go to
+  /// `[path].chat`. An existing file is only replaced once the new one is
+  /// complete.
+  void chatSave({required int chatId, required String path}) {
+    final pathPtr = path.toNativeUtf8();
+    try {
+      if (_chatSave(chatId, pathPtr) < 0) {
+        throw OnnxGenAIException('Failed to save chat: ${getLastError()}');
+      }
+    } finally {
+      calloc.free(pathPtr);
+    }
+  }
+
+  /// Opens a chat that continues from a file written by [chatSave] and returns
+  /// its id.
+  ///
+  /// Use the model the chat was saved with and the same [attentionSinkSize];
+  /// [maxLength] must fit the saved conversation. A KV cache that doesn't fit
+  /// the model's device is recomputed from the tokens.
+  ///
+  /// WARNING: This can be a LONG-RUNNING, BLOCKING operation!
+  /// DO NOT call from the main UI isolate. Use [chatRestoreAsync] instead.
+  int chatRestore({
+    required int modelHandle,
+    required String path,
+    int maxLength = 0,
+    int attentionSinkSize = 0,
+  }) {
+    final pathPtr = path.toNativeUtf8();
+    try {
+      final chatId =
+          _chatRestore(modelHandle, pathPtr, maxLength, attentionSinkSize);
+      if (chatId < 0) {
+        throw OnnxGenAIException('Failed to restore chat: ${getLastError()}');
+      }
+      return chatId;
+    } finally {
+      calloc.free(pathPtr);
+    }
+  }
+
+  /// Closes a chat and releases its generator.
+  ///
+  /// Returns false if the chat is unknown.
+  bool chatClose(int chatId) => _chatClose(chatId) == 1;
+
+  /// Hands the Dart native API to the library so it can post to SendPorts.
+  void _ensureDartApiInitialized() {
+    if (_dartApiInitialized) return;
+    if (_initDartApiDL(NativeApi.initializeApiDLData) != 0) {
+      throw OnnxGenAIException(
+        'Failed to initialize Dart native API: ${getLastError()}',
+      );
+    }
+    _dartApiInitialized = true;
+  }
+
+  // ===========================================================================
+  // Public API - Asynchronous (safe for main isolate)
+  // ===========================================================================
+
+  /// Runs multimodal inference asynchronously in a background isolate.
+  ///
+  /// This is the recommended method for calling from the main UI isolate.
+  ///
+  /// Parameters:
+  /// - [modelPath]: Path to the ONNX GenAI model directory.
+  /// - [prompt]: Text prompt for generation.
+  /// - [imagePath]: Optional path to image file (null for text-only).
+  ///
+  /// Returns a [Future] that completes with the generated text.
+  Future<String> runInferenceAsync({
+    required String modelPath,
+    required String prompt,
+    String? imagePath,
+  }) async {
+    return Isolate.run(() {
+      final onnx = OnnxGenAI();
+      return onnx.runInference(
+        modelPath: modelPath,
+        prompt: prompt,
+        imagePath: imagePath,
+      );
+    });
+  }
+
+  /// Runs multimodal inference with multiple images asynchronously.
+  ///
+  /// This is the recommended method for calling from the main UI isolate.
+  ///
+  /// Parameters:
+  /// - [modelPath]: Path to the ONNX GenAI model directory.
+  /// - [prompt]: Text prompt for generation (should contain <|image_N|> placeholders).
+  /// - [imagePaths]: List of paths to image files.
+  ///
+  /// Returns a [Future] that completes with the generated text.
+  Future<String> runInferenceMultiAsync({
+    required String modelPath,
+    required String prompt,
+    required List<String> imagePaths,
+  }) async {
+    return Isolate.run(() {
+      final onnx = OnnxGenAI();
+      return onnx.runInferenceMulti(
+        modelPath: modelPath,
+        prompt: prompt,
+        imagePaths: imagePaths,
+      );
+    });
+  }
+
+  /// Runs text-only inference asynchronously in a background isolate.
+  ///
+  /// This is the recommended method for calling from the main UI isolate.
+  Future<String> runTextInferenceAsync({
+    required String modelPath,
+    required String prompt,
+    int maxLength = 0,
+  }) async {
+    return Isolate.run(() {
+      final onnx = OnnxGenAI();
+      return onnx.runTextInference(
+        modelPath: modelPath,
+        prompt: prompt,
+        maxLength: maxLength,
+      );
+    });
+  }
+
+  /// Checks model health asynchronously.
+  Future<int> checkNativeHealthAsync(String modelPath) async {
+    return Isolate.run(() {
+      final onnx = OnnxGenAI();
+      return onnx.checkNativeHealth(modelPath);
+    });
+  }
+
+  /// Runs inference with custom execution provider configuration asynchronously.
   ///
   /// This is the recommended way to use custom configs from the main UI isolate.
   /// Creates the config, applies settings, runs inference, and cleans up - all
@@ -1140,6 +2309,315 @@ class OnnxGenAI {
       }
     });
   }
+
+  /// Loads a model with custom execution providers in a background isolate.
+  ///
+  /// Creates a config, applies [providers] and [providerOptions], loads the
+  /// model and destroys the config. The returned handle stays valid across
+  /// isolates until released with [unloadModel]. With
+  /// [optimizedModelCacheDir] later loads skip graph optimization (see
+  /// [configSetOptimizedModelCacheDir]). With [lazyEncoders] the vision and
+  /// speech encoders are only loaded for prompts with images or audio and
+  /// released [encoderIdleTimeout] after their last use (see
+  /// [configSetLazyEncoderSessions]).
+  ///
+  /// Example:
+  /// ```dart
+  /// final model = await onnx.loadModelAsync(
+  ///   modelPath: '/path/to/model',
+  ///   providers: ['XNNPACK', 'cpu'],
+  /// );
+  /// try {
+  ///   final a = await onnx.runTextInferenceWithModelAsync(
+  ///     modelHandle: model,
+  ///     prompt: 'Hello!',
+  ///   );
+  ///   final b = await onnx.runTextInferenceWithModelAsync(
+  ///     modelHandle: model,
+  ///     prompt: 'And again, without reloading.',
+  ///   );
+  /// } finally {
+  ///   onnx.unloadModel(model);
+  /// }
+  /// ```
+  Future<int> loadModelAsync({
+    required String modelPath,
+    List<String>? providers,
+    Map<String, Map<String, String>>? providerOptions,
+    String? optimizedModelCacheDir,
+    bool lazyEncoders = false,
+    Duration? encoderIdleTimeout,
+  }) async {
+    // Capture debug flag before entering isolate (static vars aren't shared)
+    final debugEnabled = OnnxGenAI.debugTiming;
+
+    return Isolate.run(() {
+      final onnx = OnnxGenAI();
+      final timer = InferenceTimer(enabled: debugEnabled);
+
+      final configHandle = timer.time('Create config', () {
+        return onnx.createConfig(modelPath);
+      });
+      if (configHandle == 0) {
+        timer.stop();
+        throw OnnxGenAIException(
+          'Failed to create config: ${onnx.getLastError()}',
+        );
+      }
+
+      try {
+        if (providers != null && providers.isNotEmpty) {
+          timer.time('Clear providers', () {
+            onnx.configClearProviders(configHandle);
+          });
+          for (final provider in providers) {
+            final result = timer.time('Add provider $provider', () {
+              return onnx.configAppendProvider(configHandle, provider);
+            });
+            if (result < 0) {
+              throw OnnxGenAIException(
+                'Failed to add provider "$provider": ${onnx.getLastError()}',
+              );
+            }
+          }
+        }
+
+        if (providerOptions != null) {
+          for (final entry in providerOptions.entries) {
+            for (final option in entry.value.entries) {
+              final result = timer.time('Set ${entry.key}.${option.key}', () {
+                return onnx.configSetProviderOption(
+                  configHandle,
+                  entry.key,
+                  option.key,
+                  option.value,
+                );
+              });
+              if (result < 0) {
+                throw OnnxGenAIException(
+                  'Failed to set option "${option.key}" for "${entry.key}": ${onnx.getLastError()}',
+                );
+              }
+            }
+          }
+        }
+
+        if (optimizedModelCacheDir != null) {
+          final result = onnx.configSetOptimizedModelCacheDir(
+            configHandle,
+            optimizedModelCacheDir,
+          );
+          if (result < 0) {
+            throw OnnxGenAIException(
+              'Failed to set the optimized model cache: ${onnx.getLastError()}',
+            );
+          }
+        }
+
+        if (lazyEncoders) {
+          final result = onnx.configSetLazyEncoderSessions(
+            configHandle,
+            idleTimeout: encoderIdleTimeout,
+          );
+          if (result < 0) {
+            throw OnnxGenAIException(
+              'Failed to set lazy encoder sessions: ${onnx.getLastError()}',
+            );
+          }
+        }
+
+        final modelHandle = timer.time('Load model', () {
+          return onnx.loadModel(configHandle);
+        });
+        if (modelHandle == 0) {
+          throw OnnxGenAIException(
+            'Failed to load model: ${onnx.getLastError()}',
+          );
+        }
+        return modelHandle;
+      } finally {
+        timer.time('Destroy config', () {
+          onnx.destroyConfig(configHandle);
+        });
+        timer.stop();
+      }
+    });
+  }
+
+  /// Runs inference on a loaded model in a background isolate.
+  Future<String> runInferenceWithModelAsync({
+    required int modelHandle,
+    required String prompt,
+    String? imagePath,
+    int maxLength = 0,
+  }) async {
+    final debugEnabled = OnnxGenAI.debugTiming;
+
+    return Isolate.run(() {
+      final timer = InferenceTimer(enabled: debugEnabled);
+      try {
+        return timer.time('Run inference', () {
+          return OnnxGenAI().runInferenceWithModel(
+            modelHandle: modelHandle,
+            prompt: prompt,
+            imagePath: imagePath,
+            maxLength: maxLength,
+          );
+        });
+      } finally {
+        timer.stop();
+      }
+    });
+  }
+
+  /// Runs inference with encoded in-memory images in a background isolate.
+  Future<String> runInferenceWithImageBytesAsync({
+    required int modelHandle,
+    required String prompt,
+    required List<Uint8List> images,
+    int maxLength = 0,
+  }) async {
+    final debugEnabled = OnnxGenAI.debugTiming;
+
+    return Isolate.run(() {
+      final timer = InferenceTimer(enabled: debugEnabled);
+      try {
+        return timer.time('Run inference (image bytes)', () {
+          return OnnxGenAI().runInferenceWithImageBytes(
+            modelHandle: modelHandle,
+            prompt: prompt,
+            images: images,
+            maxLength: maxLength,
+          );
+        });
+      } finally {
+        timer.stop();
+      }
+    });
+  }
+
+  /// Runs inference with one raw RGBA image in a background isolate.
+  Future<String> runInferenceWithRgbaAsync({
+    required int modelHandle,
+    required String prompt,
+    required Uint8List pixels,
+    required int width,
+    required int height,
+    int stride = 0,
+    int maxLength = 0,
+  }) async {
+    final debugEnabled = OnnxGenAI.debugTiming;
+
+    return Isolate.run(() {
+      final timer = InferenceTimer(enabled: debugEnabled);
+      try {
+        return timer.time('Run inference (RGBA)', () {
+          return OnnxGenAI().runInferenceWithRgba(
+            modelHandle: modelHandle,
+            prompt: prompt,
+            pixels: pixels,
+            width: width,
+            height: height,
+            stride: stride,
+            maxLength: maxLength,
+          );
+        });
+      } finally {
+        timer.stop();
+      }
+    });
+  }
+
+  /// Runs multi-image inference on a loaded model in a background isolate.
+  Future<String> runInferenceMultiWithModelAsync({
+    required int modelHandle,
+    required String prompt,
+    required List<String> imagePaths,
+    int maxLength = 0,
+  }) async {
+    final debugEnabled = OnnxGenAI.debugTiming;
+
+    return Isolate.run(() {
+      final timer = InferenceTimer(enabled: debugEnabled);
+      try {
+        return timer.time('Run inference (multi)', () {
+          return OnnxGenAI().runInferenceMultiWithModel(
+            modelHandle: modelHandle,
+            prompt: prompt,
+            imagePaths: imagePaths,
+            maxLength: maxLength,
+          );
+        });
+      } finally {
+        timer.stop();
+      }
+    });
+  }
+
+  /// Runs text-only inference on a loaded model in a background isolate.
+  Future<String> runTextInferenceWithModelAsync({
+    required int modelHandle,
+    required String prompt,
+    int maxLength = 0,
+  }) async {
+    final debugEnabled = OnnxGenAI.debugTiming;
+
+    return Isolate.run(() {
+      final timer = InferenceTimer(enabled: debugEnabled);
+      try {
+        return timer.time('Run inference', () {
+          return OnnxGenAI().runTextInferenceWithModel(
+            modelHandle: modelHandle,
+            prompt: prompt,
+            maxLength: maxLength,
+          );
+        });
+      } finally {
+        timer.stop();
+      }
+    });
+  }
+
+  /// Runs [chatSend] in a background isolate.
+  Future<String> chatSendAsync({
+    required int chatId,
+    required String message,
+    int maxNewTokens = 0,
+  }) async {
+    final debugEnabled = OnnxGenAI.debugTiming;
+
+    return Isolate.run(() {
+      final timer = InferenceTimer(enabled: debugEnabled);
+      try {
+        return timer.time('Chat send', () {
+          return OnnxGenAI().chatSend(
+            chatId: chatId,
+            message: message,
+            maxNewTokens: maxNewTokens,
+          );
+        });
+      } finally {
+        timer.stop();
+      }
+    });
+  }
+
+  /// Runs [chatRestore] in a background isolate.
+  Future<int> chatRestoreAsync({
+    required int modelHandle,
+    required String path,
+    int maxLength = 0,
+    int attentionSinkSize = 0,
+  }) async {
+    return Isolate.run(() {
+      return OnnxGenAI().chatRestore(
+        modelHandle: modelHandle,
+        path: path,
+        maxLength: maxLength,
+        attentionSinkSize: attentionSinkSize,
+      );
+    });
+  }
 }
 
 // =============================================================================
@@ -1165,78 +2643,53 @@ class OnnxGenAI {
 class OnnxGenAIStreamer {
   /// Streams inference results token-by-token.
   ///
-  /// NOTE: The current native implementation does not support true streaming.
-  /// This method runs inference in a background isolate and streams the
-  /// complete result in chunks to simulate streaming behavior.
+  /// Loads the model in a background isolate, then streams text from a native
+  /// worker thread as each token is decoded. The model is released when the
+  /// stream completes or is cancelled. To avoid reloading the model for every
+  /// prompt, load it once with [OnnxGenAI.loadModelAsync] and use
+  /// [OnnxGenAI.streamInferenceWithModel].
   ///
-  /// For true token-by-token streaming, a callback-based native implementation
-  /// would be needed.
+  /// [chunkSize] is ignored: fragments are delivered as they are decoded.
   Stream<String> streamInference({
     required String modelPath,
     required String prompt,
     String? imagePath,
     int chunkSize = 1,
   }) async* {
-    // Run inference in background
-    final result = await Isolate.run(() {
-      final onnx = OnnxGenAI();
-      return onnx.runInference(
-        modelPath: modelPath,
+    final onnx = OnnxGenAI();
+    final modelHandle = await onnx.loadModelAsync(modelPath: modelPath);
+    try {
+      // Same KV-cache limit as runInference
+      yield* onnx.streamInferenceWithModel(
+        modelHandle: modelHandle,
         prompt: prompt,
-        imagePath: imagePath,
+        imagePaths: imagePath != null ? [imagePath] : const [],
+        maxLength: 2048,
       );
-    });
-
-    // Stream the result character by character (simulated streaming)
-    final chars = result.split('');
-    final buffer = StringBuffer();
-
-    for (var i = 0; i < chars.length; i++) {
-      buffer.write(chars[i]);
-
-      if (buffer.length >= chunkSize) {
-        yield buffer.toString();
-        buffer.clear();
-      }
-    }
-
-    // Yield any remaining characters
-    if (buffer.isNotEmpty) {
-      yield buffer.toString();
+    } finally {
+      onnx.unloadModel(modelHandle);
     }
   }
 
   /// Streams text inference results.
+  ///
+  /// [chunkSize] is ignored: fragments are delivered as they are decoded.
   Stream<String> streamTextInference({
     required String modelPath,
     required String prompt,
     int maxLength = 0,
     int chunkSize = 1,
   }) async* {
-    final result = await Isolate.run(() {
-      final onnx = OnnxGenAI();
-      return onnx.runTextInference(
-        modelPath: modelPath,
+    final onnx = OnnxGenAI();
+    final modelHandle = await onnx.loadModelAsync(modelPath: modelPath);
+    try {
+      yield* onnx.streamInferenceWithModel(
+        modelHandle: modelHandle,
         prompt: prompt,
         maxLength: maxLength,
       );
-    });
-
-    // Stream the result
-    final chars = result.split('');
-    final buffer = StringBuffer();
-
-    for (var i = 0; i < chars.length; i++) {
-      buffer.write(chars[i]);
-
-      if (buffer.length >= chunkSize) {
-        yield buffer.toString();
-        buffer.clear();
-      }
-    }
-
-    if (buffer.isNotEmpty) {
-      yield buffer.toString();
+    } finally {
+      onnx.unloadModel(modelHandle);
     }
   }
 }
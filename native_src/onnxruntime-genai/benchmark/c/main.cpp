@@ -181,6 +181,10 @@ void RunBenchmark(const benchmark::Options& opts) {
     auto params = OgaGeneratorParams::Create(*model);
     params->SetSearchOption("max_length", static_cast<double>(num_tokens));
     params->SetSearchOption("min_length", static_cast<double>(num_tokens));
+    if (opts.prompt_lookup_ngram_size > 0) {
+      params->SetSearchOption("prompt_lookup_ngram_size", static_cast<double>(opts.prompt_lookup_ngram_size));
+      params->SetSearchOption("num_speculative_tokens", static_cast<double>(opts.num_speculative_tokens));
+    }
     return params;
   };
 
@@ -212,6 +216,8 @@ void RunBenchmark(const benchmark::Options& opts) {
   token_gen_times.reserve(opts.num_iterations * (opts.num_tokens_to_generate - 1));
   sampling_times.reserve(opts.num_iterations * opts.num_tokens_to_generate);
 
+  size_t speculative_tokens_proposed = 0, speculative_tokens_accepted = 0;
+
   if (opts.verbose) std::cout << "Running iterations (" << opts.num_iterations << ")...\n";
   for (size_t i = 0; i < opts.num_iterations; ++i) {
     auto generator = OgaGenerator::Create(*model, *generator_params);
@@ -241,6 +247,11 @@ void RunBenchmark(const benchmark::Options& opts) {
         }
       }
     }
+
+    size_t proposed = 0, accepted = 0;
+    generator->GetSpeculativeDecodingStats(proposed, accepted);
+    speculative_tokens_proposed += proposed;
+    speculative_tokens_accepted += accepted;
   }
 
   {
@@ -260,6 +271,11 @@ void RunBenchmark(const benchmark::Options& opts) {
     WritePerTokenStats("Token sampling", sampling_stats, opts.batch_size);
     WriteE2EStats("E2E generation (entire generation loop)", e2e_gen_stats);
 
+    if (speculative_tokens_proposed > 0) {
+      std::cout << "Speculative tokens accepted: " << speculative_tokens_accepted << " of " << speculative_tokens_proposed
+                << " (" << 100.0 * speculative_tokens_accepted / speculative_tokens_proposed << "%)\n";
+    }
+
     std::cout << "Peak working set size (bytes): " << benchmark::utils::GetPeakWorkingSetSizeInBytes() << "\n";
   }
 }
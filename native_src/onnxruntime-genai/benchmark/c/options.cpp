@@ -47,6 +47,10 @@ namespace {
     << "      Number of times to repeat the benchmark. Default: " << defaults.num_iterations << "\n"
     << "    -w,--warmup <number>\n"
     << "      Number of warmup runs before benchmarking. Default: " << defaults.num_warmup_iterations << "\n"
+    << "    --prompt_lookup_ngram_size <number>\n"
+    << "      Enable prompt lookup speculative decoding, matching n-grams of up to this many tokens. Default: disabled\n"
+    << "    --num_speculative_tokens <number>\n"
+    << "      Tokens proposed per model run with --prompt_lookup_ngram_size. Default: " << defaults.num_speculative_tokens << "\n"
     << "    -v,--verbose\n"
     << "      Show more informational output.\n"
     << "    -h,--help\n"
@@ -130,6 +134,10 @@ Options ParseOptionsFromCommandLine(int argc, const char* const* argv) {
         opts.num_iterations = ParseNumber<size_t>(next_arg(i));
       } else if (arg == "-w" || arg == "--warmup") {
         opts.num_warmup_iterations = ParseNumber<size_t>(next_arg(i));
+      } else if (arg == "--prompt_lookup_ngram_size") {
+        opts.prompt_lookup_ngram_size = ParseNumber<size_t>(next_arg(i));
+      } else if (arg == "--num_speculative_tokens") {
+        opts.num_speculative_tokens = ParseNumber<size_t>(next_arg(i));
       } else if (arg == "-v" || arg == "--verbose") {
         opts.verbose = true;
       } else if (arg == "-h" || arg == "--help") {
@@ -19,6 +19,8 @@ struct Options {
   size_t batch_size{1};
   size_t num_iterations{5};
   size_t num_warmup_iterations{1};
+  size_t prompt_lookup_ngram_size{};  // 0 disables prompt lookup speculative decoding
+  size_t num_speculative_tokens{4};
   bool verbose{};
 };
 
@@ -477,6 +477,8 @@ struct SlidingWindow_Element : JSON::Element {
       v_->slide_key_value_cache = JSON::Get<bool>(value);
     } else if (name == "slide_inputs") {
       v_->slide_inputs = JSON::Get<bool>(value);
+    } else if (name == "num_update_threads") {
+      v_->num_update_threads = static_cast<int>(JSON::Get<double>(value));
     } else {
       throw JSON::unknown_value_error{};
     }
@@ -498,6 +500,46 @@ struct SlidingWindow_Element : JSON::Element {
   std::unique_ptr<IntArray_Element> layers_;
 };
 
+struct FloatArray_Element : JSON::Element {
+  explicit FloatArray_Element(std::vector<float>& v) : v_{v} {}
+
+  void OnValue(std::string_view name, JSON::Value value) override {
+    v_.push_back(static_cast<float>(JSON::Get<double>(value)));
+  }
+
+ private:
+  std::vector<float>& v_;
+};
+
+struct RotaryEmbedding_Element : JSON::Element {
+  explicit RotaryEmbedding_Element(std::optional<Config::Model::Decoder::RotaryEmbedding>& v) : v_{v} {}
+
+  void OnValue(std::string_view name, JSON::Value value) override {
+    if (name == "theta") {
+      v_->theta = static_cast<float>(JSON::Get<double>(value));
+    } else if (name == "dim") {
+      v_->dim = static_cast<int>(JSON::Get<double>(value));
+    } else if (name == "interleaved") {
+      v_->interleaved = JSON::Get<bool>(value);
+    } else {
+      throw JSON::unknown_value_error{};
+    }
+  }
+
+  Element& OnArray(std::string_view name) override {
+    if (name == "factors") {
+      v_->factors.clear();
+      factors_ = std::make_unique<FloatArray_Element>(v_->factors);
+      return *factors_;
+    }
+    throw JSON::unknown_value_error{};
+  }
+
+ private:
+  std::optional<Config::Model::Decoder::RotaryEmbedding>& v_;
+  std::unique_ptr<FloatArray_Element> factors_;
+};
+
 struct Encoder_Element : JSON::Element {
   explicit Encoder_Element(Config::Model::Encoder& v) : v_{v} {}
 
@@ -563,6 +605,8 @@ struct Decoder_Element : JSON::Element {
       v_.num_hidden_layers = static_cast<int>(JSON::Get<double>(value));
     } else if (name == "head_size") {
       v_.head_size = static_cast<int>(JSON::Get<double>(value));
+    } else if (name == "prefix_cache_quantization") {
+      v_.prefix_cache_quantization = JSON::Get<std::string_view>(value);
     } else {
       throw JSON::unknown_value_error{};
     }
@@ -587,6 +631,10 @@ struct Decoder_Element : JSON::Element {
       v_.sliding_window = Config::Model::Decoder::SlidingWindow{};
       return sliding_window_;
     }
+    if (name == "rotary_embedding") {
+      v_.rotary_embedding = Config::Model::Decoder::RotaryEmbedding{};
+      return rotary_embedding_;
+    }
     // Support object-style pipeline: "pipeline": { "embeddings": { ... }, ... }
     if (name == "pipeline") {
       pipeline_object_ = std::make_unique<PipelineModelObject_Element>(v_.pipeline);
@@ -610,6 +658,7 @@ struct Decoder_Element : JSON::Element {
   DecoderOutputs_Element outputs_{v_.outputs};
   Pipeline_Element pipeline_{v_.pipeline};
   SlidingWindow_Element sliding_window_{v_.sliding_window};
+  RotaryEmbedding_Element rotary_embedding_{v_.rotary_embedding};
   std::unique_ptr<PipelineModelObject_Element> pipeline_object_;  // object-style pipeline support
 };
 
@@ -943,6 +992,12 @@ struct Model_Element : JSON::Element {
       v_.vocab_size = static_cast<int>(JSON::Get<double>(value));
     } else if (name == "context_length") {
       v_.context_length = static_cast<int>(JSON::Get<double>(value));
+    } else if (name == "optimized_model_cache_dir") {
+      v_.optimized_model_cache_dir = JSON::Get<std::string_view>(value);
+    } else if (name == "lazy_encoder_sessions") {
+      v_.lazy_encoder_sessions = JSON::Get<bool>(value);
+    } else if (name == "encoder_idle_timeout_ms") {
+      v_.encoder_idle_timeout_ms = static_cast<int>(JSON::Get<double>(value));
     } else if (name == "pad_token_id") {
       v_.pad_token_id = static_cast<int>(JSON::Get<double>(value));
     } else if (name == "eos_token_id") {
@@ -1045,6 +1100,10 @@ struct Search_Element : JSON::Element {
       v_.temperature = static_cast<float>(JSON::Get<double>(value));
     } else if (name == "repetition_penalty") {
       v_.repetition_penalty = static_cast<float>(JSON::Get<double>(value));
+    } else if (name == "frequency_penalty") {
+      v_.frequency_penalty = static_cast<float>(JSON::Get<double>(value));
+    } else if (name == "presence_penalty") {
+      v_.presence_penalty = static_cast<float>(JSON::Get<double>(value));
     } else if (name == "length_penalty") {
       v_.length_penalty = static_cast<float>(JSON::Get<double>(value));
     } else if (name == "no_repeat_ngram_size") {
@@ -1062,6 +1121,18 @@ struct Search_Element : JSON::Element {
       } else {
         v_.chunk_size = std::nullopt;
       }
+    } else if (name == "prefix_cache_bytes") {
+      v_.prefix_cache_bytes = static_cast<size_t>(JSON::Get<double>(value));
+    } else if (name == "image_features_cache_bytes") {
+      v_.image_features_cache_bytes = static_cast<size_t>(JSON::Get<double>(value));
+    } else if (name == "draft_model") {
+      v_.draft_model = JSON::Get<std::string_view>(value);
+    } else if (name == "num_speculative_tokens") {
+      v_.num_speculative_tokens = static_cast<int>(JSON::Get<double>(value));
+    } else if (name == "prompt_lookup_ngram_size") {
+      v_.prompt_lookup_ngram_size = static_cast<int>(JSON::Get<double>(value));
+    } else if (name == "attention_sink_size") {
+      v_.attention_sink_size = static_cast<int>(JSON::Get<double>(value));
     } else if (name == "do_sample") {
       v_.do_sample = JSON::Get<bool>(value);
     } else if (name == "past_present_share_buffer") {
@@ -1088,10 +1159,17 @@ struct DynamicBatching_Element : JSON::Element {
       v_->block_size = static_cast<size_t>(JSON::Get<double>(value));
     } else if (name == "num_blocks") {
       v_->num_blocks = static_cast<size_t>(JSON::Get<double>(value));
+    } else if (name == "kv_cache_bytes") {
+      v_->kv_cache_bytes = static_cast<size_t>(JSON::Get<double>(value));
     } else if (name == "gpu_utilization_factor") {
       v_->gpu_utilization_factor = static_cast<float>(JSON::Get<double>(value));
     } else if (name == "max_batch_size") {
       v_->max_batch_size = static_cast<size_t>(JSON::Get<double>(value));
+    } else if (name == "max_num_batched_tokens") {
+      const auto max_num_batched_tokens = JSON::Get<double>(value);
+      if (max_num_batched_tokens < 1)
+        throw std::runtime_error("max_num_batched_tokens must be 1 or greater, is " + std::to_string(max_num_batched_tokens));
+      v_->max_num_batched_tokens = static_cast<size_t>(max_num_batched_tokens);
     } else {
       throw JSON::unknown_value_error{};
     }
@@ -116,6 +116,17 @@ struct Config {
     int vocab_size{};
     int context_length{};
 
+    // Directory to keep the ORT optimized graphs of the model files in, so later loads skip graph optimization (see
+    // models/optimized_model_cache.h). Relative to the config directory. Empty to optimize on every load.
+    std::string optimized_model_cache_dir;
+
+    // Multimodal models: create the vision and speech sessions when a prompt first has images or audio instead of
+    // keeping them loaded from the start. Their inputs and outputs are still read at load.
+    bool lazy_encoder_sessions{};
+    // Release an encoder session this long after it was last used, to be created again by the next prompt that needs
+    // it. 0 releases it as soon as no generator is using it, -1 keeps it loaded.
+    int encoder_idle_timeout_ms{-1};
+
     struct Encoder {
       std::string filename;
       std::optional<SessionOptions> session_options;
@@ -224,6 +235,7 @@ struct Config {
       int num_key_value_heads{};
       int num_hidden_layers{};
       int head_size{};
+      std::string prefix_cache_quantization;  // "int8" or "fp8" to store key/values kept outside a session (prefix cache entries) in 8 bits on CPU. Running generators' caches keep the model's type
 
       struct SlidingWindow {               // Sliding window parameters for models that process input prompt in chunks
         int window_size{};                 // The size of the window to slide over the input prompt
@@ -232,9 +244,18 @@ struct Config {
         bool slide_key_value_cache{true};  // Whether to slide the key-value cache along with the input prompt
         bool slide_inputs{true};           // Whether to slide the input prompt along with the key-value cache
         std::vector<int> layers;           // Layer indices that use sliding window attention (for models with alternating patterns)
+        int num_update_threads{};          // Threads that slide the key-value cache layers in parallel. 0 = the hardware concurrency. Sizes the model's shared thread pool
       };
       std::optional<SlidingWindow> sliding_window;
 
+      struct RotaryEmbedding {  // How the model rotates keys before caching them, so an attention sink cache can move them to new positions
+        float theta{10000.0f};  // Base of the rotation frequencies (rope_theta)
+        int dim{};              // Leading channels of each head that are rotated. 0 means head_size
+        bool interleaved{};     // Rotated pairs are adjacent channels instead of the two halves of dim
+        std::vector<float> factors;  // Divisor of each pair's frequency (rope scaling: LongRoPE short_factor, YaRN, Llama 3). Empty for none
+      };
+      std::optional<RotaryEmbedding> rotary_embedding;
+
       struct Inputs {
         std::string input_ids{Defaults::InputIdsName};
         std::string embeddings{Defaults::InputsEmbedsName};
@@ -298,6 +319,8 @@ struct Config {
     int num_beams{1};                  // 1 means no beam search.
     int num_return_sequences{1};       // Number of sequences to return after search. Default is 1.
     float repetition_penalty{1.0f};    // 1.0 means no penalty.
+    float frequency_penalty{};         // Subtracted from a token's logit once per occurrence in the sequence (OpenAI style). 0.0 means no penalty.
+    float presence_penalty{};          // Subtracted from the logit of every token occurring in the sequence (OpenAI style). 0.0 means no penalty.
     int top_k{50};                     // Number of highest probability vocabulary tokens to keep for top-k-filtering that will be used by default in the generate method of the model.
     float top_p{};                     // If set to float >0 and <1, only the most probable tokens with probabilities that add up to top_p or higher are kept for generation.
     float temperature{1.0f};           // Temperature to control during generation. Default is 1.0.
@@ -305,17 +328,25 @@ struct Config {
     int no_repeat_ngram_size{};        // Unused param
     float diversity_penalty{};         // Unused param
     float length_penalty{1.0f};        // Exponential penalty to the length that is used with beam-based generation. length_penalty > 0.0 promotes longer sequences, while length_penalty < 0.0 encourages shorter sequences.
-    bool past_present_share_buffer{};  // The past/present kv tensors are shared and allocated once to max_length (cuda only)
+    bool past_present_share_buffer{};  // The past/present kv tensors are shared and written in place (allocated once to max_length, grown on demand on CPU)
     int random_seed{-1};               // -1 = Seed with random device, otherwise use value to seed RNG
     std::optional<size_t> chunk_size;  // Chunk size for prefill chunking during context processing. If present, chunking is enabled with the chunk size > 0.
+    size_t prefix_cache_bytes{};       // Byte budget of the model's cache of prompt prefix key/values shared by generators. 0 disables it.
+    size_t image_features_cache_bytes{};  // Byte budget of a multimodal model's cache of vision model outputs keyed by the processed images. 0 disables it.
+    std::string draft_model;           // Directory of a smaller model with the same tokenizer for speculative decoding, relative to this config's directory
+    int num_speculative_tokens{4};     // Tokens proposed per target model run. 0 disables speculative decoding.
+    int prompt_lookup_ngram_size{};    // Without a draft model, propose the tokens that followed the longest earlier match (up to this many tokens) of the sequence's end. 0 disables it.
+    int attention_sink_size{};         // At max_length keep the first attention_sink_size tokens and evict the oldest others instead of stopping (StreamingLLM). 0 disables it.
   } search;
 
   struct Engine {
     struct DynamicBatching {
-      size_t block_size{256};                       // Total number of slots per block.
-      std::optional<size_t> num_blocks;             // Total number of blocks per layer.
-      std::optional<float> gpu_utilization_factor;  // Fraction of free GPU memory to use for key-value cache.
-      size_t max_batch_size{16};                    // Maximum batch size for dynamically batching requests.
+      size_t block_size{256};                        // Total number of slots per block.
+      std::optional<size_t> num_blocks;              // Total number of blocks per layer.
+      std::optional<size_t> kv_cache_bytes;          // Byte budget for the key-value cache of all layers. Used when num_blocks is not set.
+      std::optional<float> gpu_utilization_factor;   // Fraction of free device memory (system memory on CPU) to use for key-value cache. Used when neither of the above is set.
+      size_t max_batch_size{16};                     // Maximum batch size for dynamically batching requests.
+      std::optional<size_t> max_num_batched_tokens;  // Tokens run per engine step. Decodes go first, prompts are prefilled in chunks with the rest.
     };
     std::optional<DynamicBatching> dynamic_batching;  // Dynamic batching settings
 
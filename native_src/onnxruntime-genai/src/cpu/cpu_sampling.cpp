@@ -0,0 +1,221 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "cpu_sampling.h"
+#include "vector_math.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace Generators {
+namespace cpu {
+
+namespace {
+
+// Top-p buckets probabilities by binary exponent: bucket b holds [2^-b, 2^(1-b)), the last one everything smaller
+constexpr int kNumProbabilityBuckets = 64;
+
+inline int ProbabilityBucket(float probability) {
+  uint32_t bits;
+  std::memcpy(&bits, &probability, sizeof(bits));
+  const int exponent = static_cast<int>(bits >> 23);  // Sign is clear, probability <= 1
+  return std::min(127 - exponent, kNumProbabilityBuckets - 1);
+}
+
+}  // namespace
+
+SamplingData::SamplingData(int vocab_size)
+    : probs_(static_cast<size_t>(vocab_size)),
+      candidate_buffer_(static_cast<size_t>(vocab_size)) {
+}
+
+void SamplingData::SelectTopK(std::span<const float> scores, int k) {
+  const size_t size = scores.size();
+  const size_t heap_size = std::min(static_cast<size_t>(k), size);
+  auto min_first = [](const Candidate& a, const Candidate& b) { return a.value > b.value; };
+
+  candidates_ = std::span<Candidate>{candidate_buffer_.data(), heap_size};
+  for (size_t i = 0; i < heap_size; i++)
+    candidates_[i] = {scores[i], static_cast<int32_t>(i)};
+  std::make_heap(candidates_.begin(), candidates_.end(), min_first);
+
+  // Only scores above the current k-th best can change the heap, and those get rarer as it fills with large ones
+  for (size_t i = FindFirstGreater(scores, heap_size, candidates_[0].value); i < size;
+       i = FindFirstGreater(scores, i + 1, candidates_[0].value)) {
+    std::pop_heap(candidates_.begin(), candidates_.end(), min_first);
+    candidates_.back() = {scores[i], static_cast<int32_t>(i)};
+    std::push_heap(candidates_.begin(), candidates_.end(), min_first);
+  }
+
+  std::sort_heap(candidates_.begin(), candidates_.end(), min_first);
+}
+
+void SamplingData::SelectTopK(std::span<const uint16_t> scores, int k) {
+  const size_t size = scores.size();
+  const size_t heap_size = std::min(static_cast<size_t>(k), size);
+  auto min_first = [](const Candidate& a, const Candidate& b) { return a.value > b.value; };
+
+  candidates_ = std::span<Candidate>{candidate_buffer_.data(), heap_size};
+  for (size_t i = 0; i < heap_size; i++)
+    candidates_[i] = {Float16ToFloat32(scores[i]), static_cast<int32_t>(i)};
+  std::make_heap(candidates_.begin(), candidates_.end(), min_first);
+
+  // As above, comparing against the fp16 score of the current k-th best
+  for (size_t i = FindFirstGreaterFloat16(scores, heap_size, scores[candidates_[0].index]); i < size;
+       i = FindFirstGreaterFloat16(scores, i + 1, scores[candidates_[0].index])) {
+    std::pop_heap(candidates_.begin(), candidates_.end(), min_first);
+    candidates_.back() = {Float16ToFloat32(scores[i]), static_cast<int32_t>(i)};
+    std::push_heap(candidates_.begin(), candidates_.end(), min_first);
+  }
+
+  std::sort_heap(candidates_.begin(), candidates_.end(), min_first);
+}
+
+float SamplingData::TopKProbabilities(float temperature) {
+  const float max_score = candidates_[0].value;
+  const float inv_temperature = 1.0f / temperature;
+  float sum = 0.0f;
+  for (auto& candidate : candidates_) {
+    candidate.value = std::exp((candidate.value - max_score) * inv_temperature);
+    sum += candidate.value;
+  }
+  return sum;
+}
+
+size_t SamplingData::NucleusSize(float target, float& mass) const {
+  mass = 0.0f;
+  for (size_t i = 0; i < candidates_.size(); i++) {
+    mass += candidates_[i].value;
+    if (mass >= target)
+      return i + 1;
+  }
+  return candidates_.size();
+}
+
+size_t SamplingData::PartitionNucleus(float target, float& mass) {
+  // Quickselect on mass: the order inside the nucleus doesn't matter for inverse CDF sampling, so only the boundary
+  // has to be found. Three-way partitions keep runs of equal probabilities from stalling the search.
+  constexpr size_t kSortThreshold = 64;
+  auto begin = candidates_.begin();
+  auto end = candidates_.end();
+  float mass_before = 0.0f;  // Mass of candidates_ ahead of begin, all of which are in the nucleus
+
+  while (static_cast<size_t>(end - begin) > kSortThreshold) {
+    const float pivot = begin[(end - begin) / 2].value;
+    const auto equal_begin = std::partition(begin, end, [pivot](const Candidate& c) { return c.value > pivot; });
+    const auto equal_end = std::partition(equal_begin, end, [pivot](const Candidate& c) { return c.value == pivot; });
+
+    float greater_mass = 0.0f;
+    for (auto it = begin; it != equal_begin; ++it)
+      greater_mass += it->value;
+    const float equal_mass = pivot * static_cast<float>(equal_end - equal_begin);
+
+    if (mass_before + greater_mass >= target) {
+      end = equal_begin;
+    } else if (mass_before + greater_mass + equal_mass >= target) {
+      // The boundary falls inside the run of equal values, any of them can close the nucleus
+      mass = mass_before + greater_mass;
+      auto it = equal_begin;
+      while (it != equal_end && mass < target)
+        mass += (it++)->value;
+      return static_cast<size_t>(it - candidates_.begin());
+    } else {
+      mass_before += greater_mass + equal_mass;
+      begin = equal_end;
+    }
+  }
+
+  std::sort(begin, end, [](const Candidate& a, const Candidate& b) { return a.value > b.value; });
+  mass = mass_before;
+  for (auto it = begin; it != end; ++it) {
+    mass += it->value;
+    if (mass >= target)
+      return static_cast<size_t>(it - candidates_.begin()) + 1;
+  }
+  return static_cast<size_t>(end - candidates_.begin());
+}
+
+size_t SamplingData::SampleCandidate(size_t count, float mass, std::mt19937& engine) {
+  assert(count > 0 && count <= candidates_.size());
+  std::uniform_real_distribution<float> distribution(0.0f, mass);
+  const float draw = distribution(engine);
+
+  float cumulative = 0.0f;
+  for (size_t i = 0; i < count; i++) {
+    cumulative += candidates_[i].value;
+    if (draw < cumulative)
+      return i;
+  }
+
+  // Rounding can leave the draw at the very end; the last candidate with non-zero weight owns it
+  size_t last = count - 1;
+  while (last > 0 && candidates_[last].value == 0.0f)
+    last--;
+  return last;
+}
+
+int32_t SamplingData::SampleTopK(std::span<const float> scores, int k, float temperature, std::mt19937& engine) {
+  SelectTopK(scores, k);
+  const float mass = TopKProbabilities(temperature);
+  return candidates_[SampleCandidate(candidates_.size(), mass, engine)].index;
+}
+
+int32_t SamplingData::SampleTopKTopP(std::span<const float> scores, int k, float p, float temperature, std::mt19937& engine) {
+  SelectTopK(scores, k);
+  const float sum = TopKProbabilities(temperature);
+
+  float mass;
+  const size_t count = NucleusSize(p * sum, mass);
+  return candidates_[SampleCandidate(count, mass, engine)].index;
+}
+
+int32_t SamplingData::SampleTopK(std::span<const uint16_t> scores, int k, float temperature, std::mt19937& engine) {
+  SelectTopK(scores, k);
+  const float mass = TopKProbabilities(temperature);
+  return candidates_[SampleCandidate(candidates_.size(), mass, engine)].index;
+}
+
+int32_t SamplingData::SampleTopKTopP(std::span<const uint16_t> scores, int k, float p, float temperature, std::mt19937& engine) {
+  SelectTopK(scores, k);
+  const float sum = TopKProbabilities(temperature);
+
+  float mass;
+  const size_t count = NucleusSize(p * sum, mass);
+  return candidates_[SampleCandidate(count, mass, engine)].index;
+}
+
+int32_t SamplingData::SampleTopP(std::span<const float> scores, float p, float temperature, std::mt19937& engine) {
+  assert(scores.size() <= probs_.size());
+  const std::span<float> probs{probs_.data(), scores.size()};
+  const float sum = ExpScaled(scores, MaxValue(scores), temperature, probs);
+  const float target = p * sum;
+
+  // Find the largest probability bucket boundary that still keeps p of the mass above it. Every token above the
+  // boundary outranks every token below it, so the nucleus is among them and only those need to be looked at.
+  std::array<float, kNumProbabilityBuckets> bucket_mass{};
+  for (const float probability : probs)
+    bucket_mass[ProbabilityBucket(probability)] += probability;
+
+  int last_bucket = 0;
+  for (float cumulative = bucket_mass[0]; cumulative < target && last_bucket < kNumProbabilityBuckets - 1;)
+    cumulative += bucket_mass[++last_bucket];
+  const float threshold = last_bucket < kNumProbabilityBuckets - 1 ? std::ldexp(1.0f, -last_bucket) : 0.0f;
+
+  // Branch-free compaction, the nucleus is often a large part of a flat distribution
+  size_t count = 0;
+  for (size_t i = 0; i < probs.size(); i++) {
+    candidate_buffer_[count] = {probs[i], static_cast<int32_t>(i)};
+    count += probs[i] >= threshold;
+  }
+  candidates_ = std::span<Candidate>{candidate_buffer_.data(), count};
+
+  float mass;
+  const size_t nucleus_size = PartitionNucleus(target, mass);
+  return candidates_[SampleCandidate(nucleus_size, mass, engine)].index;
+}
+
+}  // namespace cpu
+}  // namespace Generators
@@ -0,0 +1,60 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "../span.h"
+
+namespace Generators {
+namespace cpu {
+
+// Top-k / top-p sampling over one row of logits. All scratch buffers are sized for the vocabulary once, so sampling
+// a token does not allocate:
+//  - Top-k keeps a k-entry min-heap and skips (vectorized) every score that can't enter it, instead of sorting
+//    the vocabulary.
+//  - Top-p buckets the probabilities by exponent to find a threshold that already holds p of the mass, partitions
+//    the tokens above it around the nucleus boundary, and samples by inverse CDF over the nucleus alone.
+struct SamplingData {
+  explicit SamplingData(int vocab_size);
+
+  int32_t SampleTopK(std::span<const float> scores, int k, float temperature, std::mt19937& engine);
+  int32_t SampleTopP(std::span<const float> scores, float p, float temperature, std::mt19937& engine);
+  int32_t SampleTopKTopP(std::span<const float> scores, int k, float p, float temperature, std::mt19937& engine);
+
+  // Same as above for fp16 scores (as their bits), of which only the top-k candidates get converted to float
+  int32_t SampleTopK(std::span<const uint16_t> scores, int k, float temperature, std::mt19937& engine);
+  int32_t SampleTopKTopP(std::span<const uint16_t> scores, int k, float p, float temperature, std::mt19937& engine);
+
+ private:
+  struct Candidate {
+    float value;  // Score or probability, depending on the stage
+    int32_t index;
+  };
+
+  // Fills candidates_ with the k highest scores, sorted in descending order
+  void SelectTopK(std::span<const float> scores, int k);
+  void SelectTopK(std::span<const uint16_t> scores, int k);
+
+  // Converts the sorted top-k scores in candidates_ to unnormalized probabilities and returns their sum
+  float TopKProbabilities(float temperature);
+
+  // Index into candidates_ of the token drawn from the first count candidates, whose values sum to mass
+  size_t SampleCandidate(size_t count, float mass, std::mt19937& engine);
+
+  // Number of leading (sorted) candidates whose cumulative value first reaches target, and their sum
+  size_t NucleusSize(float target, float& mass) const;
+
+  // Same as NucleusSize for unsorted candidates: reorders candidates_ so the nucleus comes first, without sorting it
+  size_t PartitionNucleus(float target, float& mass);
+
+  std::vector<float> probs_;                  // shape (vocab_size)
+  std::vector<Candidate> candidate_buffer_;  // shape (vocab_size)
+  std::span<Candidate> candidates_;          // Leading part of candidate_buffer_ in use
+};
+
+}  // namespace cpu
+}  // namespace Generators
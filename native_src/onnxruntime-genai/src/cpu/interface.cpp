@@ -5,6 +5,20 @@
 #include "../search.h"
 #include "../models/utils.h"
 #include "interface.h"
+#include "vector_math.h"
+
+#if defined(__APPLE__)
+#include <TargetConditionals.h>
+#include <mach/mach.h>
+#include <sys/sysctl.h>
+#if TARGET_OS_IPHONE
+#include <os/proc.h>
+#endif
+#elif !defined(_WIN32)
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#endif
 
 namespace Generators {
 
@@ -42,6 +56,85 @@ struct CpuMemory final : DeviceBuffer {
   bool owned_;
 };
 
+// Float32 memory filled from fp16 values on the first CPU access, see WrapFloat16AsFloat32
+struct Float16AsFloat32Memory final : DeviceBuffer {
+  Float16AsFloat32Memory(std::span<const uint16_t> source, std::span<float> target) : source_{source} {
+    size_in_bytes_ = target.size_bytes();
+    p_cpu_ = p_device_ = reinterpret_cast<uint8_t*>(target.data());
+  }
+
+  const char* GetType() const override { return label_cpu; }
+  void AllocateCpu() override { Convert(); }
+  void CopyDeviceToCpu() override { Convert(); }
+  void CopyCpuToDevice() override {}
+  void CopyFrom(size_t begin_dest, DeviceBuffer& source, size_t begin_source, size_t size_in_bytes) override {
+    CopyThroughCpu(*this, begin_dest, source, begin_source, size_in_bytes);
+  }
+
+  void Zero() override {
+    source_ = {};
+    memset(p_device_, 0, size_in_bytes_);
+  }
+
+  std::span<const uint16_t> PendingFloat16() const override { return source_; }
+
+ private:
+  void Convert() {
+    if (source_.empty())
+      return;
+    cpu::Float16ToFloat32(source_, std::span<float>{reinterpret_cast<float*>(p_cpu_), source_.size()});
+    source_ = {};
+  }
+
+  std::span<const uint16_t> source_;  // Empty once converted
+};
+
+// Physical memory the process can still take without making the OS swap or reclaim it, and the total
+static void GetSystemMemory(size_t& available_bytes, size_t& total_bytes) {
+#if defined(_WIN32)
+  MEMORYSTATUSEX status{};
+  status.dwLength = sizeof(status);
+  if (!GlobalMemoryStatusEx(&status))
+    throw std::runtime_error("GlobalMemoryStatusEx failed");
+  available_bytes = static_cast<size_t>(status.ullAvailPhys);
+  total_bytes = static_cast<size_t>(status.ullTotalPhys);
+#elif defined(__APPLE__)
+  uint64_t memory_size{};
+  size_t length = sizeof(memory_size);
+  sysctlbyname("hw.memsize", &memory_size, &length, nullptr, 0);
+  total_bytes = static_cast<size_t>(memory_size);
+#if TARGET_OS_IPHONE
+  // iOS enforces a per-app limit well below the free system memory
+  if (__builtin_available(iOS 13.0, *)) {
+    available_bytes = os_proc_available_memory();
+    return;
+  }
+#endif
+  vm_statistics64_data_t vm_stats{};
+  mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+  if (host_statistics64(mach_host_self(), HOST_VM_INFO64, reinterpret_cast<host_info64_t>(&vm_stats), &count) != KERN_SUCCESS)
+    throw std::runtime_error("host_statistics64 failed");
+  available_bytes = static_cast<size_t>(vm_stats.free_count + vm_stats.inactive_count) * vm_page_size;
+#else
+  // MemAvailable includes the page cache the kernel can drop; free pages alone would badly underestimate
+  available_bytes = total_bytes = 0;
+  std::ifstream meminfo{"/proc/meminfo"};
+  for (std::string line; std::getline(meminfo, line);) {
+    unsigned long long kilobytes;
+    if (std::sscanf(line.c_str(), "MemAvailable: %llu kB", &kilobytes) == 1)
+      available_bytes = static_cast<size_t>(kilobytes) * 1024;
+    else if (std::sscanf(line.c_str(), "MemTotal: %llu kB", &kilobytes) == 1)
+      total_bytes = static_cast<size_t>(kilobytes) * 1024;
+  }
+
+  const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  if (total_bytes == 0)
+    total_bytes = static_cast<size_t>(sysconf(_SC_PHYS_PAGES)) * page_size;
+  if (available_bytes == 0)
+    available_bytes = static_cast<size_t>(sysconf(_SC_AVPHYS_PAGES)) * page_size;
+#endif
+}
+
 struct CpuInterface : DeviceInterface {
   CpuInterface() {
   }
@@ -80,10 +173,8 @@ struct CpuInterface : DeviceInterface {
       for (size_t i = 0; i < element_count; i++)
         bf16[i] = Float32ToBFloat16(fp32[i]);
     } else if (input_type == Ort::TypeToTensorType<Ort::Float16_t> && output_type == Ort::TypeToTensorType<float>) {
-      auto* fp16 = static_cast<uint16_t*>(input_data);
-      auto* fp32 = static_cast<float*>(output_data);
-      for (size_t i = 0; i < element_count; i++)
-        fp32[i] = FastFloat16ToFloat32(fp16[i]);
+      cpu::Float16ToFloat32(std::span<const uint16_t>{static_cast<const uint16_t*>(input_data), element_count},
+                            std::span<float>{static_cast<float*>(output_data), element_count});
     } else if (input_type == Ort::TypeToTensorType<Ort::BFloat16_t> && output_type == Ort::TypeToTensorType<float>) {
       auto* bf16 = static_cast<uint16_t*>(input_data);
       auto* fp32 = static_cast<float*>(output_data);
@@ -164,8 +255,17 @@ struct CpuInterface : DeviceInterface {
   std::unique_ptr<Search> CreateBeam(const GeneratorParams& params) override { return std::make_unique<BeamSearch_Cpu>(params); }
 
   void Synchronize() override {}  // Nothing to do as CPU is always in sync with itself
+
+  void GetAvailableMemory(size_t& free_bytes, size_t& total_bytes) override {
+    GetSystemMemory(free_bytes, total_bytes);
+  }
 };
 
+std::shared_ptr<DeviceBuffer> WrapFloat16AsFloat32(std::span<const uint16_t> source, std::span<float> target) {
+  assert(source.size() == target.size());
+  return std::make_shared<Float16AsFloat32Memory>(source, target);
+}
+
 DeviceInterface* GetCpuInterface() {
   static std::unique_ptr<CpuInterface> g_cpu = std::make_unique<CpuInterface>();
   return g_cpu.get();
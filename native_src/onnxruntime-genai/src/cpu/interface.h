@@ -5,4 +5,9 @@ namespace Generators {
 
 DeviceInterface* GetCpuInterface();
 
+// Float32 view of fp16 values that converts them into target on the first CpuSpan or CopyDeviceToCpu. Until then
+// DeviceSpan::PendingFloat16 returns the fp16 values, so code that only looks at a few of them can skip converting.
+// Both spans have to outlive the returned memory.
+std::shared_ptr<DeviceBuffer> WrapFloat16AsFloat32(std::span<const uint16_t> source, std::span<float> target);
+
 }
\ No newline at end of file
@@ -0,0 +1,603 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "vector_math.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define GENAI_VECTOR_MATH_NEON 1
+#elif defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define GENAI_VECTOR_MATH_X64 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// MSVC exposes every intrinsic regardless of /arch, so the kernels need no per-function target
+#define GENAI_TARGET_AVX2
+#define GENAI_TARGET_AVX512
+#else
+#define GENAI_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define GENAI_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+namespace Generators {
+namespace cpu {
+
+namespace {
+
+// Inputs below this underflow expf; they (and -inf for masked tokens) produce exactly 0
+constexpr float kExpLowerBound = -87.3f;
+constexpr float kExpUpperBound = 88.3f;
+
+// expf after range reduction x = n*ln(2) + r, with a degree 5 polynomial for e^r (Cephes)
+constexpr float kLog2e = 1.44269504088896341f;
+constexpr float kLn2Hi = 0.693359375f;
+constexpr float kLn2Lo = -2.12194440e-4f;
+constexpr float kExpP0 = 1.9875691500e-4f;
+constexpr float kExpP1 = 1.3981999507e-3f;
+constexpr float kExpP2 = 8.3334519073e-3f;
+constexpr float kExpP3 = 4.1665795894e-2f;
+constexpr float kExpP4 = 1.6666665459e-1f;
+constexpr float kExpP5 = 5.0000001201e-1f;
+
+struct Kernels {
+  const char* name;
+  float (*max_value)(const float* values, size_t size);
+  // out may be null to only compute the sum
+  float (*exp_scaled)(const float* values, size_t size, float max_value, float inv_temperature, float* out);
+  void (*affine)(float* values, size_t size, float subtract, float multiply, float add);
+  size_t (*find_first_greater)(const float* values, size_t begin, size_t size, float threshold);
+  void (*float16_to_float32)(const uint16_t* values, size_t size, float* out);
+  // Half precision values are compared through their Float16Key
+  int16_t (*max_float16_key)(const uint16_t* values, size_t size);
+  size_t (*find_first_greater_float16)(const uint16_t* values, size_t begin, size_t size, int16_t threshold_key);
+};
+
+// Maps half precision bits to integers that order like the values: negative values get their magnitude bits flipped,
+// so comparing the keys as int16_t compares the values (-0 sorts just below +0)
+inline int16_t Float16Key(uint16_t value) {
+  const auto bits = static_cast<int16_t>(value);
+  return static_cast<int16_t>(bits ^ ((bits >> 15) & 0x7FFF));
+}
+
+namespace scalar {
+
+float MaxValue(const float* values, size_t size) {
+  float max_value = -std::numeric_limits<float>::infinity();
+  for (size_t i = 0; i < size; i++)
+    max_value = std::max(max_value, values[i]);
+  return max_value;
+}
+
+float ExpScaled(const float* values, size_t size, float max_value, float inv_temperature, float* out) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < size; i++) {
+    const float x = (values[i] - max_value) * inv_temperature;
+    const float e = x >= kExpLowerBound ? std::exp(x) : 0.0f;  // Flush like the vector kernels do
+    if (out)
+      out[i] = e;
+    sum += e;
+  }
+  return sum;
+}
+
+void Affine(float* values, size_t size, float subtract, float multiply, float add) {
+  for (size_t i = 0; i < size; i++)
+    values[i] = (values[i] - subtract) * multiply + add;
+}
+
+size_t FindFirstGreater(const float* values, size_t begin, size_t size, float threshold) {
+  for (size_t i = begin; i < size; i++) {
+    if (values[i] > threshold)
+      return i;
+  }
+  return size;
+}
+
+float Float16ToFloat32(uint16_t value) {
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1F;
+  const uint32_t mantissa = value & 0x3FF;
+
+  uint32_t bits;
+  if (exponent == 0x1F) {
+    bits = sign | 0x7F800000 | mantissa << 13;  // Infinity or NaN
+  } else if (exponent != 0) {
+    bits = sign | (exponent + 112) << 23 | mantissa << 13;
+  } else {
+    const float subnormal = static_cast<float>(mantissa) * 0x1p-24f;  // Also covers zero
+    return sign ? -subnormal : subnormal;
+  }
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+void Float16ToFloat32(const uint16_t* values, size_t size, float* out) {
+  for (size_t i = 0; i < size; i++)
+    out[i] = Float16ToFloat32(values[i]);
+}
+
+int16_t MaxFloat16Key(const uint16_t* values, size_t size) {
+  int16_t max_key = std::numeric_limits<int16_t>::min();
+  for (size_t i = 0; i < size; i++)
+    max_key = std::max(max_key, Float16Key(values[i]));
+  return max_key;
+}
+
+size_t FindFirstGreaterFloat16(const uint16_t* values, size_t begin, size_t size, int16_t threshold_key) {
+  for (size_t i = begin; i < size; i++) {
+    if (Float16Key(values[i]) > threshold_key)
+      return i;
+  }
+  return size;
+}
+
+constexpr Kernels kKernels{"scalar", MaxValue, ExpScaled, Affine, FindFirstGreater,
+                           Float16ToFloat32, MaxFloat16Key, FindFirstGreaterFloat16};
+
+}  // namespace scalar
+
+#if GENAI_VECTOR_MATH_NEON
+namespace neon {
+
+inline float32x4_t Exp(float32x4_t x) {
+  const uint32x4_t in_range = vcgeq_f32(x, vdupq_n_f32(kExpLowerBound));
+  x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(kExpLowerBound)), vdupq_n_f32(kExpUpperBound));
+
+  const float32x4_t n = vrndnq_f32(vmulq_f32(x, vdupq_n_f32(kLog2e)));
+  float32x4_t r = vfmsq_f32(x, n, vdupq_n_f32(kLn2Hi));
+  r = vfmsq_f32(r, n, vdupq_n_f32(kLn2Lo));
+
+  float32x4_t p = vdupq_n_f32(kExpP0);
+  p = vfmaq_f32(vdupq_n_f32(kExpP1), p, r);
+  p = vfmaq_f32(vdupq_n_f32(kExpP2), p, r);
+  p = vfmaq_f32(vdupq_n_f32(kExpP3), p, r);
+  p = vfmaq_f32(vdupq_n_f32(kExpP4), p, r);
+  p = vfmaq_f32(vdupq_n_f32(kExpP5), p, r);
+  const float32x4_t y = vfmaq_f32(vaddq_f32(r, vdupq_n_f32(1.0f)), p, vmulq_f32(r, r));
+
+  const int32x4_t scale = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+  const float32x4_t result = vmulq_f32(y, vreinterpretq_f32_s32(scale));
+  return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(result), in_range));
+}
+
+float MaxValue(const float* values, size_t size) {
+  float max_value = -std::numeric_limits<float>::infinity();
+  size_t i = 0;
+  if (size >= 8) {
+    float32x4_t m0 = vld1q_f32(values), m1 = vld1q_f32(values + 4);
+    for (i = 8; i + 8 <= size; i += 8) {
+      m0 = vmaxq_f32(m0, vld1q_f32(values + i));
+      m1 = vmaxq_f32(m1, vld1q_f32(values + i + 4));
+    }
+    max_value = vmaxvq_f32(vmaxq_f32(m0, m1));
+  }
+  return std::max(max_value, scalar::MaxValue(values + i, size - i));
+}
+
+float ExpScaled(const float* values, size_t size, float max_value, float inv_temperature, float* out) {
+  const float32x4_t max_v = vdupq_n_f32(max_value), inv_t = vdupq_n_f32(inv_temperature);
+  float32x4_t sum0 = vdupq_n_f32(0.0f), sum1 = vdupq_n_f32(0.0f);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const float32x4_t e0 = Exp(vmulq_f32(vsubq_f32(vld1q_f32(values + i), max_v), inv_t));
+    const float32x4_t e1 = Exp(vmulq_f32(vsubq_f32(vld1q_f32(values + i + 4), max_v), inv_t));
+    if (out) {
+      vst1q_f32(out + i, e0);
+      vst1q_f32(out + i + 4, e1);
+    }
+    sum0 = vaddq_f32(sum0, e0);
+    sum1 = vaddq_f32(sum1, e1);
+  }
+  return vaddvq_f32(vaddq_f32(sum0, sum1)) +
+         scalar::ExpScaled(values + i, size - i, max_value, inv_temperature, out ? out + i : nullptr);
+}
+
+void Affine(float* values, size_t size, float subtract, float multiply, float add) {
+  const float32x4_t sub_v = vdupq_n_f32(subtract), mul_v = vdupq_n_f32(multiply), add_v = vdupq_n_f32(add);
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4)
+    vst1q_f32(values + i, vfmaq_f32(add_v, vsubq_f32(vld1q_f32(values + i), sub_v), mul_v));
+  scalar::Affine(values + i, size - i, subtract, multiply, add);
+}
+
+size_t FindFirstGreater(const float* values, size_t begin, size_t size, float threshold) {
+  const float32x4_t t = vdupq_n_f32(threshold);
+  size_t i = begin;
+  for (; i + 8 <= size; i += 8) {
+    const uint32x4_t above = vorrq_u32(vcgtq_f32(vld1q_f32(values + i), t), vcgtq_f32(vld1q_f32(values + i + 4), t));
+    if (vmaxvq_u32(above) != 0)
+      break;
+  }
+  return scalar::FindFirstGreater(values, i, size, threshold);
+}
+
+void Float16ToFloat32(const uint16_t* values, size_t size, float* out) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const float16x8_t half = vreinterpretq_f16_u16(vld1q_u16(values + i));
+    vst1q_f32(out + i, vcvt_f32_f16(vget_low_f16(half)));
+    vst1q_f32(out + i + 4, vcvt_high_f32_f16(half));
+  }
+  scalar::Float16ToFloat32(values + i, size - i, out + i);
+}
+
+inline int16x8_t Float16Keys(uint16x8_t values) {
+  const int16x8_t bits = vreinterpretq_s16_u16(values);
+  return veorq_s16(bits, vandq_s16(vshrq_n_s16(bits, 15), vdupq_n_s16(0x7FFF)));
+}
+
+int16_t MaxFloat16Key(const uint16_t* values, size_t size) {
+  int16_t max_key = std::numeric_limits<int16_t>::min();
+  size_t i = 0;
+  if (size >= 16) {
+    int16x8_t m0 = Float16Keys(vld1q_u16(values)), m1 = Float16Keys(vld1q_u16(values + 8));
+    for (i = 16; i + 16 <= size; i += 16) {
+      m0 = vmaxq_s16(m0, Float16Keys(vld1q_u16(values + i)));
+      m1 = vmaxq_s16(m1, Float16Keys(vld1q_u16(values + i + 8)));
+    }
+    max_key = vmaxvq_s16(vmaxq_s16(m0, m1));
+  }
+  return std::max(max_key, scalar::MaxFloat16Key(values + i, size - i));
+}
+
+size_t FindFirstGreaterFloat16(const uint16_t* values, size_t begin, size_t size, int16_t threshold_key) {
+  const int16x8_t t = vdupq_n_s16(threshold_key);
+  size_t i = begin;
+  for (; i + 16 <= size; i += 16) {
+    const uint16x8_t above = vorrq_u16(vcgtq_s16(Float16Keys(vld1q_u16(values + i)), t),
+                                       vcgtq_s16(Float16Keys(vld1q_u16(values + i + 8)), t));
+    if (vmaxvq_u16(above) != 0)
+      break;
+  }
+  return scalar::FindFirstGreaterFloat16(values, i, size, threshold_key);
+}
+
+constexpr Kernels kKernels{"neon", MaxValue, ExpScaled, Affine, FindFirstGreater,
+                           Float16ToFloat32, MaxFloat16Key, FindFirstGreaterFloat16};
+
+}  // namespace neon
+#endif
+
+#if GENAI_VECTOR_MATH_X64
+namespace avx2 {
+
+GENAI_TARGET_AVX2 inline __m256 Exp(__m256 x) {
+  const __m256 in_range = _mm256_cmp_ps(x, _mm256_set1_ps(kExpLowerBound), _CMP_GE_OQ);
+  x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(kExpLowerBound)), _mm256_set1_ps(kExpUpperBound));
+
+  const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(kLog2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Hi), x);
+  r = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Lo), r);
+
+  __m256 p = _mm256_set1_ps(kExpP0);
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kExpP1));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kExpP2));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kExpP3));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kExpP4));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kExpP5));
+  const __m256 y = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+  const __m256i scale = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+  return _mm256_and_ps(_mm256_mul_ps(y, _mm256_castsi256_ps(scale)), in_range);
+}
+
+GENAI_TARGET_AVX2 inline float HorizontalMax(__m256 v) {
+  __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+  m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+  return _mm_cvtss_f32(m);
+}
+
+GENAI_TARGET_AVX2 inline float HorizontalSum(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+GENAI_TARGET_AVX2 float MaxValue(const float* values, size_t size) {
+  float max_value = -std::numeric_limits<float>::infinity();
+  size_t i = 0;
+  if (size >= 16) {
+    __m256 m0 = _mm256_loadu_ps(values), m1 = _mm256_loadu_ps(values + 8);
+    for (i = 16; i + 16 <= size; i += 16) {
+      m0 = _mm256_max_ps(m0, _mm256_loadu_ps(values + i));
+      m1 = _mm256_max_ps(m1, _mm256_loadu_ps(values + i + 8));
+    }
+    max_value = HorizontalMax(_mm256_max_ps(m0, m1));
+  }
+  return std::max(max_value, scalar::MaxValue(values + i, size - i));
+}
+
+GENAI_TARGET_AVX2 float ExpScaled(const float* values, size_t size, float max_value, float inv_temperature, float* out) {
+  const __m256 max_v = _mm256_set1_ps(max_value), inv_t = _mm256_set1_ps(inv_temperature);
+  __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const __m256 e0 = Exp(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(values + i), max_v), inv_t));
+    const __m256 e1 = Exp(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(values + i + 8), max_v), inv_t));
+    if (out) {
+      _mm256_storeu_ps(out + i, e0);
+      _mm256_storeu_ps(out + i + 8, e1);
+    }
+    sum0 = _mm256_add_ps(sum0, e0);
+    sum1 = _mm256_add_ps(sum1, e1);
+  }
+  return HorizontalSum(_mm256_add_ps(sum0, sum1)) +
+         scalar::ExpScaled(values + i, size - i, max_value, inv_temperature, out ? out + i : nullptr);
+}
+
+GENAI_TARGET_AVX2 void Affine(float* values, size_t size, float subtract, float multiply, float add) {
+  const __m256 sub_v = _mm256_set1_ps(subtract), mul_v = _mm256_set1_ps(multiply), add_v = _mm256_set1_ps(add);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+    _mm256_storeu_ps(values + i, _mm256_fmadd_ps(_mm256_sub_ps(_mm256_loadu_ps(values + i), sub_v), mul_v, add_v));
+  scalar::Affine(values + i, size - i, subtract, multiply, add);
+}
+
+GENAI_TARGET_AVX2 size_t FindFirstGreater(const float* values, size_t begin, size_t size, float threshold) {
+  const __m256 t = _mm256_set1_ps(threshold);
+  size_t i = begin;
+  for (; i + 8 <= size; i += 8) {
+    if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(values + i), t, _CMP_GT_OQ)) != 0)
+      break;
+  }
+  return scalar::FindFirstGreater(values, i, size, threshold);
+}
+
+GENAI_TARGET_AVX2 void Float16ToFloat32(const uint16_t* values, size_t size, float* out) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i))));
+    _mm256_storeu_ps(out + i + 8, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i + 8))));
+  }
+  scalar::Float16ToFloat32(values + i, size - i, out + i);
+}
+
+GENAI_TARGET_AVX2 inline __m256i Float16Keys(const uint16_t* values) {
+  const __m256i bits = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values));
+  return _mm256_xor_si256(bits, _mm256_and_si256(_mm256_srai_epi16(bits, 15), _mm256_set1_epi16(0x7FFF)));
+}
+
+GENAI_TARGET_AVX2 int16_t MaxFloat16Key(const uint16_t* values, size_t size) {
+  int16_t max_key = std::numeric_limits<int16_t>::min();
+  size_t i = 0;
+  if (size >= 32) {
+    __m256i m0 = Float16Keys(values), m1 = Float16Keys(values + 16);
+    for (i = 32; i + 32 <= size; i += 32) {
+      m0 = _mm256_max_epi16(m0, Float16Keys(values + i));
+      m1 = _mm256_max_epi16(m1, Float16Keys(values + i + 16));
+    }
+    const __m256i m = _mm256_max_epi16(m0, m1);
+    int16_t lanes[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_max_epi16(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1)));
+    max_key = *std::max_element(lanes, lanes + 8);
+  }
+  return std::max(max_key, scalar::MaxFloat16Key(values + i, size - i));
+}
+
+GENAI_TARGET_AVX2 size_t FindFirstGreaterFloat16(const uint16_t* values, size_t begin, size_t size, int16_t threshold_key) {
+  const __m256i t = _mm256_set1_epi16(threshold_key);
+  size_t i = begin;
+  for (; i + 16 <= size; i += 16) {
+    if (_mm256_movemask_epi8(_mm256_cmpgt_epi16(Float16Keys(values + i), t)) != 0)
+      break;
+  }
+  return scalar::FindFirstGreaterFloat16(values, i, size, threshold_key);
+}
+
+constexpr Kernels kKernels{"avx2", MaxValue, ExpScaled, Affine, FindFirstGreater,
+                           Float16ToFloat32, MaxFloat16Key, FindFirstGreaterFloat16};
+
+}  // namespace avx2
+
+namespace avx512 {
+
+GENAI_TARGET_AVX512 inline __m512 Exp(__m512 x) {
+  const __mmask16 in_range = _mm512_cmp_ps_mask(x, _mm512_set1_ps(kExpLowerBound), _CMP_GE_OQ);
+  x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(kExpLowerBound)), _mm512_set1_ps(kExpUpperBound));
+
+  const __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(kLog2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(kLn2Hi), x);
+  r = _mm512_fnmadd_ps(n, _mm512_set1_ps(kLn2Lo), r);
+
+  __m512 p = _mm512_set1_ps(kExpP0);
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kExpP1));
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kExpP2));
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kExpP3));
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kExpP4));
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kExpP5));
+  const __m512 y = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+
+  return _mm512_maskz_mov_ps(in_range, _mm512_scalef_ps(y, n));
+}
+
+GENAI_TARGET_AVX512 float MaxValue(const float* values, size_t size) {
+  float max_value = -std::numeric_limits<float>::infinity();
+  size_t i = 0;
+  if (size >= 32) {
+    __m512 m0 = _mm512_loadu_ps(values), m1 = _mm512_loadu_ps(values + 16);
+    for (i = 32; i + 32 <= size; i += 32) {
+      m0 = _mm512_max_ps(m0, _mm512_loadu_ps(values + i));
+      m1 = _mm512_max_ps(m1, _mm512_loadu_ps(values + i + 16));
+    }
+    max_value = _mm512_reduce_max_ps(_mm512_max_ps(m0, m1));
+  }
+  return std::max(max_value, scalar::MaxValue(values + i, size - i));
+}
+
+GENAI_TARGET_AVX512 float ExpScaled(const float* values, size_t size, float max_value, float inv_temperature, float* out) {
+  const __m512 max_v = _mm512_set1_ps(max_value), inv_t = _mm512_set1_ps(inv_temperature);
+  __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    const __m512 e0 = Exp(_mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(values + i), max_v), inv_t));
+    const __m512 e1 = Exp(_mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(values + i + 16), max_v), inv_t));
+    if (out) {
+      _mm512_storeu_ps(out + i, e0);
+      _mm512_storeu_ps(out + i + 16, e1);
+    }
+    sum0 = _mm512_add_ps(sum0, e0);
+    sum1 = _mm512_add_ps(sum1, e1);
+  }
+  return _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1)) +
+         scalar::ExpScaled(values + i, size - i, max_value, inv_temperature, out ? out + i : nullptr);
+}
+
+GENAI_TARGET_AVX512 void Affine(float* values, size_t size, float subtract, float multiply, float add) {
+  const __m512 sub_v = _mm512_set1_ps(subtract), mul_v = _mm512_set1_ps(multiply), add_v = _mm512_set1_ps(add);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16)
+    _mm512_storeu_ps(values + i, _mm512_fmadd_ps(_mm512_sub_ps(_mm512_loadu_ps(values + i), sub_v), mul_v, add_v));
+  scalar::Affine(values + i, size - i, subtract, multiply, add);
+}
+
+GENAI_TARGET_AVX512 size_t FindFirstGreater(const float* values, size_t begin, size_t size, float threshold) {
+  const __m512 t = _mm512_set1_ps(threshold);
+  size_t i = begin;
+  for (; i + 16 <= size; i += 16) {
+    if (_mm512_cmp_ps_mask(_mm512_loadu_ps(values + i), t, _CMP_GT_OQ) != 0)
+      break;
+  }
+  return scalar::FindFirstGreater(values, i, size, threshold);
+}
+
+GENAI_TARGET_AVX512 void Float16ToFloat32(const uint16_t* values, size_t size, float* out) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16)
+    _mm512_storeu_ps(out + i, _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i))));
+  scalar::Float16ToFloat32(values + i, size - i, out + i);
+}
+
+// 16-bit integer compares need AVX512BW, so the half precision searches use the AVX2 kernels that every AVX-512 CPU has
+constexpr Kernels kKernels{"avx512", MaxValue, ExpScaled, Affine, FindFirstGreater,
+                           Float16ToFloat32, avx2::MaxFloat16Key, avx2::FindFirstGreaterFloat16};
+
+}  // namespace avx512
+
+#if defined(_MSC_VER) && !defined(__clang__)
+// Checks the CPUID feature bits and that the OS saves the required register state (XCR0)
+bool CpuSupports(int leaf7_ebx_bit, unsigned long long xcr0_mask) {
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+  __cpuid(info, 1);
+  constexpr int kFma = 1 << 12, kOsxsave = 1 << 27, kF16c = 1 << 29;
+  constexpr int kRequired = kFma | kOsxsave | kF16c;
+  if ((info[2] & kRequired) != kRequired || (_xgetbv(0) & xcr0_mask) != xcr0_mask)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << leaf7_ebx_bit)) != 0;
+}
+
+bool HasAvx512() { return CpuSupports(16, 0xe6); }  // ZMM, opmask and YMM state
+bool HasAvx2() { return CpuSupports(5, 0x6); }      // YMM state
+#else
+bool HasAvx512() { return __builtin_cpu_supports("avx512f"); }
+bool HasAvx2() { return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"); }
+#endif
+#endif
+
+const Kernels& SelectKernels() {
+#if GENAI_VECTOR_MATH_NEON
+  return neon::kKernels;
+#elif GENAI_VECTOR_MATH_X64
+  if (HasAvx512())
+    return avx512::kKernels;
+  if (HasAvx2())
+    return avx2::kKernels;
+  return scalar::kKernels;
+#else
+  return scalar::kKernels;
+#endif
+}
+
+std::atomic<const Kernels*>& ActiveKernels() {
+  static std::atomic<const Kernels*> kernels{&SelectKernels()};
+  return kernels;
+}
+
+const Kernels& GetKernels() {
+  return *ActiveKernels().load(std::memory_order_relaxed);
+}
+
+}  // namespace
+
+const char* VectorIsa() {
+  return SelectKernels().name;
+}
+
+void UseScalarVectorMath(bool scalar) {
+  ActiveKernels().store(scalar ? &scalar::kKernels : &SelectKernels(), std::memory_order_relaxed);
+}
+
+float MaxValue(std::span<const float> values) {
+  return GetKernels().max_value(values.data(), values.size());
+}
+
+namespace {
+
+// Sums in blocks so the float rounding error grows with the block count rather than the vocabulary size
+constexpr size_t kSumBlockSize = 4096;
+
+float ExpScaledBlocked(const float* values, size_t size, float max_value, float temperature, float* out) {
+  const auto exp_scaled = GetKernels().exp_scaled;
+  const float inv_temperature = 1.0f / temperature;
+  float sum = 0.0f;
+  for (size_t i = 0; i < size; i += kSumBlockSize)
+    sum += exp_scaled(values + i, std::min(kSumBlockSize, size - i), max_value, inv_temperature, out ? out + i : nullptr);
+  return sum;
+}
+
+}  // namespace
+
+float ExpScaled(std::span<const float> values, float max_value, float temperature, std::span<float> out) {
+  assert(out.size() >= values.size());
+  return ExpScaledBlocked(values.data(), values.size(), max_value, temperature, out.data());
+}
+
+float SumExpScaled(std::span<const float> values, float max_value, float temperature) {
+  return ExpScaledBlocked(values.data(), values.size(), max_value, temperature, nullptr);
+}
+
+void Affine(std::span<float> values, float subtract, float multiply, float add) {
+  GetKernels().affine(values.data(), values.size(), subtract, multiply, add);
+}
+
+size_t FindFirstGreater(std::span<const float> values, size_t begin, float threshold) {
+  return GetKernels().find_first_greater(values.data(), begin, values.size(), threshold);
+}
+
+float Float16ToFloat32(uint16_t value) {
+  return scalar::Float16ToFloat32(value);
+}
+
+void Float16ToFloat32(std::span<const uint16_t> values, std::span<float> out) {
+  assert(out.size() >= values.size());
+  GetKernels().float16_to_float32(values.data(), values.size(), out.data());
+}
+
+size_t ArgMaxFloat16(std::span<const uint16_t> values) {
+  const int16_t max_key = GetKernels().max_float16_key(values.data(), values.size());
+  if (values.empty() || max_key == std::numeric_limits<int16_t>::min())
+    return 0;  // Every value has the smallest key
+  return GetKernels().find_first_greater_float16(values.data(), 0, values.size(), static_cast<int16_t>(max_key - 1));
+}
+
+size_t FindFirstGreaterFloat16(std::span<const uint16_t> values, size_t begin, uint16_t threshold) {
+  return GetKernels().find_first_greater_float16(values.data(), begin, values.size(), Float16Key(threshold));
+}
+
+}  // namespace cpu
+}  // namespace Generators
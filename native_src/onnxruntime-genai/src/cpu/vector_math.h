@@ -0,0 +1,54 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../span.h"
+
+namespace Generators {
+namespace cpu {
+
+// Vectorized float kernels used per token by the CPU softmax and sampling code. The implementation is picked once at
+// runtime: NEON on arm64, AVX-512F or AVX2+FMA+F16C on x86-64 when the CPU supports them, scalar code otherwise. Exp is a
+// polynomial approximation within a few ulp of std::exp; inputs below about -87.3 (and -infinity) give exactly 0.
+
+// Name of the selected implementation ("neon", "avx512", "avx2" or "scalar")
+const char* VectorIsa();
+
+// Makes the functions below run the scalar code (true) or the selected implementation again (false), so tests can
+// compare the two. Not meant to be called while other threads use them.
+void UseScalarVectorMath(bool scalar);
+
+// Returns the largest value, or -infinity for an empty span
+float MaxValue(std::span<const float> values);
+
+// Writes exp((values[i] - max_value) / temperature) to out and returns the sum of the written values.
+// out may alias values.
+float ExpScaled(std::span<const float> values, float max_value, float temperature, std::span<float> out);
+
+// Same as ExpScaled without storing the exponentials
+float SumExpScaled(std::span<const float> values, float max_value, float temperature);
+
+// values[i] = (values[i] - subtract) * multiply + add
+void Affine(std::span<float> values, float subtract, float multiply, float add);
+
+// Index of the first value at or after begin that is greater than threshold, or values.size() if there is none
+size_t FindFirstGreater(std::span<const float> values, size_t begin, float threshold);
+
+// IEEE half precision (fp16, passed as its bits) to float. The span version converts with F16C / NEON fcvt.
+float Float16ToFloat32(uint16_t value);
+void Float16ToFloat32(std::span<const uint16_t> values, std::span<float> out);
+
+// The fp16 versions below compare the values without converting them. NaN is not expected; -0 counts as below +0.
+
+// Index of the first largest value, or 0 for an empty span
+size_t ArgMaxFloat16(std::span<const uint16_t> values);
+
+// Index of the first value at or after begin that is greater than threshold, or values.size() if there is none
+size_t FindFirstGreaterFloat16(std::span<const uint16_t> values, size_t begin, uint16_t threshold);
+
+}  // namespace cpu
+}  // namespace Generators
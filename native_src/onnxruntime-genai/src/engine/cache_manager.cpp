@@ -68,10 +68,10 @@ void StaticCacheManager::Allocate(const std::vector<std::shared_ptr<Request>>& r
 
 bool StaticCacheManager::SupportsDynamicBatching() const { return false; }
 
-void StaticCacheManager::Step() {
+void StaticCacheManager::Step(const ScheduledRequests& scheduled_requests) {
   auto request_with_max_sequence_length =
       std::max_element(
-          cache_allocated_requests_.begin(), cache_allocated_requests_.end(),
+          scheduled_requests.begin(), scheduled_requests.end(),
           [](const std::shared_ptr<Request>& a, const std::shared_ptr<Request>& b) {
             return a->CurrentSequenceLength() < b->CurrentSequenceLength();
           });
@@ -125,8 +125,9 @@ void PagedCacheManager::Allocate(const std::vector<std::shared_ptr<Request>>& re
   }
 }
 
-void PagedCacheManager::Step() {
-  for (auto& request : cache_allocated_requests_) {
+void PagedCacheManager::Step(const ScheduledRequests& scheduled_requests) {
+  std::vector<std::shared_ptr<Request>> requests(scheduled_requests.begin(), scheduled_requests.end());
+  for (auto& request : requests) {
     if (request->status_ == RequestStatus::Completed) {
       continue;
     }
@@ -138,7 +139,8 @@ void PagedCacheManager::Step() {
     key_value_cache_->AppendTokens(request);
   }
 
-  key_value_cache_->UpdateState(*key_value_cache_state_, cache_allocated_requests_);
+  // The block tables follow the order of the requests in the batch
+  key_value_cache_->UpdateState(*key_value_cache_state_, requests);
 }
 
 void PagedCacheManager::Deallocate(std::vector<std::shared_ptr<Request>>& requests) {
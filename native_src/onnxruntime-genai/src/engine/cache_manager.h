@@ -4,6 +4,7 @@
 #pragma once
 
 #include "request.h"
+#include "scheduled_requests.h"
 #include "../models/kv_cache.h"
 #include "paged_key_value_cache.h"
 
@@ -28,7 +29,8 @@ struct CacheManager {
 
   virtual void Allocate(const std::vector<std::shared_ptr<Request>>& requests) = 0;
 
-  virtual void Step() = 0;
+  // Prepares the cache for the tokens the scheduled requests run next
+  virtual void Step(const ScheduledRequests& scheduled_requests) = 0;
 
   KeyValueCacheState* Cache() { return key_value_cache_state_.get(); };
 
@@ -52,7 +54,7 @@ struct StaticCacheManager : CacheManager {
 
   void Allocate(const std::vector<std::shared_ptr<Request>>& requests) override;
 
-  void Step() override;
+  void Step(const ScheduledRequests& scheduled_requests) override;
 
   void Deallocate(std::vector<std::shared_ptr<Request>>& requests) override;
 
@@ -73,7 +75,7 @@ struct PagedCacheManager : CacheManager {
 
   void Allocate(const std::vector<std::shared_ptr<Request>>& requests) override;
 
-  void Step() override;
+  void Step(const ScheduledRequests& scheduled_requests) override;
 
   void Deallocate(std::vector<std::shared_ptr<Request>>& requests) override;
 
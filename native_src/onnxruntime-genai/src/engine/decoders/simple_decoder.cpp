@@ -12,7 +12,7 @@ SimpleDecoder::SimpleDecoder(std::shared_ptr<DecoderOnly_Model> model,
     : model_{model}, cache_manager_{cache_manager} {}
 
 void SimpleDecoder::Decode(ScheduledRequests& scheduled_requests) {
-  cache_manager_->Step();
+  cache_manager_->Step(scheduled_requests);
   std::unique_ptr<DecoderIO> decoder_state =
       cache_manager_->SupportsDynamicBatching()
           ? static_cast<std::unique_ptr<DecoderIO>>(std::make_unique<VarlenDecoderIO>(model_, scheduled_requests, cache_manager_))
@@ -31,7 +31,9 @@ std::shared_ptr<Request> Engine::Step() {
     return request;
   }
 
-  if (auto scheduled_requests = scheduler_->Schedule()) {
+  // A step that only prefills chunks of prompts produces no tokens, so keep stepping until one does
+  while (ready_requests_.empty()) {
+    auto scheduled_requests = scheduler_->Schedule();
     model_executor_->Decode(scheduled_requests);
     scheduled_requests.GenerateNextTokens();
 
@@ -42,10 +44,6 @@ std::shared_ptr<Request> Engine::Step() {
     }
   }
 
-  if (ready_requests_.empty()) {
-    throw std::runtime_error("Expected at least one request to be ready, but none were found.");
-  }
-
   auto request = ready_requests_.front();
   ready_requests_.pop();
   return request;
@@ -7,51 +7,88 @@ namespace Generators {
 
 namespace {
 
-size_t ComputeNumBlocks(std::shared_ptr<Model> model) {
-  if (model->config_->engine.dynamic_batching->num_blocks.has_value()) {
-    return *model->config_->engine.dynamic_batching->num_blocks;
+// Share of the free memory given to the key-value cache when the config doesn't set gpu_utilization_factor. On CPU
+// the cache competes with the rest of the process and the OS for system memory, so it takes less.
+constexpr float kDefaultGpuUtilizationFactor = 0.9f;
+constexpr float kDefaultCpuUtilizationFactor = 0.5f;
+
+size_t ComputeNumBlocks(std::shared_ptr<Model> model, ONNXTensorElementDataType dtype) {
+  const auto& dynamic_batching = *model->config_->engine.dynamic_batching;
+  if (dynamic_batching.num_blocks.has_value()) {
+    return *dynamic_batching.num_blocks;
   }
 
-  const auto dtype_size = Ort::SizeOf(ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16);
-
-  size_t free_bytes, total_bytes;
-  model->p_device_kvcache_->GetAvailableMemory(free_bytes, total_bytes);
-
-  constexpr float memory_fragmentation_factor = 0.9f;
   constexpr size_t num_caches_per_layer = 2;  // 2 for key and value caches
+  const size_t bytes_per_block = dynamic_batching.block_size *
+                                 model->config_->model.decoder.num_key_value_heads *
+                                 model->config_->model.decoder.head_size *
+                                 model->config_->model.decoder.num_hidden_layers *
+                                 Ort::SizeOf(dtype) *
+                                 num_caches_per_layer;
+
+  size_t budget_bytes;
+  if (dynamic_batching.kv_cache_bytes.has_value()) {
+    budget_bytes = *dynamic_batching.kv_cache_bytes;
+  } else {
+    size_t free_bytes, total_bytes;
+    model->p_device_kvcache_->GetAvailableMemory(free_bytes, total_bytes);
+
+    constexpr float memory_fragmentation_factor = 0.9f;
+    const float utilization_factor = dynamic_batching.gpu_utilization_factor.value_or(
+        model->p_device_kvcache_->GetType() == DeviceType::CPU ? kDefaultCpuUtilizationFactor : kDefaultGpuUtilizationFactor);
+
+    // Use the free memory to compute the number of blocks needed to achieve the given utilization factor.
+    budget_bytes = static_cast<size_t>(free_bytes * memory_fragmentation_factor * utilization_factor);
+  }
 
-  // Use the free memory to compute the number of blocks needed to achieve the given gpu_utilization_factor.
-  return static_cast<size_t>(free_bytes *
-                             memory_fragmentation_factor *
-                             *model->config_->engine.dynamic_batching->gpu_utilization_factor) /
-         (model->config_->engine.dynamic_batching->block_size *
-          model->config_->model.decoder.num_key_value_heads *
-          model->config_->model.decoder.head_size *
-          model->config_->model.decoder.num_hidden_layers *
-          dtype_size *
-          num_caches_per_layer);
+  const size_t num_blocks = budget_bytes / bytes_per_block;
+  if (num_blocks == 0) {
+    throw std::runtime_error("The key-value cache budget of " + std::to_string(budget_bytes) +
+                             " bytes does not fit a single block of " + std::to_string(bytes_per_block) +
+                             " bytes. Lower engine.dynamic_batching.block_size or raise the cache budget.");
+  }
+  return num_blocks;
 }
 
 }  // namespace
 
+size_t PagedKeyValueCache::RequiredSlots(const BlockTable& block_table) {
+  // Add reserved the slots of the whole prompt, which a chunked prefill then fills over several steps. Only tokens
+  // past the slots already in the table need new ones.
+  const size_t allocated_slots = std::accumulate(block_table.blocks.begin(), block_table.blocks.end(), size_t{0},
+                                                 [](size_t sum, const std::shared_ptr<Block>& block) {
+                                                   return sum + block->Size();
+                                                 });
+  const size_t used_slots = static_cast<size_t>(block_table.request->ProcessedSequenceLength()) +
+                            block_table.request->ScheduledTokens().size();
+  return used_slots > allocated_slots ? used_slots - allocated_slots : 0;
+}
+
 PagedKeyValueCache::PagedKeyValueCache(std::shared_ptr<Model> model)
     : model_(model) {
-  const auto num_blocks = ComputeNumBlocks(model_);
-  const std::vector<int64_t> cache_shape_per_layer{static_cast<int64_t>(num_blocks),
-                                                   static_cast<int64_t>(model->config_->engine.dynamic_batching->block_size),
-                                                   static_cast<int64_t>(model->config_->model.decoder.num_key_value_heads),
-                                                   static_cast<int64_t>(model->config_->model.decoder.head_size)};
-  const auto dtype = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16;
-  for (size_t i = 0; i < model->config_->model.decoder.num_hidden_layers; ++i) {
+  const auto& decoder_config = model->config_->model.decoder;
+  for (size_t i = 0; i < decoder_config.num_hidden_layers; ++i) {
     cache_.push_back(LayerCache{
-        OrtValue::CreateTensor(model->p_device_kvcache_->GetAllocator(), cache_shape_per_layer, dtype),      // Key cache
-        OrtValue::CreateTensor(model->p_device_kvcache_->GetAllocator(), cache_shape_per_layer, dtype),      // Value cache
-        ComposeKeyValueName(model->config_->model.decoder.inputs.past_key_names, static_cast<int>(i)),       // Key cache name
-        ComposeKeyValueName(model->config_->model.decoder.inputs.past_value_names, static_cast<int>(i)),     // Value cache name
-        ComposeKeyValueName(model->config_->model.decoder.outputs.present_key_names, static_cast<int>(i)),   // Key cache output name
-        ComposeKeyValueName(model->config_->model.decoder.outputs.present_value_names, static_cast<int>(i))  // Value cache output name
+        nullptr,                                                                              // Key cache
+        nullptr,                                                                              // Value cache
+        ComposeKeyValueName(decoder_config.inputs.past_key_names, static_cast<int>(i)),       // Key cache name
+        ComposeKeyValueName(decoder_config.inputs.past_value_names, static_cast<int>(i)),     // Value cache name
+        ComposeKeyValueName(decoder_config.outputs.present_key_names, static_cast<int>(i)),   // Key cache output name
+        ComposeKeyValueName(decoder_config.outputs.present_value_names, static_cast<int>(i))  // Value cache output name
     });
   }
+
+  // The cache holds whatever type the model's PagedAttention inputs take (fp16 on GPU, often fp32 on CPU)
+  const auto dtype = model->session_info_.GetInputDataType(cache_.front().key_cache_name);
+  const auto num_blocks = ComputeNumBlocks(model_, dtype);
+  const std::vector<int64_t> cache_shape_per_layer{static_cast<int64_t>(num_blocks),
+                                                   static_cast<int64_t>(model->config_->engine.dynamic_batching->block_size),
+                                                   static_cast<int64_t>(decoder_config.num_key_value_heads),
+                                                   static_cast<int64_t>(decoder_config.head_size)};
+  for (auto& layer_cache : cache_) {
+    layer_cache.key_cache = OrtValue::CreateTensor(model->p_device_kvcache_->GetAllocator(), cache_shape_per_layer, dtype);
+    layer_cache.value_cache = OrtValue::CreateTensor(model->p_device_kvcache_->GetAllocator(), cache_shape_per_layer, dtype);
+  }
   block_pool_ = std::make_unique<BlockPool>(model->config_->engine.dynamic_batching->block_size, num_blocks);
 }
 
@@ -77,7 +114,7 @@ bool PagedKeyValueCache::CanAppendTokens(std::shared_ptr<Request> request) const
     throw std::runtime_error("Given request is not found in the cache.");
   }
 
-  const size_t num_required_slots = request->UnprocessedTokens().size();
+  const size_t num_required_slots = RequiredSlots(*block_table_it);
   const size_t num_slots_available = block_table_it->blocks.back()->EmptySlots() +
                                      block_pool_->AvailableBlocks() * block_table_it->blocks.back()->Capacity();
 
@@ -95,12 +132,13 @@ void PagedKeyValueCache::AppendTokens(std::shared_ptr<Request> request) {
                                            });
   assert(block_table_it != block_tables_.end());
 
-  size_t num_slots = request->UnprocessedTokens().size();
+  size_t num_slots = RequiredSlots(*block_table_it);
   if (!block_table_it->blocks.back()->IsFull()) {
-    for (size_t i = 0; i < std::min(num_slots, block_table_it->blocks.back()->EmptySlots()); ++i) {
+    const size_t num_slots_in_last_block = std::min(num_slots, block_table_it->blocks.back()->EmptySlots());
+    for (size_t i = 0; i < num_slots_in_last_block; ++i) {
       block_table_it->blocks.back()->AddSlot();
-      --num_slots;
     }
+    num_slots -= num_slots_in_last_block;
   }
 
   auto allocated_blocks = block_pool_->AllocateBlocks(num_slots);
@@ -143,13 +181,17 @@ std::vector<std::pair<const char*, const char*>> PagedKeyValueCache::OutputNames
 }
 
 std::pair<OrtValue*, const char*> PagedKeyValueCache::BlockTables(const std::vector<std::shared_ptr<Request>>& requests) {
+  // The requests may be a subset of those in the cache, when a step only runs some of them
+  std::vector<const BlockTable*> request_block_tables;
   size_t max_blocks = 0;
-  for (auto& block_table : block_tables_) {
-    if (std::find(requests.begin(), requests.end(), block_table.request) != requests.end()) {
-      max_blocks = std::max(max_blocks, block_table.blocks.size());
-    } else {
+  for (auto& request : requests) {
+    auto it = std::find_if(block_tables_.begin(), block_tables_.end(),
+                           [&request](const BlockTable& block_table) { return block_table.request == request; });
+    if (it == block_tables_.end()) {
       throw std::runtime_error("Given request is not found in the cache. Please add it before requesting block tables.");
     }
+    request_block_tables.push_back(&*it);
+    max_blocks = std::max(max_blocks, it->blocks.size());
   }
 
   std::vector<int64_t> shape = {static_cast<int64_t>(requests.size()), static_cast<int64_t>(max_blocks)};
@@ -158,12 +200,8 @@ std::pair<OrtValue*, const char*> PagedKeyValueCache::BlockTables(const std::vec
 
   constexpr int32_t block_tables_pad_value = -1;
 
-  for (auto& block_table : block_tables_) {
-    auto it = std::find(requests.begin(), requests.end(), block_table.request);
-    if (it == requests.end()) {
-      throw std::runtime_error("Given request is not found in the cache. Please add it before requesting block tables.");
-    }
-    size_t index = std::distance(requests.begin(), it);
+  for (size_t index = 0; index < request_block_tables.size(); ++index) {
+    const auto& block_table = *request_block_tables[index];
     for (size_t j = 0; j < block_table.blocks.size(); ++j) {
       block_table_data[index * max_blocks + j] = static_cast<int32_t>(block_table.blocks[j]->Id());
     }
@@ -189,19 +227,19 @@ void PagedKeyValueCache::UpdateState(State& state, const std::vector<std::shared
   }
 
   for (size_t layer_idx = 0; layer_idx < cache.size(); ++layer_idx) {
-    // Key cache
+                                                                                              // Key cache
     state.inputs_[layer_idx * 2] = cache[layer_idx].first;
     state.outputs_[layer_idx * 2] = cache[layer_idx].first;
 
-    // Key cache name
+                                                                                              // Key cache name
     state.input_names_[layer_idx * 2] = cache_names[layer_idx].first;
     state.output_names_[layer_idx * 2] = cache_output_names[layer_idx].first;
 
-    // Value cache
+                                                                                              // Value cache
     state.inputs_[layer_idx * 2 + 1] = cache[layer_idx].second;
     state.outputs_[layer_idx * 2 + 1] = cache[layer_idx].second;
 
-    // Value cache name
+                                                                                              // Value cache name
     state.input_names_[layer_idx * 2 + 1] = cache_names[layer_idx].second;
     state.output_names_[layer_idx * 2 + 1] = cache_output_names[layer_idx].second;
   }
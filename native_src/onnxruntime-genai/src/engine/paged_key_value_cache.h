@@ -103,6 +103,9 @@ struct PagedKeyValueCache {
     std::vector<std::shared_ptr<Block>> blocks;
   };
 
+  // Slots the request's scheduled tokens need beyond those already in its block table
+  static size_t RequiredSlots(const BlockTable& block_table);
+
   std::shared_ptr<Model> model_;
   std::vector<LayerCache> cache_;                 // Pair of key and value caches for all layers
   std::unique_ptr<BlockPool> block_pool_;         // Allocator for blocks
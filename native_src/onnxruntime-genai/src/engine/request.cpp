@@ -100,6 +100,21 @@ DeviceSpan<int32_t> Request::UnprocessedTokens() {
   return unprocessed_tokens;
 }
 
+void Request::ScheduleTokens(size_t count) {
+  const size_t unprocessed_count = static_cast<size_t>(CurrentSequenceLength() - processed_sequence_length_);
+  if (count == 0 || count > unprocessed_count)
+    throw std::runtime_error("Cannot schedule " + std::to_string(count) + " tokens of a request with " +
+                             std::to_string(unprocessed_count) + " unprocessed tokens.");
+  scheduled_token_count_ = count;
+}
+
+DeviceSpan<int32_t> Request::ScheduledTokens() {
+  auto unprocessed_tokens = UnprocessedTokens();
+  if (scheduled_token_count_ == 0)
+    return unprocessed_tokens;
+  return unprocessed_tokens.subspan(0, scheduled_token_count_);
+}
+
 bool Request::IsDone() const {
   return status_ == RequestStatus::Completed;
 }
@@ -108,7 +123,19 @@ bool Request::IsPrefill() const {
   return is_prefill_;
 }
 
+int64_t Request::ProcessedSequenceLength() const {
+  return processed_sequence_length_;
+}
+
 void Request::GenerateNextTokens(DeviceSpan<float> logits) {
+  const size_t scheduled_token_count = std::exchange(scheduled_token_count_, 0);
+  if (scheduled_token_count != 0 &&
+      processed_sequence_length_ + static_cast<int64_t>(scheduled_token_count) < CurrentSequenceLength()) {
+    // Only a chunk of the prompt ran. Its logits predict the next prompt token, which is already known.
+    processed_sequence_length_ += static_cast<int64_t>(scheduled_token_count);
+    return;
+  }
+
   processed_sequence_length_ = search_->GetSequence(0).size();
   is_prefill_ = false;
 
@@ -116,6 +143,7 @@ void Request::GenerateNextTokens(DeviceSpan<float> logits) {
   auto& search_params = search_->params_->search;
   search_->ApplyMinLength(search_params.min_length);
   search_->ApplyRepetitionPenalty(search_params.repetition_penalty);
+  search_->ApplyFrequencyAndPresencePenalties(search_params.frequency_penalty, search_params.presence_penalty);
 
   if (!search_params.do_sample || search_params.top_k == 1 || search_params.temperature == 0) {
     search_->SelectTop();
@@ -83,6 +83,22 @@ struct Request : std::enable_shared_from_this<Request>,
    */
   DeviceSpan<int32_t> UnprocessedTokens();
 
+  /**
+   * @brief Limits the next step to the first count unprocessed tokens.
+   * @param count Number of unprocessed tokens to run, at least 1.
+   *
+   * The scheduler uses this to prefill a long prompt in chunks across several steps,
+   * so that it doesn't stall the decoding requests batched with it. Without a call,
+   * a step runs every unprocessed token.
+   */
+  void ScheduleTokens(size_t count);
+
+  /**
+   * @brief Returns a span of the unprocessed tokens the next step runs.
+   * @return DeviceSpan containing the scheduled token IDs.
+   */
+  DeviceSpan<int32_t> ScheduledTokens();
+
   /**
    * @brief Checks if there are any unseen tokens in the request.
    * @return True if there are unseen tokens, false otherwise.
@@ -92,6 +108,9 @@ struct Request : std::enable_shared_from_this<Request>,
   /**
    * @brief Generates the next set of tokens based on the provided logits.
    * @param logits DeviceSpan containing logits for token generation.
+   *
+   * After a prefill chunk that leaves part of the prompt unprocessed, the logits
+   * are ignored and only the processed length advances.
    */
   void GenerateNextTokens(DeviceSpan<float> logits);
 
@@ -112,6 +131,12 @@ struct Request : std::enable_shared_from_this<Request>,
    */
   bool IsPrefill() const;
 
+  /**
+   * @brief Gets the number of tokens the model has already processed.
+   * @return The processed sequence length.
+   */
+  int64_t ProcessedSequenceLength() const;
+
   /**
    * @brief Gets the current sequence length of the request.
    * @return The current sequence length.
@@ -150,6 +175,7 @@ struct Request : std::enable_shared_from_this<Request>,
   std::vector<int32_t> prefill_input_ids_;
   int64_t seen_sequence_length_{};
   int64_t processed_sequence_length_{};
+  size_t scheduled_token_count_{};  // 0 = every unprocessed token
   std::shared_ptr<GeneratorParams> params_;
   std::unique_ptr<Search> search_;
   std::weak_ptr<Engine> engine_;
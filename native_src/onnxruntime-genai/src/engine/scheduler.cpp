@@ -101,7 +101,47 @@ ScheduledRequests DynamicBatchScheduler::Schedule() {
     }
   }
 
-  ScheduledRequests scheduled_requests(cache_manager_->AllocatedRequests(), model_);
+  // Every decoding request runs its next token, so the streams already generating don't wait on new prompts.
+  // Prompts are prefilled with the rest of the token budget, in order of arrival, in chunks of at most
+  // search.chunk_size tokens. A long prompt therefore takes several steps instead of stalling one.
+  const auto& max_num_batched_tokens = model_->config_->engine.dynamic_batching->max_num_batched_tokens;
+  const auto& chunk_size = model_->config_->search.chunk_size;
+  const auto allocated_requests = cache_manager_->AllocatedRequests();
+  size_t num_batched_tokens = 0;
+  for (auto& request : allocated_requests) {
+    if (request->status_ != RequestStatus::Completed && !request->IsPrefill()) {
+      num_batched_tokens += request->UnprocessedTokens().size();
+    }
+  }
+
+  std::vector<std::shared_ptr<Request>> requests_to_run;
+  for (auto& request : allocated_requests) {
+    if (request->status_ == RequestStatus::Completed) {
+      continue;
+    }
+
+    if (!request->IsPrefill()) {
+      requests_to_run.push_back(request);
+      continue;
+    }
+
+    size_t num_tokens = request->UnprocessedTokens().size();
+    if (chunk_size.has_value()) {
+      num_tokens = std::min(num_tokens, *chunk_size);
+    }
+    if (max_num_batched_tokens.has_value()) {
+      num_tokens = std::min(num_tokens, *max_num_batched_tokens - std::min(num_batched_tokens, *max_num_batched_tokens));
+    }
+    if (num_tokens == 0) {
+      continue;
+    }
+
+    request->ScheduleTokens(num_tokens);
+    num_batched_tokens += num_tokens;
+    requests_to_run.push_back(request);
+  }
+
+  ScheduledRequests scheduled_requests(requests_to_run, model_);
 
   if (!scheduled_requests) {
     throw std::runtime_error("Unable to schedule requests: no requests available or all requests are completed.");
@@ -6,8 +6,11 @@
 #include "models/env_utils.h"
 #include "models/model.h"
 #include "models/decoder_only.h"
+#include "models/session_state.h"
 #include "constrained_logits_processor.h"
 #include "search.h"
+#include "ngram_index.h"
+#include "models/rotary_shift.h"
 #include "tracing.h"
 #include "cpu/interface.h"
 #include "cuda/interface.h"
@@ -16,6 +19,7 @@
 #include "webgpu/interface.h"
 #include "openvino/interface.h"
 #include "engine/engine.h"
+#include <limits>
 
 #if defined(_WIN32)
 EXTERN_C IMAGE_DOS_HEADER __ImageBase;
@@ -298,12 +302,322 @@ Generator::Generator(const Model& model, const GeneratorParams& params) : model_
     throw std::runtime_error("batch_size must be 1 or greater, is " + std::to_string(params.search.batch_size));
   if (params.config.model.vocab_size < 1)
     throw std::runtime_error("vocab_size must be 1 or greater, is " + std::to_string(params.config.model.vocab_size));
+  if (params.search.attention_sink_size < 0 || params.search.attention_sink_size >= params.search.max_length)
+    throw std::runtime_error("attention_sink_size (" + std::to_string(params.search.attention_sink_size) + ") must be 0 or less than max_length (" + std::to_string(params.search.max_length) + ")");
+  if (params.search.attention_sink_size > 0 &&
+      (params.BatchBeamSize() != 1 || params.p_device->GetType() != DeviceType::CPU || !ModelType::IsLLM(model.config_->model.type) ||
+       model.config_->model.decoder.sliding_window.has_value()))
+    throw std::runtime_error("attention_sink_size needs batch_size 1, num_beams 1, the CPU device and a text decoder model without a sliding_window");
+  if (params.search.attention_sink_size > 0)
+    CheckAttentionSinkSupport(model.config_->model.type, model.config_->model.decoder.rotary_embedding.has_value(),
+                              static_cast<size_t>(params.search.max_length));
 
   search_ = CreateSearch(params);
   state_ = model.CreateState(search_->GetSequenceLengths(), params);    // Search sequence lengths set when creating state
   guidance_logits_processor_ = CreateGuidanceLogitsProcessor(*state_);  // Could be nullptr if use_guidance (constrained decoding) is not used
 }
 
+Generator::~Generator() {
+  if (!UsesPrefixCache())
+    return;
+
+  try {
+    SavePrefix();
+  } catch (const std::exception& e) {
+    if (g_log.enabled && g_log.warning)
+      Log("warning", std::string("Could not add the key-value cache to the prefix cache: ") + e.what());
+  }
+}
+
+bool Generator::CopiesKeyValues() const {
+  const auto& params = *state_->params_;
+  const auto& config = *model_->config_;
+  const auto kv_device_type = model_->p_device_kvcache_->GetType();
+  return params.BatchBeamSize() == 1 &&
+         !params.use_graph_capture &&
+         ModelType::IsLLM(config.model.type) &&
+         !config.model.decoder.sliding_window.has_value() &&
+         extra_inputs_.empty() &&
+         state_->adapter_names_.empty() &&  // Key/values computed with a LoRA adapter only fit generators with the same one
+         (kv_device_type == DeviceType::CPU || kv_device_type == DeviceType::CUDA);
+}
+
+bool Generator::UsesPrefixCache() const {
+  return state_->params_->search.prefix_cache_bytes > 0 && CopiesKeyValues();
+}
+
+size_t Generator::RestorePrefix(cpu_span<const int32_t> input_ids, DeviceSpan<int32_t> input_ids_device) {
+  if (input_ids.size() > RopeFactorSwitchLength(model_->config_->model.type))
+    return 0;
+
+  auto match = model_->prefix_cache_->Lookup(input_ids);
+  // The last prompt token always runs, it produces the logits of the first generated token
+  const size_t length = std::min(match.length, input_ids.size() - 1);
+  if (length == 0 || !state_->RestorePrefix(input_ids_device.subspan(0, length), *match.prefix))
+    return 0;
+  return length;
+}
+
+void Generator::SavePrefix() {
+  // After a rewind the processed key/values aren't where DetachPrefix looks for them until the next run. After an
+  // eviction they no longer are what the sequence's tokens would compute.
+  if (computed_length_ == 0 || last_action_ == Action::rewound || state_->session_terminated_ || evicted_tokens_ > 0 ||
+      computed_length_ > RopeFactorSwitchLength(model_->config_->model.type))
+    return;
+
+  auto prefix = state_->DetachPrefix(computed_length_);
+  if (!prefix)
+    return;
+
+  auto sequence = GetSequence(0).CopyDeviceToCpu();
+  model_->prefix_cache_->Insert(sequence.subspan(0, computed_length_), std::move(prefix), state_->params_->search.prefix_cache_bytes);
+}
+
+void Generator::SaveState(const std::string& path) {
+  const auto& params = *state_->params_;
+  if (params.BatchBeamSize() != 1)
+    throw std::runtime_error("SaveState is only supported for batch_size 1 without beam search");
+  if (guidance_logits_processor_)
+    throw std::runtime_error("SaveState is not supported with guidance");
+  if (search_->GetSequenceLength() == 0)
+    throw std::runtime_error("SaveState needs a sequence, call AppendTokens first");
+
+  SessionState session;
+  auto sequence = GetSequence(0).CopyDeviceToCpu();
+  session.tokens.assign(sequence.begin(), sequence.end());
+  session.evicted_tokens = evicted_tokens_;
+  session.random_state = search_->GetRandomState();
+
+  // Unlike SavePrefix this copies, so a rewind is fine (the rows before computed_length_ stay valid), and so are
+  // evicted tokens: the key/values are restored as they are, not recomputed from the tokens. The last token is left
+  // out so loading has logits to continue from.
+  const size_t length = std::min(computed_length_, session.tokens.size() - 1);
+  if (length > 0 && CopiesKeyValues() && !state_->session_terminated_ &&
+      length <= RopeFactorSwitchLength(model_->config_->model.type))
+    session.key_values = state_->CopyPrefix(length);
+
+  WriteSessionState(path, session, *model_->p_device_kvcache_);
+}
+
+void Generator::LoadState(const std::string& path) {
+  ThrowErrorIfSessionTerminated(state_->session_terminated_);
+  const auto& params = *state_->params_;
+  if (search_->GetSequenceLength() != 0)
+    throw std::runtime_error("LoadState needs a generator without tokens");
+  if (params.BatchBeamSize() != 1)
+    throw std::runtime_error("LoadState is only supported for batch_size 1 without beam search");
+  if (guidance_logits_processor_)
+    throw std::runtime_error("LoadState is not supported with guidance");
+
+  auto session = ReadSessionState(path, *model_->p_device_kvcache_);
+  const size_t token_count = session.tokens.size();
+  if (token_count == 0)
+    throw std::runtime_error("The session state file " + path + " has no tokens");
+  if (token_count > static_cast<size_t>(params.search.max_length))
+    throw std::runtime_error("The session state file " + path + " has " + std::to_string(token_count) +
+                             " tokens, more than max_length (" + std::to_string(params.search.max_length) + ")");
+  const int vocab_size = model_->config_->model.vocab_size;
+  if (std::any_of(session.tokens.begin(), session.tokens.end(), [vocab_size](int32_t token) { return token < 0 || token >= vocab_size; }))
+    throw std::runtime_error("The session state file " + path + " has tokens outside the vocabulary of this model");
+
+  if (set_extra_inputs_) {
+    state_->SetExtraInputs(extra_inputs_);
+    set_extra_inputs_ = false;
+  }
+
+  auto input_ids_device = AllocateInputIdsOnDevice(session.tokens);
+  search_->AppendTokens(input_ids_device);
+  if (!session.random_state.empty())
+    search_->SetRandomState(session.random_state);
+  evicted_tokens_ = session.evicted_tokens;
+  computed_logits_ = false;
+
+  // Key/values this model can't take (another model, type or device) are recomputed from the tokens instead
+  const auto* key_values = session.key_values.get();
+  const bool restored = key_values && key_values->length < token_count && CopiesKeyValues() &&
+                        token_count <= RopeFactorSwitchLength(model_->config_->model.type) &&
+                        state_->RestorePrefix(input_ids_device.subspan(0, key_values->length), *key_values);
+  if (restored)
+    ComputeLogits(input_ids_device.subspan(key_values->length, token_count - key_values->length));
+  else
+    ComputeLogits(input_ids_device);
+}
+
+bool Generator::UsesSpeculativeDecoding() const {
+  const auto& params = *state_->params_;
+  const auto& search = params.search;
+  const auto& config = *model_->config_;
+  const auto kv_device_type = model_->p_device_kvcache_->GetType();
+  // The draft tokens are checked against the model's greedy choices, so anything that changes them is excluded
+  const bool greedy = !search.do_sample || search.top_k == 1 || search.temperature == 0;
+  return (model_->draft_model_ || search.prompt_lookup_ngram_size > 0) && search.num_speculative_tokens > 0 &&
+         greedy && search.repetition_penalty == 1.0f && search.frequency_penalty == 0.0f && search.presence_penalty == 0.0f &&
+         !guidance_logits_processor_ &&
+         params.BatchBeamSize() == 1 &&
+         !params.use_graph_capture &&
+         params.p_device->GetType() == DeviceType::CPU &&
+         ModelType::IsLLM(config.model.type) &&
+         !config.model.decoder.sliding_window.has_value() &&
+         (!config.search.chunk_size.has_value() || *config.search.chunk_size > static_cast<size_t>(search.num_speculative_tokens)) &&
+         (kv_device_type == DeviceType::CPU || kv_device_type == DeviceType::CUDA);
+}
+
+void Generator::Speculate() {
+  const auto& search = state_->params_->search;
+  const size_t length = search_->GetSequenceLength();
+
+  // Every token handed out must fit both sequences and stay on one side of the rope factor switch
+  size_t limit = search.max_length;
+  if (model_->draft_model_)
+    limit = std::min<size_t>(limit, model_->draft_model_->config_->model.context_length);
+  const size_t rope_switch_length = RopeFactorSwitchLength(model_->config_->model.type);
+  if (length <= rope_switch_length)
+    limit = std::min(limit, rope_switch_length);
+  if (length + 1 >= limit)
+    return;
+  const size_t count = std::min(static_cast<size_t>(search.num_speculative_tokens), limit - length - 1);
+
+  // The model hasn't run the last token of the sequence yet, it goes first
+  auto sequence = GetSequence(0).CopyDeviceToCpu();
+  const auto proposed = ProposeTokens(sequence, count);
+  if (proposed.empty())
+    return;
+  std::vector<int32_t> tokens{sequence[length - 1]};
+  tokens.insert(tokens.end(), proposed.begin(), proposed.end());
+
+  computed_length_ = 0;  // The key-value cache is only consistent again once the run succeeds
+  auto input_ids = AllocateInputIdsOnDevice(tokens);
+  state_->Run(static_cast<int>(length + tokens.size() - 1), input_ids, search_->GetNextIndices());
+  auto logits = state_->GetAllLogits().CopyDeviceToCpu();
+  const size_t vocab_size = static_cast<size_t>(model_->config_->model.vocab_size);
+  if (logits.size() != tokens.size() * vocab_size)
+    throw std::runtime_error("Speculative decoding needs the logits of every input token, but the model returned " +
+                             std::to_string(logits.size() / vocab_size) + " of " + std::to_string(tokens.size()));
+
+  // Keep the model's choice after each token until it disagrees with the next proposed one
+  const auto& eos_token_ids = model_->config_->model.eos_token_id;
+  size_t accepted = 0;
+  for (size_t i = 0; i < tokens.size(); i++) {
+    auto scores = logits.subspan(i * vocab_size, vocab_size);
+    if (length + i < static_cast<size_t>(search.min_length)) {  // As ApplyMinLength would
+      for (auto token_id : eos_token_ids)
+        scores[token_id] = std::numeric_limits<float>::lowest();
+    }
+    const auto token = static_cast<int32_t>(std::max_element(scores.begin(), scores.end()) - scores.begin());
+    speculated_tokens_.push_back(token);
+    if (i + 1 == tokens.size() || token != tokens[i + 1] || contains(eos_token_ids, token))
+      break;
+    accepted++;
+  }
+
+  // Forget the key/values of the rejected tokens
+  speculated_length_ = length + accepted;
+  if (accepted + 1 < tokens.size())
+    state_->RewindTo(speculated_length_);
+  computed_length_ = length;
+  draft_tokens_proposed_ += proposed.size();
+  draft_tokens_accepted_ += accepted;
+
+  if (g_log.enabled && g_log.generate_next_token) {
+    auto& stream = Log("generate_next_token");
+    stream << SGR::Fg_Green << "speculative tokens accepted: " << SGR::Reset << accepted << " of " << proposed.size() << ' '
+           << SGR::Fg_Cyan << "sequence length: " << SGR::Reset << length
+           << std::endl;
+  }
+}
+
+std::vector<int32_t> Generator::ProposeTokens(cpu_span<const int32_t> sequence, size_t count) {
+  const auto& search = state_->params_->search;
+  const auto& eos_token_ids = model_->config_->model.eos_token_id;
+  std::vector<int32_t> tokens;
+
+  if (!model_->draft_model_) {
+    if (!ngram_index_)
+      ngram_index_ = std::make_unique<NgramIndex>(search.prompt_lookup_ngram_size);
+    ngram_index_->Update(sequence);
+    for (int32_t token : ngram_index_->Propose(count)) {
+      tokens.push_back(token);
+      if (contains(eos_token_ids, token))
+        break;
+    }
+    return tokens;
+  }
+
+  if (!draft_) {
+    const auto& draft_model = *model_->draft_model_;
+    auto draft_params = CreateGeneratorParams(draft_model);
+    draft_params->search.max_length = std::min(search.max_length, draft_model.config_->model.context_length);
+    draft_params->search.do_sample = false;
+    draft_params->search.attention_sink_size = 0;  // SyncDraft follows the model's evictions
+    draft_ = CreateGenerator(draft_model, *draft_params);
+  }
+
+  SyncDraft(sequence);
+  while (tokens.size() < count) {
+    draft_->GenerateNextToken();
+    const int32_t token = draft_->search_->GetNextTokens().CopyDeviceToCpu()[0];
+    tokens.push_back(token);
+    if (contains(eos_token_ids, token) || draft_->search_->IsDone())
+      break;
+  }
+  return tokens;
+}
+
+void Generator::SyncDraft(cpu_span<const int32_t> sequence) {
+  auto draft_sequence = draft_->GetSequence(0).CopyDeviceToCpu();
+  const size_t common = static_cast<size_t>(
+      std::mismatch(sequence.begin(), sequence.end(), draft_sequence.begin(), draft_sequence.end()).first - sequence.begin());
+
+  // The draft hasn't run the last token it generated, and the last token of sequence has to run to give the first proposal
+  size_t keep = std::min(common, sequence.size() - 1);
+  if (!draft_sequence.empty())
+    keep = std::min(keep, draft_sequence.size() - 1);
+  draft_->RewindToLength(keep);
+  draft_->AppendTokens(sequence.subspan(keep));
+}
+
+void Generator::DropSpeculatedTokens() {
+  if (speculated_tokens_.empty())
+    return;
+  speculated_tokens_.clear();
+
+  // The model already ran tokens that never made it into the sequence
+  const size_t length = search_->GetSequenceLength();
+  if (speculated_length_ > length) {
+    state_->RewindTo(length);
+    speculated_length_ = length;
+  }
+  computed_length_ = length;
+}
+
+void Generator::EvictForAttentionSinks(size_t token_count) {
+  const auto& search = state_->params_->search;
+  const size_t length = search_->GetSequenceLength();
+  const size_t max_length = static_cast<size_t>(search.max_length);
+  if (search.attention_sink_size <= 0 || length + token_count <= max_length)
+    return;
+
+  // Evict at least an eighth of the window at once, so the cache isn't copied for every token. Only tokens the model
+  // has processed can go.
+  const size_t sink_size = static_cast<size_t>(search.attention_sink_size);
+  const size_t needed = length + token_count - max_length;
+  const size_t evictable = computed_length_ > sink_size ? computed_length_ - sink_size : 0;
+  const size_t count = std::min(evictable, std::max(needed, (max_length - sink_size) / 8));
+  if (count < needed)
+    throw std::runtime_error("input_ids size (" + std::to_string(token_count) + ") + current sequence length (" + std::to_string(length) + ") exceeds max length (" + std::to_string(max_length) + ") by more than the " + std::to_string(evictable) + " tokens that can be evicted after the attention sinks");
+  if (!state_->Evict(sink_size, count, computed_length_))
+    throw std::runtime_error("attention_sink_size is not supported by the key-value cache of " + model_->config_->model.type + " on " + to_string(model_->p_device_kvcache_->GetType()));
+
+  search_->Evict(sink_size, count);
+  computed_length_ -= count;
+  evicted_tokens_ += count;
+
+  if (g_log.enabled && g_log.hit_max_length) {
+    auto& stream = Log("hit_max_length");
+    stream << "evicted " << count << " tokens after " << sink_size << " attention sinks, " << evicted_tokens_ << " in total" << std::endl;
+  }
+}
+
 DeviceSpan<int32_t> Generator::AllocateInputIdsOnDevice(cpu_span<const int32_t> input_ids) {
   size_t padded_input_ids_size = input_ids.size();
   if (model_->config_->model.decoder.sliding_window.has_value()) {
@@ -346,10 +660,15 @@ void Generator::AppendTokens(cpu_span<const int32_t> input_ids) {
   ThrowErrorIfSessionTerminated(state_->session_terminated_);
   if (input_ids.size() == 0)
     throw std::runtime_error("input_ids is empty");
+  if (state_->params_->search.attention_sink_size > 0) {
+    DropSpeculatedTokens();
+    EvictForAttentionSinks(input_ids.size());
+  }
   if ((input_ids.size() / state_->params_->search.batch_size) + search_->GetSequenceLength() > state_->params_->search.max_length)
     throw std::runtime_error("input_ids size (" + std::to_string(input_ids.size()) + ") + current sequence length (" + std::to_string(search_->GetSequenceLength()) + ") exceeds max length (" + std::to_string(state_->params_->search.max_length) + ")");
   if (search_->GetSequenceLength() != 0 && state_->params_->search.batch_size > 1)
     throw std::runtime_error("AppendTokens can only be called once for batch_size > 1. To call AppendTokens again, use RewindToLength(0)");
+  DropSpeculatedTokens();
 
   // Some models fallback to CPU for the attention operator (for example, some decoder-pipeline NPU models).
   // Continuous decoding is supported for this case as the kv cache for such models is always on CPU.
@@ -374,9 +693,16 @@ void Generator::AppendTokens(cpu_span<const int32_t> input_ids) {
   }
 
   auto input_ids_device = AllocateInputIdsOnDevice(input_ids);
+  const bool is_new_prompt = search_->GetSequenceLength() == 0;
   search_->AppendTokens(input_ids_device);
   computed_logits_ = false;
-  ComputeLogits(input_ids_device);
+
+  // Only the part of a new prompt that no earlier generator has processed needs to run
+  const size_t restored_length = is_new_prompt && UsesPrefixCache() ? RestorePrefix(input_ids, input_ids_device) : 0;
+  if (restored_length > 0)
+    ComputeLogits(input_ids_device.subspan(restored_length, input_ids.size() - restored_length));
+  else
+    ComputeLogits(input_ids_device);
 }
 
 void Generator::SetInputs(const NamedTensors& named_tensors) {
@@ -418,7 +744,9 @@ void Generator::ComputeLogits(DeviceSpan<int32_t> next_tokens) {
     guidance_logits_processor_->CommitTokens(next_tokens_span);
   }
 
+  computed_length_ = 0;  // The key-value cache is only consistent again once the run succeeds
   auto logits = state_->Run(search_->GetSequenceLength(), next_tokens, search_->GetNextIndices());
+  computed_length_ = search_->GetSequenceLength();
   if (g_log.enabled && g_log.model_logits) {
     auto& stream = Log("model_logits");
     DumpValues(stream, Ort::TypeToTensorType<float>, logits.CopyDeviceToCpu().data(), logits.size());
@@ -436,7 +764,9 @@ void Generator::ComputeLogits(DeviceSpan<int32_t> next_tokens) {
 
       std::span<int32_t> new_next_token_span{ff_tokens};
       auto new_next_token = AllocateInputIdsOnDevice(new_next_token_span);
+      computed_length_ = 0;
       logits = state_->Run(search_->GetSequenceLength(), new_next_token, search_->GetNextIndices());
+      computed_length_ = search_->GetSequenceLength();
       if (g_log.enabled && g_log.model_logits) {
         auto& stream_ = Log("model_logits");
         DumpValues(stream_, Ort::TypeToTensorType<float>, logits.CopyDeviceToCpu().data(), logits.size());
@@ -500,11 +830,26 @@ void Generator::GenerateNextToken() {
   if (search_->params_->BatchBeamSize() == 1 && !epUsesSingleRopeFactor) {
     if (((search_->GetSequenceLength() == 4097) && (model_->config_->model.type == "phi3" || model_->config_->model.type == "phimoe")) || ((search_->GetSequenceLength() == 8193) && (model_->config_->model.type == "phi3small"))) {
       auto current_seq = cpu_span<int32_t>(GetSequence(0).CopyDeviceToCpu());
+      const size_t evicted_tokens = evicted_tokens_;
       RewindToLength(0);
       AppendTokens(current_seq);
+      evicted_tokens_ = evicted_tokens;
     }
   }
 
+  if (speculated_tokens_.empty() && !computed_logits_ && last_action_ == Action::generated && UsesSpeculativeDecoding())
+    Speculate();
+  if (!speculated_tokens_.empty()) {
+    search_->SelectToken(speculated_tokens_.front());
+    speculated_tokens_.pop_front();
+    computed_length_ = std::min<size_t>(search_->GetSequenceLength(), speculated_length_);
+    last_action_ = Action::generated;
+    return;
+  }
+
+  // The token chosen below, and after a rewind the token that's appended again first, have to fit
+  EvictForAttentionSinks(!computed_logits_ && last_action_ == Action::rewound ? 2 : 1);
+
   if (!computed_logits_) {
     auto next_tokens = search_->GetNextTokens();
     if (last_action_ == Action::rewound)
@@ -519,6 +864,7 @@ void Generator::GenerateNextToken() {
   auto& search = search_->params_->search;
   search_->ApplyMinLength(search.min_length);
   search_->ApplyRepetitionPenalty(search.repetition_penalty);
+  search_->ApplyFrequencyAndPresencePenalties(search.frequency_penalty, search.presence_penalty);
 
   if (g_log.enabled && g_log.generate_next_token) {
     auto& stream = Log("generate_next_token");
@@ -561,6 +907,7 @@ void Generator::RewindToLength(size_t new_length) {
     throw std::runtime_error("RewindTo is currently not supported for " + model_->config_->model.type + ".");
   if (new_length > search_->GetSequenceLength())
     throw std::runtime_error("Cannot rewind to a length greater than the current sequence length");
+  DropSpeculatedTokens();
   if (new_length == search_->GetSequenceLength())
     return;
   size_t batch_size = search_->params_->search.batch_size;
@@ -568,6 +915,9 @@ void Generator::RewindToLength(size_t new_length) {
     throw std::runtime_error("RewindToLength must be called with new_length=0 when batch_size > 1");
   search_->RewindTo(new_length);
   state_->RewindTo(new_length);
+  computed_length_ = std::min(computed_length_, new_length);
+  if (new_length <= static_cast<size_t>(search_->params_->search.attention_sink_size))
+    evicted_tokens_ = 0;  // Only tokens after the sinks were evicted
   if (guidance_logits_processor_) {
     guidance_logits_processor_->Reset();
   }
@@ -8,6 +8,7 @@
 #include <atomic>
 #include <cmath>
 #include <cstring>
+#include <deque>
 #include "filesystem.h"
 #include <functional>
 #include <iostream>
@@ -42,6 +43,7 @@ struct State;
 struct Search;
 struct Tokenizer;
 struct ConstrainedLogitsProcessor;
+struct NgramIndex;
 struct ExtraInput {  // Extra inputs provided via SetInputs()
   std::string name;
   std::shared_ptr<Tensor> tensor;
@@ -93,6 +95,7 @@ struct GeneratorParams : std::enable_shared_from_this<GeneratorParams>, LeakChec
 
 struct Generator : LeakChecked<Generator> {
   Generator(const Model& model, const GeneratorParams& params);
+  ~Generator();
 
   bool IsDone();
   void AppendTokens(cpu_span<const int32_t> input_ids);
@@ -105,6 +108,12 @@ struct Generator : LeakChecked<Generator> {
 
   DeviceSpan<int32_t> GetSequence(size_t index) const;
 
+  // Writes the sequence, the search state and the key/values of the processed tokens to a file (see
+  // models/session_state.h), and continues from one in a generator without tokens. Loading only runs the model over
+  // the tokens without saved key/values, at least the last one, which produces the logits. batch_size 1 only.
+  void SaveState(const std::string& path);
+  void LoadState(const std::string& path);
+
   // A list of extra model inputs that will be matched at runtime based on name
   std::vector<ExtraInput> extra_inputs_;
   void SetInputs(const NamedTensors& inputs);
@@ -116,10 +125,48 @@ struct Generator : LeakChecked<Generator> {
 
   bool computed_logits_{};       // Set to true in ComputeLogits() and false after appending a token to ensure a 1 to 1 call ratio
   bool set_extra_inputs_{true};  // Set to false once SetExtraInputs() is called once
+  size_t computed_length_{};     // Number of leading sequence tokens the model has processed
+
+  // Speculative decoding (search.draft_model or search.prompt_lookup_ngram_size): tokens proposed and how many of them
+  // the model accepted
+  size_t draft_tokens_proposed_{};
+  size_t draft_tokens_accepted_{};
+
+  // Attention sinks (search.attention_sink_size): tokens evicted from the middle of the sequence, so sequence index i
+  // past the sinks is token i + evicted_tokens_ of everything appended and generated
+  size_t evicted_tokens_{};
 
  private:
   DeviceSpan<int32_t> AllocateInputIdsOnDevice(cpu_span<const int32_t> input_ids);
   void ComputeLogits(DeviceSpan<int32_t> next_tokens);
+
+  // Whether the key/value cache can be copied out and restored (for the prefix cache and SaveState)
+  bool CopiesKeyValues() const;
+
+  // Prefix cache (search.prefix_cache_bytes): a new generator starts from the key/values an earlier one computed for
+  // the start of its prompt, and leaves its own behind when it is destroyed
+  bool UsesPrefixCache() const;
+  size_t RestorePrefix(cpu_span<const int32_t> input_ids, DeviceSpan<int32_t> input_ids_device);  // Returns the number of restored tokens
+  void SavePrefix();
+
+  // Speculative decoding: the draft model (or a lookup of the sequence's end in its earlier tokens) proposes tokens
+  // after the last one, the model runs all of them at once and keeps the prefix that matches its own greedy choices
+  // plus its choice after it. The verified tokens are handed out one per GenerateNextToken.
+  bool UsesSpeculativeDecoding() const;
+  void Speculate();
+  std::vector<int32_t> ProposeTokens(cpu_span<const int32_t> sequence, size_t count);
+  void SyncDraft(cpu_span<const int32_t> sequence);  // Makes the draft's sequence equal to sequence
+  void DropSpeculatedTokens();                       // Before the sequence changes in any other way
+
+  // Attention sinks: once token_count more tokens wouldn't fit max_length, the oldest processed tokens after the first
+  // attention_sink_size ones are evicted from the sequence and the key-value cache
+  void EvictForAttentionSinks(size_t token_count);
+
+  std::unique_ptr<Generator> draft_;
+  std::unique_ptr<NgramIndex> ngram_index_;  // Of the sequence, for search.prompt_lookup_ngram_size
+  std::deque<int32_t> speculated_tokens_;  // Verified tokens not yet added to the sequence
+  size_t speculated_length_{};             // Number of leading tokens of sequence + speculated_tokens_ the model has processed
+
   enum Action { standard,   // Default, set in any other case
                 generated,  // Set after GenerateNextToken
                 rewound };  // Set after RewindToLength
@@ -16,8 +16,7 @@ const OrtLoraAdapter* Adapter::AcquireRef() {
 }
 
 void Adapter::ReleaseRef() {
-  ref_count_--;
-  if (ref_count_ < 0) {
+  if (--ref_count_ < 0) {
     throw std::runtime_error("Adapter ref count went negative.");
   }
 }
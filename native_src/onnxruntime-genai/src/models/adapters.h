@@ -20,7 +20,7 @@ struct Adapter {
   int32_t RefCount() const;
 
  private:
-  int32_t ref_count_{};
+  std::atomic<int32_t> ref_count_{};  // Generators on several threads can share a model's adapters
   std::unique_ptr<OrtLoraAdapter> adapter_;
 };
 
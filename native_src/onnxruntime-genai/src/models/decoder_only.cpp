@@ -83,6 +83,38 @@ void DecoderOnly_State::RewindTo(size_t index) {
   kv_cache_->RewindTo(index);
 }
 
+std::unique_ptr<KeyValuePrefix> DecoderOnly_State::DetachPrefix(size_t length) {
+  return kv_cache_->DetachPrefix(length);
+}
+
+std::unique_ptr<KeyValuePrefix> DecoderOnly_State::CopyPrefix(size_t length) {
+  return kv_cache_->CopyPrefix(length);
+}
+
+bool DecoderOnly_State::RestorePrefix(DeviceSpan<int32_t> prefix_tokens, const KeyValuePrefix& prefix) {
+  const int length = static_cast<int>(prefix_tokens.size());
+  if (!kv_cache_->RestorePrefix(prefix, length))
+    return false;
+
+  // The same input bookkeeping as running the prefix, so the next Run() continues after it
+  input_ids_.Update(prefix_tokens);
+  position_inputs_->Update(prefix_tokens, length, length);
+  return true;
+}
+
+bool DecoderOnly_State::Evict(size_t start, size_t count, size_t length) {
+  if (!kv_cache_->Evict(start, count, length))
+    return false;
+
+  // The next positions continue from the shorter cache
+  position_inputs_->RewindTo(length - count);
+  return true;
+}
+
+DeviceSpan<float> DecoderOnly_State::GetAllLogits() {
+  return logits_.GetAll();
+}
+
 void DecoderOnly_State::UpdateInputsOutputs(DeviceSpan<int32_t>& next_tokens, DeviceSpan<int32_t> beam_indices, int total_length) {
   input_ids_.Update(next_tokens);
   size_t new_length = static_cast<size_t>(input_ids_.GetShape()[1]);
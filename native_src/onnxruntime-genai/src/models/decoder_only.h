@@ -25,6 +25,13 @@ struct DecoderOnly_State : State {
 
   void RewindTo(size_t index) override;
 
+  std::unique_ptr<KeyValuePrefix> DetachPrefix(size_t length) override;
+  std::unique_ptr<KeyValuePrefix> CopyPrefix(size_t length) override;
+  bool RestorePrefix(DeviceSpan<int32_t> prefix_tokens, const KeyValuePrefix& prefix) override;
+  bool Evict(size_t start, size_t count, size_t length) override;
+
+  DeviceSpan<float> GetAllLogits() override;
+
  private:
   DeviceSpan<float> RunWithChunking(int total_length, DeviceSpan<int32_t>& next_tokens,
                                     DeviceSpan<int32_t> next_indices, size_t chunk_size);
@@ -429,4 +429,11 @@ OrtValue* DecoderOnlyPipelineState::GetOutput(const char* name) {
   return State::GetOutput(name);
 }
 
+void DecoderOnlyPipelineState::SetRunOption(const char* key, const char* value) {
+  State::SetRunOption(key, value);
+  // Each stage runs with its own run options
+  for (auto& pipeline_state : pipeline_states_)
+    pipeline_state->SetRunOption(key, value);
+}
+
 }  // namespace Generators
@@ -66,6 +66,8 @@ struct DecoderOnlyPipelineState : State {
 
   OrtValue* GetOutput(const char* name) override;
 
+  void SetRunOption(const char* key, const char* value) override;
+
   void RunPipeline(int total_length, DeviceSpan<int32_t>& next_tokens,
                    DeviceSpan<int32_t> next_indices, bool is_last_chunk);
 
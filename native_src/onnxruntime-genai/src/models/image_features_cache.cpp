@@ -0,0 +1,111 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "image_features_cache.h"
+
+#include <cstring>
+#include <utility>
+
+namespace Generators {
+
+namespace {
+
+constexpr uint64_t kMultiplier = 0x9e3779b97f4a7c15ull;
+
+uint64_t Mix(uint64_t hash, uint64_t word) {
+  hash ^= word * kMultiplier;
+  hash = (hash << 31) | (hash >> 33);
+  return hash * 0xbf58476d1ce4e5b9ull;
+}
+
+// Pixel values are megabytes, so they are hashed a word at a time in four independent lanes
+uint64_t HashBytes(uint64_t hash, std::span<const uint8_t> bytes) {
+  uint64_t lanes[4]{hash, hash + kMultiplier, hash - kMultiplier, ~hash};
+  size_t offset = 0;
+  for (; offset + sizeof(lanes) <= bytes.size(); offset += sizeof(lanes)) {
+    uint64_t words[4];
+    std::memcpy(words, bytes.data() + offset, sizeof(words));
+    for (size_t i = 0; i < 4; i++)
+      lanes[i] = Mix(lanes[i], words[i]);
+  }
+  for (; offset < bytes.size(); offset++)
+    lanes[0] = Mix(lanes[0], bytes[offset]);
+
+  for (size_t i = 1; i < 4; i++)
+    lanes[0] = Mix(lanes[0], lanes[i]);
+  return Mix(lanes[0], bytes.size());
+}
+
+}  // namespace
+
+void ImageFeaturesKey::Add(std::string_view name, ONNXTensorElementDataType type, std::span<const int64_t> shape,
+                           std::span<const uint8_t> bytes) {
+  value = HashBytes(value, {reinterpret_cast<const uint8_t*>(name.data()), name.size()});
+  Add(static_cast<uint64_t>(type));
+  Add(shape.size());
+  for (auto dim : shape)
+    Add(static_cast<uint64_t>(dim));
+  value = HashBytes(value, bytes);
+}
+
+void ImageFeaturesKey::Add(uint64_t number) {
+  value = Mix(value, number);
+}
+
+std::shared_ptr<const ImageFeatures> ImageFeaturesCache::Lookup(uint64_t key) {
+  std::scoped_lock lock{mutex_};
+
+  auto it = index_.find(key);
+  if (it == index_.end())
+    return nullptr;
+
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return it->second->features;
+}
+
+void ImageFeaturesCache::Insert(uint64_t key, std::shared_ptr<const ImageFeatures> features, size_t max_bytes) {
+  if (!features || features->bytes > max_bytes)
+    return;
+
+  std::scoped_lock lock{mutex_};
+
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    bytes_ -= it->second->features->bytes;
+    entries_.erase(it->second);
+    index_.erase(it);
+  }
+
+  bytes_ += features->bytes;
+  entries_.push_front({key, std::move(features)});
+  index_.emplace(key, entries_.begin());
+  Evict(max_bytes);
+}
+
+void ImageFeaturesCache::Clear() {
+  std::scoped_lock lock{mutex_};
+  entries_.clear();
+  index_.clear();
+  bytes_ = 0;
+}
+
+size_t ImageFeaturesCache::EntryCount() const {
+  std::scoped_lock lock{mutex_};
+  return entries_.size();
+}
+
+size_t ImageFeaturesCache::Bytes() const {
+  std::scoped_lock lock{mutex_};
+  return bytes_;
+}
+
+void ImageFeaturesCache::Evict(size_t max_bytes) {
+  while (bytes_ > max_bytes) {
+    auto& oldest = entries_.back();
+    bytes_ -= oldest.features->bytes;
+    index_.erase(oldest.key);
+    entries_.pop_back();
+  }
+}
+
+}  // namespace Generators
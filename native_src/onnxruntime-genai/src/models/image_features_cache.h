@@ -0,0 +1,63 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+#include "../span.h"
+#include "onnxruntime_api.h"
+
+namespace Generators {
+
+// Hash of the vision model inputs an image was processed into (pixel values, image sizes, attention masks, ...).
+// Their names, types and shapes are part of it, so the same picture processed with other settings hashes differently.
+struct ImageFeaturesKey {
+  void Add(std::string_view name, ONNXTensorElementDataType type, std::span<const int64_t> shape, std::span<const uint8_t> bytes);
+  void Add(uint64_t number);
+
+  uint64_t value{0x6a09e667f3bcc908ull};
+};
+
+// The image_features output of a vision model run
+struct ImageFeatures {
+  std::unique_ptr<OrtValue> features;
+  size_t bytes{};
+};
+
+// image_features of earlier prompts of a model keyed by ImageFeaturesKey, so that asking about the same image again
+// copies its features instead of running the vision model. Entries are evicted least recently used first to stay
+// within the byte budget of the generator that inserts. All methods are thread safe.
+struct ImageFeaturesCache {
+  // nullptr when no entry has key
+  std::shared_ptr<const ImageFeatures> Lookup(uint64_t key);
+
+  // Stores features under key, replacing an earlier entry, then evicts entries until the cache holds at most
+  // max_bytes. Nothing is stored if the entry alone is larger than max_bytes.
+  void Insert(uint64_t key, std::shared_ptr<const ImageFeatures> features, size_t max_bytes);
+
+  void Clear();
+
+  size_t EntryCount() const;
+  size_t Bytes() const;
+
+ private:
+  struct Entry {
+    uint64_t key;
+    std::shared_ptr<const ImageFeatures> features;
+  };
+
+  void Evict(size_t max_bytes);
+
+  mutable std::mutex mutex_;
+  std::list<Entry> entries_;  // Most recently used first
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+  size_t bytes_{};
+};
+
+}  // namespace Generators
@@ -0,0 +1,106 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "image_patches.h"
+#include "threadpool.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define GENAI_IMAGE_PATCHES_NEON 1
+#endif
+
+namespace Generators {
+
+namespace {
+
+// Splits count interleaved pixels into planes channel_stride floats apart
+void Deinterleave(const float* pixels, int64_t count, int64_t channels, float* planes, int64_t channel_stride) {
+  if (channels == 3) {
+    float* r = planes;
+    float* g = planes + channel_stride;
+    float* b = planes + 2 * channel_stride;
+    int64_t x = 0;
+#if GENAI_IMAGE_PATCHES_NEON
+    for (; x + 4 <= count; x += 4) {
+      const float32x4x3_t rgb = vld3q_f32(pixels + 3 * x);
+      vst1q_f32(r + x, rgb.val[0]);
+      vst1q_f32(g + x, rgb.val[1]);
+      vst1q_f32(b + x, rgb.val[2]);
+    }
+#endif
+    for (; x < count; x++) {
+      r[x] = pixels[3 * x];
+      g[x] = pixels[3 * x + 1];
+      b[x] = pixels[3 * x + 2];
+    }
+    return;
+  }
+
+  for (int64_t c = 0; c < channels; c++) {
+    float* plane = planes + c * channel_stride;
+    for (int64_t x = 0; x < count; x++)
+      plane[x] = pixels[x * channels + c];
+  }
+}
+
+void ExtractPatchRow(const float* image, const ImagePatchesShape& shape, int64_t patch_row, float* patches) {
+  const int64_t patch_size = shape.patch_size;
+  const int64_t row_width = shape.WidthPatches() * patch_size;  // Pixels of the row that are part of a patch
+  const int64_t plane_size = patch_size * row_width;
+  const int64_t spatial_dim = shape.channels * patch_size * patch_size;
+
+  // [channels, patch_size, row_width], kept by each thread for the next call
+  thread_local std::vector<float> planes;
+  planes.resize(static_cast<size_t>(shape.channels * plane_size));
+
+  for (int64_t h = 0; h < patch_size; h++) {
+    const float* pixels = image + (patch_row * patch_size + h) * shape.width * shape.channels;
+    Deinterleave(pixels, row_width, shape.channels, planes.data() + h * row_width, plane_size);
+  }
+
+  const size_t patch_row_bytes = static_cast<size_t>(patch_size) * sizeof(float);
+  for (int64_t pw = 0; pw < shape.WidthPatches(); pw++) {
+    float* const patch = patches + pw * shape.PatchDim();
+    float* out = patch;
+    for (int64_t c = 0; c < shape.channels; c++) {
+      const float* source = planes.data() + c * plane_size + pw * patch_size;
+      for (int64_t h = 0; h < patch_size; h++, out += patch_size)
+        std::memcpy(out, source + h * row_width, patch_row_bytes);
+    }
+    for (int64_t t = 1; t < shape.temporal_patch_size; t++)
+      std::memcpy(patch + t * spatial_dim, patch, static_cast<size_t>(spatial_dim) * sizeof(float));
+  }
+}
+
+}  // namespace
+
+void ExtractImagePatches(std::span<const float> image, const ImagePatchesShape& shape, std::span<float> patches,
+                         ThreadPool* thread_pool) {
+  if (shape.patch_size <= 0 || shape.temporal_patch_size <= 0 || shape.channels <= 0)
+    throw std::runtime_error("ExtractImagePatches: patch sizes and channels must be positive");
+  if (image.size() < static_cast<size_t>(shape.height * shape.width * shape.channels))
+    throw std::runtime_error("ExtractImagePatches: the image is smaller than its shape");
+  if (patches.size() != static_cast<size_t>(shape.PatchCount() * shape.PatchDim()))
+    throw std::runtime_error("ExtractImagePatches: expected " + std::to_string(shape.PatchCount() * shape.PatchDim()) +
+                             " patch values, got " + std::to_string(patches.size()));
+
+  const int64_t row_dim = shape.WidthPatches() * shape.PatchDim();
+  auto extract_row = [&](size_t patch_row) {
+    ExtractPatchRow(image.data(), shape, static_cast<int64_t>(patch_row), patches.data() + patch_row * row_dim);
+  };
+
+  const auto row_count = static_cast<size_t>(shape.HeightPatches());
+  if (thread_pool && thread_pool->NumThreads() > 1 && row_count > 1) {
+    thread_pool->Compute(row_count, extract_row);
+  } else {
+    for (size_t row = 0; row < row_count; row++)
+      extract_row(row);
+  }
+}
+
+}  // namespace Generators
@@ -0,0 +1,34 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstdint>
+
+#include "../span.h"
+
+namespace Generators {
+
+struct ThreadPool;
+
+struct ImagePatchesShape {
+  int64_t height, width, channels;  // Of the HWC input image
+  int64_t patch_size;               // Patches are patch_size x patch_size pixels
+  int64_t temporal_patch_size;      // Times each patch is repeated, as a still image has one frame
+
+  int64_t HeightPatches() const { return height / patch_size; }
+  int64_t WidthPatches() const { return width / patch_size; }
+  int64_t PatchCount() const { return HeightPatches() * WidthPatches(); }
+  int64_t PatchDim() const { return temporal_patch_size * channels * patch_size * patch_size; }
+};
+
+// Rearranges an HWC float image into the flattened patches Qwen2-VL style vision models take:
+// [PatchCount(), PatchDim()] in row-major patch order, each patch laid out [temporal, channel, patch_h, patch_w].
+// Pixels past the last whole patch are dropped.
+//
+// Each row of patches is first deinterleaved into per-channel planes (NEON ld3 for RGB on arm64), then copied out
+// a patch row of pixels at a time. Rows of patches are spread over thread_pool if it's not null.
+void ExtractImagePatches(std::span<const float> image, const ImagePatchesShape& shape, std::span<float> patches,
+                         ThreadPool* thread_pool = nullptr);
+
+}  // namespace Generators
@@ -6,10 +6,75 @@
 #include "kv_cache.h"
 #include "windowed_kv_cache.h"
 #include "../openvino/interface.h"
+#include "kv_quantization.h"
+#include "rotary_shift.h"
+#include "utils.h"
 #include <algorithm>
+#include <cstring>
 
 namespace Generators {
 
+namespace {
+
+// Initial capacity of growable CPU shared KV buffers, in positions
+constexpr int64_t kInitialSharedBufferCapacity = 256;
+
+// Converts count values of a float or fp16 CPU tensor to float
+void ReadFloats(const OrtValue& tensor, size_t offset, size_t count, float* values) {
+  if (tensor.GetTensorTypeAndShapeInfo()->GetElementType() == Ort::TypeToTensorType<float>) {
+    const float* source = tensor.GetTensorData<float>() + offset;
+    std::copy(source, source + count, values);
+  } else {
+    const Ort::Float16_t* source = tensor.GetTensorData<Ort::Float16_t>() + offset;
+    std::transform(source, source + count, values, [](Ort::Float16_t v) { return Float16ToFloat32(v.value); });
+  }
+}
+
+void WriteFloats(const float* values, size_t count, OrtValue& tensor, size_t offset) {
+  if (tensor.GetTensorTypeAndShapeInfo()->GetElementType() == Ort::TypeToTensorType<float>) {
+    std::copy(values, values + count, tensor.GetTensorMutableData<float>() + offset);
+  } else {
+    std::transform(values, values + count, tensor.GetTensorMutableData<Ort::Float16_t>() + offset,
+                   [](float v) { return Ort::Float16_t{FastFloat32ToFloat16(v)}; });
+  }
+}
+
+// Copies the first length positions of each of rows rows from source to target, leaving out [start, start + count)
+void CopyWithoutPositions(const OrtValue& source, OrtValue& target, size_t rows, size_t start, size_t count, size_t length,
+                          size_t position_bytes) {
+  // Positions are the second to last dimension of both layouts
+  const auto source_shape = source.GetTensorTypeAndShapeInfo()->GetShape();
+  const auto target_shape = target.GetTensorTypeAndShapeInfo()->GetShape();
+  const size_t source_capacity = static_cast<size_t>(source_shape[source_shape.size() - 2]);
+  const size_t target_capacity = static_cast<size_t>(target_shape[target_shape.size() - 2]);
+  const auto* source_data = static_cast<const uint8_t*>(source.GetTensorRawData());
+  auto* target_data = static_cast<uint8_t*>(target.GetTensorMutableRawData());
+  for (size_t row = 0; row < rows; row++) {
+    const uint8_t* source_row = source_data + row * source_capacity * position_bytes;
+    uint8_t* target_row = target_data + row * target_capacity * position_bytes;
+    std::memcpy(target_row, source_row, start * position_bytes);
+    std::memcpy(target_row + start * position_bytes, source_row + (start + count) * position_bytes,
+                (length - start - count) * position_bytes);
+  }
+}
+
+// Rotates the keys of positions consecutive positions, starting offset values into a float or fp16 CPU tensor, back by
+// shift positions
+void ShiftKeys(OrtValue& keys, size_t offset, size_t positions, size_t head_size,
+               const Config::Model::Decoder::RotaryEmbedding& rotary_embedding, int64_t shift, std::vector<float>& buffer) {
+  buffer.resize(positions * head_size);
+  ReadFloats(keys, offset, buffer.size(), buffer.data());
+  ShiftRotaryPositions(buffer, head_size, static_cast<size_t>(rotary_embedding.dim), rotary_embedding.theta,
+                       rotary_embedding.interleaved, shift, rotary_embedding.factors);
+  WriteFloats(buffer.data(), buffer.size(), keys, offset);
+}
+
+bool IsFloatType(ONNXTensorElementDataType type) {
+  return type == Ort::TypeToTensorType<float> || type == Ort::TypeToTensorType<Ort::Float16_t>;
+}
+
+}  // namespace
+
 CombinedKeyValueCache::CombinedKeyValueCache(State& state)
     : state_{state},
       layer_count_{model_.config_->model.decoder.num_hidden_layers},
@@ -79,28 +144,26 @@ void CombinedKeyValueCache::RewindTo(size_t index) {
       pasts_[i] = nullptr;
       state_.inputs_[input_index_ + i] = empty_past_.get();
     }
-  } else if (type_ == Ort::TypeToTensorType<float>) {
-    RewindPastTensorsTo<float>(index);
   } else {
-    RewindPastTensorsTo<Ort::Float16_t>(index);
+    RewindPastTensorsTo(index);
   }
 }
 
-template <typename T>
 void CombinedKeyValueCache::RewindPastTensorsTo(size_t index) {
   assert(index > 0 && shape_[3] >= static_cast<int64_t>(index));
+  const size_t element_size = Ort::SizeOf(type_);
   std::array<int64_t, 5> new_shape = shape_;
   new_shape[3] = static_cast<int>(index);
   auto batch_x_num_heads = new_shape[1] * new_shape[2];
-  auto new_length_x_head_size = new_shape[3] * new_shape[4];
-  auto old_length_x_head_size = shape_[3] * new_shape[4];
+  auto new_length_x_head_size = new_shape[3] * new_shape[4] * element_size;
+  auto old_length_x_head_size = shape_[3] * new_shape[4] * element_size;
   shape_[3] = new_shape[3];
 
   for (int i = 0; i < layer_count_; i++) {
     OrtValue& present = *presents_[i];
     std::unique_ptr<OrtValue> past = OrtValue::CreateTensor(Allocator(), shape_, type_);
-    auto present_span = WrapTensor<T>(Device(), present);
-    auto past_span = WrapTensor<T>(Device(), *past);
+    auto present_span = ByteWrapTensor(Device(), present);
+    auto past_span = ByteWrapTensor(Device(), *past);
 
     for (int j = 0; j < 2 * batch_x_num_heads; j++) {
       auto present_data = present_span.subspan(j * old_length_x_head_size, new_length_x_head_size);
@@ -113,17 +176,16 @@ void CombinedKeyValueCache::RewindPastTensorsTo(size_t index) {
 }
 
 // Copy present state to past state reordered by the beam_indices
-template <typename ScoreType>
 void CombinedKeyValueCache::PickPastState(DeviceSpan<int32_t> beam_indices_device, int index) {
   std::span<const int32_t> beam_indices = beam_indices_device.CopyDeviceToCpu();
-  auto block_size_per_beam = shape_[2] * shape_[3] * shape_[4];
+  auto block_size_per_beam = shape_[2] * shape_[3] * shape_[4] * Ort::SizeOf(type_);
   auto past_key_size = shape_[1] * block_size_per_beam;
 
   OrtValue& present = *presents_[index];
-  std::unique_ptr<OrtValue> past = OrtValue::CreateTensor<ScoreType>(Allocator(), shape_);
+  std::unique_ptr<OrtValue> past = OrtValue::CreateTensor(Allocator(), shape_, type_);
 
-  auto past_span = WrapTensor<ScoreType>(Device(), *past);
-  auto present_span = WrapTensor<ScoreType>(Device(), present);
+  auto past_span = ByteWrapTensor(Device(), *past);
+  auto present_span = ByteWrapTensor(Device(), present);
 
   for (size_t j = 0; j < beam_indices.size(); j++) {
     int32_t beam_index = beam_indices[j];
@@ -139,18 +201,49 @@ void CombinedKeyValueCache::PickPastState(DeviceSpan<int32_t> beam_indices_devic
   pasts_[index] = std::move(past);
 }
 
-void CombinedKeyValueCache::PickPastState(DeviceSpan<int32_t> beam_indices, int index) {
-  if (type_ == Ort::TypeToTensorType<float>) {
-    PickPastState<float>(beam_indices, index);
-  } else {
-    PickPastState<Ort::Float16_t>(beam_indices, index);
+bool CombinedKeyValueCache::Evict(size_t start, size_t count, size_t length) {
+  const auto& rotary_embedding = model_.config_->model.decoder.rotary_embedding;
+  if (count == 0 || start + count > length || Device().GetType() != DeviceType::CPU ||
+      (rotary_embedding && !IsFloatType(type_)))
+    return false;
+
+  // After a run the presents hold every processed position, after a rewind the pasts do
+  auto& sources = is_first_update_ ? pasts_ : presents_;
+  for (const auto& source : sources) {
+    if (!source || source->GetTensorTypeAndShapeInfo()->GetShape()[3] != static_cast<int64_t>(length))
+      return false;
   }
+
+  const size_t head_size = static_cast<size_t>(shape_[4]);
+  const size_t rows = static_cast<size_t>(shape_[1] * shape_[2]);  // Per key or value half
+  const size_t new_length = length - count;
+  std::array<int64_t, 5> new_shape = shape_;
+  new_shape[3] = static_cast<int64_t>(new_length);
+  std::vector<float> buffer;
+
+  for (int i = 0; i < layer_count_; i++) {
+    auto past = OrtValue::CreateTensor(Allocator(), new_shape, type_);
+    CopyWithoutPositions(*sources[i], *past, 2 * rows, start, count, length, head_size * Ort::SizeOf(type_));
+    if (rotary_embedding) {
+      for (size_t row = 0; row < rows; row++)  // The keys are the first half
+        ShiftKeys(*past, (row * new_length + start) * head_size, new_length - start, head_size, *rotary_embedding,
+                  static_cast<int64_t>(count), buffer);
+    }
+    pasts_[i] = std::move(past);
+    state_.inputs_[input_index_ + i] = pasts_[i].get();
+  }
+
+  // Same state as RewindTo(new_length)
+  shape_[3] = static_cast<int64_t>(new_length);
+  is_first_update_ = true;
+  return true;
 }
 
 DefaultKeyValueCache::DefaultKeyValueCache(State& state)
     : state_{state},
       layer_count_{model_.config_->model.decoder.num_hidden_layers},
       past_present_share_buffer_{state_.params_->IsPastPresentShareBufferEnabled(model_.config_->model.type)},
+      prefix_quantization_{ParseKvQuantization(model_.config_->model.decoder.prefix_cache_quantization)},
       shape_{state_.params_->BatchBeamSize(), model_.config_->model.decoder.num_key_value_heads, 0, model_.config_->model.decoder.head_size} {
   if (g_log.enabled && g_log.warning && past_present_share_buffer_ != state_.params_->search.past_present_share_buffer)
     Log("warning", "past_present_share_buffer search option set to true, but has been disabled due to the current configuration. See https://aka.ms/generate_config for details");
@@ -204,6 +297,13 @@ DefaultKeyValueCache::DefaultKeyValueCache(State& state)
     }
   } else if (past_present_share_buffer_) {
     shape_[2] = state_.params_->search.max_length;
+
+    // On CPU there is no graph capture that needs a fixed buffer, so start small and grow in Update().
+    // Long-context models would otherwise commit max_length (e.g. 128K) positions per layer up front.
+    if (Device().GetType() == DeviceType::CPU && model_.config_->model.type != "whisper") {
+      grow_shared_buffers_ = true;
+      shape_[2] = std::min(shape_[2], kInitialSharedBufferCapacity);
+    }
   }
 
   try {
@@ -254,9 +354,15 @@ void DefaultKeyValueCache::Add() {
 }
 
 void DefaultKeyValueCache::Update(DeviceSpan<int32_t> beam_indices, int total_length) {
-  // If we're sharing past & present buffers there is nothing to do here, so early exit
-  if (past_present_share_buffer_)
+  // If we're sharing past & present buffers the new K/V is written in place, so at most grow the buffers
+  if (past_present_share_buffer_) {
+    if (grow_shared_buffers_) {
+      if (total_length > shape_[2])
+        GrowSharedBuffers(total_length);
+      shared_length_ = total_length;
+    }
     return;
+  }
 
   if (!is_first_update_) {
     for (int i = 0; i < layer_count_ * 2; i++) {
@@ -296,8 +402,52 @@ void DefaultKeyValueCache::Update(DeviceSpan<int32_t> beam_indices, int total_le
   is_first_update_ = false;
 }
 
+void DefaultKeyValueCache::GrowSharedBuffers(int total_length) {
+  assert(grow_shared_buffers_ && Device().GetType() == DeviceType::CPU);
+  const int64_t max_length = state_.params_->search.max_length;
+  if (total_length > max_length) {
+    throw std::runtime_error("Requested key-value cache length " + std::to_string(total_length) +
+                             " exceeds max_length " + std::to_string(max_length) + ".");
+  }
+
+  std::array<int64_t, 4> new_shape = shape_;
+  new_shape[2] = std::min(max_length, std::max<int64_t>(shape_[2] * 2, total_length));
+
+  // Each [batch, head] row keeps its first shared_length_ positions, the rest of the row is zeroed
+  const size_t element_size = Ort::SizeOf(type_);
+  const size_t row_count = static_cast<size_t>(shape_[0] * shape_[1]);
+  const size_t old_row_bytes = static_cast<size_t>(shape_[2] * shape_[3]) * element_size;
+  const size_t new_row_bytes = static_cast<size_t>(new_shape[2] * new_shape[3]) * element_size;
+  const size_t kept_bytes = static_cast<size_t>(shared_length_ * shape_[3]) * element_size;
+
+  try {
+    for (int i = 0; i < layer_count_ * 2; ++i) {
+      auto grown = OrtValue::CreateTensor(Allocator(), new_shape, type_);
+      auto* source = static_cast<const uint8_t*>(presents_[i]->GetTensorRawData());
+      auto* target = static_cast<uint8_t*>(grown->GetTensorMutableRawData());
+      for (size_t row = 0; row < row_count; ++row) {
+        std::memcpy(target + row * new_row_bytes, source + row * old_row_bytes, kept_bytes);
+        std::memset(target + row * new_row_bytes + kept_bytes, 0, new_row_bytes - kept_bytes);
+      }
+
+      presents_[i] = std::move(grown);
+      state_.inputs_[input_index_ + i] = presents_[i].get();
+      state_.outputs_[output_index_ + i] = presents_[i].get();
+    }
+  } catch (const Ort::Exception&) {
+    std::ostringstream oss;
+    oss << "Could not grow the key-value cache buffer to max_length (" << new_shape[2] << ") for "
+        << layer_count_ << " layers. Try reducing the max_length requested or reducing the batch size.";
+    throw std::runtime_error(oss.str());
+  }
+
+  shape_[2] = new_shape[2];
+}
+
 void DefaultKeyValueCache::RewindTo(size_t index) {
   if (past_present_share_buffer_) {
+    // The buffers stay in place; only the logical length shrinks and later tokens overwrite the tail
+    shared_length_ = std::min(shared_length_, static_cast<int>(index));
     return;
   } else if (shape_[2] <= static_cast<int>(index)) {
     throw std::runtime_error("Requested length of rewind is greater than the current length.");
@@ -309,16 +459,14 @@ void DefaultKeyValueCache::RewindTo(size_t index) {
       pasts_[i] = nullptr;
       state_.inputs_[input_index_ + i] = empty_past_.get();
     }
-  } else if (type_ == Ort::TypeToTensorType<float>) {
-    RewindPastTensorsTo<float>(index);
   } else {
-    RewindPastTensorsTo<Ort::Float16_t>(index);
+    RewindPastTensorsTo(index);
   }
 }
 
-template <typename T>
 void DefaultKeyValueCache::RewindPastTensorsTo(size_t index) {
   assert(index > 0 && !past_present_share_buffer_);
+  const size_t element_size = Ort::SizeOf(type_);
 
   if (!layer_shapes_.empty()) {
     // Handle per-layer shapes
@@ -341,15 +489,15 @@ void DefaultKeyValueCache::RewindPastTensorsTo(size_t index) {
       std::array<int64_t, 4> new_shape = layer_shape;
       new_shape[2] = actual_rewind_length;
       const auto batch_x_num_heads = new_shape[0] * new_shape[1];
-      const auto new_length_x_head_size = new_shape[2] * new_shape[3];
+      const auto new_length_x_head_size = new_shape[2] * new_shape[3] * element_size;
 
       OrtValue& present = *presents_[i];
       const auto present_shape = present.GetTensorTypeAndShapeInfo()->GetShape();
-      const auto old_length_x_head_size = present_shape[2] * new_shape[3];
+      const auto old_length_x_head_size = present_shape[2] * new_shape[3] * element_size;
 
       std::unique_ptr<OrtValue> past = OrtValue::CreateTensor(Allocator(), new_shape, type_);
-      auto past_span = WrapTensor<T>(Device(), *past);
-      auto present_span = WrapTensor<T>(Device(), present);
+      auto past_span = ByteWrapTensor(Device(), *past);
+      auto present_span = ByteWrapTensor(Device(), present);
 
       for (int j = 0; j < batch_x_num_heads; j++) {
         auto present_data = present_span.subspan(j * old_length_x_head_size, new_length_x_head_size);
@@ -365,16 +513,16 @@ void DefaultKeyValueCache::RewindPastTensorsTo(size_t index) {
     std::array<int64_t, 4> new_shape = shape_;
     new_shape[2] = static_cast<int>(index);
     auto batch_x_num_heads = new_shape[0] * new_shape[1];
-    auto new_length_x_head_size = new_shape[2] * new_shape[3];
-    auto old_length_x_head_size = shape_[2] * new_shape[3];
+    auto new_length_x_head_size = new_shape[2] * new_shape[3] * element_size;
+    auto old_length_x_head_size = shape_[2] * new_shape[3] * element_size;
     shape_[2] = new_shape[2];
 
     for (int i = 0; i < layer_count_ * 2; i++) {
       OrtValue& present = *presents_[i];
       std::unique_ptr<OrtValue> past = OrtValue::CreateTensor(Allocator(), shape_, type_);
 
-      auto past_span = WrapTensor<T>(Device(), *past);
-      auto present_span = WrapTensor<T>(Device(), present);
+      auto past_span = ByteWrapTensor(Device(), *past);
+      auto present_span = ByteWrapTensor(Device(), present);
 
       for (int j = 0; j < batch_x_num_heads; j++) {
         auto present_data = present_span.subspan(j * old_length_x_head_size, new_length_x_head_size);
@@ -387,8 +535,223 @@ void DefaultKeyValueCache::RewindPastTensorsTo(size_t index) {
   }
 }
 
+bool DefaultKeyValueCache::HoldsPrefix(size_t length) const {
+  if (length == 0 || shape_[0] != 1 || !layer_shapes_.empty())
+    return false;
+
+  // presents_ hold every processed position, either as the shared buffers or as the outputs of the last run
+  for (const auto& present : presents_) {
+    if (!present || present->GetTensorTypeAndShapeInfo()->GetShape()[2] < static_cast<int64_t>(length))
+      return false;
+  }
+  return true;
+}
+
+bool DefaultKeyValueCache::QuantizesPrefix() {
+  const bool float_type = type_ == Ort::TypeToTensorType<float> || type_ == Ort::TypeToTensorType<Ort::Float16_t>;
+  return prefix_quantization_ != KvQuantization::None && float_type && Device().GetType() == DeviceType::CPU;
+}
+
+std::unique_ptr<KeyValuePrefix> DefaultKeyValueCache::DetachPrefix(size_t length) {
+  if (!HoldsPrefix(length))
+    return nullptr;
+  if (QuantizesPrefix())
+    return QuantizePrefix(length);
+
+  auto prefix = std::make_unique<KeyValuePrefix>();
+  prefix->length = length;
+  for (auto& present : presents_) {
+    prefix->bytes += present->GetTensorTypeAndShapeInfo()->GetElementCount() * Ort::SizeOf(type_);
+    prefix->tensors.push_back(std::move(present));
+  }
+  return prefix;
+}
+
+std::unique_ptr<KeyValuePrefix> DefaultKeyValueCache::CopyPrefix(size_t length) {
+  if (!HoldsPrefix(length))
+    return nullptr;
+  if (QuantizesPrefix())
+    return QuantizePrefix(length);
+
+  const size_t element_size = Ort::SizeOf(type_);
+  const size_t row_bytes = length * shape_[3] * element_size;
+  const std::array<int64_t, 4> prefix_shape{1, shape_[1], static_cast<int64_t>(length), shape_[3]};
+
+  auto prefix = std::make_unique<KeyValuePrefix>();
+  prefix->length = length;
+  for (auto& present : presents_) {
+    const size_t source_row_stride = present->GetTensorTypeAndShapeInfo()->GetShape()[2] * shape_[3] * element_size;
+    auto tensor = OrtValue::CreateTensor(Allocator(), prefix_shape, type_);
+    auto source_bytes = ByteWrapTensor(Device(), *present);
+    auto target_bytes = ByteWrapTensor(Device(), *tensor);
+    for (int64_t head = 0; head < shape_[1]; head++)
+      target_bytes.subspan(head * row_bytes, row_bytes).CopyFrom(source_bytes.subspan(head * source_row_stride, row_bytes));
+    prefix->bytes += shape_[1] * row_bytes;
+    prefix->tensors.push_back(std::move(tensor));
+  }
+  return prefix;
+}
+
+std::unique_ptr<KeyValuePrefix> DefaultKeyValueCache::QuantizePrefix(size_t length) {
+  const int64_t head_count = shape_[1];
+  const size_t head_size = static_cast<size_t>(shape_[3]);
+  const size_t head_values = length * head_size;  // A head's positions are contiguous
+  const std::array<int64_t, 4> codes_shape{1, head_count, static_cast<int64_t>(length), shape_[3]};
+  const std::array<int64_t, 3> scales_shape{1, head_count, static_cast<int64_t>(length)};
+
+  auto prefix = std::make_unique<KeyValuePrefix>();
+  prefix->length = length;
+  prefix->quantization = prefix_quantization_;
+  std::vector<float> values(head_values);
+  for (const auto& present : presents_) {
+    const size_t capacity = static_cast<size_t>(present->GetTensorTypeAndShapeInfo()->GetShape()[2]);
+    auto codes = OrtValue::CreateTensor<uint8_t>(Allocator(), codes_shape);
+    auto scales = OrtValue::CreateTensor<float>(Allocator(), scales_shape);
+    for (int64_t head = 0; head < head_count; head++) {
+      ReadFloats(*present, head * capacity * head_size, head_values, values.data());
+      QuantizeRows(prefix_quantization_, values, head_size,
+                   std::span<uint8_t>{codes->GetTensorMutableData<uint8_t>() + head * head_values, head_values},
+                   std::span<float>{scales->GetTensorMutableData<float>() + head * length, length});
+    }
+    prefix->bytes += head_count * (head_values + length * sizeof(float));
+    prefix->tensors.push_back(std::move(codes));
+    prefix->scales.push_back(std::move(scales));
+  }
+  return prefix;
+}
+
+bool DefaultKeyValueCache::RestorePrefix(const KeyValuePrefix& prefix, size_t length) {
+  if (length == 0 || length > prefix.length || shape_[0] != 1 || !layer_shapes_.empty() ||
+      prefix.tensors.size() != presents_.size())
+    return false;
+
+  // Quantized entries decode on the CPU into the cache's type
+  const bool quantized = prefix.quantization != KvQuantization::None;
+  if (quantized && (Device().GetType() != DeviceType::CPU || prefix.scales.size() != presents_.size() ||
+                    (type_ != Ort::TypeToTensorType<float> && type_ != Ort::TypeToTensorType<Ort::Float16_t>)))
+    return false;
+
+  auto prefix_info = prefix.tensors[0]->GetTensorTypeAndShapeInfo();
+  const auto prefix_shape = prefix_info->GetShape();
+  const auto prefix_type = quantized ? Ort::TypeToTensorType<uint8_t> : type_;
+  if (prefix_info->GetElementType() != prefix_type || prefix_shape[0] != 1 || prefix_shape[1] != shape_[1] || prefix_shape[3] != shape_[3])
+    return false;
+
+  if (past_present_share_buffer_ && static_cast<int64_t>(length) > shape_[2]) {
+    if (!grow_shared_buffers_)
+      return false;
+    GrowSharedBuffers(static_cast<int>(length));
+  }
+
+  // Copy the first length positions of every head, the rows of the prefix and of the cache can differ in capacity
+  const size_t element_size = Ort::SizeOf(type_);
+  const size_t row_bytes = length * shape_[3] * element_size;
+  const size_t source_row_stride = prefix_shape[2] * shape_[3] * element_size;
+  const std::array<int64_t, 4> past_shape{1, shape_[1], static_cast<int64_t>(length), shape_[3]};
+
+  for (int i = 0; i < layer_count_ * 2; i++) {
+    OrtValue* target = presents_[i].get();
+    if (!past_present_share_buffer_) {
+      pasts_[i] = OrtValue::CreateTensor(Allocator(), past_shape, type_);
+      target = pasts_[i].get();
+      state_.inputs_[input_index_ + i] = target;
+    }
+
+    if (quantized) {
+      const size_t head_size = static_cast<size_t>(shape_[3]);
+      const size_t head_values = length * head_size;
+      const size_t source_capacity = static_cast<size_t>(prefix_shape[2]);
+      const size_t target_capacity = static_cast<size_t>(target->GetTensorTypeAndShapeInfo()->GetShape()[2]);
+      std::vector<float> values(head_values);
+      for (int64_t head = 0; head < shape_[1]; head++) {
+        DequantizeRows(prefix.quantization,
+                       std::span<const uint8_t>{prefix.tensors[i]->GetTensorData<uint8_t>() + head * source_capacity * head_size, head_values},
+                       std::span<const float>{prefix.scales[i]->GetTensorData<float>() + head * source_capacity, length},
+                       head_size, values);
+        WriteFloats(values.data(), head_values, *target, head * target_capacity * head_size);
+      }
+      continue;
+    }
+
+    const size_t target_row_stride = target->GetTensorTypeAndShapeInfo()->GetShape()[2] * shape_[3] * element_size;
+    auto source_bytes = ByteWrapTensor(Device(), *prefix.tensors[i]);
+    auto target_bytes = ByteWrapTensor(Device(), *target);
+    for (int64_t head = 0; head < shape_[1]; head++) {
+      target_bytes.subspan(head * target_row_stride, row_bytes).CopyFrom(source_bytes.subspan(head * source_row_stride, row_bytes));
+    }
+  }
+
+  // Same state as RewindTo(length): the next Update() keeps the pasts and sizes presents for the new total length
+  if (past_present_share_buffer_) {
+    shared_length_ = static_cast<int>(length);
+  } else {
+    shape_[2] = static_cast<int64_t>(length);
+    is_first_update_ = true;
+  }
+  return true;
+}
+
+bool DefaultKeyValueCache::Evict(size_t start, size_t count, size_t length) {
+  const auto& rotary_embedding = model_.config_->model.decoder.rotary_embedding;
+  if (count == 0 || start + count > length || Device().GetType() != DeviceType::CPU || !layer_shapes_.empty() ||
+      (rotary_embedding && !IsFloatType(type_)))
+    return false;
+
+  const size_t head_size = static_cast<size_t>(shape_[3]);
+  const size_t position_bytes = head_size * Ort::SizeOf(type_);
+  const size_t rows = static_cast<size_t>(shape_[0] * shape_[1]);
+  const size_t new_length = length - count;
+  std::vector<float> buffer;
+
+  if (past_present_share_buffer_) {
+    if (!grow_shared_buffers_ || shared_length_ != static_cast<int>(length))
+      return false;
+
+    // In place: the later positions of every row move down over the evicted ones
+    const size_t capacity = static_cast<size_t>(shape_[2]);
+    for (int i = 0; i < layer_count_ * 2; i++) {
+      auto* data = static_cast<uint8_t*>(presents_[i]->GetTensorMutableRawData());
+      for (size_t row = 0; row < rows; row++) {
+        uint8_t* row_data = data + row * capacity * position_bytes;
+        std::memmove(row_data + start * position_bytes, row_data + (start + count) * position_bytes,
+                     (length - start - count) * position_bytes);
+        if (rotary_embedding && i % 2 == 0)
+          ShiftKeys(*presents_[i], (row * capacity + start) * head_size, new_length - start, head_size, *rotary_embedding,
+                    static_cast<int64_t>(count), buffer);
+      }
+    }
+    shared_length_ = static_cast<int>(new_length);
+    return true;
+  }
+
+  // After a run the presents hold every processed position, after a rewind (or a restored prefix) the pasts do
+  auto& sources = is_first_update_ ? pasts_ : presents_;
+  for (const auto& source : sources) {
+    if (!source || source->GetTensorTypeAndShapeInfo()->GetShape()[2] != static_cast<int64_t>(length))
+      return false;
+  }
+
+  std::array<int64_t, 4> new_shape = shape_;
+  new_shape[2] = static_cast<int64_t>(new_length);
+  for (int i = 0; i < layer_count_ * 2; i++) {
+    auto past = OrtValue::CreateTensor(Allocator(), new_shape, type_);
+    CopyWithoutPositions(*sources[i], *past, rows, start, count, length, position_bytes);
+    if (rotary_embedding && i % 2 == 0) {
+      for (size_t row = 0; row < rows; row++)
+        ShiftKeys(*past, (row * new_length + start) * head_size, new_length - start, head_size, *rotary_embedding,
+                  static_cast<int64_t>(count), buffer);
+    }
+    pasts_[i] = std::move(past);
+    state_.inputs_[input_index_ + i] = pasts_[i].get();
+  }
+
+  // Same state as RewindTo(new_length)
+  shape_[2] = static_cast<int64_t>(new_length);
+  is_first_update_ = true;
+  return true;
+}
+
 // Copy present state to past state reordered by the beam_indices
-template <typename ScoreType>
 void DefaultKeyValueCache::PickPastState(DeviceSpan<int32_t> beam_indices_device, int index) {
   std::span<int32_t> beam_indices = beam_indices_device.CopyDeviceToCpu();
 
@@ -402,13 +765,13 @@ void DefaultKeyValueCache::PickPastState(DeviceSpan<int32_t> beam_indices_device
     tensor_shape = shape_;
   }
 
-  auto block_size_per_beam = tensor_shape[1] * tensor_shape[2] * tensor_shape[3];
+  auto block_size_per_beam = tensor_shape[1] * tensor_shape[2] * tensor_shape[3] * Ort::SizeOf(type_);
 
   OrtValue& present_value = *presents_[index];
-  std::unique_ptr<OrtValue> past_value = OrtValue::CreateTensor<ScoreType>(Allocator(), tensor_shape);
+  std::unique_ptr<OrtValue> past_value = OrtValue::CreateTensor(Allocator(), tensor_shape, type_);
 
-  auto past_span = WrapTensor<ScoreType>(Device(), *past_value);
-  auto present_span = WrapTensor<ScoreType>(Device(), present_value);
+  auto past_span = ByteWrapTensor(Device(), *past_value);
+  auto present_span = ByteWrapTensor(Device(), present_value);
 
   for (size_t j = 0; j < beam_indices.size(); j++) {
     int32_t beam_index = beam_indices[j];
@@ -420,14 +783,6 @@ void DefaultKeyValueCache::PickPastState(DeviceSpan<int32_t> beam_indices_device
   pasts_[index] = std::move(past_value);
 }
 
-void DefaultKeyValueCache::PickPastState(DeviceSpan<int32_t> beam_indices, int index) {
-  if (type_ == Ort::TypeToTensorType<float>) {
-    PickPastState<float>(beam_indices, index);
-  } else {
-    PickPastState<Ort::Float16_t>(beam_indices, index);
-  }
-}
-
 CrossCache::CrossCache(State& state, int sequence_length) {
   const Model& model = state.model_;
   auto& allocator = state.model_.p_device_kvcache_->GetAllocator();
@@ -16,6 +16,22 @@ struct KeyValueCache {
 
   virtual void RewindTo(size_t index) = 0;
 
+  // Moves the key/values of the first `length` positions out of the cache, which can't be used afterwards.
+  // Returns nullptr if the cache layout can't be handed over.
+  virtual std::unique_ptr<KeyValuePrefix> DetachPrefix(size_t length) { return nullptr; }
+
+  // Same as DetachPrefix, but copies the key/values into tensors with capacity == length and leaves the cache as is
+  virtual std::unique_ptr<KeyValuePrefix> CopyPrefix(size_t length) { return nullptr; }
+
+  // Copies the first `length` positions of prefix into an unused cache, leaving it as if they had been processed.
+  // Returns false, without changing the cache, if prefix doesn't fit the cache layout.
+  virtual bool RestorePrefix(const KeyValuePrefix& prefix, size_t length) { return false; }
+
+  // Attention sinks (search.attention_sink_size): drops positions [start, start + count) of the first `length` ones,
+  // which are all processed, and moves the later positions down. With decoder.rotary_embedding the moved keys are
+  // rotated to their new positions. Returns false, without changing the cache, if its layout doesn't allow it.
+  virtual bool Evict(size_t start, size_t count, size_t length) { return false; }
+
   // Note: PartialUpdate() is mainly for supporting DecoderOnlyPipelineState usage where we update
   // part of the KV cache after running part of the pipeline.
   // An alternative may be to have a dedicated KV cache per IntermediatePipelineState.
@@ -34,13 +50,11 @@ struct CombinedKeyValueCache : KeyValueCache {
   void Add() override;  // Add to state inputs/outputs
   void Update(DeviceSpan<int32_t> beam_indices, int total_length) override;
   void RewindTo(size_t index) override;
+  bool Evict(size_t start, size_t count, size_t length) override;
 
  private:
-  template <typename ScoreType>
-  void PickPastState(DeviceSpan<int32_t> beam_indices, int index);
+  // Byte copies, so any key/value element type works (including 8-bit types of models that quantize their cache)
   void PickPastState(DeviceSpan<int32_t> beam_indices, int index);
-
-  template <typename T>
   void RewindPastTensorsTo(size_t index);
 
   DeviceInterface& Device() { return *model_.p_device_kvcache_; }
@@ -75,14 +89,25 @@ struct DefaultKeyValueCache : KeyValueCache {
   void Update(DeviceSpan<int32_t> beam_indices, int total_length) override;
   void RewindTo(size_t index) override;
 
+  std::unique_ptr<KeyValuePrefix> DetachPrefix(size_t length) override;
+  std::unique_ptr<KeyValuePrefix> CopyPrefix(size_t length) override;
+  bool RestorePrefix(const KeyValuePrefix& prefix, size_t length) override;
+  bool Evict(size_t start, size_t count, size_t length) override;
+
  private:
-  template <typename ScoreType>
-  void PickPastState(DeviceSpan<int32_t> beam_indices, int index);
+  // Byte copies, so any key/value element type works (including 8-bit types of models that quantize their cache)
   void PickPastState(DeviceSpan<int32_t> beam_indices, int index);
-
-  template <typename T>
   void RewindPastTensorsTo(size_t index);
 
+  // Reallocate the shared past/present buffers so they can hold total_length positions
+  void GrowSharedBuffers(int total_length);
+
+  // Whether presents_ hold the first length positions in a layout a KeyValuePrefix can take
+  bool HoldsPrefix(size_t length) const;
+  // Whether prefixes are stored with decoder.prefix_cache_quantization, as QuantizePrefix makes them
+  bool QuantizesPrefix();
+  std::unique_ptr<KeyValuePrefix> QuantizePrefix(size_t length);
+
   DeviceInterface& Device() { return *model_.p_device_kvcache_; }
   Ort::Allocator& Allocator() { return model_.p_device_kvcache_->GetAllocator(); }
 
@@ -90,7 +115,13 @@ struct DefaultKeyValueCache : KeyValueCache {
   const Model& model_{state_.model_};
   int layer_count_;
   size_t input_index_{~0U}, output_index_{~0U};
-  bool past_present_share_buffer_;  // True if model.decoder.past_present_share_buffer is set to true, and we're using cuda, and not beam search
+  bool past_present_share_buffer_;  // True if model.decoder.past_present_share_buffer is set to true and not beam search
+  KvQuantization prefix_quantization_;  // decoder.prefix_cache_quantization, used by DetachPrefix and CopyPrefix on CPU
+
+  // On CPU the shared buffers start small and double on demand up to max_length, instead of
+  // reserving max_length up front. shape_[2] is then the current capacity.
+  bool grow_shared_buffers_{};
+  int shared_length_{};  // Positions currently held in the shared buffers
 
   bool is_first_update_{true};
 
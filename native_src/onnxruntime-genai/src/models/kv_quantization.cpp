@@ -0,0 +1,138 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "kv_quantization.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace Generators {
+
+namespace {
+
+constexpr float kInt8Max = 127.0f;
+constexpr float kFp8Max = 448.0f;  // Largest finite E4M3FN value
+
+void CheckSizes(size_t value_count, size_t code_count, size_t scale_count, size_t row_size) {
+  if (row_size == 0 || value_count != scale_count * row_size || code_count != value_count)
+    throw std::runtime_error("Key-value quantization got " + std::to_string(value_count) + " values, " +
+                             std::to_string(code_count) + " codes and " + std::to_string(scale_count) +
+                             " scales for rows of " + std::to_string(row_size));
+}
+
+const std::array<float, 256>& Fp8Values() {
+  static const std::array<float, 256> values = [] {
+    std::array<float, 256> result{};
+    for (size_t code = 0; code < result.size(); code++)
+      result[code] = Float8E4M3ToFloat32(static_cast<uint8_t>(code));
+    return result;
+  }();
+  return values;
+}
+
+}  // namespace
+
+KvQuantization ParseKvQuantization(std::string_view name) {
+  if (name.empty() || name == "none")
+    return KvQuantization::None;
+  if (name == "int8")
+    return KvQuantization::Int8;
+  if (name == "fp8")
+    return KvQuantization::Fp8;
+  throw std::runtime_error("Unknown prefix_cache_quantization '" + std::string(name) + "', expected int8 or fp8");
+}
+
+uint8_t Float32ToFloat8E4M3(float value) {
+  const uint8_t sign = std::signbit(value) ? 0x80 : 0;
+  if (std::isnan(value))
+    return sign | 0x7F;
+  const float magnitude = std::fabs(value);
+  if (magnitude >= kFp8Max)
+    return sign | 0x7E;
+
+  int exponent = 0;
+  std::frexp(magnitude, &exponent);
+  exponent -= 1;  // magnitude = 1.xxx * 2^exponent
+  if (magnitude == 0.0f || exponent < -6) {
+    // Subnormals are multiples of 2^-9; rounding up to 8 gives the smallest normal code
+    return sign | static_cast<uint8_t>(std::nearbyint(std::ldexp(magnitude, 9)));
+  }
+
+  int mantissa = static_cast<int>(std::nearbyint(std::ldexp(magnitude, 3 - exponent))) - 8;
+  if (mantissa == 8) {
+    mantissa = 0;
+    exponent++;
+  }
+  return sign | static_cast<uint8_t>(((exponent + 7) << 3) | mantissa);
+}
+
+float Float8E4M3ToFloat32(uint8_t code) {
+  const int exponent = (code >> 3) & 0xF;
+  const int mantissa = code & 0x7;
+  float magnitude;
+  if ((code & 0x7F) == 0x7F)
+    magnitude = std::numeric_limits<float>::quiet_NaN();
+  else if (exponent == 0)
+    magnitude = std::ldexp(static_cast<float>(mantissa), -9);
+  else
+    magnitude = std::ldexp(static_cast<float>(8 + mantissa), exponent - 10);
+  return (code & 0x80) ? -magnitude : magnitude;
+}
+
+void QuantizeRows(KvQuantization quantization, std::span<const float> values, size_t row_size,
+                  std::span<uint8_t> codes, std::span<float> scales) {
+  CheckSizes(values.size(), codes.size(), scales.size(), row_size);
+  if (quantization == KvQuantization::None)
+    throw std::runtime_error("QuantizeRows called without a quantization type");
+
+  const float code_max = quantization == KvQuantization::Int8 ? kInt8Max : kFp8Max;
+  for (size_t row = 0; row < scales.size(); row++) {
+    const float* row_values = values.data() + row * row_size;
+    uint8_t* row_codes = codes.data() + row * row_size;
+
+    float max_abs = 0.0f;
+    for (size_t i = 0; i < row_size; i++)
+      max_abs = std::max(max_abs, std::fabs(row_values[i]));
+    const float scale = max_abs / code_max;
+    const float inverse_scale = scale > 0.0f ? 1.0f / scale : 0.0f;
+    scales[row] = scale;
+
+    if (quantization == KvQuantization::Int8) {
+      for (size_t i = 0; i < row_size; i++) {
+        const float code = std::clamp(std::nearbyint(row_values[i] * inverse_scale), -kInt8Max, kInt8Max);
+        row_codes[i] = static_cast<uint8_t>(static_cast<int8_t>(code));
+      }
+    } else {
+      for (size_t i = 0; i < row_size; i++)
+        row_codes[i] = Float32ToFloat8E4M3(row_values[i] * inverse_scale);
+    }
+  }
+}
+
+void DequantizeRows(KvQuantization quantization, std::span<const uint8_t> codes, std::span<const float> scales,
+                    size_t row_size, std::span<float> values) {
+  CheckSizes(values.size(), codes.size(), scales.size(), row_size);
+  if (quantization == KvQuantization::None)
+    throw std::runtime_error("DequantizeRows called without a quantization type");
+
+  const auto& fp8_values = Fp8Values();
+  for (size_t row = 0; row < scales.size(); row++) {
+    const uint8_t* row_codes = codes.data() + row * row_size;
+    float* row_values = values.data() + row * row_size;
+    const float scale = scales[row];
+
+    if (quantization == KvQuantization::Int8) {
+      for (size_t i = 0; i < row_size; i++)
+        row_values[i] = static_cast<int8_t>(row_codes[i]) * scale;
+    } else {
+      for (size_t i = 0; i < row_size; i++)
+        row_values[i] = fp8_values[row_codes[i]] * scale;
+    }
+  }
+}
+
+}  // namespace Generators
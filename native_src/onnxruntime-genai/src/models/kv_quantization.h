@@ -0,0 +1,37 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "../span.h"
+
+namespace Generators {
+
+// 8-bit storage for key/values kept outside a running session (decoder.prefix_cache_quantization). Each row of head_size
+// values, one head at one position, is stored as 8-bit codes with its own float scale. That halves fp16 and quarters
+// fp32 key/values; the error per value is at most half a quantization step of its row.
+enum class KvQuantization {
+  None,
+  Int8,  // Symmetric, codes -127..127 times scale
+  Fp8,   // Float8 E4M3FN codes times scale, finer near zero
+};
+
+// "" (or "none"), "int8" or "fp8". Throws on anything else.
+KvQuantization ParseKvQuantization(std::string_view name);
+
+// Quantizes values, a whole number of rows of row_size, into one code per value and one scale per row
+void QuantizeRows(KvQuantization quantization, std::span<const float> values, size_t row_size,
+                  std::span<uint8_t> codes, std::span<float> scales);
+
+// Inverse of QuantizeRows
+void DequantizeRows(KvQuantization quantization, std::span<const uint8_t> codes, std::span<const float> scales,
+                    size_t row_size, std::span<float> values);
+
+uint8_t Float32ToFloat8E4M3(float value);  // Rounds to nearest even, saturates to +-448
+float Float8E4M3ToFloat32(uint8_t code);
+
+}  // namespace Generators
@@ -0,0 +1,80 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "lazy_session.h"
+
+#include <algorithm>
+
+namespace Generators {
+
+LazySession::LazySession(Factory factory, std::unique_ptr<OrtSession> session, std::vector<std::string> input_names,
+                         std::chrono::milliseconds idle_timeout)
+    : factory_{std::move(factory)},
+      input_names_{std::move(input_names)},
+      idle_timeout_{idle_timeout},
+      session_{std::move(session)},
+      loaded_{session_ != nullptr},
+      last_use_{std::chrono::steady_clock::now()} {}
+
+LazySession::Lease::~Lease() {
+  if (owner_)
+    owner_->Return();
+}
+
+LazySession::Lease LazySession::Acquire() {
+  std::scoped_lock lock{mutex_};
+  // Loading under the lock makes a concurrent Acquire wait for this session instead of loading a second one
+  if (!loaded_) {
+    session_ = factory_();
+    loaded_ = true;
+  }
+  leases_++;
+  return Lease{*this, session_.get()};
+}
+
+void LazySession::Return() {
+  std::scoped_lock lock{mutex_};
+  last_use_ = std::chrono::steady_clock::now();
+  if (--leases_ == 0 && idle_timeout_.count() == 0) {
+    session_.reset();
+    loaded_ = false;
+  }
+}
+
+bool LazySession::ReleaseIfIdle(std::chrono::steady_clock::duration idle_for) {
+  std::scoped_lock lock{mutex_};
+  if (!loaded_ || leases_ > 0 || std::chrono::steady_clock::now() - last_use_ < idle_for)
+    return false;
+  session_.reset();
+  loaded_ = false;
+  return true;
+}
+
+bool LazySession::IsLoaded() const {
+  std::scoped_lock lock{mutex_};
+  return loaded_;
+}
+
+IdleSessionReleaser::IdleSessionReleaser(std::vector<LazySession*> sessions, std::chrono::milliseconds idle_timeout)
+    : sessions_{std::move(sessions)}, idle_timeout_{idle_timeout} {
+  // Sessions are released at most a quarter of the timeout late
+  const auto period = std::max(idle_timeout_ / 4, std::chrono::milliseconds{1});
+  thread_ = std::thread([this, period] {
+    std::unique_lock lock{mutex_};
+    while (!stop_cv_.wait_for(lock, period, [this] { return stop_; })) {
+      for (auto* session : sessions_)
+        session->ReleaseIfIdle(idle_timeout_);
+    }
+  });
+}
+
+IdleSessionReleaser::~IdleSessionReleaser() {
+  {
+    std::scoped_lock lock{mutex_};
+    stop_ = true;
+  }
+  stop_cv_.notify_one();
+  thread_.join();
+}
+
+}  // namespace Generators
@@ -0,0 +1,89 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "onnxruntime_api.h"
+
+namespace Generators {
+
+// A session that can be released to free its memory and is created again by the next run that needs it. The
+// encoders of multimodal models (vision, speech) are only run for prompts with images or audio, so a text-only chat
+// doesn't have to keep them loaded. Its input names are kept, so that building the inputs of a state doesn't need the
+// session. All methods are thread safe.
+struct LazySession {
+  using Factory = std::function<std::unique_ptr<OrtSession>()>;
+
+  // session may be nullptr to create it on first use; input_names are those of the session factory creates. A
+  // factory that returns nullptr (tests) still counts as loaded.
+  LazySession(Factory factory, std::unique_ptr<OrtSession> session, std::vector<std::string> input_names,
+              std::chrono::milliseconds idle_timeout);
+
+  // Keeps the session loaded while it's alive
+  struct Lease {
+    Lease(LazySession& owner, OrtSession* session) : owner_{&owner}, session_{session} {}
+    Lease(Lease&& other) noexcept : owner_{std::exchange(other.owner_, nullptr)}, session_{other.session_} {}
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+    Lease& operator=(Lease&&) = delete;
+    ~Lease();
+
+    OrtSession& operator*() const { return *session_; }
+
+   private:
+    LazySession* owner_;
+    OrtSession* session_;
+  };
+
+  // Creates the session if it isn't loaded
+  Lease Acquire();
+
+  // Releases the session if no lease holds it and it was last used at least idle_for ago. Returns whether it did.
+  bool ReleaseIfIdle(std::chrono::steady_clock::duration idle_for = {});
+
+  bool IsLoaded() const;
+  const std::vector<std::string>& GetInputNames() const { return input_names_; }
+
+ private:
+  void Return();
+
+  const Factory factory_;
+  const std::vector<std::string> input_names_;
+  const std::chrono::milliseconds idle_timeout_;  // 0 releases the session with its last lease, negative never
+
+  mutable std::mutex mutex_;
+  std::unique_ptr<OrtSession> session_;
+  bool loaded_{};
+  size_t leases_{};
+  std::chrono::steady_clock::time_point last_use_;
+};
+
+// Releases the sessions that weren't used for idle_timeout, checking on a background thread
+struct IdleSessionReleaser {
+  IdleSessionReleaser(std::vector<LazySession*> sessions, std::chrono::milliseconds idle_timeout);
+  ~IdleSessionReleaser();
+
+  IdleSessionReleaser(const IdleSessionReleaser&) = delete;
+  IdleSessionReleaser& operator=(const IdleSessionReleaser&) = delete;
+
+ private:
+  const std::vector<LazySession*> sessions_;
+  const std::chrono::milliseconds idle_timeout_;
+
+  std::mutex mutex_;
+  std::condition_variable stop_cv_;
+  bool stop_{};
+  std::thread thread_;
+};
+
+}  // namespace Generators
@@ -3,6 +3,7 @@
 #include "../generators.h"
 #include "model.h"
 #include "logits.h"
+#include "../cpu/interface.h"
 #include "../openvino/interface.h"
 
 namespace Generators {
@@ -66,7 +67,16 @@ DeviceSpan<float> Logits::Get() {
     element_count = shape_[0] * shape_[2];  // shape_[1] is now 1, so the element count must be updated
   }
 
-  // Convert from float16 to float32 if necessary
+  // Convert from float16 to float32 if necessary. On CPU that's left until the float32 values are read, as greedy
+  // search and top-k sampling pick their tokens from the float16 ones.
+  if (type_ == Ort::TypeToTensorType<Ort::Float16_t> && model_.p_device_inputs_->GetType() == DeviceType::CPU) {
+    if (!logits_of_last_token_fp32_ || logits_of_last_token_fp32_->GetTensorTypeAndShapeInfo()->GetElementCount() != element_count)
+      logits_of_last_token_fp32_ = OrtValue::CreateTensor<float>(model_.p_device_inputs_->GetAllocator(), shape_last);
+    logits_ = DeviceSpan<float>(WrapFloat16AsFloat32(
+        std::span<const uint16_t>{logits_of_last_token->GetTensorData<uint16_t>(), element_count},
+        std::span<float>{logits_of_last_token_fp32_->GetTensorMutableData<float>(), element_count}));
+    return logits_;
+  }
   if (type_ == Ort::TypeToTensorType<Ort::Float16_t>) {
     Cast(*logits_of_last_token, logits_of_last_token_fp32_, *model_.p_device_inputs_, Ort::TypeToTensorType<float>);
     logits_of_last_token = logits_of_last_token_fp32_.get();
@@ -78,6 +88,18 @@ DeviceSpan<float> Logits::Get() {
   return logits_;
 }
 
+DeviceSpan<float> Logits::GetAll() {
+  if (trimmed_prefill_logits_)
+    return {};
+
+  OrtValue* logits = output_raw_->GetOrtTensor();
+  if (type_ == Ort::TypeToTensorType<Ort::Float16_t>) {
+    Cast(*logits, all_logits_fp32_, *model_.p_device_inputs_, Ort::TypeToTensorType<float>);
+    logits = all_logits_fp32_.get();
+  }
+  return WrapTensor<float>(*model_.p_device_inputs_, *logits);
+}
+
 void Logits::Update(const DeviceSpan<int32_t>& next_tokens, size_t new_kv_length) {
   if (trimmed_prefill_logits_) {
     new_kv_length = 1;
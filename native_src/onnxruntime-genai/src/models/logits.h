@@ -12,6 +12,10 @@ struct Logits {
   // For first iteration, find last token of each beam and store it in output_last_tokens_.
   DeviceSpan<float> Get();
 
+  // Logits of every input token of the last run as float32, [batch_beam_size, token_count, vocab_size]. Empty when
+  // the model only returns the last token's logits.
+  DeviceSpan<float> GetAll();
+
   // Resize logits to [bz, token_count, vocab_size] if necessary.
   void Update(const DeviceSpan<int32_t>& next_tokens, size_t new_kv_length);
 
@@ -28,6 +32,7 @@ struct Logits {
   // 2. token gen: store the converted fp32 logits if output_raw_ is fp16.
   std::unique_ptr<OrtValue> output_last_tokens_;
   std::unique_ptr<OrtValue> logits_of_last_token_fp32_;
+  std::unique_ptr<OrtValue> all_logits_fp32_;  // GetAll() result when output_raw_ is fp16
 
   std::unique_ptr<Tensor> output_raw_;  // Raw logits output from model
 
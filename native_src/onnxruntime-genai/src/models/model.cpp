@@ -6,6 +6,7 @@
 #include <climits>
 #include <random>
 #include <set>
+#include <sstream>
 #include <string>
 #include <thread>
 
@@ -21,6 +22,7 @@
 #include "decoder_only_pipeline.h"
 #include "qwen_vl_model.h"
 #include "qwen2_5_vl_image_processor.h"
+#include "optimized_model_cache.h"
 #include "../dml/interface.h"
 #include "../openvino/interface.h"
 
@@ -71,6 +73,26 @@ class DirGuard {
   }
 };
 
+// Everything in the config that can change the graph ORT optimizes, for the optimized-graph cache key. Options that
+// only affect running it (threads, arenas, logging, profiling) are left out.
+std::string SessionOptionsKey(const Config::SessionOptions& options, bool is_primary_session_options, bool disable_graph_capture) {
+  std::ostringstream key;
+  key << "primary=" << is_primary_session_options << ";disable_graph_capture=" << disable_graph_capture
+      << ";graph_optimization_level=" << (options.graph_optimization_level ? static_cast<int>(*options.graph_optimization_level) : -1)
+      << ";custom_ops_library=" << options.custom_ops_library.value_or("") << ";providers=";
+  for (const auto& provider : options.providers)
+    key << provider << ',';
+  for (const auto& provider_options : options.provider_options) {
+    key << ";" << provider_options.name << ':';
+    for (const auto& [name, value] : provider_options.options)
+      key << name << '=' << value << ',';
+  }
+  key << ";config_entries:";
+  for (const auto& [name, value] : options.config_entries)
+    key << name << '=' << value << ',';
+  return key.str();
+}
+
 }  // namespace
 
 State::State(const GeneratorParams& params, const Model& model)
@@ -1067,6 +1089,8 @@ void Model::CreateSessionOptionsFromConfig(const Config::SessionOptions& config_
     session_options.SetGraphOptimizationLevel(config_session_options.graph_optimization_level.value());
   }
 
+  session_options_keys_[&session_options] = SessionOptionsKey(config_session_options, is_primary_session_options, disable_graph_capture);
+
   auto session_device = SetProviderSessionOptions(session_options, config_session_options.providers,
                                                   config_session_options.provider_options, is_primary_session_options,
                                                   disable_graph_capture, *config_, arena_cfg_);
@@ -1131,15 +1155,34 @@ std::unique_ptr<OrtSession> Model::CreateSession(OrtEnv& ort_env, const std::str
   }
 
   // Otherwise, load the model from the file system
-  return OrtSession::Create(ort_env, (config_->config_path / fs::path(model_filename)).c_str(), session_options);
+  const fs::path model_path = config_->config_path / fs::path(model_filename);
+  if (const auto& cache_dir = config_->model.optimized_model_cache_dir; !cache_dir.empty() && session_options) {
+    const fs::path cache_path{cache_dir};
+    auto options_key = session_options_keys_.find(session_options);
+    return CreateCachedSession(ort_env, cache_path.is_relative() ? config_->config_path / cache_path : cache_path, model_path,
+                               *session_options, options_key != session_options_keys_.end() ? options_key->second : std::string{});
+  }
+  return OrtSession::Create(ort_env, model_path.c_str(), session_options);
 }
 
 std::shared_ptr<Tokenizer> Model::CreateTokenizer() const {
   return std::make_shared<Tokenizer>(*config_);
 }
 
+ThreadPool& Model::GetThreadPool() const {
+  std::call_once(thread_pool_once_, [this] {
+    const auto& sliding_window = config_->model.decoder.sliding_window;
+    size_t num_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    if (sliding_window.has_value() && sliding_window->num_update_threads > 0) {
+      num_threads = static_cast<size_t>(sliding_window->num_update_threads);
+    }
+    thread_pool_ = std::make_unique<ThreadPool>(num_threads);
+  });
+  return *thread_pool_;
+}
+
 std::shared_ptr<MultiModalProcessor> Model::CreateMultiModalProcessor() const {
-  return std::make_shared<MultiModalProcessor>(*config_, session_info_);
+  return std::make_shared<MultiModalProcessor>(*config_, session_info_, &GetThreadPool());
 }
 
 std::shared_ptr<Model> CreateModel(OrtEnv& ort_env, const char* config_path, const RuntimeSettings* settings /*= nullptr*/) {
@@ -1151,7 +1194,7 @@ std::shared_ptr<Model> CreateModel(OrtEnv& ort_env, const char* config_path, con
   return CreateModel(ort_env, std::move(config));
 }
 
-std::shared_ptr<Model> CreateModel(OrtEnv& ort_env, std::unique_ptr<Config> config) {
+static std::shared_ptr<Model> CreateModelOfType(OrtEnv& ort_env, std::unique_ptr<Config> config) {
   // Check if it's a pipeline model by checking if decoder.pipeline is configured
   if ((config->model.type == "fara" || config->model.type == "qwen2_5_vl") && !config->model.decoder.pipeline.empty())
     return std::make_shared<Qwen2_5_VL_PipelineModel>(std::move(config), ort_env);
@@ -1173,6 +1216,25 @@ std::shared_ptr<Model> CreateModel(OrtEnv& ort_env, std::unique_ptr<Config> conf
   throw std::runtime_error("Unsupported model_type in config.json: " + config->model.type);
 }
 
+std::shared_ptr<Model> CreateModel(OrtEnv& ort_env, std::unique_ptr<Config> config) {
+  auto model = CreateModelOfType(ort_env, std::move(config));
+
+  const auto& draft_model = model->config_->search.draft_model;
+  if (!draft_model.empty()) {
+    fs::path draft_path{draft_model};
+    if (draft_path.is_relative())
+      draft_path = model->config_->config_path / draft_path;
+
+    // The draft runs with its own config (and providers), but never has a draft itself
+    auto draft_config = std::make_unique<Config>(draft_path, std::string_view{});
+    if (draft_config->model.vocab_size > model->config_->model.vocab_size)
+      throw std::runtime_error("Draft model vocab_size (" + std::to_string(draft_config->model.vocab_size) +
+                               ") is larger than the model's (" + std::to_string(model->config_->model.vocab_size) + ")");
+    model->draft_model_ = CreateModelOfType(ort_env, std::move(draft_config));
+  }
+  return model;
+}
+
 std::shared_ptr<GeneratorParams> CreateGeneratorParams(const Model& model) {
   return std::make_shared<GeneratorParams>(model);
 }
@@ -1244,7 +1306,7 @@ std::unique_ptr<OrtValue> Model::ExpandInputs(std::unique_ptr<OrtValue>& input,
   return expanded;
 }
 
-MultiModalProcessor::MultiModalProcessor(Config& config, const SessionInfo& session_info)
+MultiModalProcessor::MultiModalProcessor(Config& config, const SessionInfo& session_info, ThreadPool* thread_pool)
     : tokenizer_{std::make_shared<Tokenizer>(config)},
       processor_factory_{
           {"phi3v", Processor::Create<PhiImageProcessor>},
@@ -1256,6 +1318,7 @@ MultiModalProcessor::MultiModalProcessor(Config& config, const SessionInfo& sess
   auto processor = processor_factory_.find(config.model.type);
   if (processor != processor_factory_.end()) {
     processor_ = processor->second(config, session_info);
+    processor_->thread_pool_ = thread_pool;
   } else {
     throw std::runtime_error("MultiModalProcessor cannot be created. " + config.model.type + " is not a registered multi-modal model type.");
   }
@@ -11,6 +11,8 @@
 #include "gemma_image_processor.h"
 #include "adapters.h"
 #include "extra_outputs.h"
+#include "prefix_cache.h"
+#include "threadpool.h"
 
 namespace Generators {
 
@@ -27,13 +29,30 @@ struct State {
   virtual void Finalize(int current_length) {}
 
   virtual void RewindTo(size_t index) { (void)index; };
+
+  // Hand the key/values of the first length tokens to the model's PrefixCache, or start from them. Models that
+  // can't do either return nullptr / false and process the whole prompt.
+  virtual std::unique_ptr<KeyValuePrefix> DetachPrefix(size_t length) { return nullptr; }
+  virtual bool RestorePrefix(DeviceSpan<int32_t> prefix_tokens, const KeyValuePrefix& prefix) { return false; }
+  // Same as DetachPrefix, leaving the state usable (for Generator::SaveState)
+  virtual std::unique_ptr<KeyValuePrefix> CopyPrefix(size_t length) { return nullptr; }
+
+  // Attention sinks: forget tokens [start, start + count) of the first length processed ones, as if the later ones
+  // had been processed right after start. Returns false, without changing anything, if the model can't.
+  virtual bool Evict(size_t start, size_t count, size_t length) { return false; }
+
+  // Logits of every token of the last Run as [batch_beam_size, token_count, vocab_size], used to verify speculated
+  // tokens. Empty for models that only keep the last token's logits.
+  virtual DeviceSpan<float> GetAllLogits() { return {}; }
+
   virtual OrtValue* GetInput(const char* name);
   virtual OrtValue* GetOutput(const char* name);
 
   void ClearIO();  // Clear all inputs/outputs
 
   void SetActiveAdapter(Adapters* adapters, const std::string& adapter_name);
-  void SetRunOption(const char* key, const char* value);
+  // Pipelines whose stages run with their own run options pass the option on to every stage
+  virtual void SetRunOption(const char* key, const char* value);
   void SetRunOptions(const Config::RunOptions& config_run_options);
   virtual void SetExtraInputs(const std::vector<ExtraInput>& extra_inputs) {}
 
@@ -105,7 +124,7 @@ struct Tokenizer : std::enable_shared_from_this<Tokenizer>, LeakChecked<Tokenize
 };
 
 struct MultiModalProcessor : std::enable_shared_from_this<MultiModalProcessor>, ExternalRefCounted<MultiModalProcessor> {
-  MultiModalProcessor(Config& config, const SessionInfo& session_info);
+  MultiModalProcessor(Config& config, const SessionInfo& session_info, ThreadPool* thread_pool = nullptr);
 
   std::unique_ptr<NamedTensors> Process(const std::string& prompt, const Images* images, const Audios* audios) const;
   std::unique_ptr<NamedTensors> Process(std::span<const char*> prompts, const Images* images, const Audios* audios) const;
@@ -153,6 +172,15 @@ struct Model : std::enable_shared_from_this<Model>, LeakChecked<Model>, External
 
   std::unique_ptr<OrtSession> CreateSession(OrtEnv& ort_env, const std::string& model_filename, OrtSessionOptions* session_options);
 
+  // Releases the sessions a model can create again when needed (like the encoders of multimodal models) that no
+  // generator is using, to free their memory. Returns how many were released.
+  virtual size_t ReleaseIdleSessions() const { return 0; }
+
+  // Worker threads for the CPU-side parallel loops of this model's generators and processors (e.g. per-layer windowed
+  // key-value cache updates, image patch extraction). Created on first use and shared, so concurrent generators take turns on one set of threads
+  // instead of each starting its own.
+  ThreadPool& GetThreadPool() const;
+
   std::unique_ptr<Config> config_;
   std::unique_ptr<OrtSessionOptions> session_options_;
   std::unique_ptr<OrtArenaCfg> arena_cfg_;
@@ -165,6 +193,9 @@ struct Model : std::enable_shared_from_this<Model>, LeakChecked<Model>, External
 
   SessionInfo session_info_;
 
+  std::unique_ptr<PrefixCache> prefix_cache_{std::make_unique<PrefixCache>()};  // Key/values left behind by finished generators
+  std::shared_ptr<Model> draft_model_;                                           // Proposes tokens for speculative decoding (search.draft_model)
+
  protected:
   void CreateSessionOptions();
 
@@ -174,6 +205,13 @@ struct Model : std::enable_shared_from_this<Model>, LeakChecked<Model>, External
                                       bool disable_graph_capture);
 
   std::map<std::string, std::unique_ptr<OrtSessionOptions>> pipeline_session_options_;
+
+ private:
+  // What CreateSessionOptionsFromConfig set on each session options, the key of the optimized-graph cache
+  std::map<const OrtSessionOptions*, std::string> session_options_keys_;
+
+  mutable std::once_flag thread_pool_once_;
+  mutable std::unique_ptr<ThreadPool> thread_pool_;
 };
 
 }  // namespace Generators
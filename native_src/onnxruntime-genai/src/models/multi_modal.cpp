@@ -63,18 +63,6 @@ int64_t GetImageFeatureBatchSize(const std::vector<ExtraInput>& extra_inputs) {
 MultiModalLanguageModel::MultiModalLanguageModel(std::unique_ptr<Config> config, OrtEnv& ort_env, bool vision, bool speech)
     : Model(std::move(config)) {
   // The non-decoder models don't support graph capture because of control flow nodes, so disable graph capture for them
-  if (vision) {
-    vision_session_options_ = OrtSessionOptions::Create();
-    CreateSessionOptionsFromConfig(config_->model.vision.session_options.has_value() ? config_->model.vision.session_options.value() : config_->model.decoder.session_options, *vision_session_options_, true, true);
-    vision_session_ = CreateSession(ort_env, config_->model.vision.filename, vision_session_options_.get());
-  }
-
-  if (speech) {
-    speech_session_options_ = OrtSessionOptions::Create();
-    CreateSessionOptionsFromConfig(config_->model.speech.session_options.has_value() ? config_->model.speech.session_options.value() : config_->model.decoder.session_options, *speech_session_options_, true, true);
-    speech_session_ = CreateSession(ort_env, config_->model.speech.filename, speech_session_options_.get());
-  }
-
   embedding_session_options_ = OrtSessionOptions::Create();
   CreateSessionOptionsFromConfig(config_->model.embedding.session_options.has_value() ? config_->model.embedding.session_options.value() : config_->model.decoder.session_options, *embedding_session_options_, true, true);
 
@@ -83,12 +71,62 @@ MultiModalLanguageModel::MultiModalLanguageModel(std::unique_ptr<Config> config,
 
   session_info_.Add(*decoder_session_);
   session_info_.Add(*embedding_session_);
+
+  // Created after the decoder so that lazy encoders, which are released once their inputs and outputs are known,
+  // don't add to the peak memory of loading
   if (speech) {
-    session_info_.Add(*speech_session_);
+    speech_session_options_ = OrtSessionOptions::Create();
+    CreateSessionOptionsFromConfig(config_->model.speech.session_options.has_value() ? config_->model.speech.session_options.value() : config_->model.decoder.session_options, *speech_session_options_, true, true);
+    speech_session_ = CreateEncoderSession(ort_env, config_->model.speech.filename, speech_session_options_.get());
   }
+
   if (vision) {
-    session_info_.Add(*vision_session_);
+    vision_session_options_ = OrtSessionOptions::Create();
+    CreateSessionOptionsFromConfig(config_->model.vision.session_options.has_value() ? config_->model.vision.session_options.value() : config_->model.decoder.session_options, *vision_session_options_, true, true);
+    vision_session_ = CreateEncoderSession(ort_env, config_->model.vision.filename, vision_session_options_.get());
+  }
+
+  adapters_ = std::make_shared<Adapters>(this);
+  if (vision && config_->model.vision.adapter_filename.has_value()) {
+    const auto lora_adapter = (config_->config_path / fs::path(*config_->model.vision.adapter_filename)).string();
+    adapters_->LoadAdapter(lora_adapter.c_str(), vision_adapter_name_);
+  }
+  if (speech && config_->model.speech.adapter_filename.has_value()) {
+    const auto lora_adapter = (config_->config_path / fs::path(*config_->model.speech.adapter_filename)).string();
+    adapters_->LoadAdapter(lora_adapter.c_str(), speech_adapter_name_);
+  }
+
+  if (config_->model.encoder_idle_timeout_ms > 0 && (vision_session_ || speech_session_)) {
+    std::vector<LazySession*> sessions;
+    for (auto* session : {vision_session_.get(), speech_session_.get()}) {
+      if (session)
+        sessions.push_back(session);
+    }
+    idle_session_releaser_ = std::make_unique<IdleSessionReleaser>(std::move(sessions),
+                                                                   std::chrono::milliseconds{config_->model.encoder_idle_timeout_ms});
+  }
+}
+
+std::unique_ptr<LazySession> MultiModalLanguageModel::CreateEncoderSession(OrtEnv& ort_env, const std::string& filename,
+                                                                           OrtSessionOptions* session_options) {
+  auto session = CreateSession(ort_env, filename, session_options);
+  session_info_.Add(*session);
+  auto input_names = session->GetInputNames();
+  if (config_->model.lazy_encoder_sessions)
+    session.reset();  // Only its inputs and outputs were needed yet
+
+  return std::make_unique<LazySession>([this, &ort_env, filename, session_options] { return CreateSession(ort_env, filename, session_options); },
+                                       std::move(session), std::move(input_names),
+                                       std::chrono::milliseconds{config_->model.encoder_idle_timeout_ms});
+}
+
+size_t MultiModalLanguageModel::ReleaseIdleSessions() const {
+  size_t released = 0;
+  for (auto* session : {vision_session_.get(), speech_session_.get()}) {
+    if (session && session->ReleaseIfIdle())
+      released++;
   }
+  return released;
 }
 
 std::unique_ptr<State> MultiModalLanguageModel::CreateState(DeviceSpan<int32_t> sequence_lengths, const GeneratorParams& params) const {
@@ -107,14 +145,50 @@ void VisionState::SetExtraInputs(const std::vector<ExtraInput>& extra_inputs, co
                                                          model_.config_->model.vision.outputs.image_features,
                                                          num_images_, num_image_tokens_);
   image_features_->Add();
-  extra_inputs_.Add(extra_inputs, model_.vision_session_->GetInputNames());
+  const auto& input_names = model_.vision_session_->GetInputNames();
+  extra_inputs_.Add(extra_inputs, input_names);
+
+  if (params_->search.image_features_cache_bytes == 0 || num_image_tokens_ == 0)
+    return;
+
+  // The processor's output already reflects its settings (image size, crops, normalization), so hashing the vision
+  // inputs covers both the image and how it was processed
+  ImageFeaturesKey key;
+  for (const auto& input : extra_inputs) {
+    if (std::find(input_names.begin(), input_names.end(), input.name) == input_names.end())
+      continue;
+    auto info = input.tensor->ort_tensor_->GetTensorTypeAndShapeInfo();
+    key.Add(input.name, info->GetElementType(), info->GetShape(), input.tensor->GetByteSpan().CopyDeviceToCpu());
+  }
+  for (auto dim : image_features_->GetShape())
+    key.Add(static_cast<uint64_t>(dim));
+  image_features_key_ = key.value;
 }
 
 DeviceSpan<float> VisionState::Run(int current_length, DeviceSpan<int32_t>& next_tokens, DeviceSpan<int32_t> next_indices) {
+  const size_t cache_bytes = params_->search.image_features_cache_bytes;
+  auto features = ByteWrapTensor(*model_.p_device_, *image_features_->Get());
+  if (cache_bytes > 0) {
+    auto cached = model_.image_features_cache_->Lookup(image_features_key_);
+    if (cached && cached->bytes == features.size()) {
+      features.CopyFrom(ByteWrapTensor(*model_.p_device_, *cached->features));
+      return {};
+    }
+  }
+
   if (model_.config_->model.vision.run_options.has_value()) {
     State::SetRunOptions(model_.config_->model.vision.run_options.value());
   }
-  State::Run(*model_.vision_session_);
+  State::Run(*model_.vision_session_->Acquire());
+
+  if (cache_bytes > 0 && features.size() <= cache_bytes) {
+    auto entry = std::make_shared<ImageFeatures>();
+    entry->features = OrtValue::CreateTensor(model_.p_device_->GetAllocator(), image_features_->GetShape(),
+                                             image_features_->Get()->GetTensorTypeAndShapeInfo()->GetElementType());
+    ByteWrapTensor(*model_.p_device_, *entry->features).CopyFrom(features);
+    entry->bytes = features.size();
+    model_.image_features_cache_->Insert(image_features_key_, std::move(entry), cache_bytes);
+  }
   return {};
 }
 
@@ -136,7 +210,7 @@ DeviceSpan<float> SpeechState::Run(int current_length, DeviceSpan<int32_t>& next
   if (model_.config_->model.speech.run_options.has_value()) {
     State::SetRunOptions(model_.config_->model.speech.run_options.value());
   }
-  State::Run(*model_.speech_session_);
+  State::Run(*model_.speech_session_->Acquire());
   return {};
 }
 
@@ -217,8 +291,7 @@ void DecoderState::UpdateInputsOutputs(DeviceSpan<int32_t>& next_tokens, int tot
 
 MultiModalPipelineState::MultiModalPipelineState(const MultiModalLanguageModel& model, DeviceSpan<int32_t> sequence_lengths, const GeneratorParams& params)
     : State{params, model},
-      model_{model},
-      adapters_{std::make_shared<Adapters>(&model_)} {
+      model_{model} {
   if (model_.vision_session_) {
     vision_state_ = std::make_unique<VisionState>(model_, params);
   }
@@ -227,16 +300,6 @@ MultiModalPipelineState::MultiModalPipelineState(const MultiModalLanguageModel&
   }
   embedding_state_ = std::make_unique<EmbeddingState>(model, params);
   decoder_state_ = std::make_unique<DecoderState>(model_, sequence_lengths, params);
-
-  if (vision_state_ != nullptr && model_.config_->model.vision.adapter_filename.has_value() && num_image_tokens_ > 0) {
-    const auto lora_adapter = (model_.config_->config_path / fs::path(*model_.config_->model.vision.adapter_filename)).string();
-    adapters_->LoadAdapter(lora_adapter.c_str(), vision_adapter_name_);
-    decoder_state_->SetActiveAdapter(adapters_.get(), vision_adapter_name_);
-  } else if (speech_state_ != nullptr && model_.config_->model.speech.adapter_filename.has_value() && num_audio_tokens_ > 0) {
-    const auto lora_adapter = (model_.config_->config_path / fs::path(*model_.config_->model.speech.adapter_filename)).string();
-    adapters_->LoadAdapter(lora_adapter.c_str(), speech_adapter_name_);
-    decoder_state_->SetActiveAdapter(adapters_.get(), speech_adapter_name_);
-  }
 }
 
 void MultiModalPipelineState::SetExtraInputs(const std::vector<ExtraInput>& extra_inputs) {
@@ -244,6 +307,18 @@ void MultiModalPipelineState::SetExtraInputs(const std::vector<ExtraInput>& extr
   num_audio_tokens_ = GetNumAudioTokens(extra_inputs, model_.config_->model.speech.inputs.audio_sizes);
   num_images_ = GetImageFeatureBatchSize(extra_inputs);
 
+  // Only the token counts of the inputs tell whether the decoder runs with an encoder's adapter. The adapters are the
+  // model's, so activating one only adds it to the run options.
+  if (!adapter_active_) {
+    if (vision_state_ != nullptr && model_.config_->model.vision.adapter_filename.has_value() && num_image_tokens_ > 0) {
+      decoder_state_->SetActiveAdapter(model_.adapters_.get(), model_.vision_adapter_name_);
+      adapter_active_ = true;
+    } else if (speech_state_ != nullptr && model_.config_->model.speech.adapter_filename.has_value() && num_audio_tokens_ > 0) {
+      decoder_state_->SetActiveAdapter(model_.adapters_.get(), model_.speech_adapter_name_);
+      adapter_active_ = true;
+    }
+  }
+
   if (model_.vision_session_) {
     vision_state_->SetExtraInputs(extra_inputs, num_images_, num_image_tokens_);
   }
@@ -313,6 +388,16 @@ DeviceSpan<float> MultiModalPipelineState::Run(int current_length, DeviceSpan<in
   return decoder_state_->Run(current_length, next_tokens, next_indices);
 }
 
+void MultiModalPipelineState::SetRunOption(const char* key, const char* value) {
+  State::SetRunOption(key, value);
+  // The stages run with their own run options, so e.g. terminate_session also stops a running vision encoder
+  for (State* state : std::initializer_list<State*>{vision_state_.get(), speech_state_.get(), embedding_state_.get(),
+                                                    decoder_state_.get()}) {
+    if (state != nullptr)
+      state->SetRunOption(key, value);
+  }
+}
+
 OrtValue* MultiModalPipelineState::GetInput(const char* name) {
   if (vision_state_) {
     // Check if input name is in vision state's inputs
@@ -5,6 +5,8 @@
 #include "model.h"
 #include "input_ids.h"
 #include "multi_modal_features.h"
+#include "image_features_cache.h"
+#include "lazy_session.h"
 #include "embeddings.h"
 #include "extra_inputs.h"
 #include "logits.h"
@@ -20,14 +22,31 @@ struct MultiModalLanguageModel : Model {
 
   std::unique_ptr<State> CreateState(DeviceSpan<int32_t> sequence_lengths, const GeneratorParams& params) const override;
 
-  std::unique_ptr<OrtSession> vision_session_;     // pixel_values, [image_attention_mask], image_sizes -> image_features
-  std::unique_ptr<OrtSession> speech_session_;     // audio_embeds, audio_sizes, audio_projection_mode -> audio_features
+  size_t ReleaseIdleSessions() const override;
+
+  // The encoders only run for prompts with images or audio, so they can be created on first use and released again
+  // (model.lazy_encoder_sessions, model.encoder_idle_timeout_ms)
+  std::unique_ptr<LazySession> vision_session_;    // pixel_values, [image_attention_mask], image_sizes -> image_features
+  std::unique_ptr<LazySession> speech_session_;    // audio_embeds, audio_sizes, audio_projection_mode -> audio_features
   std::unique_ptr<OrtSession> embedding_session_;  // input_ids, image_features, audio_features -> inputs_embeds
   std::unique_ptr<OrtSession> decoder_session_;    // inputs_embeds, attention_mask, kv_cache -> logits
 
   std::unique_ptr<OrtSessionOptions> vision_session_options_;
   std::unique_ptr<OrtSessionOptions> speech_session_options_;
   std::unique_ptr<OrtSessionOptions> embedding_session_options_;
+
+  std::unique_ptr<ImageFeaturesCache> image_features_cache_{std::make_unique<ImageFeaturesCache>()};  // Vision outputs of earlier prompts
+
+  // LoRA adapters of the decoder for prompts with images or audio (vision/speech.adapter_filename), loaded once and
+  // shared by all generators
+  std::shared_ptr<Adapters> adapters_;
+  const std::string vision_adapter_name_{"vision"};
+  const std::string speech_adapter_name_{"speech"};
+
+ private:
+  std::unique_ptr<LazySession> CreateEncoderSession(OrtEnv& ort_env, const std::string& filename, OrtSessionOptions* session_options);
+
+  std::unique_ptr<IdleSessionReleaser> idle_session_releaser_;  // Declared after the sessions it releases
 };
 
 struct VisionState : State {
@@ -46,6 +65,7 @@ struct VisionState : State {
   int64_t num_images_{};
   ExtraInputs extra_inputs_{*this};  // Model inputs
   std::unique_ptr<MultiModalFeatures> image_features_;
+  uint64_t image_features_key_{};  // ImageFeaturesKey of the inputs, set when search.image_features_cache_bytes > 0
 };
 
 struct SpeechState : State {
@@ -126,6 +146,8 @@ struct MultiModalPipelineState : State {
 
   OrtValue* GetOutput(const char* name) override;
 
+  void SetRunOption(const char* key, const char* value) override;
+
  private:
   void UpdateInputsOutputs(const DeviceSpan<int32_t>& next_tokens, DeviceSpan<int32_t> next_indices,
                            int current_length);
@@ -138,11 +160,8 @@ struct MultiModalPipelineState : State {
   std::unique_ptr<SpeechState> speech_state_;
   std::unique_ptr<EmbeddingState> embedding_state_;
   std::unique_ptr<DecoderState> decoder_state_;
-  std::shared_ptr<Adapters> adapters_;
+  bool adapter_active_{};
   bool is_prompt_{true};
-
-  const std::string vision_adapter_name_{"vision"};
-  const std::string speech_adapter_name_{"speech"};
 };
 
 }  // namespace Generators
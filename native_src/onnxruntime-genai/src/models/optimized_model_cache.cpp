@@ -0,0 +1,158 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "../generators.h"
+#include "optimized_model_cache.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+namespace Generators {
+
+namespace {
+
+constexpr uint32_t kCacheVersion = 1;
+constexpr size_t kFingerprintBytes = 1 << 20;  // Hashed from both ends of a file
+constexpr const char* kUnsupportedPrefix = "unsupported ";
+
+// FNV-1a
+struct Hasher {
+  uint64_t value{14695981039346656037ull};
+
+  void Add(const void* data, size_t bytes) {
+    const auto* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < bytes; i++) {
+      value ^= p[i];
+      value *= 1099511628211ull;
+    }
+  }
+
+  void Add(uint64_t number) { Add(&number, sizeof(number)); }
+
+  void Add(std::string_view text) {
+    Add(static_cast<uint64_t>(text.size()));
+    Add(text.data(), text.size());
+  }
+
+  // Hashing a multi-gigabyte model would cost more than the optimization the cache saves, so only its size and the
+  // bytes at both ends are. They hold the graph (or the header and the last tensors of external data).
+  void AddFile(const fs::path& path) {
+    auto stream = path.open(std::ios::binary);
+    if (!stream) {
+      Add(uint64_t{0});
+      return;
+    }
+    stream.seekg(0, std::ios::end);
+    const auto size = static_cast<size_t>(stream.tellg());
+    Add(static_cast<uint64_t>(size) + 1);
+
+    std::vector<char> buffer(std::min(size, kFingerprintBytes));
+    stream.seekg(0);
+    stream.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    Add(buffer.data(), buffer.size());
+    if (size > kFingerprintBytes) {
+      buffer.resize(std::min(size - kFingerprintBytes, kFingerprintBytes));
+      stream.seekg(static_cast<std::streamoff>(size - buffer.size()));
+      stream.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+      Add(buffer.data(), buffer.size());
+    }
+  }
+
+  std::string Hex() const {
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016" PRIx64, value);
+    return text;
+  }
+};
+
+std::string ReadKey(const fs::path& path) {
+  auto stream = path.open();
+  std::string key;
+  std::getline(stream, key);
+  return key;
+}
+
+void WriteKey(const fs::path& path, const std::string& key) {
+  auto stream = path.open_for_write(std::ios::trunc);
+  stream << key << '\n';
+}
+
+void RemoveFile(const fs::path& path) {
+#ifdef _WIN32
+  _wremove(path.c_str());
+#else
+  std::remove(path.c_str());
+#endif
+}
+
+bool ReplaceFile(const fs::path& from, const fs::path& to) {
+#ifdef _WIN32
+  return MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+}  // namespace
+
+std::unique_ptr<OrtSession> CreateCachedSession(OrtEnv& ort_env, const fs::path& cache_directory, const fs::path& model_path,
+                                                const OrtSessionOptions& session_options, const std::string& options_key) {
+  if (!cache_directory.is_directory())
+    throw std::runtime_error("optimized_model_cache_dir " + cache_directory.string() + " is not a directory");
+
+  Hasher name_hasher;
+  name_hasher.Add(model_path.string());
+  const std::string name = name_hasher.Hex() + ".onnx";
+  const fs::path cached_path = cache_directory / name;
+  const fs::path key_path = cache_directory / (name + ".key");
+
+  Hasher key_hasher;
+  key_hasher.Add(uint64_t{kCacheVersion});
+  key_hasher.Add(Ort::api->GetBuildInfoString());
+  key_hasher.Add(options_key);
+  key_hasher.AddFile(model_path);
+  key_hasher.AddFile(fs::path{model_path.string() + ".data"});  // The external data names the model builder uses
+  key_hasher.AddFile(fs::path{model_path.string() + "_data"});
+  const std::string key = key_hasher.Hex();
+
+  const std::string stored_key = ReadKey(key_path);
+  if (stored_key == key) {
+    // The graph is already optimized for these options
+    auto options = session_options.Clone();
+    options->SetGraphOptimizationLevel(ORT_DISABLE_ALL);
+    return OrtSession::Create(ort_env, cached_path.c_str(), options.get());
+  }
+  if (stored_key == kUnsupportedPrefix + key)
+    return OrtSession::Create(ort_env, model_path.c_str(), &session_options);
+
+  // Until the new entry is complete the old one must not be used
+  RemoveFile(key_path);
+
+  const fs::path temp_path = cache_directory / (name + ".tmp");
+  auto options = session_options.Clone();
+  options->SetOptimizedModelFilePath(temp_path.c_str());
+  options->AddConfigEntry("session.save_model_format", "ONNX");
+  options->AddConfigEntry("session.optimized_model_external_initializers_file_name", (name + ".data").c_str());
+  options->AddConfigEntry("session.optimized_model_external_initializers_min_size_in_bytes", "1024");
+  options->AddConfigEntry("session.save_external_prepacked_constant_initializers", "1");
+
+  std::unique_ptr<OrtSession> session;
+  try {
+    session = OrtSession::Create(ort_env, model_path.c_str(), options.get());
+  } catch (const std::exception& e) {
+    // Execution providers that compile nodes (QNN, NNAPI, CoreML, ...) can't save the graph. Only remember that once
+    // the model loads without the cache, so other errors are reported as usual.
+    session = OrtSession::Create(ort_env, model_path.c_str(), &session_options);
+    if (g_log.enabled && g_log.warning)
+      Log("warning", "Not caching the optimized graph of " + model_path.string() + ": " + e.what());
+    RemoveFile(temp_path);
+    WriteKey(key_path, kUnsupportedPrefix + key);
+    return session;
+  }
+
+  if (ReplaceFile(temp_path, cached_path))
+    WriteKey(key_path, key);
+  return session;
+}
+
+}  // namespace Generators
@@ -0,0 +1,25 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "../filesystem.h"
+#include "onnxruntime_api.h"
+
+namespace Generators {
+
+// Optimized-graph cache (model.optimized_model_cache_dir): the first session of a model file writes the graph ORT
+// optimized, with its initializers (prepacked where the kernels support it) in an external data file, to the cache
+// directory. Later sessions load that file with graph optimizations disabled instead of optimizing again.
+//
+// The cache holds one entry per model file, named after a hash of its path. Its key hashes the ORT build, the size and
+// the first and last bytes of the model file and its external data, and options_key, which has to describe everything
+// the session options change about the optimized graph. An entry with another key is rewritten. An entry is only used
+// once its key file exists, which is written last.
+std::unique_ptr<OrtSession> CreateCachedSession(OrtEnv& ort_env, const fs::path& cache_directory, const fs::path& model_path,
+                                                const OrtSessionOptions& session_options, const std::string& options_key);
+
+}  // namespace Generators
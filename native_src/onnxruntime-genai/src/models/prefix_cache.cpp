@@ -0,0 +1,174 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "prefix_cache.h"
+
+#include <utility>
+
+namespace Generators {
+
+PrefixCache::PrefixCache() : root_{std::make_unique<Node>()} {}
+
+PrefixCache::~PrefixCache() = default;
+
+PrefixCache::Match PrefixCache::Lookup(std::span<const int32_t> tokens) {
+  std::scoped_lock lock{mutex_};
+
+  Node* node = root_.get();
+  size_t matched = 0;
+  while (matched < tokens.size()) {
+    auto child = node->children.find(tokens[matched]);
+    if (child == node->children.end())
+      break;
+
+    node = child->second.get();
+    size_t common = 1;  // The first token is the child's key
+    while (common < node->label.size() && matched + common < tokens.size() && node->label[common] == tokens[matched + common])
+      common++;
+    matched += common;
+    if (common < node->label.size())
+      break;
+  }
+
+  if (matched == 0)
+    return {};
+
+  // Every entry below node starts with the matched tokens, take the nearest one
+  while (!node->prefix)
+    node = node->children.begin()->second.get();
+  node->last_use = ++clock_;
+  return {node->prefix, matched};
+}
+
+void PrefixCache::Insert(std::span<const int32_t> tokens, std::shared_ptr<const KeyValuePrefix> prefix, size_t max_bytes) {
+  if (tokens.empty() || !prefix || prefix->bytes > max_bytes)
+    return;
+
+  std::scoped_lock lock{mutex_};
+
+  Node* node = root_.get();
+  size_t matched = 0;
+  while (matched < tokens.size()) {
+    auto child = node->children.find(tokens[matched]);
+    if (child == node->children.end()) {
+      auto leaf = std::make_unique<Node>();
+      leaf->label.assign(tokens.begin() + matched, tokens.end());
+      leaf->parent = node;
+      node = node->children.emplace(tokens[matched], std::move(leaf)).first->second.get();
+      matched = tokens.size();
+      break;
+    }
+
+    Node* next = child->second.get();
+    size_t common = 1;
+    while (common < next->label.size() && matched + common < tokens.size() && next->label[common] == tokens[matched + common])
+      common++;
+
+    if (common < next->label.size()) {
+      // The entries below next already hold every prefix of tokens
+      if (matched + common == tokens.size())
+        return;
+
+      // Split the edge where tokens diverge from it
+      auto branch = std::make_unique<Node>();
+      branch->label.assign(next->label.begin(), next->label.begin() + common);
+      branch->parent = node;
+      next->label.erase(next->label.begin(), next->label.begin() + common);
+      next->parent = branch.get();
+      branch->children.emplace(next->label[0], std::move(child->second));
+      child->second = std::move(branch);
+      next = child->second.get();
+    }
+
+    matched += common;
+    node = next;
+  }
+
+  // tokens end inside the tree, so a longer entry already holds them
+  if (!node->children.empty())
+    return;
+
+  if (node->prefix) {
+    bytes_ -= node->prefix->bytes;
+    entry_count_--;
+  }
+  node->prefix = std::move(prefix);
+  node->last_use = ++clock_;
+  bytes_ += node->prefix->bytes;
+  entry_count_++;
+
+  // Entries on the way down hold a prefix of tokens and are now redundant
+  for (Node* ancestor = node->parent; ancestor != root_.get();) {
+    Node* parent = ancestor->parent;
+    if (ancestor->prefix)
+      RemoveEntry(ancestor);
+    ancestor = parent;
+  }
+
+  Evict(max_bytes);
+}
+
+void PrefixCache::Clear() {
+  std::scoped_lock lock{mutex_};
+  root_ = std::make_unique<Node>();
+  entry_count_ = 0;
+  bytes_ = 0;
+}
+
+size_t PrefixCache::EntryCount() const {
+  std::scoped_lock lock{mutex_};
+  return entry_count_;
+}
+
+size_t PrefixCache::Bytes() const {
+  std::scoped_lock lock{mutex_};
+  return bytes_;
+}
+
+void PrefixCache::RemoveEntry(Node* node) {
+  bytes_ -= node->prefix->bytes;
+  entry_count_--;
+  node->prefix = nullptr;
+  Compact(node);
+}
+
+void PrefixCache::Compact(Node* node) {
+  while (node != root_.get() && !node->prefix) {
+    if (node->children.size() > 1)
+      return;
+
+    if (node->children.size() == 1) {
+      // Merge the only child into node
+      auto child = std::move(node->children.begin()->second);
+      node->label.insert(node->label.end(), child->label.begin(), child->label.end());
+      node->children = std::move(child->children);
+      for (auto& [token, grandchild] : node->children)
+        grandchild->parent = node;
+      node->prefix = std::move(child->prefix);
+      node->last_use = child->last_use;
+      return;
+    }
+
+    Node* parent = node->parent;
+    parent->children.erase(node->label[0]);
+    node = parent;
+  }
+}
+
+void PrefixCache::Evict(size_t max_bytes) {
+  while (bytes_ > max_bytes) {
+    Node* oldest = nullptr;
+    std::vector<Node*> pending{root_.get()};
+    while (!pending.empty()) {
+      Node* node = pending.back();
+      pending.pop_back();
+      if (node->prefix && (!oldest || node->last_use < oldest->last_use))
+        oldest = node;
+      for (auto& [token, child] : node->children)
+        pending.push_back(child.get());
+    }
+    RemoveEntry(oldest);
+  }
+}
+
+}  // namespace Generators
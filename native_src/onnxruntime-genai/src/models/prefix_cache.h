@@ -0,0 +1,82 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../span.h"
+#include "kv_quantization.h"
+#include "onnxruntime_api.h"
+
+namespace Generators {
+
+// Key/value tensors a generator computed for the first `length` tokens of its sequence. The tensors keep the layout
+// of the DefaultKeyValueCache they came from: key and value per layer, [1, num_key_value_heads, capacity, head_size]
+// with positions [0, length) valid.
+struct KeyValuePrefix {
+  std::vector<std::unique_ptr<OrtValue>> tensors;
+  // With decoder.prefix_cache_quantization, tensors instead hold the 8-bit codes of the first `length` positions,
+  // [1, num_key_value_heads, length, head_size], and scales one float per head and position
+  KvQuantization quantization{KvQuantization::None};
+  std::vector<std::unique_ptr<OrtValue>> scales;
+  size_t length{};
+  size_t bytes{};  // Total size of tensors and scales
+};
+
+// Key/value prefixes left behind by earlier generators of a model, keyed by their tokens in a radix tree. A new
+// generator copies the part of the cache that matches the start of its prompt and only runs the rest, so a chat
+// that resends the same system prompt and history every turn only prefills the new turn.
+//
+// An entry stands for every prefix of its tokens, so storing a sequence drops the entries it extends and a sequence
+// that an entry already extends isn't stored. Entries are evicted least recently used first to stay within the byte
+// budget of the generator that inserts. All methods are thread safe.
+struct PrefixCache {
+  struct Match {
+    std::shared_ptr<const KeyValuePrefix> prefix;  // nullptr when no token matched
+    size_t length{};                               // Number of leading tokens whose key/values prefix holds
+  };
+
+  PrefixCache();
+  ~PrefixCache();
+
+  // Finds the entry sharing the longest prefix with tokens
+  Match Lookup(std::span<const int32_t> tokens);
+
+  // Stores the key/values of tokens (prefix->length == tokens.size()), then evicts entries until the cache holds at
+  // most max_bytes. Nothing is stored if the entry alone is larger than max_bytes.
+  void Insert(std::span<const int32_t> tokens, std::shared_ptr<const KeyValuePrefix> prefix, size_t max_bytes);
+
+  void Clear();
+
+  size_t EntryCount() const;
+  size_t Bytes() const;
+
+ private:
+  struct Node {
+    std::vector<int32_t> label;                         // Tokens on the edge from the parent
+    std::map<int32_t, std::unique_ptr<Node>> children;  // Keyed by the first token of their label
+    Node* parent{};
+    std::shared_ptr<const KeyValuePrefix> prefix;  // Set when an entry ends at this node
+    uint64_t last_use{};
+  };
+
+  void RemoveEntry(Node* node);
+
+  // Restores the radix tree invariant that every node other than the root ends an entry or branches
+  void Compact(Node* node);
+
+  void Evict(size_t max_bytes);
+
+  mutable std::mutex mutex_;
+  std::unique_ptr<Node> root_;
+  size_t entry_count_{};
+  size_t bytes_{};
+  uint64_t clock_{};
+};
+
+}  // namespace Generators
@@ -47,6 +47,7 @@ struct Payload {
 
 struct Config;
 struct SessionInfo;
+struct ThreadPool;
 
 template <typename T>
 std::unique_ptr<OrtValue> ProcessTensor(OrtxTensor* tensor, Ort::Allocator& allocator);
@@ -64,6 +65,8 @@ struct Processor {
   }
 
   virtual std::unique_ptr<NamedTensors> Process(const Tokenizer& tokenizer, const Payload& payload) const = 0;
+
+  ThreadPool* thread_pool_{};  // The model's shared pool for parallel preprocessing, set by MultiModalProcessor
 };
 
 }  // namespace Generators
@@ -4,6 +4,7 @@
 #include "../generators.h"
 #include "model.h"
 #include "qwen2_5_vl_image_processor.h"
+#include "image_patches.h"
 #include <numeric>
 #include <regex>
 
@@ -12,22 +13,16 @@ namespace Generators {
 namespace {
 
 // Helper to convert float32 tensor to target type (float16 or bfloat16)
-std::unique_ptr<OrtValue> ConvertPixelValues(const OrtValue& float_tensor,
+std::unique_ptr<OrtValue> ConvertPixelValues(std::unique_ptr<OrtValue> float_tensor,
                                              ONNXTensorElementDataType target_type,
                                              Ort::Allocator& allocator) {
   if (target_type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
-    // No conversion needed, return a copy
-    auto shape = float_tensor.GetTensorTypeAndShapeInfo()->GetShape();
-    auto result = OrtValue::CreateTensor<float>(allocator, shape);
-    const float* src = float_tensor.GetTensorData<float>();
-    float* dst = result->GetTensorMutableData<float>();
-    size_t count = float_tensor.GetTensorTypeAndShapeInfo()->GetElementCount();
-    std::copy(src, src + count, dst);
-    return result;
+    // No conversion needed
+    return float_tensor;
   }
 
-  auto shape = float_tensor.GetTensorTypeAndShapeInfo()->GetShape();
-  size_t count = float_tensor.GetTensorTypeAndShapeInfo()->GetElementCount();
+  auto shape = float_tensor->GetTensorTypeAndShapeInfo()->GetShape();
+  size_t count = float_tensor->GetTensorTypeAndShapeInfo()->GetElementCount();
 
   std::unique_ptr<OrtValue> result;
   if (target_type == ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16) {
@@ -40,7 +35,7 @@ std::unique_ptr<OrtValue> ConvertPixelValues(const OrtValue& float_tensor,
 
   // Use CPU device Cast method for optimized conversion
   auto* cpu_device = GetDeviceInterface(DeviceType::CPU);
-  void* input_data = const_cast<void*>(static_cast<const void*>(float_tensor.GetTensorData<float>()));
+  void* input_data = float_tensor->GetTensorMutableData<float>();
   void* output_data = result->GetTensorMutableRawData();
   cpu_device->Cast(input_data, output_data, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT, target_type, count);
 
@@ -228,10 +223,11 @@ std::unique_ptr<NamedTensors> QwenImageProcessor::Process(const Tokenizer& token
     int64_t width = pixel_values_shape[2];
     int64_t channels = pixel_values_shape[3];
 
-    int64_t height_patches = height / kPatchSize;
-    int64_t width_patches = width / kPatchSize;
-    int64_t total_patches = height_patches * width_patches;
-    int64_t patch_dim = channels * kTemporalPatchSize * kPatchSize * kPatchSize;
+    const ImagePatchesShape patches_shape{height, width, channels, kPatchSize, kTemporalPatchSize};
+    int64_t height_patches = patches_shape.HeightPatches();
+    int64_t width_patches = patches_shape.WidthPatches();
+    int64_t total_patches = patches_shape.PatchCount();
+    int64_t patch_dim = patches_shape.PatchDim();
 
     // Create patched pixel_values: [1, total_patches, patch_dim] for NPU pipeline compatibility
     // NPU pipeline expects rank 3, CUDA/CPU models will squeeze if needed
@@ -241,30 +237,9 @@ std::unique_ptr<NamedTensors> QwenImageProcessor::Process(const Tokenizer& token
 
     // Extract patches from single image in HWC format
     // Each spatial patch is replicated kTemporalPatchSize times
-    int64_t patch_idx = 0;
-    for (int64_t ph = 0; ph < height_patches; ++ph) {
-      for (int64_t pw = 0; pw < width_patches; ++pw) {
-        int64_t h_start = ph * kPatchSize;
-        int64_t w_start = pw * kPatchSize;
-
-        int64_t write_idx = patch_idx * patch_dim;
-
-        // Repeat the same spatial patch kTemporalPatchSize times
-        // Output: [temporal, channels, patch_h, patch_w]
-        for (int64_t t = 0; t < kTemporalPatchSize; ++t) {
-          for (int64_t c = 0; c < channels; ++c) {
-            for (int64_t h = 0; h < kPatchSize; ++h) {
-              for (int64_t w = 0; w < kPatchSize; ++w) {
-                // HWC format: pixel_values[height][width][channels]
-                int64_t src_idx = (h_start + h) * width * channels + (w_start + w) * channels + c;
-                patched_data[write_idx++] = pixel_values_data[src_idx];
-              }
-            }
-          }
-        }
-        patch_idx++;
-      }
-    }
+    ExtractImagePatches(std::span<const float>{pixel_values_data, static_cast<size_t>(height * width * channels)},
+                        patches_shape, std::span<float>{patched_data, static_cast<size_t>(total_patches * patch_dim)},
+                        thread_pool_);  // Extracts rows of patches in parallel
 
     // Create image_grid_thw: [1, 3] for single image
     if (status != kOrtxOK || !image_grid_thw) {
@@ -289,7 +264,7 @@ std::unique_ptr<NamedTensors> QwenImageProcessor::Process(const Tokenizer& token
 
   // Use patched pixel_values if we computed it, otherwise use processor output
   if (patched_pixel_values) {
-    auto converted_tensor = ConvertPixelValues(*patched_pixel_values, pixel_values_type_, allocator);
+    auto converted_tensor = ConvertPixelValues(std::move(patched_pixel_values), pixel_values_type_, allocator);
     named_tensors->emplace(std::string(Config::Defaults::PixelValuesName),
                            std::make_shared<Tensor>(std::move(converted_tensor)));
   } else {
@@ -320,7 +295,7 @@ std::unique_ptr<NamedTensors> QwenImageProcessor::Process(const Tokenizer& token
               float_tensor->GetTensorMutableData<float>());
 
     // Convert to target type
-    auto converted_tensor = ConvertPixelValues(*float_tensor, pixel_values_type_, allocator);
+    auto converted_tensor = ConvertPixelValues(std::move(float_tensor), pixel_values_type_, allocator);
     named_tensors->emplace(std::string(Config::Defaults::PixelValuesName),
                            std::make_shared<Tensor>(std::move(converted_tensor)));
   }
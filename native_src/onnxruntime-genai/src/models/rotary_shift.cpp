@@ -0,0 +1,76 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "rotary_shift.h"
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Generators {
+
+void ShiftRotaryPositions(std::span<float> keys, size_t head_size, size_t rotary_dim, float theta, bool interleaved,
+                          int64_t shift, std::span<const float> factors) {
+  if (rotary_dim == 0)
+    rotary_dim = head_size;
+  if (head_size == 0 || keys.size() % head_size != 0 || rotary_dim > head_size || rotary_dim % 2 != 0)
+    throw std::runtime_error("Can't shift rotary positions of " + std::to_string(keys.size()) + " values with head_size " +
+                             std::to_string(head_size) + " and rotary dim " + std::to_string(rotary_dim));
+  if (!factors.empty() && factors.size() != rotary_dim / 2)
+    throw std::runtime_error("rotary_embedding factors has " + std::to_string(factors.size()) + " values, expected one per rotated pair (" +
+                             std::to_string(rotary_dim / 2) + ")");
+  if (shift == 0)
+    return;
+
+  // Rotating back by shift positions is a rotation by -shift * frequency for each pair
+  const size_t pair_count = rotary_dim / 2;
+  std::vector<float> cos_values(pair_count), sin_values(pair_count);
+  for (size_t i = 0; i < pair_count; i++) {
+    double frequency = std::pow(static_cast<double>(theta), -2.0 * static_cast<double>(i) / static_cast<double>(rotary_dim));
+    if (!factors.empty())
+      frequency /= static_cast<double>(factors[i]);
+    const double angle = -static_cast<double>(shift) * frequency;
+    cos_values[i] = static_cast<float>(std::cos(angle));
+    sin_values[i] = static_cast<float>(std::sin(angle));
+  }
+
+  const size_t first_stride = interleaved ? 2 : 1;
+  const size_t second_offset = interleaved ? 1 : pair_count;
+  for (size_t row = 0; row < keys.size(); row += head_size) {
+    float* values = keys.data() + row;
+    for (size_t i = 0; i < pair_count; i++) {
+      float& x = values[i * first_stride];
+      float& y = values[i * first_stride + second_offset];
+      const float rotated_x = x * cos_values[i] - y * sin_values[i];
+      y = x * sin_values[i] + y * cos_values[i];
+      x = rotated_x;
+    }
+  }
+}
+
+size_t RopeFactorSwitchLength(std::string_view model_type) {
+  if (model_type == "phi3" || model_type == "phimoe")
+    return 4096;
+  if (model_type == "phi3small")
+    return 8192;
+  return std::numeric_limits<size_t>::max();
+}
+
+void CheckAttentionSinkSupport(std::string_view model_type, bool has_rotary_embedding, size_t max_length) {
+  if (model_type == "gpt2")
+    return;  // Learned position embeddings, the keys don't depend on their position
+
+  if (model_type == "gemma3" || model_type == "gemma3_text")
+    throw std::runtime_error("attention_sink_size isn't supported for " + std::string{model_type} +
+                             ", whose local and global layers rotate keys with different rope_theta");
+  if (max_length > RopeFactorSwitchLength(model_type))
+    throw std::runtime_error("attention_sink_size needs max_length of at most " + std::to_string(RopeFactorSwitchLength(model_type)) +
+                             " for " + std::string{model_type} + ", which switches rope factors after that length");
+  if (!has_rotary_embedding)
+    throw std::runtime_error("attention_sink_size needs decoder.rotary_embedding in genai_config.json for " + std::string{model_type} +
+                             " models, to move the kept keys to their new positions");
+}
+
+}  // namespace Generators
@@ -0,0 +1,35 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "../span.h"
+
+namespace Generators {
+
+// Cached keys already carry the rotary embedding of their position. When an attention sink cache evicts positions,
+// the keys after them move down by `shift` slots and have to be rotated back by as many positions to match the
+// position ids the moved keys get from then on. Rotations compose, so this is one rotation per channel pair, the
+// same for every position.
+//
+// keys holds whole rows of head_size values. rotary_dim leading channels of each row are rotated (0 = head_size),
+// paired as the two halves of rotary_dim, or as adjacent channels when interleaved. Pair i rotates with frequency
+// theta^(-2i/rotary_dim) / factors[i]; factors is empty for plain RoPE or has one value per pair (LongRoPE, YaRN and
+// Llama 3 rope scaling change the frequencies this way).
+void ShiftRotaryPositions(std::span<float> keys, size_t head_size, size_t rotary_dim, float theta, bool interleaved,
+                          int64_t shift, std::span<const float> factors = {});
+
+// Phi3 models switch from the short to the long rope factor once the sequence is longer than this, so key/values
+// computed on either side of it can't be mixed
+size_t RopeFactorSwitchLength(std::string_view model_type);
+
+// Throws unless the keys an attention sink cache keeps can be moved to new positions for model_type. Models with
+// learned position embeddings (gpt2) need nothing, the others need decoder.rotary_embedding. Models whose rotation
+// differs between layers (gemma3) or changes within max_length (LongRoPE phi3) can't be described by it.
+void CheckAttentionSinkSupport(std::string_view model_type, bool has_rotary_embedding, size_t max_length);
+
+}  // namespace Generators
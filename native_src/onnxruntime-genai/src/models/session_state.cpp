@@ -0,0 +1,193 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "../generators.h"
+#include "session_state.h"
+
+#include <cstdio>
+
+namespace Generators {
+
+namespace {
+
+constexpr char kMagic[8] = {'O', 'G', 'A', 'S', 'T', 'A', 'T', 'E'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;    // kByteOrderMark as the writer stored it
+  uint32_t element_type;  // ONNXTensorElementDataType of the key/value tensors, uint8 when quantized
+  uint32_t quantization;  // KvQuantization
+  uint64_t token_count;
+  uint64_t evicted_tokens;
+  uint64_t random_state_bytes;
+  uint64_t tensor_count;      // Key and value per layer, 0 when no key/values were saved
+  uint64_t key_value_length;  // The tensors are [1, head_count, key_value_length, head_size]
+  uint64_t head_count;
+  uint64_t head_size;
+};
+
+size_t Padding(size_t offset) {
+  return (kSessionStateAlignment - offset % kSessionStateAlignment) % kSessionStateAlignment;
+}
+
+struct Writer {
+  std::ofstream& stream;
+  size_t offset{};
+
+  void Write(const void* data, size_t bytes) {
+    stream.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+    offset += bytes;
+  }
+
+  void Align() {
+    static constexpr char zeros[kSessionStateAlignment]{};
+    Write(zeros, Padding(offset));
+  }
+
+  void WriteTensor(DeviceInterface& device, OrtValue& tensor) {
+    Align();
+    auto bytes = ByteWrapTensor(device, tensor).CopyDeviceToCpu();
+    Write(bytes.data(), bytes.size());
+  }
+};
+
+struct Reader {
+  std::ifstream& stream;
+  const std::string& path;
+  size_t offset{};
+
+  void Read(void* data, size_t bytes) {
+    if (!stream.read(static_cast<char*>(data), static_cast<std::streamsize>(bytes)))
+      throw std::runtime_error("The session state file " + path + " is truncated");
+    offset += bytes;
+  }
+
+  void Align() {
+    const size_t padding = Padding(offset);
+    stream.ignore(static_cast<std::streamsize>(padding));
+    offset += padding;
+  }
+
+  // Reads straight into the tensor when it lives on the CPU
+  std::unique_ptr<OrtValue> ReadTensor(DeviceInterface& device, std::span<const int64_t> shape, ONNXTensorElementDataType type) {
+    auto tensor = OrtValue::CreateTensor(device.GetAllocator(), shape, type);
+    auto bytes = ByteWrapTensor(device, *tensor);
+    Align();
+    Read(bytes.CpuSpan().data(), bytes.size());
+    bytes.CopyCpuToDevice();
+    return tensor;
+  }
+};
+
+}  // namespace
+
+void WriteSessionState(const std::string& path, const SessionState& state, DeviceInterface& device) {
+  Header header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byte_order = kByteOrderMark;
+  header.token_count = state.tokens.size();
+  header.evicted_tokens = state.evicted_tokens;
+  header.random_state_bytes = state.random_state.size();
+
+  const KeyValuePrefix* key_values = state.key_values.get();
+  if (key_values) {
+    auto info = key_values->tensors.front()->GetTensorTypeAndShapeInfo();
+    const auto shape = info->GetShape();
+    if (shape[2] != static_cast<int64_t>(key_values->length))
+      throw std::runtime_error("WriteSessionState: the key/value tensors hold more positions than their length");
+    header.element_type = static_cast<uint32_t>(info->GetElementType());
+    header.quantization = static_cast<uint32_t>(key_values->quantization);
+    header.tensor_count = key_values->tensors.size();
+    header.key_value_length = key_values->length;
+    header.head_count = static_cast<uint64_t>(shape[1]);
+    header.head_size = static_cast<uint64_t>(shape[3]);
+  }
+
+  const std::string temp_path = path + ".tmp";
+  {
+    auto stream = fs::path{temp_path}.open_for_write(std::ios::binary | std::ios::trunc);
+    if (!stream)
+      throw std::runtime_error("Could not open " + temp_path + " for writing");
+
+    Writer writer{stream};
+    writer.Write(&header, sizeof(header));
+    writer.Align();
+    writer.Write(state.tokens.data(), state.tokens.size() * sizeof(int32_t));
+    writer.Align();
+    writer.Write(state.random_state.data(), state.random_state.size());
+    if (key_values) {
+      const bool quantized = key_values->quantization != KvQuantization::None;
+      for (size_t i = 0; i < key_values->tensors.size(); i++) {
+        writer.WriteTensor(device, *key_values->tensors[i]);
+        if (quantized)
+          writer.WriteTensor(device, *key_values->scales[i]);
+      }
+    }
+
+    stream.flush();
+    if (!stream)
+      throw std::runtime_error("Could not write the session state to " + temp_path);
+  }
+
+#ifdef _WIN32
+  if (!MoveFileExW(fs::path{temp_path}.c_str(), fs::path{path}.c_str(), MOVEFILE_REPLACE_EXISTING))
+#else
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+#endif
+    throw std::runtime_error("Could not replace " + path + " with the new session state");
+}
+
+SessionState ReadSessionState(const std::string& path, DeviceInterface& device) {
+  auto stream = fs::path{path}.open(std::ios::binary);
+  if (!stream)
+    throw std::runtime_error("Could not open the session state file " + path);
+
+  Reader reader{stream, path};
+  Header header;
+  reader.Read(&header, sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0)
+    throw std::runtime_error(path + " is not a session state file");
+  if (header.byte_order != kByteOrderMark)
+    throw std::runtime_error("The session state file " + path + " was written on a machine with a different byte order");
+  if (header.version != kVersion)
+    throw std::runtime_error("The session state file " + path + " has version " + std::to_string(header.version) +
+                             ", expected " + std::to_string(kVersion));
+
+  SessionState state;
+  state.tokens.resize(header.token_count);
+  state.evicted_tokens = header.evicted_tokens;
+  state.random_state.resize(header.random_state_bytes);
+  reader.Align();
+  reader.Read(state.tokens.data(), state.tokens.size() * sizeof(int32_t));
+  reader.Align();
+  reader.Read(state.random_state.data(), state.random_state.size());
+
+  if (header.tensor_count == 0)
+    return state;
+
+  auto key_values = std::make_unique<KeyValuePrefix>();
+  key_values->length = header.key_value_length;
+  key_values->quantization = static_cast<KvQuantization>(header.quantization);
+  const bool quantized = key_values->quantization != KvQuantization::None;
+  const auto element_type = static_cast<ONNXTensorElementDataType>(header.element_type);
+  const std::array<int64_t, 4> shape{1, static_cast<int64_t>(header.head_count), static_cast<int64_t>(header.key_value_length),
+                                     static_cast<int64_t>(header.head_size)};
+  const std::array<int64_t, 3> scales_shape{1, shape[1], shape[2]};
+
+  for (uint64_t i = 0; i < header.tensor_count; i++) {
+    key_values->tensors.push_back(reader.ReadTensor(device, shape, element_type));
+    key_values->bytes += header.head_count * header.key_value_length * header.head_size * Ort::SizeOf(element_type);
+    if (quantized) {
+      key_values->scales.push_back(reader.ReadTensor(device, scales_shape, Ort::TypeToTensorType<float>));
+      key_values->bytes += header.head_count * header.key_value_length * sizeof(float);
+    }
+  }
+  state.key_values = std::move(key_values);
+  return state;
+}
+
+}  // namespace Generators
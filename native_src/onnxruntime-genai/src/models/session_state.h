@@ -0,0 +1,36 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "prefix_cache.h"
+
+namespace Generators {
+
+struct DeviceInterface;
+
+// What Generator::SaveState writes and Generator::LoadState continues from: the sequence and search state, and the
+// key/values of its first tokens so that restoring doesn't run the model over them again
+struct SessionState {
+  std::vector<int32_t> tokens;
+  size_t evicted_tokens{};                     // Generator::evicted_tokens_
+  std::string random_state;                    // Search::GetRandomState(), empty if the search has none
+  std::unique_ptr<KeyValuePrefix> key_values;  // Of the first key_values->length tokens, nullptr if none were saved
+};
+
+// The file is a fixed size header followed by the tokens, the random state and every key/value tensor (then its
+// scales when quantized), each starting at a multiple of kSessionStateAlignment so it can be memory mapped. Values are
+// in the byte order of the machine that wrote them, which reading checks. The key/value tensors have the layout
+// KeyValuePrefix holds them in with capacity == length, and live on device.
+constexpr size_t kSessionStateAlignment = 64;
+
+// Writes to path + ".tmp" first and renames it over path, so an interrupted save leaves an earlier file intact
+void WriteSessionState(const std::string& path, const SessionState& state, DeviceInterface& device);
+SessionState ReadSessionState(const std::string& path, DeviceInterface& device);
+
+}  // namespace Generators
@@ -3,20 +3,105 @@
 
 #include "threadpool.h"
 
+#include <utility>
+
 namespace Generators {
 
-ThreadPool::ThreadPool(size_t num_threads) : num_threads_{num_threads} {}
+ThreadPool::ThreadPool(size_t num_threads) {
+  if (num_threads > 1) {
+    workers_.reserve(num_threads - 1);
+    for (size_t i = 0; i < num_threads - 1; ++i) {
+      workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::scoped_lock l{mutex_};
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::Compute(size_t count, const std::function<void(size_t)>& func) {
+  if (count == 0) {
+    return;
+  }
+
+  // Nothing to share, run inline rather than paying for a wake up
+  if (workers_.empty() || count == 1) {
+    for (size_t i = 0; i < count; ++i) {
+      func(i);
+    }
+    return;
+  }
+
+  std::scoped_lock compute_lock{compute_mutex_};
+  {
+    std::scoped_lock l{mutex_};
+    func_ = &func;
+    count_ = count;
+    next_item_ = 0;
+    error_ = nullptr;
+    active_workers_ = workers_.size();
+    ++generation_;
+  }
+  work_cv_.notify_all();
 
-void ThreadPool::Compute(const std::function<void(size_t)>& func) {
-  for (size_t i = 0; i < num_threads_; ++i) {
-    threads_.emplace_back([&, i] { func(i); });
+  RunItems();
+
+  std::exception_ptr error;
+  {
+    std::unique_lock l{mutex_};
+    done_cv_.wait(l, [this] { return active_workers_ == 0; });
+    func_ = nullptr;
+    error = std::exchange(error_, nullptr);
   }
 
-  for (auto& thread : threads_) {
-    thread.join();
+  if (error) {
+    std::rethrow_exception(error);
   }
+}
+
+void ThreadPool::WorkerLoop() {
+  size_t seen_generation = 0;
+  while (true) {
+    {
+      std::unique_lock l{mutex_};
+      work_cv_.wait(l, [&] { return stop_ || generation_ != seen_generation; });
+      if (stop_) {
+        return;
+      }
+      seen_generation = generation_;
+    }
 
-  threads_.clear();
+    RunItems();
+
+    {
+      std::scoped_lock l{mutex_};
+      if (--active_workers_ == 0) {
+        done_cv_.notify_one();
+      }
+    }
+  }
+}
+
+void ThreadPool::RunItems() {
+  for (size_t i = next_item_.fetch_add(1); i < count_; i = next_item_.fetch_add(1)) {
+    try {
+      (*func_)(i);
+    } catch (...) {
+      std::scoped_lock l{mutex_};
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+  }
 }
 
-}  // namespace Generators
\ No newline at end of file
+}  // namespace Generators
@@ -1,20 +1,51 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
 #include <functional>
+#include <mutex>
 #include <vector>
 #include <thread>
 
 namespace Generators {
 
+// A fixed set of worker threads that live as long as the pool, so parallel loops on the hot path
+// (e.g. per-layer key-value cache updates every decode step) don't create and join OS threads per call.
 struct ThreadPool {
-  ThreadPool(size_t num_threads);
+  // Starts num_threads - 1 workers; the thread calling Compute() takes part as the last one.
+  explicit ThreadPool(size_t num_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t NumThreads() const { return workers_.size() + 1; }
 
-  void Compute(const std::function<void(size_t)>& func);
+  // Calls func(i) for every i in [0, count) and returns once all calls have finished.
+  // Items are claimed one at a time, so threads that finish early pick up the remaining ones.
+  // The first exception thrown by func is rethrown here. Concurrent calls are serialized.
+  void Compute(size_t count, const std::function<void(size_t)>& func);
 
  private:
-  size_t num_threads_;
-  std::vector<std::thread> threads_;
+  void WorkerLoop();
+  void RunItems();
+
+  std::vector<std::thread> workers_;
+
+  std::mutex compute_mutex_;  // Held for the duration of a Compute() call
+  std::mutex mutex_;          // Guards the state below
+  std::condition_variable work_cv_, done_cv_;
+  const std::function<void(size_t)>* func_{};
+  size_t count_{};
+  std::atomic<size_t> next_item_{};
+  size_t generation_{};     // Incremented by each Compute() to wake the workers
+  size_t active_workers_{};  // Workers still running items of the current generation
+  bool stop_{};
+  std::exception_ptr error_;
 };
 
 }  // namespace Generators
@@ -0,0 +1,73 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "ngram_index.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Generators {
+
+namespace {
+
+// FNV-1a over the tokens from the last one backwards, so the hashes of all n-grams ending at a position come out of
+// one pass
+constexpr uint64_t kHashBasis = 14695981039346656037ull;
+
+uint64_t HashStep(uint64_t hash, int32_t token) {
+  return (hash ^ static_cast<uint32_t>(token)) * 1099511628211ull;
+}
+
+}  // namespace
+
+NgramIndex::NgramIndex(size_t max_ngram_size) : max_ngram_size_{max_ngram_size}, starts_(max_ngram_size) {
+  if (max_ngram_size == 0)
+    throw std::runtime_error("NgramIndex max_ngram_size must be 1 or greater");
+}
+
+uint64_t NgramIndex::Hash(size_t end, size_t ngram_size) const {
+  uint64_t hash = kHashBasis;
+  for (size_t i = 0; i < ngram_size; i++)
+    hash = HashStep(hash, tokens_[end - 1 - i]);
+  return hash;
+}
+
+void NgramIndex::Update(std::span<const int32_t> sequence) {
+  if (sequence.size() < tokens_.size() || !std::equal(tokens_.begin(), tokens_.end(), sequence.begin())) {
+    tokens_.clear();
+    for (auto& starts : starts_)
+      starts.clear();
+  }
+
+  // An n-gram is indexed once the token after it arrives
+  size_t position = tokens_.size();
+  tokens_.insert(tokens_.end(), sequence.begin() + position, sequence.end());
+  for (position = std::max<size_t>(position, 1); position < tokens_.size(); position++) {
+    uint64_t hash = kHashBasis;
+    for (size_t ngram_size = 1; ngram_size <= std::min(max_ngram_size_, position); ngram_size++) {
+      hash = HashStep(hash, tokens_[position - ngram_size]);
+      starts_[ngram_size - 1][hash] = position - ngram_size;
+    }
+  }
+}
+
+std::vector<int32_t> NgramIndex::Propose(size_t count) const {
+  const size_t length = tokens_.size();
+  for (size_t ngram_size = std::min(max_ngram_size_, length); ngram_size > 0; ngram_size--) {
+    const auto& starts = starts_[ngram_size - 1];
+    auto found = starts.find(Hash(length, ngram_size));
+    if (found == starts.end())
+      continue;
+
+    const size_t start = found->second;
+    if (!std::equal(tokens_.begin() + start, tokens_.begin() + start + ngram_size, tokens_.end() - ngram_size))
+      continue;  // Hash collision
+
+    const size_t begin = start + ngram_size;
+    const size_t end = std::min(length, begin + count);
+    return std::vector<int32_t>(tokens_.begin() + begin, tokens_.begin() + end);
+  }
+  return {};
+}
+
+}  // namespace Generators
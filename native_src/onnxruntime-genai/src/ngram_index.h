@@ -0,0 +1,38 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "span.h"
+
+namespace Generators {
+
+// Where each n-gram of a token sequence last occurred, for prompt lookup speculative decoding: when the end of the
+// sequence repeats an earlier n-gram, the tokens that followed it are a free guess at what comes next. Summaries,
+// code edits and answers quoting the prompt copy long spans, so the guess is often right.
+struct NgramIndex {
+  explicit NgramIndex(size_t max_ngram_size);
+
+  // Indexes the tokens added to the sequence since the last call. If the sequence no longer starts with the indexed
+  // tokens (it was rewound), it's indexed again from the start.
+  void Update(std::span<const int32_t> sequence);
+
+  // Up to count tokens that followed the latest earlier occurrence of the longest n-gram (of at most max_ngram_size
+  // tokens) ending the indexed sequence. Empty when there is none.
+  std::vector<int32_t> Propose(size_t count) const;
+
+ private:
+  uint64_t Hash(size_t end, size_t ngram_size) const;  // Of the ngram_size tokens before end
+
+  size_t max_ngram_size_;
+  std::vector<int32_t> tokens_;
+  // Per n-gram size - 1: hash of the n-gram -> start of its latest occurrence that has a token after it
+  std::vector<std::unordered_map<uint64_t, size_t>> starts_;
+};
+
+}  // namespace Generators
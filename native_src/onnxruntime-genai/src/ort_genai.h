@@ -503,6 +503,24 @@ struct OgaGenerator : OgaAbstract {
     return OgaGenerator_GetSequenceData(this, index);
   }
 
+  void GetSpeculativeDecodingStats(size_t& proposed, size_t& accepted) const {
+    OgaCheckResult(OgaGenerator_GetSpeculativeDecodingStats(this, &proposed, &accepted));
+  }
+
+  size_t GetEvictedTokenCount() const {
+    size_t evicted;
+    OgaCheckResult(OgaGenerator_GetEvictedTokenCount(this, &evicted));
+    return evicted;
+  }
+
+  void SaveState(const char* path) {
+    OgaCheckResult(OgaGenerator_SaveState(this, path));
+  }
+
+  void LoadState(const char* path) {
+    OgaCheckResult(OgaGenerator_LoadState(this, path));
+  }
+
   std::unique_ptr<OgaTensor> GetInput(const char* name) {
     OgaTensor* out;
     OgaCheckResult(OgaGenerator_GetInput(this, name, &out));
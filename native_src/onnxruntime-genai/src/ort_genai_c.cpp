@@ -359,6 +359,13 @@ OgaResult* OGA_API_CALL OgaModelGetDeviceType(const OgaModel* model, const char*
   OGA_CATCH
 }
 
+OgaResult* OGA_API_CALL OgaModelReleaseIdleSessions(const OgaModel* model, size_t* out) {
+  OGA_TRY
+  *out = model->ReleaseIdleSessions();
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaCreateGeneratorParams(const OgaModel* model, OgaGeneratorParams** out) {
   OGA_TRY
   auto params = std::make_shared<Generators::GeneratorParams>(*model);
@@ -573,6 +580,35 @@ const int32_t* OGA_API_CALL OgaGenerator_GetSequenceData(const OgaGenerator* gen
   return generator->GetSequence(static_cast<int>(index)).CopyDeviceToCpu().data();
 }
 
+OgaResult* OGA_API_CALL OgaGenerator_GetSpeculativeDecodingStats(const OgaGenerator* generator, size_t* proposed, size_t* accepted) {
+  OGA_TRY
+  *proposed = generator->draft_tokens_proposed_;
+  *accepted = generator->draft_tokens_accepted_;
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGenerator_GetEvictedTokenCount(const OgaGenerator* generator, size_t* evicted) {
+  OGA_TRY
+  *evicted = generator->evicted_tokens_;
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGenerator_SaveState(OgaGenerator* generator, const char* path) {
+  OGA_TRY
+  generator->SaveState(path);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGenerator_LoadState(OgaGenerator* generator, const char* path) {
+  OGA_TRY
+  generator->LoadState(path);
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaCreateTokenizer(const OgaModel* model, OgaTokenizer** out) {
   OGA_TRY
   auto tokenizer = model->CreateTokenizer();
@@ -385,6 +385,15 @@ OGA_EXPORT OgaResult* OGA_API_CALL OgaModelGetType(const OgaModel* model, const
  */
 OGA_EXPORT OgaResult* OGA_API_CALL OgaModelGetDeviceType(const OgaModel* model, const char** out);
 
+/**
+ * \brief Releases the sessions of the model that are created again when needed and that no generator is using, like
+ *        the vision and speech encoders of multimodal models with model.lazy_encoder_sessions set.
+ * \param[in] model The model to release the sessions of.
+ * \param[out] out The number of sessions released.
+ * \return OgaResult containing the error message if the releasing of the sessions failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaModelReleaseIdleSessions(const OgaModel* model, size_t* out);
+
 /**
  * \brief Destroys the given config
  * \param[in] config The config to be destroyed.
@@ -566,6 +575,47 @@ OGA_EXPORT size_t OGA_API_CALL OgaGenerator_GetSequenceCount(const OgaGenerator*
  */
 OGA_EXPORT const int32_t* OGA_API_CALL OgaGenerator_GetSequenceData(const OgaGenerator* generator, size_t index);
 
+/**
+ * \brief Returns how many draft model tokens the generator proposed and how many of them it accepted when the
+ *        model's genai_config.json sets search.draft_model. Both are 0 when speculative decoding isn't used.
+ * \param[in] generator The generator to get the statistics of.
+ * \param[out] proposed The number of draft tokens the model verified.
+ * \param[out] accepted The number of draft tokens that matched the model's own choices.
+ * \return OgaResult containing the error message if getting the statistics failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GetSpeculativeDecodingStats(const OgaGenerator* generator, size_t* proposed, size_t* accepted);
+
+/**
+ * \brief Returns how many tokens the generator evicted from the middle of its sequence when search.attention_sink_size
+ *        is set. Sequence index i past the attention sinks holds token i + evicted of everything appended and generated.
+ *        Rewinding to a length within the attention sinks resets it to 0.
+ * \param[in] generator The generator to get the count of.
+ * \param[out] evicted The number of evicted tokens.
+ * \return OgaResult containing the error message if getting the count failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GetEvictedTokenCount(const OgaGenerator* generator, size_t* evicted);
+
+/**
+ * \brief Saves the generator's sequence, its random number generator state and the key/values of its processed
+ *        tokens to a file, so that OgaGenerator_LoadState can continue from it later or in another process. The file
+ *        is written next to path first and then renamed over it. Only batch_size 1 without guidance is supported.
+ * \param[in] generator The generator to save.
+ * \param[in] path The file to write.
+ * \return OgaResult containing the error message if saving failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_SaveState(OgaGenerator* generator, const char* path);
+
+/**
+ * \brief Continues from a file written by OgaGenerator_SaveState, in a generator of the same model without tokens.
+ *        The model only runs over the tokens without saved key/values, which is at least the last one, so the
+ *        generator has logits afterwards just like after OgaGenerator_AppendTokens. Key/values that don't fit the
+ *        generator's cache are recomputed from the tokens.
+ * \param[in] generator The generator to restore into.
+ * \param[in] path The file to read.
+ * \return OgaResult containing the error message if loading failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_LoadState(OgaGenerator* generator, const char* path);
+
 OGA_EXPORT OgaResult* OGA_API_CALL OgaCreateTokenizer(const OgaModel* model, OgaTokenizer** out);
 OGA_EXPORT void OGA_API_CALL OgaDestroyTokenizer(OgaTokenizer*);
 
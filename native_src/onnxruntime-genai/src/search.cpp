@@ -6,7 +6,7 @@
 #include <queue>
 #include <algorithm>
 #include <limits>
-#include <unordered_set>
+#include <sstream>
 
 namespace Generators {
 
@@ -19,7 +19,8 @@ Search_Cpu::Search_Cpu(const GeneratorParams& params)
 }
 
 GreedySearch_Cpu::GreedySearch_Cpu(const GeneratorParams& params)
-    : Search_Cpu(params) {
+    : Search_Cpu(params),
+      sampling_data_{params.config.model.vocab_size} {
   if (params_->search.random_seed != -1)
     gen_.seed(params_->search.random_seed);
   else {
@@ -55,7 +56,10 @@ DeviceSpan<float> Search_Cpu::GetLogits() const {
 
 void Search_Cpu::SetLogits(DeviceSpan<float> logits) {
   next_token_scores_ = logits;
-  next_token_scores_.CopyDeviceToCpu();  // To the device->cpu copy once here as all later calls use CpuSpan()
+  // To the device->cpu copy once here as all later calls use CpuSpan(). Float16 logits stay unconverted, greedy search
+  // and top-k sampling pick from them directly, and anything else converts them on its first CpuSpan().
+  if (next_token_scores_.PendingFloat16().empty())
+    next_token_scores_.CopyDeviceToCpu();
 }
 
 DeviceSpan<int32_t> GreedySearch_Cpu::GetNextTokens() {
@@ -144,12 +148,20 @@ void BeamSearch_Cpu::SelectTop() {
 }
 
 void GreedySearch_Cpu::SelectTop() {
+  const size_t vocab_size = params_->config.model.vocab_size;
+  const auto float16_scores = next_token_scores_.PendingFloat16();
+
   // next_tokens = torch.argmax(scores, dim=-1)
   for (size_t batch_id = 0; batch_id < params_->search.batch_size; batch_id++) {
     if (PadIfAlreadyEOS(batch_id)) {
       continue;
     }
 
+    if (!float16_scores.empty()) {
+      SetNextToken(batch_id, static_cast<int32_t>(cpu::ArgMaxFloat16(float16_scores.subspan(batch_id * vocab_size, vocab_size))));
+      continue;
+    }
+
     std::span<float> const scores = next_token_scores_.CpuSpan().subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
     auto const token = static_cast<int32_t>(std::distance(scores.begin(), std::max_element(scores.begin(), scores.end())));
     SetNextToken(batch_id, token);
@@ -160,22 +172,18 @@ void GreedySearch_Cpu::SelectTop() {
 }
 
 void GreedySearch_Cpu::SampleTopK(int k, float temperature) {
+  const size_t vocab_size = params_->config.model.vocab_size;
+  const auto float16_scores = next_token_scores_.PendingFloat16();
   for (size_t batch_id = 0; batch_id < params_->search.batch_size; batch_id++) {
     if (PadIfAlreadyEOS(batch_id)) {
       continue;
     }
+    if (!float16_scores.empty()) {
+      SetNextToken(batch_id, sampling_data_.SampleTopK(float16_scores.subspan(batch_id * vocab_size, vocab_size), k, temperature, gen_));
+      continue;
+    }
     std::span<float> const scores = next_token_scores_.CpuSpan().subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
-    // Find the top K scores
-    std::vector<int> indices(scores.size());
-    std::iota(indices.begin(), indices.end(), 0);
-    std::partial_sort(indices.begin(), indices.begin() + k, indices.end(), [scores = scores.data()](int i, int j) { return scores[i] > scores[j]; });
-    std::vector<float> top_k_scores(k);
-    for (int i = 0; i < k; i++)
-      top_k_scores[i] = scores[indices[i]];
-    // Sample a token from the top K
-    Softmax(top_k_scores, temperature);
-    std::discrete_distribution<> dis(top_k_scores.begin(), top_k_scores.end());
-    SetNextToken(batch_id, indices[dis(gen_)]);
+    SetNextToken(batch_id, sampling_data_.SampleTopK(scores, k, temperature, gen_));
   }
   if (!done_)
     AppendNextTokensToSequences();
@@ -186,35 +194,8 @@ void GreedySearch_Cpu::SampleTopP(float p, float temperature) {
     if (PadIfAlreadyEOS(batch_id)) {
       continue;
     }
-
-    std::span<float> scores = next_token_scores_.CpuSpan().subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
-
-    // 1. Apply temperature and softmax to get probabilities
-    Softmax(scores, temperature);
-
-    // 2. Sort indices by probability
-    std::vector<int32_t> indices(scores.size());
-    std::iota(indices.begin(), indices.end(), 0);
-    std::sort(indices.begin(), indices.end(),
-              [&scores](int32_t i, int32_t j) { return scores[i] > scores[j]; });
-
-    // 3. Find nucleus and mute probabilities of tokens outside it
-    float cumulative_prob = 0.0f;
-    for (size_t i = 0; i < indices.size(); ++i) {
-      cumulative_prob += scores[indices[i]];
-      if (cumulative_prob >= p) {
-        for (size_t j = i + 1; j < indices.size(); ++j) {
-          scores[indices[j]] = 0.0f;
-        }
-        break;
-      }
-    }
-
-    // 4. Sample
-    std::discrete_distribution<> dist(scores.begin(), scores.end());
-    int32_t token = dist(gen_);
-
-    SetNextToken(batch_id, token);
+    std::span<float> const scores = next_token_scores_.CpuSpan().subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
+    SetNextToken(batch_id, sampling_data_.SampleTopP(scores, p, temperature, gen_));
   }
   if (!done_)
     AppendNextTokensToSequences();
@@ -222,60 +203,42 @@ void GreedySearch_Cpu::SampleTopP(float p, float temperature) {
 
 void GreedySearch_Cpu::SampleTopKTopP(int k, float p, float temperature) {
   assert(temperature > 0.0f);
-
-  // --- Buffers allocated once to avoid re-allocations in the batch loop ---
-  std::vector<int32_t> indices(params_->config.model.vocab_size);
-
-  // Buffer for the top-k logits
-  std::vector<float> top_k_logits;
-  top_k_logits.reserve(k);
-
-  // Buffer for probabilities used in Top-P filtering
-  std::vector<float> temp_probs;
-  temp_probs.reserve(k);
-
+  const size_t vocab_size = params_->config.model.vocab_size;
+  const auto float16_scores = next_token_scores_.PendingFloat16();
   for (size_t batch_id = 0; batch_id < params_->search.batch_size; batch_id++) {
     if (PadIfAlreadyEOS(batch_id)) {
       continue;
     }
-
-    std::span<float> scores = next_token_scores_.CpuSpan().subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
-
-    std::iota(indices.begin(), indices.end(), 0);
-    std::partial_sort(indices.begin(), indices.begin() + k, indices.end(),
-                      [&scores](int32_t i, int32_t j) { return scores[i] > scores[j]; });
-
-    // 2. Populate top K logits, applying temperature.
-    top_k_logits.clear();
-    for (int i = 0; i < k; ++i) {
-      top_k_logits.push_back(scores[indices[i]] / temperature);
-    }
-
-    // 3. Top-p (nucleus) filtering.
-    temp_probs.assign(top_k_logits.begin(), top_k_logits.end());
-    Softmax(temp_probs, 1.0f);  // Temperature is already baked into top_k_logits
-
-    float cumulative_prob = 0.0f;
-    int cutoff_index = k;  // Default to keeping all top-k tokens
-    for (int i = 0; i < k; ++i) {
-      cumulative_prob += temp_probs[i];
-      if (cumulative_prob >= p) {
-        cutoff_index = i + 1;
-        break;
-      }
+    if (!float16_scores.empty()) {
+      SetNextToken(batch_id, sampling_data_.SampleTopKTopP(float16_scores.subspan(batch_id * vocab_size, vocab_size), k, p, temperature, gen_));
+      continue;
     }
+    std::span<float> const scores = next_token_scores_.CpuSpan().subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
+    SetNextToken(batch_id, sampling_data_.SampleTopKTopP(scores, k, p, temperature, gen_));
+  }
+  if (!done_)
+    AppendNextTokensToSequences();
+}
 
-    // 4. Resize logits to the nucleus, re-normalize, and sample.
-    top_k_logits.resize(cutoff_index);
-    Softmax(top_k_logits, 1.0f);
+std::string GreedySearch_Cpu::GetRandomState() const {
+  std::ostringstream stream;
+  stream << gen_;
+  return stream.str();
+}
 
-    std::discrete_distribution<> dist(top_k_logits.begin(), top_k_logits.end());
-    int32_t sampled_k_index = dist(gen_);
+void GreedySearch_Cpu::SetRandomState(const std::string& state) {
+  if (state.empty())
+    return;
+  std::istringstream stream{state};
+  stream >> gen_;
+  if (!stream)
+    throw std::runtime_error("Invalid random engine state");
+}
 
-    // The final token is the one from the original vocab indices.
-    int32_t token = indices[sampled_k_index];
-    SetNextToken(batch_id, token);
-  }
+void GreedySearch_Cpu::SelectToken(int32_t token) {
+  assert(params_->BatchBeamSize() == 1);
+  if (!PadIfAlreadyEOS(0))
+    SetNextToken(0, token);
   if (!done_)
     AppendNextTokensToSequences();
 }
@@ -310,12 +273,15 @@ void GreedySearch_Cpu::AppendNextTokensToSequences() {
   auto batch_beam_size = params_->BatchBeamSize();
   for (int i = 0; i < batch_beam_size; i++) {
     sequences_span[i * sequences_.max_length_ + current_length] = next_tokens[i];
+    if (!token_counts_.empty())
+      token_counts_[i].Add(next_tokens[i]);
   }
   sequences_.GetSequences().CopyCpuToDevice();
 
   sequences_.AfterAppendNextTokens(next_tokens_ptr_, batch_beam_size);
 
-  if (sequences_.GetSequenceLength() == params_->search.max_length) {
+  // With attention sinks the generator evicts tokens to make room instead
+  if (sequences_.GetSequenceLength() == params_->search.max_length && params_->search.attention_sink_size == 0) {
     if (g_log.enabled && g_log.hit_max_length)
       Log("hit_max_length", "greedy cpu hit");
     done_ = true;
@@ -350,9 +316,22 @@ void GreedySearch_Cpu::RewindTo(size_t index) {
     }
   } else
     memset(next_tokens_.data(), 0, next_tokens_.size_bytes());
+  const size_t length = static_cast<size_t>(sequences_.GetSequenceLength());
+  if (!token_counts_.empty() && index < length) {
+    for (int i = 0; i < params_->BatchBeamSize(); i++)
+      token_counts_[i].Remove(sequences_.GetSequences().Span().subspan(i * sequences_.max_length_ + index, length - index));
+  }
   sequences_.RewindTo(index);
 }
 
+void GreedySearch_Cpu::Evict(size_t start, size_t count) {
+  if (!token_counts_.empty()) {
+    for (int i = 0; i < params_->BatchBeamSize(); i++)
+      token_counts_[i].Remove(sequences_.GetSequences().Span().subspan(i * sequences_.max_length_ + start, count));
+  }
+  sequences_.Evict(start, count);
+}
+
 void BeamSearch_Cpu::AppendTokens(DeviceSpan<int32_t>& next_tokens) {
   // Set user-defined next tokens
   auto next_tokens_cpu = next_tokens.CpuSpan();
@@ -368,6 +347,8 @@ void BeamSearch_Cpu::AppendTokens(DeviceSpan<int32_t>& next_tokens) {
     std::span<int32_t> target = next_sequences_span.subspan(i * sequences_.max_length_, tokens_count_per_batch);
     std::span<const int32_t> source = next_tokens_cpu.subspan((i / params_->search.num_beams) * tokens_count_per_batch, tokens_count_per_batch);
     copy(source, target);
+    if (!token_counts_.empty())
+      token_counts_[i].Add(source);
   }
   sequences_.AfterAppendNextTokens(next_tokens, params_->search.batch_size);  // next_tokens is not expanded
 }
@@ -399,6 +380,16 @@ void BeamSearch_Cpu::AppendNextTokensToSequences() {
     // Append next token to each beam.
     sequences_next_span[i * max_length + current_length] = batch_beam_next_tokens[i];
   }
+  // Each beam continues the counts of the beam it extends
+  if (!token_counts_.empty()) {
+    std::vector<TokenCounts> next_token_counts(batch_beam_size);
+    for (ptrdiff_t i = 0; i < batch_beam_size; i++) {
+      next_token_counts[i] = token_counts_[batch_beam_indices[i]];
+      next_token_counts[i].Add(batch_beam_next_tokens[i]);
+    }
+    token_counts_ = std::move(next_token_counts);
+  }
+
   auto next_tokens_device = beam_scorer_->GetNextTokens();
   sequences_.GetNextSequences().CopyCpuToDevice();
   sequences_.AfterAppendNextTokens(next_tokens_device, params_->BatchBeamSize());
@@ -447,29 +438,34 @@ void Search_Cpu::ApplyMinLength(int min_length) {
   }
 }
 
+void Search_Cpu::CountTokens() {
+  if (!token_counts_.empty())
+    return;
+
+  const int batch_beam_size = params_->BatchBeamSize();
+  token_counts_.resize(batch_beam_size);
+  for (int i = 0; i < batch_beam_size; i++)
+    token_counts_[i].Add(sequences_.GetSequence(i).CopyDeviceToCpu());
+}
+
 void Search_Cpu::ApplyRepetitionPenalty(float penalty) {
   if (penalty == 1.0f)
     return;
 
+  CountTokens();
   const int batch_beam_size = params_->BatchBeamSize();
-  for (int i = 0; i < batch_beam_size; i++) {
-    std::span<float> const beam_token_scores = GetScores(i);
-    std::span<const int32_t> const sequence = sequences_.GetSequence(i).CopyDeviceToCpu();
-
-    // Find unique word IDs in sequence.
-    std::unordered_set<int32_t> unique_word_ids;
-    for (const auto& word_id : sequence) {
-      unique_word_ids.insert(word_id);
-    }
+  for (int i = 0; i < batch_beam_size; i++)
+    token_counts_[i].ApplyRepetitionPenalty(GetScores(i), penalty);
+}
 
-    for (const int32_t word_id : unique_word_ids) {
-      float const score = beam_token_scores[word_id];
+void Search_Cpu::ApplyFrequencyAndPresencePenalties(float frequency_penalty, float presence_penalty) {
+  if (frequency_penalty == 0.0f && presence_penalty == 0.0f)
+    return;
 
-      // If score < 0, then repetition penalty > 1.0 has to multiplied to reduce the previous token probability,
-      // This assumes that scores are either positive (like ctrl) or negative (like GPT-2), but not a mixture.
-      beam_token_scores[word_id] = (score < 0 ? score * penalty : score / penalty);
-    }
-  }
+  CountTokens();
+  const int batch_beam_size = params_->BatchBeamSize();
+  for (int i = 0; i < batch_beam_size; i++)
+    token_counts_[i].ApplyFrequencyAndPresencePenalties(GetScores(i), frequency_penalty, presence_penalty);
 }
 
 }  // namespace Generators
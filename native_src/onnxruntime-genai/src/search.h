@@ -1,6 +1,8 @@
 #include "sequences.h"
 #include <random>
 #include "beam_search_scorer.h"
+#include "cpu/cpu_sampling.h"
+#include "token_counts.h"
 #pragma once
 
 namespace Generators {
@@ -24,15 +26,27 @@ struct Search : LeakChecked<Search> {
   virtual void SampleTopP(float /*p*/, float /*temperature*/) { assert(false); }
   virtual void SampleTopK(int /*k*/, float /*temperature*/) { assert(false); }
   virtual void SampleTopKTopP(int /*k*/, float /*p*/, float /*temperature*/) { assert(false); }
+  // Speculative decoding: take a verified token as the next token, as if SelectTop had picked it (batch_beam_size 1)
+  virtual void SelectToken(int32_t /*token*/) { assert(false); }
 
   // Scoring features
   virtual void ApplyMinLength(int min_length) = 0;
   virtual void ApplyRepetitionPenalty(float penalty) = 0;
+  virtual void ApplyFrequencyAndPresencePenalties(float frequency_penalty, float presence_penalty) {
+    if (frequency_penalty != 0.0f || presence_penalty != 0.0f)
+      throw std::runtime_error("frequency_penalty and presence_penalty are only supported by the CPU search");
+  }
 
   // Set user input tokens
   virtual void AppendTokens(DeviceSpan<int32_t>& next_tokens) { assert(false); };
   // To be used for rewind
   virtual void RewindTo(size_t index) { assert(false); };
+  // Attention sinks: remove tokens [start, start + count) from the sequence (batch_beam_size 1)
+  virtual void Evict(size_t /*start*/, size_t /*count*/) { assert(false); }
+
+  // Generator::SaveState: the state of the random engine sampling draws from. Empty for searches that can't save it.
+  virtual std::string GetRandomState() const { return {}; }
+  virtual void SetRandomState(const std::string& /*state*/) {}
 
   std::shared_ptr<const GeneratorParams> params_;
   Sequences sequences_;
@@ -49,8 +63,11 @@ struct Search_Cpu : Search {
 
   void ApplyMinLength(int min_length) override;
   void ApplyRepetitionPenalty(float penalty) override;
+  void ApplyFrequencyAndPresencePenalties(float frequency_penalty, float presence_penalty) override;
 
   std::span<float> GetScores(int batch_beam_index);
+  // Counts the tokens of every sequence if token_counts_ is empty
+  void CountTokens();
 
   DeviceInterface& cpu_device_;
 
@@ -60,6 +77,10 @@ struct Search_Cpu : Search {
 
   DeviceSpan<float> next_token_scores_;  // shape (beam_size*batch_size, vocab_size)
 
+  // Token counts of each sequence for the penalties. Counted on the first penalty, then updated as tokens are
+  // appended, rewound and evicted. Empty while no penalty is applied.
+  std::vector<TokenCounts> token_counts_;  // shape (beam_size*batch_size)
+
   bool done_{};
 };
 
@@ -72,11 +93,16 @@ struct GreedySearch_Cpu : Search_Cpu {
   void SelectTop() override;
   void SampleTopK(int k, float temperature) override;
   void SampleTopP(float p, float temperature) override;
-  void SampleTopKTopP(int /*k*/, float /*p*/, float /*temperature*/) override;
+  void SampleTopKTopP(int k, float p, float temperature) override;
+  void SelectToken(int32_t token) override;
+
+  std::string GetRandomState() const override;
+  void SetRandomState(const std::string& state) override;
 
   // Used by continuous decoding search.
   void AppendTokens(DeviceSpan<int32_t>& next_tokens) override;
   void RewindTo(size_t index) override;
+  void Evict(size_t start, size_t count) override;
 
  protected:
   void SetNextToken(size_t batch_id, int32_t token);
@@ -92,6 +118,7 @@ struct GreedySearch_Cpu : Search_Cpu {
   int not_done_count_{params_->search.batch_size};  // When zero, every batch entry is done (starts at batch_size_)
 
   std::mt19937 gen_;
+  cpu::SamplingData sampling_data_;
 };
 
 struct BeamSearch_Cpu : Search_Cpu {
@@ -25,4 +25,15 @@ void Sequences::RewindTo(size_t index) {
   assert(current_length_ >= 0);
 }
 
+void Sequences::Evict(size_t start, size_t count) {
+  assert(start + count <= static_cast<size_t>(current_length_));
+  auto sequences = sequences_.CopyDeviceToCpu();
+  for (size_t row = 0; row * max_length_ < sequences.size(); row++) {
+    auto sequence = sequences.subspan(row * max_length_, static_cast<size_t>(current_length_));
+    std::copy(sequence.begin() + start + count, sequence.end(), sequence.begin() + start);
+  }
+  sequences_.CopyCpuToDevice();
+  current_length_ -= static_cast<int>(count);
+}
+
 }  // namespace Generators
@@ -31,6 +31,9 @@ struct Sequences {
   // Rewind sequences to ith token
   void RewindTo(size_t index);
 
+  // Remove tokens [start, start + count) from every sequence, the later tokens move down
+  void Evict(size_t start, size_t count);
+
  private:
   // Two buffers of shape (batch_size, num_beams, max_seq_length) to store sequences.
   // At each time, there is only one buffer is active. The other one will be active in next token.
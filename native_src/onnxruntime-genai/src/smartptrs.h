@@ -28,6 +28,10 @@ struct DeviceBuffer : std::enable_shared_from_this<DeviceBuffer> {
   virtual void CopyFrom(size_t begin_dest, DeviceBuffer& source, size_t begin_source, size_t size_in_bytes) = 0;
   virtual void Zero() = 0;  // Zero out the device memory
 
+  // Float16 values a float32 CPU buffer still has to be converted from, which happens on the first CpuSpan or
+  // CopyDeviceToCpu. Empty for every other buffer.
+  virtual std::span<const uint16_t> PendingFloat16() const { return {}; }
+
   uint8_t* p_device_{};
   uint8_t* p_cpu_{};
   size_t size_in_bytes_{};
@@ -69,6 +73,15 @@ struct DeviceSpan {
   // Zero out the device memory
   void Zero() { p_device_memory_->Zero(); }
 
+  // The fp16 values a float span is converted from on its first CPU access, to skip the conversion when only a few
+  // of them are needed. Empty once converted, and for spans that hold their values already.
+  std::span<const uint16_t> PendingFloat16() const {
+    if (!p_device_memory_)
+      return {};
+    auto pending = p_device_memory_->PendingFloat16();
+    return pending.empty() ? pending : pending.subspan(begin_, length_);
+  }
+
   void CopyFrom(const DeviceSpan<const T>& source) {
     assert(source.size() == size());  // Spans must be the same size to copy
     p_device_memory_->CopyFrom(begin_ * sizeof(T), *source.p_device_memory_, source.begin_ * sizeof(T), length_ * sizeof(T));
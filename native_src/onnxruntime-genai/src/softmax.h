@@ -1,35 +1,33 @@
 #pragma once
 
+#include <cmath>
+#include "cpu/vector_math.h"
+
 namespace Generators {
 
-void SoftmaxWithMax(std::span<float> scores, float temperature, float max_score) {
-  // Subtract max score and scale by temperature
-  std::transform(scores.begin(), scores.end(), scores.begin(), [max_score, temperature](float score) { return std::exp((score - max_score) / temperature); });
+// Vectorized (see cpu/vector_math.h): one pass for the max, one fused exp+sum pass with the temperature folded in,
+// and one pass to normalize.
 
-  // Compute sum of exponentials
-  float const exp_sum = std::accumulate(scores.begin(), scores.end(), 0.0f);
+inline void SoftmaxWithMax(std::span<float> scores, float temperature, float max_score) {
+  // exp((score - max_score) / temperature) in place, and their sum
+  float const exp_sum = cpu::ExpScaled(scores, max_score, temperature, scores);
 
   // Divide each score by the sum of exponentials
-  std::transform(scores.begin(), scores.end(), scores.begin(), [exp_sum](float score) { return score / exp_sum; });
+  cpu::Affine(scores, 0.0f, 1.0f / exp_sum, 0.0f);
 }
 
-void Softmax(std::span<float> scores, float temperature) {
-  const float max_score = *std::max_element(scores.begin(), scores.end());
-
-  SoftmaxWithMax(scores, temperature, max_score);
+inline void Softmax(std::span<float> scores, float temperature) {
+  SoftmaxWithMax(scores, temperature, cpu::MaxValue(scores));
 }
 
-void LogSoftMax(std::span<float> scores, float temperature) {
-  float const max_score = *std::max_element(scores.begin(), scores.end());
-
-  // Subtract max score and scale by temperature
-  std::transform(scores.begin(), scores.end(), scores.begin(), [max_score, temperature](float score) { return (score - max_score) / temperature; });
+inline void LogSoftMax(std::span<float> scores, float temperature) {
+  float const max_score = cpu::MaxValue(scores);
 
-  // Compute sum of exponentials
-  float const exp_sum = std::accumulate(scores.begin(), scores.end(), 0.0f, [](float a, float b) { return a + std::exp(b); });
+  // Sum of exponentials, without materializing them
+  float const exp_sum = cpu::SumExpScaled(scores, max_score, temperature);
 
-  // Subtract log of sum of exponentials from each score
-  std::transform(scores.begin(), scores.end(), scores.begin(), [exp_sum](float score) { return score - std::log(exp_sum); });
+  // (score - max_score) / temperature - log(exp_sum)
+  cpu::Affine(scores, max_score, 1.0f / temperature, -std::log(exp_sum));
 }
 
 }  // namespace Generators
@@ -0,0 +1,59 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "token_counts.h"
+
+#include <cassert>
+
+namespace Generators {
+
+void TokenCounts::Add(int32_t token) {
+  counts_[token]++;
+}
+
+void TokenCounts::Add(std::span<const int32_t> tokens) {
+  for (int32_t token : tokens)
+    counts_[token]++;
+}
+
+void TokenCounts::Remove(std::span<const int32_t> tokens) {
+  for (int32_t token : tokens) {
+    auto it = counts_.find(token);
+    assert(it != counts_.end());
+    if (it != counts_.end() && --it->second == 0)
+      counts_.erase(it);
+  }
+}
+
+int32_t TokenCounts::Count(int32_t token) const {
+  auto it = counts_.find(token);
+  return it != counts_.end() ? it->second : 0;
+}
+
+void TokenCounts::ApplyRepetitionPenalty(std::span<float> scores, float penalty) const {
+  if (penalty == 1.0f)
+    return;
+
+  for (const auto& [token, count] : counts_) {
+    if (token < 0 || static_cast<size_t>(token) >= scores.size())
+      continue;
+    float& score = scores[token];
+    // If score < 0, then repetition penalty > 1.0 has to multiplied to reduce the previous token probability,
+    // This assumes that scores are either positive (like ctrl) or negative (like GPT-2), but not a mixture.
+    score = score < 0 ? score * penalty : score / penalty;
+  }
+}
+
+void TokenCounts::ApplyFrequencyAndPresencePenalties(std::span<float> scores, float frequency_penalty,
+                                                     float presence_penalty) const {
+  if (frequency_penalty == 0.0f && presence_penalty == 0.0f)
+    return;
+
+  for (const auto& [token, count] : counts_) {
+    if (token < 0 || static_cast<size_t>(token) >= scores.size())
+      continue;
+    scores[token] -= static_cast<float>(count) * frequency_penalty + presence_penalty;
+  }
+}
+
+}  // namespace Generators
@@ -0,0 +1,36 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#include "span.h"
+
+namespace Generators {
+
+// How often each token occurs in a sequence, updated as tokens are appended and rewound instead of recounted from the
+// sequence. Penalizing the tokens of a sequence then costs O(distinct tokens) per step, however long it gets.
+struct TokenCounts {
+  void Add(int32_t token);
+  void Add(std::span<const int32_t> tokens);
+  // The tokens must have been added before
+  void Remove(std::span<const int32_t> tokens);
+
+  size_t DistinctCount() const { return counts_.size(); }
+  int32_t Count(int32_t token) const;
+
+  // Divides positive (multiplies negative) scores of the tokens in the sequence by repetition_penalty, as in
+  // Hugging Face transformers. 1.0 leaves the scores as they are.
+  void ApplyRepetitionPenalty(std::span<float> scores, float penalty) const;
+
+  // OpenAI style: subtracts count * frequency_penalty + presence_penalty from the score of each token in the sequence
+  void ApplyFrequencyAndPresencePenalties(std::span<float> scores, float frequency_penalty, float presence_penalty) const;
+
+ private:
+  std::unordered_map<int32_t, int32_t> counts_;  // Token -> occurrences, only tokens that occur
+};
+
+}  // namespace Generators
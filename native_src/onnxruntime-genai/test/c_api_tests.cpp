@@ -1,13 +1,16 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
+#include <algorithm>
 #include <cstring>  // for memcmp
 #include <fstream>
+#include <iterator>
 #include <numeric>
 #include <iostream>
 #include <thread>
 #include <vector>
 #include <regex>
+#include <string_view>
 #include "span.h"
 #include <list>
 
@@ -504,6 +507,106 @@ TEST(CAPIEngineTests, EndToEndPhiStaggeredBatch) {
 }
 #endif
 
+#if ENABLE_ENGINE_TESTS
+// Dynamic batching, and with it chunked prefill, needs a model exported with PagedAttention
+#ifndef PAGED_MODEL_PATH
+#define PAGED_MODEL_PATH ""
+#endif
+
+namespace {
+
+size_t g_decoder_runs{};
+
+// Each decoder run logs its output shapes once
+void CountDecoderRuns(const char* string, size_t length) {
+  const std::string_view text{string, length};
+  for (auto at = text.find("model_output_shapes"); at != std::string_view::npos; at = text.find("model_output_shapes", at + 1))
+    g_decoder_runs++;
+}
+
+struct StaggeredEngineRun {
+  std::vector<std::vector<int32_t>> tokens;  // Prompt and generated tokens of each request
+  size_t first_token_runs{};                 // Decoder runs until the first request had a token
+};
+
+// Adds the longest prompt first and the others while it is generating
+StaggeredEngineRun RunStaggeredRequests(const char* overlay) {
+  auto config = OgaConfig::Create(PAGED_MODEL_PATH);
+  config->Overlay(overlay);
+  auto model = OgaModel::Create(*config);
+  auto engine = OgaEngine::Create(*model);
+  auto tokenizer = OgaTokenizer::Create(*model);
+
+  const char* input_strings[] = {
+      "The quick brown fox jumps over the lazy dog.",
+      "This is a test.",
+      "Rats are awesome pets!",
+  };
+
+  StaggeredEngineRun run;
+  run.tokens.resize(std::size(input_strings));
+  std::vector<std::unique_ptr<OgaRequest>> requests;
+  std::vector<std::unique_ptr<OgaGeneratorParams>> params;
+  for (auto& string : input_strings) {
+    auto input_sequences = OgaSequences::Create();
+    tokenizer->Encode(string, *input_sequences);
+    auto& tokens = run.tokens[requests.size()];
+    tokens.assign(input_sequences->SequenceData(0), input_sequences->SequenceData(0) + input_sequences->SequenceCount(0));
+    params.emplace_back(OgaGeneratorParams::Create(*model));
+    params.back()->SetSearchOption("max_length", 40);
+    requests.push_back(OgaRequest::Create(*params.back()));
+    requests.back()->AddTokens(*input_sequences);
+    requests.back()->SetOpaqueData(&tokens);
+  }
+
+  g_decoder_runs = 0;
+  Oga::SetLogBool("enabled", true);
+  Oga::SetLogBool("ansi_tags", false);
+  Oga::SetLogBool("model_output_shapes", true);
+  Oga::SetLogCallback(CountDecoderRuns);
+
+  engine->Add(*requests[0]);
+  size_t num_steps = 0;
+  while (auto request = engine->Step()) {
+    if (num_steps++ == 0)
+      run.first_token_runs = g_decoder_runs;
+    while (request->HasUnseenTokens()) {
+      auto* tokens = reinterpret_cast<std::vector<int32_t>*>(request->GetOpaqueData());
+      tokens->push_back(request->GetUnseenToken());
+    }
+
+    if (num_steps == 2)
+      engine->Add(*requests[1]);
+    if (num_steps == 4)
+      engine->Add(*requests[2]);
+  }
+
+  Oga::SetLogCallback(nullptr);
+  Oga::SetLogBool("model_output_shapes", false);
+  Oga::SetLogBool("enabled", false);
+  return run;
+}
+
+}  // namespace
+
+TEST(CAPIEngineTests, ChunkedPrefillMatchesUnchunked) {
+  if (std::string_view{PAGED_MODEL_PATH}.empty())
+    GTEST_SKIP() << "Define PAGED_MODEL_PATH as a model exported with PagedAttention";
+
+  const auto unchunked = RunStaggeredRequests(R"({ "engine": { "dynamic_batching": { "max_batch_size": 4 } } })");
+  EXPECT_EQ(unchunked.first_token_runs, 1);
+
+  // The first prompt has 10 tokens, so it is prefilled over several steps, and the later prompts share each step's
+  // budget with the requests that are decoding
+  for (const char* overlay : {R"({ "engine": { "dynamic_batching": { "max_batch_size": 4, "max_num_batched_tokens": 4 } } })",
+                              R"({ "engine": { "dynamic_batching": { "max_batch_size": 4 } }, "search": { "chunk_size": 3 } })"}) {
+    const auto chunked = RunStaggeredRequests(overlay);
+    EXPECT_GE(chunked.first_token_runs, 3) << overlay;
+    EXPECT_EQ(chunked.tokens, unchunked.tokens) << overlay;
+  }
+}
+#endif
+
 TEST(CAPITests, EndToEndPhi) {
 #if TEST_PHI2
   auto model = OgaModel::Create(PHI2_PATH);
@@ -546,6 +649,73 @@ TEST(CAPITests, EndToEndPhi) {
 #endif
 }
 
+TEST(CAPITests, SpeculativeDecodingPhi) {
+#if TEST_PHI2 && !USE_CUDA && !USE_DML
+  auto tokenizer_model = OgaModel::Create(PHI2_PATH);
+  auto tokenizer = OgaTokenizer::Create(*tokenizer_model);
+  auto input_sequence = OgaSequences::Create();
+  tokenizer->Encode("This is a test.", *input_sequence);
+
+  auto generate = [&](OgaModel& model, size_t& proposed, size_t& accepted) {
+    auto params = OgaGeneratorParams::Create(model);
+    params->SetSearchOption("max_length", 40);
+    auto generator = OgaGenerator::Create(model, *params);
+    generator->AppendTokenSequences(*input_sequence);
+    while (!generator->IsDone())
+      generator->GenerateNextToken();
+    generator->GetSpeculativeDecodingStats(proposed, accepted);
+    const auto* data = generator->GetSequenceData(0);
+    return std::vector<int32_t>(data, data + generator->GetSequenceCount(0));
+  };
+
+  size_t proposed = 0, accepted = 0;
+  const auto expected = generate(*tokenizer_model, proposed, accepted);
+  EXPECT_EQ(proposed, 0);
+
+  // The model as its own draft agrees with nearly every proposal (batched and single token runs can round apart), and
+  // greedy output doesn't change
+  auto config = OgaConfig::Create(PHI2_PATH);
+  config->Overlay(R"({ "search": { "draft_model": ".", "num_speculative_tokens": 3 } })");
+  auto model = OgaModel::Create(*config);
+  const auto sequence = generate(*model, proposed, accepted);
+  EXPECT_EQ(sequence, expected);
+  EXPECT_GT(proposed, 0);
+  EXPECT_GT(accepted, proposed / 2);
+  EXPECT_LE(accepted, proposed);
+#endif
+}
+
+TEST(CAPITests, PromptLookupDecodingPhi) {
+#if TEST_PHI2 && !USE_CUDA && !USE_DML
+  auto model = OgaModel::Create(PHI2_PATH);
+  auto tokenizer = OgaTokenizer::Create(*model);
+  auto input_sequence = OgaSequences::Create();
+  tokenizer->Encode("Repeat after me: the quick brown fox jumps over the lazy dog. The quick brown fox", *input_sequence);
+
+  auto generate = [&](int ngram_size, size_t& proposed, size_t& accepted) {
+    auto params = OgaGeneratorParams::Create(*model);
+    params->SetSearchOption("max_length", 48);
+    params->SetSearchOption("prompt_lookup_ngram_size", ngram_size);
+    auto generator = OgaGenerator::Create(*model, *params);
+    generator->AppendTokenSequences(*input_sequence);
+    while (!generator->IsDone())
+      generator->GenerateNextToken();
+    generator->GetSpeculativeDecodingStats(proposed, accepted);
+    const auto* data = generator->GetSequenceData(0);
+    return std::vector<int32_t>(data, data + generator->GetSequenceCount(0));
+  };
+
+  size_t proposed = 0, accepted = 0;
+  const auto expected = generate(0, proposed, accepted);
+  EXPECT_EQ(proposed, 0);
+
+  // Proposals only change how many tokens each run checks, never the greedy output
+  EXPECT_EQ(generate(3, proposed, accepted), expected);
+  EXPECT_GT(proposed, 0);
+  EXPECT_LE(accepted, proposed);
+#endif
+}
+
 TEST(CAPITests, EndToEndPhiEOSPAD) {
 #if TEST_PHI2
   auto model = OgaModel::Create(PHI2_PATH);
@@ -588,6 +758,50 @@ TEST(CAPITests, EndToEndPhiEOSPAD) {
 #endif
 }
 
+// The CPU shared KV buffers start small and grow past their initial capacity during generation.
+// The output must match the out-of-place KV cache, including after a rewind.
+TEST(CAPITests, SharedKvCacheGrowthPhi) {
+#if TEST_PHI2 && !USE_CUDA && !USE_DML
+  auto model = OgaModel::Create(PHI2_PATH);
+  auto tokenizer = OgaTokenizer::Create(*model);
+
+  auto input_sequence = OgaSequences::Create();
+  tokenizer->Encode("def print_prime(n):", *input_sequence);
+
+  constexpr int max_length = 320;
+  auto generate = [&](bool share_buffer) {
+    auto params = OgaGeneratorParams::Create(*model);
+    params->SetSearchOption("max_length", max_length);
+    params->SetSearchOption("min_length", max_length);
+    params->SetSearchOptionBool("past_present_share_buffer", share_buffer);
+
+    auto generator = OgaGenerator::Create(*model, *params);
+    generator->AppendTokenSequences(*input_sequence);
+    while (!generator->IsDone()) {
+      generator->GenerateNextToken();
+    }
+    return generator;
+  };
+
+  auto shared = generate(true);
+  auto out_of_place = generate(false);
+
+  const auto sequence_length = shared->GetSequenceCount(0);
+  ASSERT_EQ(sequence_length, max_length);
+  ASSERT_EQ(out_of_place->GetSequenceCount(0), sequence_length);
+  std::vector<int32_t> expected_output(out_of_place->GetSequenceData(0), out_of_place->GetSequenceData(0) + sequence_length);
+  EXPECT_TRUE(0 == std::memcmp(expected_output.data(), shared->GetSequenceData(0), sequence_length * sizeof(int32_t)));
+
+  // Rewinding only truncates the logical length; regenerating must reproduce the same tokens
+  shared->RewindTo(200);
+  while (!shared->IsDone()) {
+    shared->GenerateNextToken();
+  }
+  ASSERT_EQ(shared->GetSequenceCount(0), sequence_length);
+  EXPECT_TRUE(0 == std::memcmp(expected_output.data(), shared->GetSequenceData(0), sequence_length * sizeof(int32_t)));
+#endif
+}
+
 #if ENABLE_ENGINE_TESTS
 TEST(CAPIEngineTests, EndToEndPhi) {
   auto model = OgaModel::Create(PHI2_PATH);
@@ -938,6 +1152,32 @@ TEST(CAPITests, SetTerminate) {
 #endif
 }
 
+TEST(CAPITests, SetTerminateDuringPrefill) {
+#if TEST_PHI2
+  auto model = OgaModel::Create(PHI2_PATH);
+  auto tokenizer = OgaTokenizer::Create(*model);
+
+  // A prompt long enough that the terminate usually lands inside the prefill's OrtSession::Run. If it lands
+  // before, the prefill throws on entry instead.
+  std::string input_string;
+  for (int i = 0; i < 64; i++)
+    input_string += "She sells sea shells by the sea shore. ";
+  auto input_sequences = OgaSequences::Create();
+  tokenizer->Encode(input_string.c_str(), *input_sequences);
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", static_cast<double>(input_sequences->SequenceCount(0) + 8));
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  std::thread prefill([&] { EXPECT_THROW(generator->AppendTokenSequences(*input_sequences), std::runtime_error); });
+  std::thread terminate([&] { generator->SetRuntimeOption("terminate_session", "1"); });
+  prefill.join();
+  terminate.join();
+
+  EXPECT_EQ(generator->IsSessionTerminated(), true);
+  EXPECT_THROW(generator->GenerateNextToken(), std::runtime_error);
+#endif
+}
+
 // DML Doesn't support batch_size > 1
 #if TEST_PHI2 && !USE_DML
 
@@ -1367,6 +1607,91 @@ TEST(CAPITests, RewindGptFp32CAPI) {
   expected_output_start = &expected_output[0];
   EXPECT_TRUE(0 == std::memcmp(expected_output_start, sequence_data, sequence_length * sizeof(int32_t)));
 }
+
+TEST(CAPITests, AttentionSinksGptFp32CAPI) {
+  std::vector<int32_t> message{0, 0, 195, 731, 52, 204, 114, 731};
+  const int max_length = 16;
+  const int sink_size = 2;
+
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", max_length);
+  params->SetSearchOption("attention_sink_size", sink_size);
+  auto generator = OgaGenerator::Create(*model, *params);
+
+  // Everything appended and generated; the sequence keeps the sinks and the most recent tokens of it
+  std::vector<int32_t> tokens;
+  auto check_sequence = [&] {
+    const size_t length = generator->GetSequenceCount(0);
+    const size_t evicted = generator->GetEvictedTokenCount();
+    const auto* sequence = generator->GetSequenceData(0);
+    ASSERT_LE(length, static_cast<size_t>(max_length));
+    ASSERT_EQ(length + evicted, tokens.size());
+    EXPECT_TRUE(std::equal(sequence, sequence + sink_size, tokens.begin()));
+    EXPECT_TRUE(std::equal(sequence + sink_size, sequence + length, tokens.begin() + sink_size + evicted));
+  };
+
+  // Appending past max_length evicts
+  for (int i = 0; i < 3; i++) {
+    generator->AppendTokens(message.data(), message.size());
+    tokens.insert(tokens.end(), message.begin(), message.end());
+  }
+  check_sequence();
+  EXPECT_EQ(generator->GetEvictedTokenCount(), 3 * message.size() - max_length);
+
+  // Generation goes on past max_length
+  for (int i = 0; i < 3 * max_length; i++) {
+    ASSERT_FALSE(generator->IsDone());
+    generator->GenerateNextToken();
+    tokens.push_back(generator->GetNextTokens()[0]);
+  }
+  check_sequence();
+
+  // Rewinding into the sinks leaves nothing evicted
+  generator->RewindTo(sink_size);
+  EXPECT_EQ(generator->GetEvictedTokenCount(), 0);
+  EXPECT_EQ(generator->GetSequenceCount(0), static_cast<size_t>(sink_size));
+
+  // The sinks can't make room for more than max_length new tokens
+  std::vector<int32_t> too_long(max_length, 731);
+  EXPECT_THROW(generator->AppendTokens(too_long.data(), too_long.size()), std::runtime_error);
+}
+
+TEST(CAPITests, SaveLoadStateGptFp32CAPI) {
+  std::vector<int32_t> input_ids{0, 0, 195, 731, 52, 204, 114, 731};
+  const char* path = "session_state_test.bin";
+
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 32);
+  params->SetSearchOptionBool("do_sample", true);
+  params->SetSearchOption("top_k", 5);
+  params->SetSearchOption("random_seed", 42);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  generator->AppendTokens(input_ids.data(), input_ids.size());
+  for (int i = 0; i < 4; i++)
+    generator->GenerateNextToken();
+  generator->SaveState(path);
+
+  // A fresh generator continues with the same sequence and, since the random state is restored too, the same samples
+  auto restored = OgaGenerator::Create(*model, *params);
+  restored->LoadState(path);
+  std::remove(path);
+
+  const size_t length = generator->GetSequenceCount(0);
+  ASSERT_EQ(restored->GetSequenceCount(0), length);
+  EXPECT_TRUE(std::equal(generator->GetSequenceData(0), generator->GetSequenceData(0) + length, restored->GetSequenceData(0)));
+
+  for (int i = 0; i < 8; i++) {
+    generator->GenerateNextToken();
+    restored->GenerateNextToken();
+    EXPECT_EQ(generator->GetNextTokens()[0], restored->GetNextTokens()[0]);
+  }
+
+  // Only a generator without tokens can load
+  EXPECT_THROW(restored->LoadState(path), std::runtime_error);
+}
 #endif
 
 #if USE_GUIDANCE
@@ -0,0 +1,91 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "models/image_features_cache.h"
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+namespace {
+
+// The cache only looks at bytes, so the entries don't need real tensors
+std::shared_ptr<const ImageFeatures> MakeFeatures(size_t bytes) {
+  auto features = std::make_shared<ImageFeatures>();
+  features->bytes = bytes;
+  return features;
+}
+
+uint64_t PixelsKey(const std::vector<uint8_t>& pixels, std::vector<int64_t> shape) {
+  ImageFeaturesKey key;
+  key.Add("pixel_values", ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT, shape, pixels);
+  return key.value;
+}
+
+}  // namespace
+
+TEST(ImageFeaturesCacheTest, LookupReturnsInsertedFeatures) {
+  ImageFeaturesCache cache;
+  EXPECT_EQ(cache.Lookup(1), nullptr);
+
+  auto features = MakeFeatures(100);
+  cache.Insert(1, features, 1000);
+  EXPECT_EQ(cache.Lookup(1), features);
+  EXPECT_EQ(cache.Lookup(2), nullptr);
+
+  // Inserting the same key again replaces the entry
+  auto newer = MakeFeatures(200);
+  cache.Insert(1, newer, 1000);
+  EXPECT_EQ(cache.Lookup(1), newer);
+  EXPECT_EQ(cache.EntryCount(), 1);
+  EXPECT_EQ(cache.Bytes(), 200);
+}
+
+TEST(ImageFeaturesCacheTest, EvictsLeastRecentlyUsed) {
+  ImageFeaturesCache cache;
+  cache.Insert(1, MakeFeatures(100), 300);
+  cache.Insert(2, MakeFeatures(100), 300);
+  cache.Insert(3, MakeFeatures(100), 300);
+  EXPECT_NE(cache.Lookup(1), nullptr);  // 2 is now the least recently used
+
+  cache.Insert(4, MakeFeatures(100), 300);
+  EXPECT_EQ(cache.EntryCount(), 3);
+  EXPECT_EQ(cache.Lookup(2), nullptr);
+  EXPECT_NE(cache.Lookup(1), nullptr);
+  EXPECT_NE(cache.Lookup(4), nullptr);
+
+  // A smaller budget from the next insert evicts down to it
+  cache.Insert(5, MakeFeatures(100), 150);
+  EXPECT_EQ(cache.EntryCount(), 1);
+  EXPECT_EQ(cache.Bytes(), 100);
+
+  // Entries larger than the budget aren't stored
+  cache.Insert(6, MakeFeatures(200), 150);
+  EXPECT_EQ(cache.Lookup(6), nullptr);
+  EXPECT_NE(cache.Lookup(5), nullptr);
+
+  cache.Clear();
+  EXPECT_EQ(cache.EntryCount(), 0);
+  EXPECT_EQ(cache.Bytes(), 0);
+}
+
+TEST(ImageFeaturesCacheTest, KeyDependsOnPixelsAndShape) {
+  std::vector<uint8_t> pixels(3 * 336 * 336 + 5);  // Not a multiple of the hash's block size
+  for (size_t i = 0; i < pixels.size(); i++)
+    pixels[i] = static_cast<uint8_t>(i * 31);
+
+  const uint64_t key = PixelsKey(pixels, {1, static_cast<int64_t>(pixels.size())});
+  EXPECT_EQ(PixelsKey(pixels, {1, static_cast<int64_t>(pixels.size())}), key);
+  EXPECT_NE(PixelsKey(pixels, {static_cast<int64_t>(pixels.size()), 1}), key);
+
+  for (size_t index : {size_t{0}, pixels.size() / 2, pixels.size() - 1}) {
+    auto changed = pixels;
+    changed[index] ^= 1;
+    EXPECT_NE(PixelsKey(changed, {1, static_cast<int64_t>(pixels.size())}), key);
+  }
+}
+
+}  // namespace Generators::test
@@ -0,0 +1,114 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "models/image_patches.h"
+#include "models/threadpool.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+namespace {
+
+// The loop nest QwenImageProcessor used before ExtractImagePatches, kept as the reference
+std::vector<float> ReferencePatches(const std::vector<float>& image, const ImagePatchesShape& shape) {
+  std::vector<float> patches(static_cast<size_t>(shape.PatchCount() * shape.PatchDim()));
+  size_t write_idx = 0;
+  for (int64_t ph = 0; ph < shape.HeightPatches(); ++ph) {
+    for (int64_t pw = 0; pw < shape.WidthPatches(); ++pw) {
+      for (int64_t t = 0; t < shape.temporal_patch_size; ++t) {
+        for (int64_t c = 0; c < shape.channels; ++c) {
+          for (int64_t h = 0; h < shape.patch_size; ++h) {
+            for (int64_t w = 0; w < shape.patch_size; ++w) {
+              const int64_t src_idx = (ph * shape.patch_size + h) * shape.width * shape.channels +
+                                      (pw * shape.patch_size + w) * shape.channels + c;
+              patches[write_idx++] = image[src_idx];
+            }
+          }
+        }
+      }
+    }
+  }
+  return patches;
+}
+
+std::vector<float> MakeImage(const ImagePatchesShape& shape) {
+  std::vector<float> image(static_cast<size_t>(shape.height * shape.width * shape.channels));
+  std::iota(image.begin(), image.end(), 0.0f);
+  return image;
+}
+
+std::vector<float> Extract(const std::vector<float>& image, const ImagePatchesShape& shape, ThreadPool* pool) {
+  std::vector<float> patches(static_cast<size_t>(shape.PatchCount() * shape.PatchDim()));
+  ExtractImagePatches(image, shape, patches, pool);
+  return patches;
+}
+
+}  // namespace
+
+TEST(ImagePatchesTest, MatchesReferenceLayout) {
+  ThreadPool pool{3};
+  const ImagePatchesShape shapes[] = {
+      {28, 42, 3, 14, 2},   // RGB, whole patches
+      {33, 47, 3, 14, 2},   // Partial patches at the edges are dropped
+      {16, 24, 1, 4, 1},    // Other channel counts take the generic path
+      {12, 20, 4, 4, 3},
+      {448, 448, 3, 14, 2}  // Typical input size
+  };
+  for (const auto& shape : shapes) {
+    const auto image = MakeImage(shape);
+    const auto expected = ReferencePatches(image, shape);
+    EXPECT_EQ(Extract(image, shape, nullptr), expected) << shape.height << "x" << shape.width << "x" << shape.channels;
+    EXPECT_EQ(Extract(image, shape, &pool), expected) << shape.height << "x" << shape.width << "x" << shape.channels;
+  }
+}
+
+TEST(ImagePatchesTest, RejectsMismatchedBuffers) {
+  const ImagePatchesShape shape{28, 28, 3, 14, 2};
+  const auto image = MakeImage(shape);
+  std::vector<float> patches(static_cast<size_t>(shape.PatchCount() * shape.PatchDim()) - 1);
+  EXPECT_THROW(ExtractImagePatches(image, shape, patches), std::runtime_error);
+
+  patches.resize(patches.size() + 1);
+  EXPECT_THROW(ExtractImagePatches(std::span<const float>{image.data(), image.size() - 1}, shape, patches), std::runtime_error);
+}
+
+// Compares the reference loop nest with ExtractImagePatches on one thread and on a pool
+TEST(ImagePatchesTest, PerformanceTests) {
+  constexpr int kRepeats = 10;
+  ThreadPool pool{4};
+
+  auto measure_ms = [](auto&& extract) {
+    extract();  // Warm up allocations and the per-thread planes
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < kRepeats; i++)
+      extract();
+    const auto stop = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count() / kRepeats;
+  };
+
+  std::cout << "\n--- Qwen2.5-VL patch extraction (ms) ---\n";
+  std::cout << std::left << std::setw(12) << "Size" << std::setw(14) << "Reference" << std::setw(14) << "1 thread"
+            << std::setw(14) << "4 threads" << "\n";
+  std::cout << std::string(54, '-') << "\n";
+
+  for (int64_t size : {448, 896, 1344}) {
+    const ImagePatchesShape shape{size, size, 3, 14, 2};
+    const auto image = MakeImage(shape);
+    std::vector<float> patches(static_cast<size_t>(shape.PatchCount() * shape.PatchDim()));
+
+    const double reference = measure_ms([&] { ReferencePatches(image, shape); });
+    const double single = measure_ms([&] { ExtractImagePatches(image, shape, patches); });
+    const double parallel = measure_ms([&] { ExtractImagePatches(image, shape, patches, &pool); });
+    std::cout << std::left << std::fixed << std::setprecision(2) << std::setw(12) << size << std::setw(14) << reference
+              << std::setw(14) << single << std::setw(14) << parallel << "\n";
+  }
+}
+
+}  // namespace Generators::test
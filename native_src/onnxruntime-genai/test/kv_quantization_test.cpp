@@ -0,0 +1,220 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "models/kv_quantization.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "ort_genai.h"
+
+#include <gtest/gtest.h>
+
+#ifndef MODEL_PATH
+#define MODEL_PATH "../../test/test_models/"
+#endif
+
+namespace Generators::test {
+
+namespace {
+
+std::vector<float> RoundTrip(KvQuantization quantization, const std::vector<float>& values, size_t row_size) {
+  std::vector<uint8_t> codes(values.size());
+  std::vector<float> scales(values.size() / row_size);
+  QuantizeRows(quantization, values, row_size, codes, scales);
+  std::vector<float> result(values.size());
+  DequantizeRows(quantization, codes, scales, row_size, result);
+  return result;
+}
+
+// Gaussian rows, optionally with one large channel like the keys of real models
+std::vector<float> RandomKeyValues(size_t positions, size_t head_size, float outlier_scale, std::mt19937& engine) {
+  std::normal_distribution<float> dist(0.0f, 1.0f);
+  std::vector<float> values(positions * head_size);
+  for (size_t i = 0; i < values.size(); i++)
+    values[i] = dist(engine) * (i % head_size == 3 ? outlier_scale : 1.0f);
+  return values;
+}
+
+struct AttentionError {
+  double output{};  // Largest L2 error of an attention output, relative to the RMS norm of a value row
+  double kl{};      // Largest KL divergence of the attention weights
+};
+
+// Compares single head attention of queries over fp32 keys/values [positions, head_size] against the same
+// keys/values after a quantization round trip
+AttentionError CompareAttention(KvQuantization quantization, const std::vector<float>& keys,
+                                const std::vector<float>& values, size_t head_size, size_t query_count,
+                                std::mt19937& engine) {
+  const auto quantized_keys = RoundTrip(quantization, keys, head_size);
+  const auto quantized_values = RoundTrip(quantization, values, head_size);
+  const size_t positions = keys.size() / head_size;
+
+  // Attention averages values, so outputs can be much shorter than any value row. Relative to the output itself the
+  // error would grow with the context length; relative to the values it measures what quantization loses.
+  double value_norm = 0.0;
+  for (float v : values)
+    value_norm += v * v;
+  value_norm = std::sqrt(std::max(value_norm / positions, 1e-30));
+
+  auto attend = [&](const std::vector<float>& query, const std::vector<float>& k, const std::vector<float>& v,
+                    std::vector<double>& weights, std::vector<double>& output) {
+    weights.assign(positions, 0.0);
+    for (size_t p = 0; p < positions; p++) {
+      for (size_t d = 0; d < head_size; d++)
+        weights[p] += query[d] * k[p * head_size + d];
+      weights[p] /= std::sqrt(static_cast<double>(head_size));
+    }
+    const double max_logit = *std::max_element(weights.begin(), weights.end());
+    double sum = 0.0;
+    for (auto& w : weights)
+      sum += (w = std::exp(w - max_logit));
+    output.assign(head_size, 0.0);
+    for (size_t p = 0; p < positions; p++) {
+      weights[p] /= sum;
+      for (size_t d = 0; d < head_size; d++)
+        output[d] += weights[p] * v[p * head_size + d];
+    }
+  };
+
+  AttentionError error;
+  std::normal_distribution<float> dist(0.0f, 1.0f);
+  std::vector<float> query(head_size);
+  std::vector<double> weights, output, quantized_weights, quantized_output;
+  for (size_t q = 0; q < query_count; q++) {
+    for (auto& x : query)
+      x = dist(engine);
+    attend(query, keys, values, weights, output);
+    attend(query, quantized_keys, quantized_values, quantized_weights, quantized_output);
+
+    double difference = 0.0, kl = 0.0;
+    for (size_t d = 0; d < head_size; d++)
+      difference += (output[d] - quantized_output[d]) * (output[d] - quantized_output[d]);
+    for (size_t p = 0; p < positions; p++) {
+      if (weights[p] > 0.0)
+        kl += weights[p] * std::log(weights[p] / std::max(quantized_weights[p], 1e-300));
+    }
+    error.output = std::max(error.output, std::sqrt(difference) / value_norm);
+    error.kl = std::max(error.kl, kl);
+  }
+  return error;
+}
+
+}  // namespace
+
+TEST(KvQuantizationTest, Parse) {
+  EXPECT_EQ(ParseKvQuantization(""), KvQuantization::None);
+  EXPECT_EQ(ParseKvQuantization("none"), KvQuantization::None);
+  EXPECT_EQ(ParseKvQuantization("int8"), KvQuantization::Int8);
+  EXPECT_EQ(ParseKvQuantization("fp8"), KvQuantization::Fp8);
+  EXPECT_THROW(ParseKvQuantization("int4"), std::runtime_error);
+}
+
+TEST(KvQuantizationTest, Float8E4M3Codes) {
+  // Every finite code survives a round trip
+  for (int code = 0; code < 256; code++) {
+    if ((code & 0x7F) == 0x7F)
+      continue;
+    EXPECT_EQ(Float32ToFloat8E4M3(Float8E4M3ToFloat32(static_cast<uint8_t>(code))), code) << "code " << code;
+  }
+
+  EXPECT_EQ(Float8E4M3ToFloat32(0x38), 1.0f);
+  EXPECT_EQ(Float8E4M3ToFloat32(0x7E), 448.0f);
+  EXPECT_EQ(Float8E4M3ToFloat32(0x01), std::ldexp(1.0f, -9));
+  EXPECT_EQ(Float8E4M3ToFloat32(0xB8), -1.0f);
+  EXPECT_TRUE(std::isnan(Float8E4M3ToFloat32(0x7F)));
+
+  EXPECT_EQ(Float32ToFloat8E4M3(1.0625f), 0x38);   // Tie rounds to the even mantissa
+  EXPECT_EQ(Float32ToFloat8E4M3(1.1875f), 0x3A);   // Tie rounds to the even mantissa
+  EXPECT_EQ(Float32ToFloat8E4M3(1000.0f), 0x7E);   // Saturates
+  EXPECT_EQ(Float32ToFloat8E4M3(-1000.0f), 0xFE);  // Saturates
+  EXPECT_EQ(Float32ToFloat8E4M3(std::ldexp(1.0f, -12)), 0x00);
+}
+
+TEST(KvQuantizationTest, RowErrorBounds) {
+  std::mt19937 engine(1);
+  const size_t head_size = 64;
+  const auto values = RandomKeyValues(128, head_size, 8.0f, engine);
+
+  for (auto quantization : {KvQuantization::Int8, KvQuantization::Fp8}) {
+    std::vector<uint8_t> codes(values.size());
+    std::vector<float> scales(values.size() / head_size);
+    QuantizeRows(quantization, values, head_size, codes, scales);
+    std::vector<float> result(values.size());
+    DequantizeRows(quantization, codes, scales, head_size, result);
+
+    for (size_t i = 0; i < values.size(); i++) {
+      const float scale = scales[i / head_size];
+      // Half a step: a fixed step for int8, a relative one (3 mantissa bits) for fp8 above its subnormals
+      const float bound = quantization == KvQuantization::Int8
+                              ? scale * 0.5f
+                              : std::max(std::fabs(values[i]) / 16.0f, std::ldexp(scale, -10));
+      ASSERT_LE(std::fabs(result[i] - values[i]), bound * 1.0001f) << "index " << i;
+    }
+  }
+
+  // All zero rows stay exact
+  const std::vector<float> zeros(2 * head_size, 0.0f);
+  EXPECT_EQ(RoundTrip(KvQuantization::Int8, zeros, head_size), zeros);
+  EXPECT_EQ(RoundTrip(KvQuantization::Fp8, zeros, head_size), zeros);
+
+  std::vector<uint8_t> codes(10);
+  std::vector<float> scales(1);
+  EXPECT_THROW(QuantizeRows(KvQuantization::Int8, std::vector<float>(10), 4, codes, scales), std::runtime_error);
+}
+
+// Accuracy check against fp32 key/values: attention over quantized key/values must stay close to attention over the
+// originals, for synthetic key/values and for those of a real model
+TEST(KvQuantizationTest, AttentionAccuracy) {
+  std::mt19937 engine(2);
+  const size_t head_size = 64;
+  const auto keys = RandomKeyValues(512, head_size, 8.0f, engine);
+  const auto values = RandomKeyValues(512, head_size, 1.0f, engine);
+
+  const auto int8_error = CompareAttention(KvQuantization::Int8, keys, values, head_size, 32, engine);
+  EXPECT_LT(int8_error.output, 0.03);
+  EXPECT_LT(int8_error.kl, 3e-3);
+
+  // The outlier channel stretches each key row's int8 step; fp8 keeps its relative precision for the small channels
+  const auto fp8_error = CompareAttention(KvQuantization::Fp8, keys, values, head_size, 32, engine);
+  EXPECT_LT(fp8_error.output, 0.02);
+  EXPECT_LT(fp8_error.kl, 2e-3);
+}
+
+TEST(KvQuantizationTest, AttentionAccuracyTinyGpt2) {
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 64);
+  auto generator = OgaGenerator::Create(*model, *params);
+
+  std::vector<int32_t> input_ids(48);
+  for (size_t i = 0; i < input_ids.size(); i++)
+    input_ids[i] = static_cast<int32_t>((i * 37 + 11) % 1000);
+  generator->AppendTokens(input_ids.data(), input_ids.size());
+
+  // Combined key/values of the first layer, [2, batch, heads, positions, head_size]
+  auto present = generator->GetOutput("present_0");
+  const auto shape = present->Shape();
+  ASSERT_EQ(shape.size(), 5);
+  const size_t heads = static_cast<size_t>(shape[2]), positions = static_cast<size_t>(shape[3]);
+  const size_t head_size = static_cast<size_t>(shape[4]);
+  const auto* data = static_cast<const float*>(present->Data());
+
+  std::mt19937 engine(3);
+  for (size_t head = 0; head < heads; head++) {
+    const size_t head_values = positions * head_size;
+    const float* key_data = data + head * head_values;
+    const float* value_data = data + (heads + head) * head_values;
+    const std::vector<float> keys(key_data, key_data + head_values);
+    const std::vector<float> values(value_data, value_data + head_values);
+
+    const auto int8_error = CompareAttention(KvQuantization::Int8, keys, values, head_size, 8, engine);
+    EXPECT_LT(int8_error.output, 0.03) << "head " << head;
+    const auto fp8_error = CompareAttention(KvQuantization::Fp8, keys, values, head_size, 8, engine);
+    EXPECT_LT(fp8_error.output, 0.03) << "head " << head;
+  }
+}
+
+}  // namespace Generators::test
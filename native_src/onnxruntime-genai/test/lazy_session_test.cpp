@@ -0,0 +1,98 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "models/lazy_session.h"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// LazySession only tracks whether its session is loaded, so the factory doesn't need to create a real one
+struct CountingFactory {
+  int created{};
+
+  LazySession::Factory Get() {
+    return [this] {
+      created++;
+      return std::unique_ptr<OrtSession>{};
+    };
+  }
+};
+
+}  // namespace
+
+TEST(LazySessionTest, AcquireCreatesOnce) {
+  CountingFactory factory;
+  LazySession session{factory.Get(), nullptr, {"pixel_values"}, -1ms};
+  EXPECT_FALSE(session.IsLoaded());
+  EXPECT_EQ(session.GetInputNames(), std::vector<std::string>{"pixel_values"});
+
+  {
+    auto lease = session.Acquire();
+    auto second = session.Acquire();
+    EXPECT_TRUE(session.IsLoaded());
+  }
+  auto third = session.Acquire();
+  EXPECT_EQ(factory.created, 1);
+  EXPECT_TRUE(session.IsLoaded());
+}
+
+TEST(LazySessionTest, ReleaseIfIdleWaitsForLeases) {
+  CountingFactory factory;
+  LazySession session{factory.Get(), nullptr, {}, -1ms};
+  EXPECT_FALSE(session.ReleaseIfIdle());  // Not loaded
+
+  {
+    auto lease = session.Acquire();
+    EXPECT_FALSE(session.ReleaseIfIdle());
+    auto moved = std::move(lease);  // The moved-from lease doesn't return the session
+  }
+  EXPECT_TRUE(session.IsLoaded());  // A negative timeout keeps it after the last lease
+  EXPECT_FALSE(session.ReleaseIfIdle(1h));
+  EXPECT_TRUE(session.ReleaseIfIdle());
+  EXPECT_FALSE(session.IsLoaded());
+
+  // The next run creates it again
+  session.Acquire();
+  EXPECT_EQ(factory.created, 2);
+}
+
+TEST(LazySessionTest, ZeroTimeoutReleasesWithLastLease) {
+  CountingFactory factory;
+  LazySession session{factory.Get(), nullptr, {}, 0ms};
+  {
+    auto lease = session.Acquire();
+    {
+      auto second = session.Acquire();
+    }
+    EXPECT_TRUE(session.IsLoaded());
+  }
+  EXPECT_FALSE(session.IsLoaded());
+  EXPECT_EQ(factory.created, 1);
+}
+
+TEST(LazySessionTest, ReleaserFreesIdleSessions) {
+  CountingFactory factory;
+  LazySession idle{factory.Get(), nullptr, {}, 20ms};
+  LazySession busy{factory.Get(), nullptr, {}, 20ms};
+  IdleSessionReleaser releaser{{&idle, &busy}, 20ms};
+
+  idle.Acquire();
+  auto lease = busy.Acquire();
+  const auto deadline = std::chrono::steady_clock::now() + 5s;
+  while (idle.IsLoaded() && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(5ms);
+
+  EXPECT_FALSE(idle.IsLoaded());
+  EXPECT_TRUE(busy.IsLoaded());  // Never released while a lease holds it
+}
+
+}  // namespace Generators::test
@@ -95,6 +95,44 @@ TEST(ModelTests, GreedySearchGptFp32) {
   }
 }
 
+TEST(ModelTests, OptimizedModelCacheGptFp32) {
+  std::vector<int32_t> input_ids{0, 0, 195, 731};
+  const int max_length = 10;
+
+  const auto cache_dir = std::filesystem::temp_directory_path() / "oga_optimized_model_cache_test";
+  std::filesystem::remove_all(cache_dir);
+  std::filesystem::create_directories(cache_dir);
+
+  auto generate = [&](bool use_cache) {
+    auto config = OgaConfig::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+    if (use_cache)
+      config->Overlay(("{ \"model\": { \"optimized_model_cache_dir\": \"" + cache_dir.generic_string() + "\" } }").c_str());
+    auto model = OgaModel::Create(*config);
+
+    auto params = OgaGeneratorParams::Create(*model);
+    params->SetSearchOption("max_length", max_length);
+    auto generator = OgaGenerator::Create(*model, *params);
+    generator->AppendTokens(input_ids);
+    while (!generator->IsDone())
+      generator->GenerateNextToken();
+
+    auto sequence = generator->GetSequence(0);
+    return std::vector<int32_t>(sequence.begin(), sequence.end());
+  };
+
+  const auto expected_output = generate(false);
+
+  // The first load writes the optimized graph, the second one runs from it
+  for (int load = 0; load < 2; load++) {
+    EXPECT_EQ(generate(true), expected_output);
+
+    const auto entries = std::distance(std::filesystem::directory_iterator{cache_dir}, std::filesystem::directory_iterator{});
+    EXPECT_GE(entries, 2);  // At least the optimized graph and its key
+  }
+
+  std::filesystem::remove_all(cache_dir);
+}
+
 TEST(ModelTests, BeamSearchGptFp32) {
   std::vector<int64_t> input_ids_shape{3, 12};
   std::vector<int32_t> input_ids{
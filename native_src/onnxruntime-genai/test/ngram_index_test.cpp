@@ -0,0 +1,60 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "ngram_index.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+namespace {
+
+std::vector<int32_t> Propose(NgramIndex& index, const std::vector<int32_t>& sequence, size_t count) {
+  index.Update(sequence);
+  return index.Propose(count);
+}
+
+}  // namespace
+
+TEST(NgramIndexTest, ProposesWhatFollowedTheLongestMatch) {
+  NgramIndex index{3};
+  EXPECT_TRUE(Propose(index, {}, 4).empty());
+  EXPECT_TRUE(Propose(index, {1, 2, 3}, 4).empty());
+
+  // 2 3 is followed by 4 5 6 in the prompt
+  EXPECT_EQ(Propose(index, {1, 2, 3, 4, 5, 6, 7, 9, 2, 3}, 3), (std::vector<int32_t>{4, 5, 6}));
+
+  // The count stops at the end of the sequence
+  EXPECT_EQ(Propose(index, {1, 2, 3, 4, 5, 6, 7, 9, 2, 3, 4, 5, 6}, 8), (std::vector<int32_t>{7, 9, 2, 3, 4, 5, 6}));
+
+  // The longer match wins over a later shorter one: 8 5 occurs once, 5 alone most recently before 1
+  EXPECT_EQ(Propose(index, {8, 5, 6, 0, 5, 1, 8, 5}, 1), (std::vector<int32_t>{6}));
+}
+
+TEST(NgramIndexTest, ProposesTheLatestOccurrence) {
+  NgramIndex index{2};
+  EXPECT_EQ(Propose(index, {1, 2, 3, 1, 2, 4, 1, 2}, 1), (std::vector<int32_t>{4}));
+
+  // Growing one token at a time matches indexing all at once
+  NgramIndex incremental{2};
+  std::vector<int32_t> sequence;
+  for (int32_t token : {1, 2, 3, 1, 2, 4, 1}) {
+    sequence.push_back(token);
+    incremental.Update(sequence);
+  }
+  EXPECT_EQ(Propose(incremental, {1, 2, 3, 1, 2, 4, 1, 2}, 1), (std::vector<int32_t>{4}));
+}
+
+TEST(NgramIndexTest, RewoundSequenceIsReindexed) {
+  NgramIndex index{2};
+  EXPECT_EQ(Propose(index, {1, 2, 3, 4, 1, 2}, 2), (std::vector<int32_t>{3, 4}));
+
+  // Same length, different tokens: nothing of the old sequence may leak into the proposal
+  EXPECT_TRUE(Propose(index, {5, 6, 7, 8, 1, 2}, 2).empty());
+  EXPECT_EQ(Propose(index, {5, 6}, 2), std::vector<int32_t>{});
+  EXPECT_EQ(Propose(index, {5, 6, 7, 5}, 2), (std::vector<int32_t>{6, 7}));
+}
+
+}  // namespace Generators::test
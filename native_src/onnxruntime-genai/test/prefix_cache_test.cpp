@@ -0,0 +1,131 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "models/prefix_cache.h"
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+namespace {
+
+// The cache only looks at length and bytes, so the entries don't need real tensors
+std::shared_ptr<const KeyValuePrefix> MakePrefix(size_t length, size_t bytes_per_token = 10) {
+  auto prefix = std::make_shared<KeyValuePrefix>();
+  prefix->length = length;
+  prefix->bytes = length * bytes_per_token;
+  return prefix;
+}
+
+void Insert(PrefixCache& cache, const std::vector<int32_t>& tokens, size_t max_bytes = 1 << 20) {
+  cache.Insert(tokens, MakePrefix(tokens.size()), max_bytes);
+}
+
+size_t MatchLength(PrefixCache& cache, const std::vector<int32_t>& tokens) {
+  return cache.Lookup(tokens).length;
+}
+
+}  // namespace
+
+TEST(PrefixCacheTest, LookupFindsLongestSharedPrefix) {
+  PrefixCache cache;
+  EXPECT_EQ(cache.Lookup(std::vector<int32_t>{1, 2, 3}).prefix, nullptr);
+
+  Insert(cache, {1, 2, 3, 4, 5});
+  Insert(cache, {1, 2, 7, 8});
+  EXPECT_EQ(cache.EntryCount(), 2);
+
+  EXPECT_EQ(MatchLength(cache, {1, 2, 3, 4, 5, 6}), 5);  // Extends an entry
+  EXPECT_EQ(MatchLength(cache, {1, 2, 3, 9}), 3);        // Diverges inside an edge
+  EXPECT_EQ(MatchLength(cache, {1, 2, 9}), 2);           // Diverges at the branch
+  EXPECT_EQ(MatchLength(cache, {1, 2}), 2);
+  EXPECT_EQ(MatchLength(cache, {9, 1, 2}), 0);
+
+  // The returned entry holds at least the matched tokens
+  auto match = cache.Lookup(std::vector<int32_t>{1, 2, 7, 8, 9});
+  ASSERT_NE(match.prefix, nullptr);
+  EXPECT_EQ(match.length, 4);
+  EXPECT_EQ(match.prefix->length, 4);
+  EXPECT_GE(cache.Lookup(std::vector<int32_t>{1, 2, 3, 0}).prefix->length, 3);
+}
+
+TEST(PrefixCacheTest, InsertKeepsOnlyTheLongestOfNestedSequences) {
+  PrefixCache cache;
+
+  // A chat's next turn extends the previous one
+  Insert(cache, {1, 2, 3});
+  Insert(cache, {1, 2, 3, 4, 5});
+  EXPECT_EQ(cache.EntryCount(), 1);
+  EXPECT_EQ(cache.Bytes(), 50);
+
+  // Shorter sequences are already covered
+  Insert(cache, {1, 2, 3});
+  Insert(cache, {1, 2});
+  EXPECT_EQ(cache.EntryCount(), 1);
+  EXPECT_EQ(cache.Bytes(), 50);
+
+  // Replacing an entry with the same tokens
+  cache.Insert(std::vector<int32_t>{1, 2, 3, 4, 5}, MakePrefix(5, 20), 1 << 20);
+  EXPECT_EQ(cache.EntryCount(), 1);
+  EXPECT_EQ(cache.Bytes(), 100);
+
+  // Extending one branch of a split leaves the other alone
+  Insert(cache, {1, 2, 9});
+  Insert(cache, {1, 2, 9, 10});
+  EXPECT_EQ(cache.EntryCount(), 2);
+  EXPECT_EQ(MatchLength(cache, {1, 2, 3, 4, 5}), 5);
+  EXPECT_EQ(MatchLength(cache, {1, 2, 9, 10, 11}), 4);
+}
+
+TEST(PrefixCacheTest, EvictsLeastRecentlyUsed) {
+  PrefixCache cache;
+  Insert(cache, {1, 1, 1}, 100);
+  Insert(cache, {2, 2, 2}, 100);
+  Insert(cache, {3, 3, 3}, 100);
+  EXPECT_EQ(cache.EntryCount(), 3);
+
+  // Touch the oldest entry so the second one goes first
+  EXPECT_EQ(MatchLength(cache, {1, 1}), 2);
+  Insert(cache, {4, 4, 4}, 100);
+  EXPECT_EQ(cache.EntryCount(), 3);
+  EXPECT_EQ(cache.Bytes(), 90);
+  EXPECT_EQ(MatchLength(cache, {2, 2, 2}), 0);
+  EXPECT_EQ(MatchLength(cache, {1, 1, 1}), 3);
+
+  // A smaller budget evicts down to it, an entry above the budget isn't stored
+  Insert(cache, {5, 5}, 40);
+  EXPECT_EQ(cache.EntryCount(), 1);
+  EXPECT_EQ(cache.Bytes(), 20);
+  Insert(cache, {6, 6, 6, 6, 6}, 40);
+  EXPECT_EQ(MatchLength(cache, {6}), 0);
+
+  cache.Clear();
+  EXPECT_EQ(cache.EntryCount(), 0);
+  EXPECT_EQ(cache.Bytes(), 0);
+  EXPECT_EQ(MatchLength(cache, {5, 5}), 0);
+}
+
+TEST(PrefixCacheTest, EvictionCompactsTheTree) {
+  PrefixCache cache;
+  Insert(cache, {1, 2, 3, 4});
+  Insert(cache, {1, 2, 5, 6});
+  Insert(cache, {1, 2, 5, 7});
+
+  // Evict everything but the newest entry, the branches it passed through must still resolve
+  Insert(cache, {1, 2, 5, 7, 8}, 50);
+  EXPECT_EQ(cache.EntryCount(), 1);
+  EXPECT_EQ(MatchLength(cache, {1, 2, 3}), 2);
+  EXPECT_EQ(MatchLength(cache, {1, 2, 5, 6}), 3);
+  EXPECT_EQ(MatchLength(cache, {1, 2, 5, 7, 8, 9}), 5);
+
+  // And new branches can grow from the merged edge again
+  Insert(cache, {1, 2, 5, 6});
+  EXPECT_EQ(cache.EntryCount(), 2);
+  EXPECT_EQ(MatchLength(cache, {1, 2, 5, 6, 0}), 4);
+  EXPECT_EQ(MatchLength(cache, {1, 2, 5, 7, 8}), 5);
+}
+
+}  // namespace Generators::test
@@ -0,0 +1,107 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "models/rotary_shift.h"
+
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+namespace {
+
+// Rotary embedding of one row at position, as the model applies it to the keys it caches
+std::vector<float> Rotate(const std::vector<float>& row, size_t rotary_dim, float theta, bool interleaved, int64_t position,
+                          const std::vector<float>& factors = {}) {
+  std::vector<float> result = row;
+  const size_t pair_count = rotary_dim / 2;
+  for (size_t i = 0; i < pair_count; i++) {
+    const double angle = position * std::pow(static_cast<double>(theta), -2.0 * i / rotary_dim) / (factors.empty() ? 1.0 : factors[i]);
+    const size_t first = interleaved ? 2 * i : i;
+    const size_t second = interleaved ? 2 * i + 1 : i + pair_count;
+    result[first] = static_cast<float>(row[first] * std::cos(angle) - row[second] * std::sin(angle));
+    result[second] = static_cast<float>(row[first] * std::sin(angle) + row[second] * std::cos(angle));
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(RotaryShiftTest, MovesKeysToEarlierPositions) {
+  std::mt19937 engine(4);
+  std::normal_distribution<float> dist(0.0f, 1.0f);
+  const size_t head_size = 16;
+
+  for (bool interleaved : {false, true}) {
+    for (size_t rotary_dim : {size_t{16}, size_t{8}}) {
+      // Three positions in a row, each moved down by the same shift
+      const int64_t first_position = 1000, shift = 937;
+      std::vector<std::vector<float>> rows(3, std::vector<float>(head_size));
+      std::vector<float> keys;
+      for (size_t p = 0; p < rows.size(); p++) {
+        for (auto& x : rows[p])
+          x = dist(engine);
+        const auto rotated = Rotate(rows[p], rotary_dim, 10000.0f, interleaved, first_position + p);
+        keys.insert(keys.end(), rotated.begin(), rotated.end());
+      }
+
+      ShiftRotaryPositions(keys, head_size, rotary_dim == head_size ? 0 : rotary_dim, 10000.0f, interleaved, shift);
+
+      for (size_t p = 0; p < rows.size(); p++) {
+        const auto expected = Rotate(rows[p], rotary_dim, 10000.0f, interleaved, first_position - shift + p);
+        for (size_t i = 0; i < head_size; i++)
+          EXPECT_NEAR(keys[p * head_size + i], expected[i], 1e-4f) << "position " << p << " channel " << i;
+      }
+    }
+  }
+}
+
+TEST(RotaryShiftTest, ScaledFrequencies) {
+  std::mt19937 engine(5);
+  std::normal_distribution<float> dist(0.0f, 1.0f);
+  const size_t head_size = 8;
+  const std::vector<float> factors{1.0f, 1.5f, 4.0f, 8.0f};  // Like Llama 3 rope scaling, low frequencies are slowed most
+
+  std::vector<float> row(head_size);
+  for (auto& x : row)
+    x = dist(engine);
+  auto keys = Rotate(row, head_size, 500000.0f, false, 3000, factors);
+
+  ShiftRotaryPositions(keys, head_size, 0, 500000.0f, false, 2000, factors);
+
+  const auto expected = Rotate(row, head_size, 500000.0f, false, 1000, factors);
+  for (size_t i = 0; i < head_size; i++)
+    EXPECT_NEAR(keys[i], expected[i], 1e-4f) << "channel " << i;
+
+  const std::vector<float> wrong_count{1.0f, 2.0f};
+  EXPECT_THROW(ShiftRotaryPositions(keys, head_size, 0, 500000.0f, false, 1, wrong_count), std::runtime_error);
+}
+
+TEST(RotaryShiftTest, AttentionSinkSupport) {
+  // Evicting from a RoPE model without decoder.rotary_embedding would leave the kept keys at their old positions
+  for (const char* model_type : {"llama", "phi3", "qwen2", "mistral", "gemma"})
+    EXPECT_THROW(CheckAttentionSinkSupport(model_type, false, 2048), std::runtime_error) << model_type;
+  EXPECT_NO_THROW(CheckAttentionSinkSupport("llama", true, 2048));
+  EXPECT_NO_THROW(CheckAttentionSinkSupport("gpt2", false, 1024));
+
+  // A single rotary_embedding can't describe these
+  EXPECT_THROW(CheckAttentionSinkSupport("gemma3_text", true, 2048), std::runtime_error);
+  EXPECT_THROW(CheckAttentionSinkSupport("phi3", true, 8192), std::runtime_error);
+  EXPECT_NO_THROW(CheckAttentionSinkSupport("phi3", true, 4096));
+}
+
+TEST(RotaryShiftTest, ZeroShiftAndBadShapes) {
+  std::vector<float> keys{1.0f, 2.0f, 3.0f, 4.0f};
+  ShiftRotaryPositions(keys, 4, 0, 10000.0f, false, 0);
+  EXPECT_EQ(keys, (std::vector<float>{1.0f, 2.0f, 3.0f, 4.0f}));
+
+  EXPECT_THROW(ShiftRotaryPositions(keys, 3, 0, 10000.0f, false, 1), std::runtime_error);
+  EXPECT_THROW(ShiftRotaryPositions(keys, 4, 3, 10000.0f, false, 1), std::runtime_error);
+  EXPECT_THROW(ShiftRotaryPositions(keys, 4, 8, 10000.0f, false, 1), std::runtime_error);
+}
+
+}  // namespace Generators::test
@@ -19,6 +19,7 @@
 #include "../src/span.h"
 #include <ort_genai.h>
 #include "statistics_helper.h"
+#include "../src/cpu/cpu_sampling.h"
 
 // Our working directory is generators/build so one up puts us in the root directory:
 #ifndef MODEL_PATH
@@ -189,7 +190,7 @@ TEST(SamplingBenchmarks, PerformanceTests) {
   }
 
   std::vector<int> batch_sizes = {1};
-  std::vector<int> vocab_sizes = {201088};
+  std::vector<int> vocab_sizes = {201088, 262144};
   std::vector<int> ks = {1, 50};
 
   for (const auto& device_type : device_types) {
@@ -213,3 +214,91 @@ TEST(SamplingBenchmarks, PerformanceTests) {
 
   PrintSummary(all_results);
 }
+
+// The sampling path as it was before Generators::cpu::SamplingData: full softmax, full sort and a
+// discrete_distribution over the vocabulary. Kept here as the baseline for the kernel benchmark below.
+static int32_t LegacySampleTopP(std::span<const float> logits, float p, float temperature, std::mt19937& engine) {
+  std::vector<float> scores(logits.begin(), logits.end());
+  const float max_score = *std::max_element(scores.begin(), scores.end());
+  for (float& score : scores)
+    score = std::exp((score - max_score) / temperature);
+  const float exp_sum = std::accumulate(scores.begin(), scores.end(), 0.0f);
+  for (float& score : scores)
+    score /= exp_sum;
+
+  std::vector<int32_t> indices(scores.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  std::sort(indices.begin(), indices.end(), [&scores](int32_t i, int32_t j) { return scores[i] > scores[j]; });
+
+  float cumulative_prob = 0.0f;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    cumulative_prob += scores[indices[i]];
+    if (cumulative_prob >= p) {
+      for (size_t j = i + 1; j < indices.size(); ++j)
+        scores[indices[j]] = 0.0f;
+      break;
+    }
+  }
+
+  std::discrete_distribution<> dist(scores.begin(), scores.end());
+  return dist(engine);
+}
+
+static int32_t LegacySampleTopK(std::span<const float> scores, int k, float temperature, std::mt19937& engine) {
+  std::vector<int> indices(scores.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  std::partial_sort(indices.begin(), indices.begin() + k, indices.end(), [scores = scores.data()](int i, int j) { return scores[i] > scores[j]; });
+  std::vector<float> top_k_scores(k);
+  for (int i = 0; i < k; i++)
+    top_k_scores[i] = std::exp((scores[indices[i]] - scores[indices[0]]) / temperature);
+  std::discrete_distribution<> dis(top_k_scores.begin(), top_k_scores.end());
+  return indices[dis(engine)];
+}
+
+template <typename Sample>
+static double MeasureKernelLatency(const std::vector<std::vector<float>>& rows, Sample&& sample) {
+  std::vector<double> latencies;
+  for (const auto& row : rows) {
+    auto start = std::chrono::high_resolution_clock::now();
+    sample(row);
+    auto stop = std::chrono::high_resolution_clock::now();
+    latencies.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+  }
+  return mean(latencies);
+}
+
+// Compares the CPU sampling kernels against the previous implementation without any model or generator overhead
+TEST(SamplingBenchmarks, CpuKernelPerformanceTests) {
+  constexpr int num_rows = 50;
+  constexpr int k = 50;
+  constexpr float p = 0.95f;
+  constexpr float temperature = 0.8f;
+
+  std::mt19937 engine(12345);
+  std::uniform_int_distribution<> dist(5, 25);
+
+  std::cout << "\n--- CPU Sampling Kernel Benchmark (legacy vs. cpu::SamplingData) ---\n";
+  std::cout << std::left << std::setw(12) << "Vocab" << std::setw(12) << "Function" << std::setw(15) << "Legacy(us)"
+            << std::setw(15) << "Kernel(us)" << std::setw(10) << "Speedup" << "\n";
+  std::cout << std::string(64, '-') << "\n";
+
+  for (int vocab_size : {32000, 201088, 262144}) {
+    std::vector<std::vector<float>> rows(num_rows, std::vector<float>(vocab_size));
+    for (auto& row : rows)
+      CreateRandomLogits(row.data(), dist(engine), vocab_size, 1, engine);
+
+    Generators::cpu::SamplingData sampling_data{vocab_size};
+    auto report = [&](const char* function, double legacy_us, double kernel_us) {
+      std::cout << std::left << std::fixed << std::setprecision(2) << std::setw(12) << vocab_size << std::setw(12)
+                << function << std::setw(15) << legacy_us << std::setw(15) << kernel_us << std::setw(10)
+                << legacy_us / kernel_us << "\n";
+    };
+
+    report("TopP",
+           MeasureKernelLatency(rows, [&](const std::vector<float>& row) { LegacySampleTopP(row, p, temperature, engine); }),
+           MeasureKernelLatency(rows, [&](const std::vector<float>& row) { sampling_data.SampleTopP(row, p, temperature, engine); }));
+    report("TopK",
+           MeasureKernelLatency(rows, [&](const std::vector<float>& row) { LegacySampleTopK(row, k, temperature, engine); }),
+           MeasureKernelLatency(rows, [&](const std::vector<float>& row) { sampling_data.SampleTopK(row, k, temperature, engine); }));
+  }
+}
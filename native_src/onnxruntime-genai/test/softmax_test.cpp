@@ -0,0 +1,303 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "softmax.h"
+#include "cpu/cpu_sampling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+namespace {
+
+// Sizes around every vector width (4, 8, 16 floats and their unrolled loops) plus a vocabulary sized row
+const std::vector<size_t> kSizes{1, 3, 4, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 1000, 262144};
+
+std::vector<float> RandomLogits(size_t size, std::mt19937& engine) {
+  std::normal_distribution<float> dist(0.0f, 4.0f);
+  std::vector<float> logits(size);
+  for (auto& logit : logits)
+    logit = dist(engine);
+  // Masked tokens
+  if (size > 2) {
+    logits[1] = -std::numeric_limits<float>::infinity();
+    logits[size - 1] = -std::numeric_limits<float>::infinity();
+  }
+  return logits;
+}
+
+std::vector<double> ReferenceLogSoftmax(const std::vector<float>& logits, double temperature) {
+  const double max_logit = *std::max_element(logits.begin(), logits.end());
+  double sum = 0.0;
+  for (float logit : logits)
+    sum += std::exp((logit - max_logit) / temperature);
+  std::vector<double> result(logits.size());
+  for (size_t i = 0; i < logits.size(); i++)
+    result[i] = (logits[i] - max_logit) / temperature - std::log(sum);
+  return result;
+}
+
+// Finite fp16 logits (as bits) in about [-16, 16], with masked tokens like RandomLogits
+std::vector<uint16_t> RandomFloat16Logits(size_t size, std::mt19937& engine) {
+  std::uniform_int_distribution<int> exponent(1, 19), mantissa(0, 0x3FF), sign(0, 1);
+  std::vector<uint16_t> logits(size);
+  for (auto& logit : logits)
+    logit = static_cast<uint16_t>(sign(engine) << 15 | exponent(engine) << 10 | mantissa(engine));
+  if (size > 2) {
+    logits[1] = 0xFC00;  // -infinity
+    logits[size - 1] = 0xFC00;
+  }
+  return logits;
+}
+
+// Runs the vector math with the scalar code while alive
+struct ScalarVectorMath {
+  ScalarVectorMath() { cpu::UseScalarVectorMath(true); }
+  ~ScalarVectorMath() { cpu::UseScalarVectorMath(false); }
+};
+
+std::vector<float> ToFloat(const std::vector<uint16_t>& values) {
+  std::vector<float> result(values.size());
+  for (size_t i = 0; i < values.size(); i++)
+    result[i] = cpu::Float16ToFloat32(values[i]);
+  return result;
+}
+
+}  // namespace
+
+TEST(SoftmaxTest, MaxValue) {
+  SCOPED_TRACE(cpu::VectorIsa());
+  std::mt19937 engine(1);
+  for (size_t size : kSizes) {
+    auto logits = RandomLogits(size, engine);
+    EXPECT_EQ(cpu::MaxValue(logits), *std::max_element(logits.begin(), logits.end())) << "size " << size;
+  }
+  EXPECT_EQ(cpu::MaxValue({}), -std::numeric_limits<float>::infinity());
+}
+
+TEST(SoftmaxTest, ExpAccuracy) {
+  SCOPED_TRACE(cpu::VectorIsa());
+  // Sweep the whole range that doesn't underflow, in both vectorized and scalar tail positions
+  std::vector<float> inputs;
+  for (float x = -87.0f; x <= 0.0f; x += 0.01f)
+    inputs.push_back(x);
+  std::vector<float> outputs(inputs.size());
+  const float sum = cpu::ExpScaled(inputs, 0.0f, 1.0f, outputs);
+
+  double reference_sum = 0.0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    const double expected = std::exp(static_cast<double>(inputs[i]));
+    reference_sum += expected;
+    ASSERT_NEAR(outputs[i], expected, expected * 1e-6) << "exp(" << inputs[i] << ")";
+  }
+  EXPECT_NEAR(sum, reference_sum, reference_sum * 1e-5);
+  EXPECT_NEAR(cpu::SumExpScaled(inputs, 0.0f, 1.0f), sum, sum * 1e-6);
+
+  // Underflow and masked tokens give exactly 0
+  std::vector<float> tiny(64, -100.0f);
+  tiny[5] = -std::numeric_limits<float>::infinity();
+  EXPECT_EQ(cpu::ExpScaled(tiny, 0.0f, 1.0f, tiny), 0.0f);
+  EXPECT_TRUE(std::all_of(tiny.begin(), tiny.end(), [](float v) { return v == 0.0f; }));
+}
+
+TEST(SoftmaxTest, SoftmaxMatchesReference) {
+  SCOPED_TRACE(cpu::VectorIsa());
+  std::mt19937 engine(2);
+  for (float temperature : {0.3f, 1.0f, 2.5f}) {
+    for (size_t size : kSizes) {
+      auto logits = RandomLogits(size, engine);
+      const auto reference = ReferenceLogSoftmax(logits, temperature);
+
+      auto probs = logits;
+      Softmax(probs, temperature);
+      double total = 0.0;
+      for (size_t i = 0; i < size; i++) {
+        const double expected = std::exp(reference[i]);
+        total += probs[i];
+        ASSERT_NEAR(probs[i], expected, 1e-6 + expected * 1e-5) << "size " << size << " index " << i << " temperature " << temperature;
+      }
+      EXPECT_NEAR(total, 1.0, 1e-4);
+    }
+  }
+}
+
+TEST(SoftmaxTest, LogSoftmaxMatchesReference) {
+  SCOPED_TRACE(cpu::VectorIsa());
+  std::mt19937 engine(3);
+  for (float temperature : {0.3f, 1.0f, 2.5f}) {
+    for (size_t size : kSizes) {
+      auto logits = RandomLogits(size, engine);
+      const auto reference = ReferenceLogSoftmax(logits, temperature);
+
+      auto log_probs = logits;
+      LogSoftMax(log_probs, temperature);
+      for (size_t i = 0; i < size; i++) {
+        if (std::isinf(reference[i])) {
+          ASSERT_TRUE(std::isinf(log_probs[i]) && log_probs[i] < 0) << "size " << size << " index " << i;
+          continue;
+        }
+        ASSERT_NEAR(log_probs[i], reference[i], 1e-5 * std::max(1.0, std::abs(reference[i])))
+            << "size " << size << " index " << i << " temperature " << temperature;
+      }
+    }
+  }
+}
+
+TEST(SoftmaxTest, FindFirstGreater) {
+  SCOPED_TRACE(cpu::VectorIsa());
+  for (size_t size : kSizes) {
+    std::vector<float> values(size, 0.0f);
+    EXPECT_EQ(cpu::FindFirstGreater(values, 0, 0.0f), size);
+    for (size_t position : {size_t{0}, size / 2, size - 1}) {
+      values[position] = 1.0f;
+      EXPECT_EQ(cpu::FindFirstGreater(values, 0, 0.5f), position) << "size " << size;
+      EXPECT_EQ(cpu::FindFirstGreater(values, position + 1, 0.5f), size) << "size " << size;
+      values[position] = 0.0f;
+    }
+  }
+}
+
+TEST(SoftmaxTest, Float16ToFloat32) {
+  SCOPED_TRACE(cpu::VectorIsa());
+  // Every fp16 value, including subnormals, infinities and NaN
+  std::vector<uint16_t> values(65536);
+  for (size_t i = 0; i < values.size(); i++)
+    values[i] = static_cast<uint16_t>(i);
+
+  EXPECT_EQ(cpu::Float16ToFloat32(0x3C00), 1.0f);
+  EXPECT_EQ(cpu::Float16ToFloat32(0xC000), -2.0f);
+  EXPECT_EQ(cpu::Float16ToFloat32(0x7BFF), 65504.0f);
+  EXPECT_EQ(cpu::Float16ToFloat32(0x0001), std::ldexp(1.0f, -24));
+  EXPECT_EQ(cpu::Float16ToFloat32(0xFC00), -std::numeric_limits<float>::infinity());
+  EXPECT_TRUE(std::isnan(cpu::Float16ToFloat32(0x7E00)));
+
+  for (size_t size : {size_t{7}, size_t{65536}}) {
+    std::vector<float> converted(size);
+    cpu::Float16ToFloat32(std::span<const uint16_t>{values.data(), size}, converted);
+    for (size_t i = 0; i < size; i++) {
+      const float expected = cpu::Float16ToFloat32(values[i]);
+      if (std::isnan(expected))
+        ASSERT_TRUE(std::isnan(converted[i])) << "value " << i;
+      else
+        ASSERT_EQ(converted[i], expected) << "value " << i;
+    }
+  }
+}
+
+TEST(SoftmaxTest, Float16Search) {
+  SCOPED_TRACE(cpu::VectorIsa());
+  std::mt19937 engine(4);
+  for (size_t size : kSizes) {
+    auto logits = RandomFloat16Logits(size, engine);
+    const auto floats = ToFloat(logits);
+    EXPECT_EQ(cpu::ArgMaxFloat16(logits), static_cast<size_t>(std::max_element(floats.begin(), floats.end()) - floats.begin()))
+        << "size " << size;
+
+    const uint16_t threshold = logits[size / 2];
+    for (size_t begin : {size_t{0}, size / 3}) {
+      const size_t expected = std::find_if(floats.begin() + begin, floats.end(),
+                                           [&](float v) { return v > floats[size / 2]; }) -
+                              floats.begin();
+      EXPECT_EQ(cpu::FindFirstGreaterFloat16(logits, begin, threshold), expected) << "size " << size;
+    }
+  }
+
+  // The first of equal maxima wins, and negative values order by magnitude
+  const std::vector<uint16_t> ties{0xC000 /* -2 */, 0xBC00 /* -1 */, 0xFC00 /* -inf */, 0xBC00};
+  EXPECT_EQ(cpu::ArgMaxFloat16(ties), 1u);
+  EXPECT_EQ(cpu::ArgMaxFloat16({}), 0u);
+}
+
+TEST(SoftmaxTest, SelectedIsaMatchesScalar) {
+  SCOPED_TRACE(cpu::VectorIsa());
+#if defined(__aarch64__) || defined(_M_ARM64)
+  EXPECT_STREQ(cpu::VectorIsa(), "neon");
+#endif
+  std::vector<uint16_t> all_float16(65536);
+  for (size_t i = 0; i < all_float16.size(); i++)
+    all_float16[i] = static_cast<uint16_t>(i);
+
+  std::mt19937 engine(7);
+  for (size_t size : kSizes) {
+    const auto logits = RandomLogits(size, engine);
+    const auto float16_logits = RandomFloat16Logits(size, engine);
+    const std::span<const uint16_t> float16_values{all_float16.data(), std::min(size, all_float16.size())};
+
+    auto run = [&](std::vector<float>& exps, std::vector<float>& affine, std::vector<float>& converted) {
+      const float max_value = cpu::MaxValue(logits);
+      exps.resize(size);
+      cpu::ExpScaled(logits, max_value, 0.7f, exps);
+      affine = logits;
+      cpu::Affine(affine, max_value, 0.5f, 1.0f);
+      converted.resize(float16_values.size());
+      cpu::Float16ToFloat32(float16_values, converted);
+      return std::make_pair(max_value, std::vector<size_t>{cpu::FindFirstGreater(logits, size / 3, 0.0f),
+                                                           cpu::ArgMaxFloat16(float16_logits),
+                                                           cpu::FindFirstGreaterFloat16(float16_logits, size / 3, 0x3C00 /* 1 */)});
+    };
+
+    std::vector<float> exps, affine, converted, scalar_exps, scalar_affine, scalar_converted;
+    const auto results = run(exps, affine, converted);
+    std::pair<float, std::vector<size_t>> scalar_results;
+    {
+      ScalarVectorMath scalar;
+      scalar_results = run(scalar_exps, scalar_affine, scalar_converted);
+    }
+
+    // Maxima and searches are exact; fused multiply-adds may round differently in the last bit. Masked tokens stay
+    // -infinity.
+    EXPECT_EQ(results, scalar_results) << "size " << size;
+    for (size_t i = 0; i < size; i++) {
+      ASSERT_NEAR(exps[i], scalar_exps[i], 1e-6f * scalar_exps[i]) << "size " << size << " index " << i;
+      if (std::isinf(scalar_affine[i]))
+        ASSERT_EQ(affine[i], scalar_affine[i]) << "size " << size << " index " << i;
+      else
+        ASSERT_NEAR(affine[i], scalar_affine[i], 1e-6f * std::abs(scalar_affine[i])) << "size " << size << " index " << i;
+    }
+    for (size_t i = 0; i < converted.size(); i++) {
+      if (std::isnan(scalar_converted[i]))
+        ASSERT_TRUE(std::isnan(converted[i])) << "value " << i;
+      else
+        ASSERT_EQ(converted[i], scalar_converted[i]) << "value " << i;
+    }
+  }
+
+  // Top-k sampling picks the same tokens through either implementation
+  const auto float16_logits = RandomFloat16Logits(32000, engine);
+  cpu::SamplingData sampling{32000}, scalar_sampling{32000};
+  std::mt19937 sampling_engine(8), scalar_sampling_engine(8);
+  for (int k : {1, 5, 50}) {
+    for (int i = 0; i < 20; i++) {
+      const int32_t token = sampling.SampleTopK(std::span<const uint16_t>{float16_logits}, k, 0.8f, sampling_engine);
+      ScalarVectorMath scalar;
+      EXPECT_EQ(token, scalar_sampling.SampleTopK(std::span<const uint16_t>{float16_logits}, k, 0.8f, scalar_sampling_engine));
+    }
+  }
+}
+
+TEST(SoftmaxTest, Float16TopKSampling) {
+  // Sampling from fp16 scores matches sampling from the same scores converted to float
+  std::mt19937 engine(5);
+  const auto logits = RandomFloat16Logits(32000, engine);
+  const auto floats = ToFloat(logits);
+  cpu::SamplingData float_sampling{32000}, float16_sampling{32000};
+  std::mt19937 float_engine(6), float16_engine(6);
+  for (int k : {1, 5, 50}) {
+    for (int i = 0; i < 20; i++) {
+      EXPECT_EQ(float16_sampling.SampleTopK(std::span<const uint16_t>{logits}, k, 0.8f, float16_engine),
+                float_sampling.SampleTopK(std::span<const float>{floats}, k, 0.8f, float_engine));
+      EXPECT_EQ(float16_sampling.SampleTopKTopP(std::span<const uint16_t>{logits}, k, 0.9f, 1.0f, float16_engine),
+                float_sampling.SampleTopKTopP(std::span<const float>{floats}, k, 0.9f, 1.0f, float_engine));
+    }
+  }
+}
+
+}  // namespace Generators::test
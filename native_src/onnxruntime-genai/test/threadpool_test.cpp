@@ -0,0 +1,76 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "models/threadpool.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+TEST(ThreadPoolTest, ComputeRunsEachItemOnce) {
+  constexpr size_t num_work_items = 37;
+
+  ThreadPool pool{4};
+  EXPECT_EQ(pool.NumThreads(), 4);
+
+  // Reuse the same workers across many calls, as a decode loop does
+  for (size_t round = 0; round < 100; ++round) {
+    std::vector<std::atomic<size_t>> hits(num_work_items);
+    pool.Compute(num_work_items, [&hits](size_t i) { ++hits[i]; });
+
+    for (const auto& hit : hits) {
+      ASSERT_EQ(hit, 1);
+    }
+  }
+}
+
+TEST(ThreadPoolTest, ComputeWithSingleThread) {
+  ThreadPool pool{1};
+
+  size_t work_counter = 0;
+  pool.Compute(8, [&work_counter](size_t) { ++work_counter; });
+
+  EXPECT_EQ(work_counter, 8);
+}
+
+TEST(ThreadPoolTest, ComputeRethrowsWorkItemException) {
+  ThreadPool pool{4};
+
+  EXPECT_THROW(pool.Compute(16, [](size_t i) {
+    if (i == 7) throw std::runtime_error("work item failed");
+  }),
+               std::runtime_error);
+
+  // The pool remains usable afterwards
+  std::atomic<size_t> work_counter = 0;
+  pool.Compute(16, [&work_counter](size_t) { ++work_counter; });
+  EXPECT_EQ(work_counter, 16);
+}
+
+TEST(ThreadPoolTest, ConcurrentComputeCalls) {
+  constexpr size_t num_callers = 3, num_rounds = 100, num_work_items = 8;
+
+  ThreadPool pool{4};
+  std::atomic<size_t> work_counter = 0;
+
+  std::vector<std::thread> callers;
+  for (size_t c = 0; c < num_callers; ++c) {
+    callers.emplace_back([&] {
+      for (size_t round = 0; round < num_rounds; ++round) {
+        pool.Compute(num_work_items, [&work_counter](size_t) { ++work_counter; });
+      }
+    });
+  }
+  for (auto& caller : callers) {
+    caller.join();
+  }
+
+  EXPECT_EQ(work_counter, num_callers * num_rounds * num_work_items);
+}
+
+}  // namespace Generators::test
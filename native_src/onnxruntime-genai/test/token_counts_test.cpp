@@ -0,0 +1,88 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "token_counts.h"
+
+#include <algorithm>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+TEST(TokenCountsTest, AddAndRemove) {
+  TokenCounts counts;
+  const std::vector<int32_t> tokens{5, 3, 5, 7, 5};
+  counts.Add(tokens);
+  EXPECT_EQ(counts.DistinctCount(), 3);
+  EXPECT_EQ(counts.Count(5), 3);
+  EXPECT_EQ(counts.Count(3), 1);
+  EXPECT_EQ(counts.Count(4), 0);
+
+  // Rewinding the last three tokens
+  counts.Remove(std::span<const int32_t>(tokens).subspan(2, 3));
+  EXPECT_EQ(counts.DistinctCount(), 2);
+  EXPECT_EQ(counts.Count(5), 1);
+  EXPECT_EQ(counts.Count(7), 0);
+
+  counts.Add(7);
+  EXPECT_EQ(counts.Count(7), 1);
+}
+
+TEST(TokenCountsTest, Penalties) {
+  TokenCounts counts;
+  counts.Add(std::vector<int32_t>{1, 2, 2, 2, 9});  // 9 is outside the scores and ignored
+
+  std::vector<float> scores{1.0f, 2.0f, -2.0f, 4.0f};
+  counts.ApplyRepetitionPenalty(scores, 2.0f);
+  EXPECT_EQ(scores, (std::vector<float>{1.0f, 1.0f, -4.0f, 4.0f}));
+
+  counts.ApplyFrequencyAndPresencePenalties(scores, 0.5f, 0.25f);
+  EXPECT_EQ(scores, (std::vector<float>{1.0f, 0.25f, -5.75f, 4.0f}));
+
+  // Neutral settings leave the scores as they are
+  counts.ApplyRepetitionPenalty(scores, 1.0f);
+  counts.ApplyFrequencyAndPresencePenalties(scores, 0.0f, 0.0f);
+  EXPECT_EQ(scores, (std::vector<float>{1.0f, 0.25f, -5.75f, 4.0f}));
+}
+
+// Counts kept up to date through appends and rewinds penalize like counting the whole sequence every step
+TEST(TokenCountsTest, IncrementalMatchesRecount) {
+  std::mt19937 engine(5);
+  std::uniform_int_distribution<int32_t> token_dist(0, 63);
+  const size_t vocab_size = 64;
+
+  std::vector<int32_t> sequence;
+  TokenCounts counts;
+  for (int step = 0; step < 500; step++) {
+    if (step % 50 == 49 && sequence.size() > 10) {
+      const size_t length = sequence.size() - 10;
+      counts.Remove(std::span<const int32_t>(sequence).subspan(length, 10));
+      sequence.resize(length);
+    }
+    const int32_t token = token_dist(engine);
+    sequence.push_back(token);
+    counts.Add(token);
+
+    std::vector<float> scores(vocab_size), expected(vocab_size);
+    for (size_t i = 0; i < vocab_size; i++)
+      scores[i] = expected[i] = static_cast<float>(i) - 32.0f;
+
+    counts.ApplyRepetitionPenalty(scores, 1.3f);
+    counts.ApplyFrequencyAndPresencePenalties(scores, 0.2f, 0.6f);
+
+    std::unordered_set<int32_t> unique(sequence.begin(), sequence.end());
+    for (int32_t t : unique) {
+      const float score = expected[t];
+      expected[t] = score < 0 ? score * 1.3f : score / 1.3f;
+      expected[t] -= static_cast<float>(std::count(sequence.begin(), sequence.end(), t)) * 0.2f + 0.6f;
+    }
+    ASSERT_EQ(counts.DistinctCount(), unique.size()) << "step " << step;
+    for (size_t i = 0; i < vocab_size; i++)
+      ASSERT_FLOAT_EQ(scores[i], expected[i]) << "step " << step << " token " << i;
+  }
+}
+
+}  // namespace Generators::test
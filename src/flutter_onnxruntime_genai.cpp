@@ -12,12 +12,25 @@
  */
 
 #include "flutter_onnxruntime_genai.h"
+#include "include/dart_native_port.h"
 #include "include/ort_genai_c.h"
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <cstdio>
 #include <signal.h>
 
@@ -98,13 +111,13 @@ static void install_signal_handlers() {
 #endif
 
 // =============================================================================
-// Thread-safe result buffer management
+// Result and error management
 // =============================================================================
 
 namespace {
-// Thread-local storage for result strings
-// This avoids memory management issues when returning strings to Dart
-thread_local std::string g_result_buffer;
+// Last error of the calling thread, read back through get_last_error. Results
+// are returned in caller-owned allocations, so concurrent requests on
+// different threads never share a buffer.
 thread_local std::string g_error_buffer;
 
 // Mutex for thread-safe operations
@@ -113,12 +126,24 @@ std::mutex g_init_mutex;
 // Track initialization state
 bool g_initialized = false;
 
+// Set by shutdown_onnx_genai while requests still hold models; the last of
+// them to be released finishes the shutdown
+bool g_shutdown_requested = false;
+
 // Track if logging/signal handlers are set up
 bool g_debug_initialized = false;
 } // namespace
 
 // Initialize debug features (logging + signal handlers)
 static void init_debug_features() {
+  {
+    // Every entry point that uses ONNX Runtime GenAI starts here, so
+    // shutdown_onnx_genai knows there is something to shut down. Using it
+    // again also cancels a shutdown still waiting on orphaned models.
+    std::lock_guard<std::mutex> lock(g_init_mutex);
+    g_initialized = true;
+    g_shutdown_requested = false;
+  }
 #if ONNX_DEBUG_LOG
   if (!g_debug_initialized) {
     g_debug_initialized = true;
@@ -143,24 +168,41 @@ static void init_debug_features() {
 }
 
 /**
- * @brief Safely copy a string to the result buffer and return a pointer.
+ * @brief Copy a string into a new allocation owned by the caller.
  *
- * The returned pointer is valid until the next call to this function
- * from the same thread. Dart must copy the string before the next FFI call.
+ * The caller releases it with free_result. Returns NULL only if the
+ * allocation fails.
  */
-static const char *set_result(const std::string &result) {
-  g_result_buffer = result;
-  return g_result_buffer.c_str();
+static char *set_result(const std::string &result) {
+  char *copy = static_cast<char *>(std::malloc(result.size() + 1));
+  if (copy == nullptr) {
+    DEBUG_ERROR("Failed to allocate %zu byte result", result.size() + 1);
+    return nullptr;
+  }
+  std::memcpy(copy, result.c_str(), result.size() + 1);
+  return copy;
 }
 
 /**
- * @brief Set an error message and return it.
+ * @brief Set the calling thread's error message and return it.
  */
 static const char *set_error(const std::string &error) {
   g_error_buffer = "ERROR: " + error;
   return g_error_buffer.c_str();
 }
 
+/**
+ * @brief Set the calling thread's error message and return a caller-owned copy.
+ */
+static char *error_result(const std::string &error) {
+  return set_result(set_error(error));
+}
+
+/**
+ * @brief Return a caller-owned copy of the error a helper already set.
+ */
+static char *last_error_result() { return set_result(g_error_buffer); }
+
 /**
  * @brief Handle OgaResult and return error message if present.
  * @return true if there was an error, false otherwise
@@ -169,7 +211,7 @@ static bool check_oga_result(OgaResult *result, const char *context) {
   if (result != nullptr) {
     const char *error_msg = OgaResultGetError(result);
     if (error_msg != nullptr) {
-      g_error_buffer = std::string(context) + ": " + error_msg;
+      set_error(std::string(context) + ": " + error_msg);
       OgaDestroyResult(result);
       return true;
     }
@@ -179,590 +221,2409 @@ static bool check_oga_result(OgaResult *result, const char *context) {
 }
 
 // =============================================================================
-// FFI Exported Functions
+// Model Registry - persistent model/tokenizer/processor handles
 // =============================================================================
 
-extern "C" {
-
+namespace {
 /**
- * @brief Check if the native library and model can be loaded.
- *
- * Use this function to verify that:
- * 1. The native library is properly linked
- * 2. The model path is accessible
- * 3. The model can be loaded successfully
+ * @brief A loaded model together with the objects derived from it.
  *
- * @param model_path Path to the ONNX GenAI model directory
- * @return 0 on success, negative error codes on failure:
- *         -1: NULL path provided
- *         -2: Model creation failed
- *         -3: Tokenizer creation failed
- *         1: Model loaded and verified successfully
+ * One entry is shared by every request that runs against the same config, so
+ * the (expensive) session initialization and weight loading happen only once.
  */
-FFI_PLUGIN_EXPORT int32_t check_native_health(const char *model_path) {
-  init_debug_features();
-  DEBUG_LOG("=== check_native_health START ===");
-  DEBUG_LOG("model_path: %s", model_path ? model_path : "NULL");
-
-  if (model_path == nullptr || strlen(model_path) == 0) {
-    DEBUG_ERROR("NULL or empty model_path provided");
-    return -1; // NULL or empty path
-  }
-
-  DEBUG_LOG("Step 1: Creating model...");
+struct LoadedModel {
+  std::string key;
   OgaModel *model = nullptr;
-  OgaResult *result = OgaCreateModel(model_path, &model);
-
-  if (check_oga_result(result, "Model creation failed") || model == nullptr) {
-    DEBUG_ERROR("Model creation failed");
-    return -2; // Model creation failed
-  }
-  DEBUG_LOG("Step 1: Model created successfully");
-
-  // Try to create a tokenizer to verify model integrity
-  DEBUG_LOG("Step 2: Creating tokenizer...");
   OgaTokenizer *tokenizer = nullptr;
-  result = OgaCreateTokenizer(model, &tokenizer);
+  // NULL for text-only models that have no multimodal processor
+  OgaMultiModalProcessor *processor = nullptr;
+  int32_t ref_count = 0;
+  // References owned by load_model handles, the rest are held by requests
+  int32_t handle_refs = 0;
+  // Removed from the registry by shutdown_onnx_genai while requests still held
+  // it; the last release_model destroys it
+  bool orphaned = false;
+  // Prefix cache budget set with set_prefix_cache_size, 0 for the config value
+  std::atomic<int64_t> prefix_cache_bytes{0};
+  // Image features cache budget set with set_image_cache_size, 0 for the config value
+  std::atomic<int64_t> image_features_cache_bytes{0};
+  // Prompt lookup settings set with set_prompt_lookup, 0 for the config values
+  std::atomic<int32_t> prompt_lookup_ngram_size{0};
+  std::atomic<int32_t> num_speculative_tokens{0};
+};
+
+// Describes each live config handle ("<model_path>|<provider edits>...") so
+// that identical configurations resolve to the same loaded model.
+std::unordered_map<int64_t, std::string> g_config_keys;
+
+// Loaded models keyed by their config description
+std::unordered_map<std::string, LoadedModel *> g_model_registry;
+
+// Guards g_config_keys, g_model_registry, LoadedModel::ref_count and
+// g_orphaned_models
+std::mutex g_registry_mutex;
+
+// Models shutdown_onnx_genai left to their requests. The last one to be
+// destroyed shuts ONNX Runtime down.
+size_t g_orphaned_models = 0;
+} // namespace
 
-  if (check_oga_result(result, "Tokenizer creation failed") ||
-      tokenizer == nullptr) {
-    DEBUG_ERROR("Tokenizer creation failed");
-    OgaDestroyModel(model);
-    return -3; // Tokenizer creation failed
+/**
+ * @brief Append a configuration edit to the key of a config handle.
+ */
+static void append_config_key(int64_t config_handle, const std::string &edit) {
+  std::lock_guard<std::mutex> lock(g_registry_mutex);
+  auto it = g_config_keys.find(config_handle);
+  if (it != g_config_keys.end()) {
+    it->second += "|" + edit;
   }
-  DEBUG_LOG("Step 2: Tokenizer created successfully");
-
-  // Cleanup
-  DEBUG_LOG("Step 3: Cleaning up...");
-  OgaDestroyTokenizer(tokenizer);
-  OgaDestroyModel(model);
-  DEBUG_LOG("Step 3: Cleanup complete");
-  DEBUG_LOG("=== check_native_health END (success) ===");
+}
 
-  return 1; // Success
+/**
+ * @brief Destroy a loaded model and everything created from it.
+ */
+static void destroy_loaded_model(LoadedModel *entry) {
+  if (entry->processor)
+    OgaDestroyMultiModalProcessor(entry->processor);
+  if (entry->tokenizer)
+    OgaDestroyTokenizer(entry->tokenizer);
+  if (entry->model)
+    OgaDestroyModel(entry->model);
+  delete entry;
 }
 
 /**
- * @brief Run text-only inference with the model.
- *
- * WARNING: This is a long-running operation! Call from a background Isolate
- * only.
- *
- * @param model_path Path to the ONNX GenAI model directory
- * @param prompt The text prompt for generation
- * @param max_length Maximum number of tokens to generate (0 for default)
- * @return Generated text on success, error message starting with "ERROR:" on
- * failure
+ * @brief Shut ONNX Runtime down if shutdown_onnx_genai asked for it.
  */
-FFI_PLUGIN_EXPORT const char *run_text_inference(const char *model_path,
-                                                 const char *prompt,
-                                                 int32_t max_length) {
-  DEBUG_LOG("=== run_text_inference START ===");
-  DEBUG_LOG("model_path: %s", model_path ? model_path : "NULL");
-  DEBUG_LOG("prompt length: %zu", prompt ? strlen(prompt) : 0);
-  DEBUG_LOG("max_length: %d", max_length);
+static void shutdown_runtime() {
+  std::lock_guard<std::mutex> lock(g_init_mutex);
+  if (g_initialized && g_shutdown_requested) {
+    DEBUG_LOG("Shutting down ONNX Runtime GenAI");
+    OgaShutdown();
+    g_initialized = false;
+    g_shutdown_requested = false;
+  }
+}
 
-  if (model_path == nullptr || prompt == nullptr) {
-    DEBUG_ERROR("NULL model_path or prompt provided");
-    return set_error("NULL model_path or prompt provided");
+/**
+ * @brief Take a reference on a model handle for the duration of a request.
+ * @return The loaded model, or nullptr if the handle is unknown.
+ */
+static LoadedModel *acquire_model(int64_t model_handle) {
+  std::lock_guard<std::mutex> lock(g_registry_mutex);
+  for (auto &kv : g_model_registry) {
+    if (reinterpret_cast<int64_t>(kv.second) == model_handle) {
+      kv.second->ref_count++;
+      return kv.second;
+    }
   }
+  return nullptr;
+}
 
-  // Create model
-  DEBUG_LOG("Step 1: Creating model...");
-  OgaModel *model = nullptr;
-  OgaResult *result = OgaCreateModel(model_path, &model);
-  if (check_oga_result(result, "Model creation failed") || model == nullptr) {
-    DEBUG_ERROR("Model creation failed");
-    return set_error(g_error_buffer);
+/**
+ * @brief Drop a reference taken by load_model or acquire_model.
+ *
+ * The model is destroyed when the last reference is released.
+ */
+static void release_model(LoadedModel *entry) {
+  bool last_orphan = false;
+  {
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    if (--entry->ref_count > 0) {
+      return;
+    }
+    if (entry->orphaned) {
+      last_orphan = --g_orphaned_models == 0;
+    } else {
+      g_model_registry.erase(entry->key);
+    }
   }
-  DEBUG_LOG("Step 1: Model created successfully");
+  DEBUG_LOG("Destroying model '%s'", entry->key.c_str());
+  destroy_loaded_model(entry);
 
-  // Create tokenizer
-  DEBUG_LOG("Step 2: Creating tokenizer...");
-  OgaTokenizer *tokenizer = nullptr;
-  result = OgaCreateTokenizer(model, &tokenizer);
-  if (check_oga_result(result, "Tokenizer creation failed") ||
-      tokenizer == nullptr) {
-    DEBUG_ERROR("Tokenizer creation failed");
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+  if (last_orphan) {
+    DEBUG_LOG("Last model in use after shutdown released");
+    shutdown_runtime();
   }
-  DEBUG_LOG("Step 2: Tokenizer created successfully");
+}
 
-  // Create sequences container first, then encode the prompt
-  DEBUG_LOG("Step 3: Creating sequences and encoding prompt...");
+/**
+ * @brief Owns the per-request objects of a single generation.
+ *
+ * Everything created for a request against a loaded model is released when
+ * this goes out of scope; the model, tokenizer and processor are untouched.
+ */
+struct GenerationRequest {
+  OgaStringArray *image_path_array = nullptr;
+  OgaImages *images = nullptr;
+  OgaNamedTensors *named_tensors = nullptr;
   OgaSequences *input_sequences = nullptr;
-  result = OgaCreateSequences(&input_sequences);
-  if (check_oga_result(result, "Sequences creation failed") ||
-      input_sequences == nullptr) {
-    DEBUG_ERROR("Sequences creation failed");
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
-  }
+  OgaGeneratorParams *params = nullptr;
+  OgaGenerator *generator = nullptr;
+  OgaTokenizerStream *stream = nullptr;
 
-  result = OgaTokenizerEncode(tokenizer, prompt, input_sequences);
-  if (check_oga_result(result, "Tokenization failed")) {
-    DEBUG_ERROR("Tokenization failed");
-    OgaDestroySequences(input_sequences);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+  GenerationRequest() = default;
+  GenerationRequest(const GenerationRequest &) = delete;
+  GenerationRequest &operator=(const GenerationRequest &) = delete;
+
+  ~GenerationRequest() {
+    if (stream)
+      OgaDestroyTokenizerStream(stream);
+    if (generator)
+      OgaDestroyGenerator(generator);
+    if (params)
+      OgaDestroyGeneratorParams(params);
+    if (input_sequences)
+      OgaDestroySequences(input_sequences);
+    if (named_tensors)
+      OgaDestroyNamedTensors(named_tensors);
+    if (images)
+      OgaDestroyImages(images);
+    if (image_path_array)
+      OgaDestroyStringArray(image_path_array);
   }
-  DEBUG_LOG("Step 3: Prompt encoded successfully");
+};
 
-  // Create generator parameters
-  DEBUG_LOG("Step 4: Creating generator params...");
-  OgaGeneratorParams *params = nullptr;
-  result = OgaCreateGeneratorParams(model, &params);
+/**
+ * @brief Create the generator params and an empty generator for a request.
+ *
+ * @param max_length Maximum total sequence length, or 0 for the value in
+ *        genai_config.json
+ * @param attention_sink_size Tokens kept at the start when the sequence
+ *        reaches max_length and older tokens are evicted (0 to stop there)
+ * @return true on success; on failure the error is left in g_error_buffer
+ */
+static bool create_generator(LoadedModel *entry, int32_t max_length,
+                             int32_t attention_sink_size,
+                             GenerationRequest &request) {
+  OgaResult *result = OgaCreateGeneratorParams(entry->model, &request.params);
   if (check_oga_result(result, "Generator params creation failed") ||
-      params == nullptr) {
-    DEBUG_ERROR("Generator params creation failed");
-    OgaDestroySequences(input_sequences);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+      request.params == nullptr) {
+    return false;
   }
 
-  // Set max length if specified
   if (max_length > 0) {
-    DEBUG_LOG("Setting max_length to %d", max_length);
-    OgaGeneratorParamsSetSearchNumber(params, "max_length",
-                                      static_cast<double>(max_length));
-  }
-  DEBUG_LOG("Step 4: Generator params created successfully");
-
-  // Create generator
-  DEBUG_LOG("Step 5: Creating generator...");
-  OgaGenerator *generator = nullptr;
-  result = OgaCreateGenerator(model, params, &generator);
-  if (check_oga_result(result, "Generator creation failed") ||
-      generator == nullptr) {
-    DEBUG_ERROR("Generator creation failed");
-    OgaDestroyGeneratorParams(params);
-    OgaDestroySequences(input_sequences);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    result = OgaGeneratorParamsSetSearchNumber(request.params, "max_length",
+                                               static_cast<double>(max_length));
+    if (check_oga_result(result, "Setting max_length failed")) {
+      return false;
+    }
   }
-  DEBUG_LOG("Step 5: Generator created successfully");
 
-  // Append input sequences to generator
-  DEBUG_LOG("Step 6: Appending input sequences...");
-  result = OgaGenerator_AppendTokenSequences(generator, input_sequences);
-  if (check_oga_result(result, "Setting input sequences failed")) {
-    DEBUG_ERROR("Setting input sequences failed");
-    OgaDestroyGenerator(generator);
-    OgaDestroyGeneratorParams(params);
-    OgaDestroySequences(input_sequences);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+  if (attention_sink_size > 0) {
+    result = OgaGeneratorParamsSetSearchNumber(
+        request.params, "attention_sink_size",
+        static_cast<double>(attention_sink_size));
+    if (check_oga_result(result, "Setting attention_sink_size failed")) {
+      return false;
+    }
   }
-  DEBUG_LOG("Step 6: Input sequences appended successfully");
 
-  // Generate tokens
-  DEBUG_LOG("Step 7: Creating tokenizer stream...");
-  std::string generated_text;
-  OgaTokenizerStream *stream = nullptr;
-  result = OgaCreateTokenizerStream(tokenizer, &stream);
-  if (check_oga_result(result, "Tokenizer stream creation failed") ||
-      stream == nullptr) {
-    DEBUG_ERROR("Tokenizer stream creation failed");
-    OgaDestroyGenerator(generator);
-    OgaDestroyGeneratorParams(params);
-    OgaDestroySequences(input_sequences);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+  const int64_t prefix_cache_bytes = entry->prefix_cache_bytes.load();
+  if (prefix_cache_bytes > 0) {
+    result = OgaGeneratorParamsSetSearchNumber(
+        request.params, "prefix_cache_bytes",
+        static_cast<double>(prefix_cache_bytes));
+    if (check_oga_result(result, "Setting prefix_cache_bytes failed")) {
+      return false;
+    }
   }
-  DEBUG_LOG("Step 7: Tokenizer stream created successfully");
 
-  DEBUG_LOG("Step 8: Starting token generation loop...");
-  int generated_count = 0;
-  while (!OgaGenerator_IsDone(generator)) {
-    result = OgaGenerator_GenerateNextToken(generator);
-    if (check_oga_result(result, "Generate next token failed")) {
-      DEBUG_ERROR("Generate next token failed at token %d", generated_count);
-      break;
+  const int64_t image_features_cache_bytes =
+      entry->image_features_cache_bytes.load();
+  if (image_features_cache_bytes > 0) {
+    result = OgaGeneratorParamsSetSearchNumber(
+        request.params, "image_features_cache_bytes",
+        static_cast<double>(image_features_cache_bytes));
+    if (check_oga_result(result,
+                         "Setting image_features_cache_bytes failed")) {
+      return false;
     }
+  }
 
-    // Get the last generated tokens
-    const int32_t *tokens = nullptr;
-    size_t token_count = 0;
-    result = OgaGenerator_GetNextTokens(generator, &tokens, &token_count);
-    if (check_oga_result(result, "Get next tokens failed") || token_count == 0) {
-      DEBUG_ERROR("Get next tokens failed at token %d", generated_count);
-      break;
+  const int32_t prompt_lookup_ngram_size = entry->prompt_lookup_ngram_size.load();
+  if (prompt_lookup_ngram_size > 0) {
+    result = OgaGeneratorParamsSetSearchNumber(
+        request.params, "prompt_lookup_ngram_size",
+        static_cast<double>(prompt_lookup_ngram_size));
+    if (check_oga_result(result, "Setting prompt_lookup_ngram_size failed")) {
+      return false;
     }
+  }
 
-    // Decode first token to text (batch size = 1)
-    const char *token_text = nullptr;
-    result = OgaTokenizerStreamDecode(stream, tokens[0], &token_text);
-    if (!check_oga_result(result, "Token decode failed") &&
-        token_text != nullptr) {
-      generated_text += token_text;
-    }
-    generated_count++;
-    
-    // Log progress every 50 tokens
-    if (generated_count % 50 == 0) {
-      DEBUG_LOG("Generated %d tokens so far...", generated_count);
+  const int32_t num_speculative_tokens = entry->num_speculative_tokens.load();
+  if (num_speculative_tokens > 0) {
+    result = OgaGeneratorParamsSetSearchNumber(
+        request.params, "num_speculative_tokens",
+        static_cast<double>(num_speculative_tokens));
+    if (check_oga_result(result, "Setting num_speculative_tokens failed")) {
+      return false;
     }
   }
-  DEBUG_LOG("Step 8: Generation complete. Total tokens: %d", generated_count);
 
-  // Cleanup
-  DEBUG_LOG("Step 9: Cleaning up resources...");
-  OgaDestroyTokenizerStream(stream);
-  OgaDestroyGenerator(generator);
-  OgaDestroyGeneratorParams(params);
-  OgaDestroySequences(input_sequences);
-  OgaDestroyTokenizer(tokenizer);
-  OgaDestroyModel(model);
-  DEBUG_LOG("Step 9: Cleanup complete");
-  DEBUG_LOG("=== run_text_inference END ===");
+  result = OgaCreateGenerator(entry->model, request.params, &request.generator);
+  if (check_oga_result(result, "Generator creation failed") ||
+      request.generator == nullptr) {
+    return false;
+  }
 
-  return set_result(generated_text);
+  return true;
 }
 
 /**
- * @brief Run multimodal inference with text and image.
- *
- * This function is specifically designed for vision-language models like
- * Phi-3.5 Vision. It processes both the text prompt and image together for
- * generation.
- *
- * WARNING: This is a long-running operation! Call from a background Isolate
- * only.
+ * @brief Encoded images (JPEG, PNG, ...) of a request that live in memory.
  *
- * @param model_path Path to the ONNX GenAI model directory
- * @param prompt The text prompt for generation
- * @param image_path Path to the image file (JPEG, PNG, etc.)
- * @return Generated text on success, error message starting with "ERROR:" on
- * failure
+ * The buffers are borrowed and must outlive the request's image loading.
  */
-FFI_PLUGIN_EXPORT const char *run_inference(const char *model_path,
-                                            const char *prompt,
-                                            const char *image_path) {
-  init_debug_features();
-  DEBUG_LOG("=== run_inference START ===");
-  DEBUG_LOG("model_path: %s", model_path ? model_path : "NULL");
-  DEBUG_LOG("prompt length: %zu", prompt ? strlen(prompt) : 0);
-  DEBUG_LOG("image_path: %s", image_path ? image_path : "NULL");
+struct ImageBuffers {
+  std::vector<const void *> data;
+  std::vector<size_t> sizes;
+};
 
-  if (model_path == nullptr || prompt == nullptr) {
-    DEBUG_ERROR("NULL model_path or prompt provided");
-    return set_error("NULL model_path or prompt provided");
-  }
+namespace {
 
-  // Create model
-  DEBUG_LOG("Step 1: Creating model...");
-  OgaModel *model = nullptr;
-  OgaResult *result = OgaCreateModel(model_path, &model);
-  if (check_oga_result(result, "Model creation failed") || model == nullptr) {
-    DEBUG_ERROR("Model creation failed");
-    return set_error(g_error_buffer);
-  }
-  DEBUG_LOG("Step 1: Model created successfully");
+uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0) {
+  static const auto table = [] {
+    std::array<uint32_t, 256> values{};
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t value = i;
+      for (int bit = 0; bit < 8; bit++)
+        value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+      values[i] = value;
+    }
+    return values;
+  }();
 
-  // Create multimodal processor
-  DEBUG_LOG("Step 2: Creating multimodal processor...");
-  OgaMultiModalProcessor *processor = nullptr;
-  result = OgaCreateMultiModalProcessor(model, &processor);
-  if (check_oga_result(result, "MultiModal processor creation failed") ||
-      processor == nullptr) {
-    DEBUG_ERROR("MultiModal processor creation failed");
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
-  }
-  DEBUG_LOG("Step 2: MultiModal processor created successfully");
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++)
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
 
-  // Create tokenizer from model
-  DEBUG_LOG("Step 3: Creating tokenizer...");
-  OgaTokenizer *tokenizer = nullptr;
-  result = OgaCreateTokenizer(model, &tokenizer);
-  if (check_oga_result(result, "Tokenizer creation failed") ||
-      tokenizer == nullptr) {
-    DEBUG_ERROR("Tokenizer creation failed");
-    OgaDestroyMultiModalProcessor(processor);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
-  }
-  DEBUG_LOG("Step 3: Tokenizer created successfully");
+void append_be32(std::vector<uint8_t> &out, uint32_t value) {
+  out.push_back(static_cast<uint8_t>(value >> 24));
+  out.push_back(static_cast<uint8_t>(value >> 16));
+  out.push_back(static_cast<uint8_t>(value >> 8));
+  out.push_back(static_cast<uint8_t>(value));
+}
 
-  // Load image if provided
-  OgaImages *images = nullptr;
-  OgaNamedTensors *named_tensors = nullptr;
+// Starts a PNG chunk, returns the offset of its type to pass to
+// finish_png_chunk once its data is appended
+size_t begin_png_chunk(std::vector<uint8_t> &out, const char *type) {
+  append_be32(out, 0); // length, set by finish_png_chunk
+  const size_t type_offset = out.size();
+  out.insert(out.end(), type, type + 4);
+  return type_offset;
+}
 
-  if (image_path != nullptr && strlen(image_path) > 0) {
-    DEBUG_LOG("Step 4: Loading image from: %s", image_path);
-    result = OgaLoadImage(image_path, &images);
-    if (check_oga_result(result, "Image loading failed") || images == nullptr) {
-      DEBUG_ERROR("Image loading failed");
-      OgaDestroyTokenizer(tokenizer);
-      OgaDestroyMultiModalProcessor(processor);
-      OgaDestroyModel(model);
-      return set_error(g_error_buffer);
-    }
-    DEBUG_LOG("Step 4: Image loaded successfully");
-  } else {
-    DEBUG_LOG("Step 4: No image provided, will process text-only through multimodal processor");
-  }
+void finish_png_chunk(std::vector<uint8_t> &out, size_t type_offset) {
+  const size_t length = out.size() - type_offset - 4;
+  const uint32_t crc = crc32(out.data() + type_offset, out.size() - type_offset);
+  for (int i = 0; i < 4; i++)
+    out[type_offset - 4 + i] = static_cast<uint8_t>(length >> (24 - 8 * i));
+  append_be32(out, crc);
+}
 
-  // Process through multimodal processor (required for vision models even for text-only)
-  DEBUG_LOG("Step 5: Processing prompt through multimodal processor (images=%p)...",
-            (void *)images);
-  result = OgaProcessorProcessImages(processor, prompt, images, &named_tensors);
-  if (check_oga_result(result, "Multimodal processing failed") ||
-      named_tensors == nullptr) {
-    DEBUG_ERROR("Multimodal processing failed");
-    if (images)
-      OgaDestroyImages(images);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyMultiModalProcessor(processor);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
-  }
-  DEBUG_LOG("Step 5: Multimodal processing completed successfully");
+} // namespace
 
-  // Create generator parameters
-  DEBUG_LOG("Step 6: Creating generator params...");
-  OgaGeneratorParams *params = nullptr;
-  result = OgaCreateGeneratorParams(model, &params);
-  if (check_oga_result(result, "Generator params creation failed") ||
-      params == nullptr) {
-    DEBUG_ERROR("Generator params creation failed");
-    if (named_tensors)
-      OgaDestroyNamedTensors(named_tensors);
-    if (images)
-      OgaDestroyImages(images);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyMultiModalProcessor(processor);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
-  }
-  
-  // Set max_length to limit memory usage for KV-cache
-  // Use 2048 tokens - must be larger than input prompt size (~954 tokens)
-  DEBUG_LOG("Step 6a: Setting max_length to 2048 to limit memory...");
-  result = OgaGeneratorParamsSetSearchNumber(params, "max_length", 2048.0);
-  if (result != nullptr) {
-    DEBUG_ERROR("Failed to set max_length: %s", OgaResultGetError(result));
-    OgaDestroyResult(result);
-    // Non-fatal, continue anyway
-  } else {
-    DEBUG_LOG("Step 6a: max_length set successfully");
+/**
+ * @brief Wrap RGBA pixels in an uncompressed RGB PNG.
+ *
+ * The processors only take encoded images, which onnxruntime-extensions
+ * decodes itself, so decoded pixels can't be handed to them as a tensor. A
+ * PNG whose deflate stream is made of stored blocks is the cheapest lossless
+ * container its decoder reads on every platform: decoding it is little more
+ * than a copy and checksums. The rows are written straight into the stored
+ * blocks, without an intermediate copy of the image. Alpha is dropped because
+ * the processors convert to RGB anyway.
+ *
+ * @param stride Bytes from one row to the next, at least width * 4
+ */
+static std::vector<uint8_t> encode_rgba_as_png(const uint8_t *pixels,
+                                               int32_t width, int32_t height,
+                                               int32_t stride) {
+  static const uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  constexpr size_t kMaxStoredBlock = 65535;
+
+  // Rows of filter type 0 followed by the RGB values
+  const size_t row_bytes = 1 + static_cast<size_t>(width) * 3;
+  const size_t raw_size = row_bytes * static_cast<size_t>(height);
+  const size_t block_count =
+      std::max<size_t>(1, (raw_size + kMaxStoredBlock - 1) / kMaxStoredBlock);
+  std::vector<uint8_t> png;
+  png.reserve(64 + raw_size + block_count * 5);
+  png.insert(png.end(), kSignature, kSignature + sizeof(kSignature));
+
+  size_t chunk = begin_png_chunk(png, "IHDR");
+  append_be32(png, static_cast<uint32_t>(width));
+  append_be32(png, static_cast<uint32_t>(height));
+  png.insert(png.end(), {8, 2, 0, 0, 0}); // 8-bit RGB, deflate, no interlace
+  finish_png_chunk(png, chunk);
+
+  chunk = begin_png_chunk(png, "IDAT");
+  png.insert(png.end(), {0x78, 0x01}); // zlib header, no compression
+
+  // Each stored block starts with its header; rows run on across blocks
+  size_t written = 0, block_left = 0;
+  auto append_raw = [&](const uint8_t *data, size_t size) {
+    while (size > 0) {
+      if (block_left == 0) {
+        const size_t block = std::min(raw_size - written, kMaxStoredBlock);
+        const bool last = written + block == raw_size;
+        png.insert(png.end(), {static_cast<uint8_t>(last ? 1 : 0),
+                               static_cast<uint8_t>(block), static_cast<uint8_t>(block >> 8),
+                               static_cast<uint8_t>(~block), static_cast<uint8_t>(~block >> 8)});
+        block_left = block;
+      }
+      const size_t count = std::min(size, block_left);
+      png.insert(png.end(), data, data + count);
+      data += count;
+      size -= count;
+      written += count;
+      block_left -= count;
+    }
+  };
+
+  std::vector<uint8_t> row(row_bytes);
+  uint32_t adler_a = 1, adler_b = 0;
+  for (int32_t y = 0; y < height; y++) {
+    const uint8_t *source = pixels + static_cast<size_t>(y) * stride;
+    row[0] = 0;
+    for (int32_t x = 0; x < width; x++) {
+      row[1 + 3 * x] = source[4 * x];
+      row[2 + 3 * x] = source[4 * x + 1];
+      row[3 + 3 * x] = source[4 * x + 2];
+    }
+    // Reduced at least every 5552 bytes, before the sums could overflow
+    for (size_t i = 0; i < row_bytes; i += 5552) {
+      const size_t end = std::min(row_bytes, i + 5552);
+      for (size_t j = i; j < end; j++) {
+        adler_a += row[j];
+        adler_b += adler_a;
+      }
+      adler_a %= 65521;
+      adler_b %= 65521;
+    }
+    append_raw(row.data(), row_bytes);
   }
-  
-  DEBUG_LOG("Step 6: Generator params created successfully");
-
-  // Create generator - this is often where multimodal models crash
-  // due to memory allocation or model graph initialization issues
-  OgaGenerator *generator = nullptr;
-  DEBUG_LOG("Step 7: Creating generator...");
-  DEBUG_LOG("Step 7a: Generator pointer address: %p", (void *)&generator);
-  DEBUG_LOG("Step 7b: Model pointer: %p", (void *)model);
-  DEBUG_LOG("Step 7c: Params pointer: %p", (void *)params);
-  DEBUG_LOG("Step 7d: named_tensors: %p, images: %p",
-            (void *)named_tensors, (void *)images);
-#ifdef __ANDROID__
-  // Force log flush before potentially crashing call
-  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
-                      "[DEBUG] Step 7e: About to call OgaCreateGenerator...");
-#else
-  fprintf(stderr, "[OnnxGenAI] Step 7e: About to call OgaCreateGenerator...\n");
-  fflush(stderr);
-#endif
+  append_be32(png, (adler_b << 16) | adler_a);
+  finish_png_chunk(png, chunk);
 
-  result = OgaCreateGenerator(model, params, &generator);
+  chunk = begin_png_chunk(png, "IEND");
+  finish_png_chunk(png, chunk);
+  return png;
+}
 
-#ifdef __ANDROID__
-  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
-                      "[DEBUG] Step 7f: OgaCreateGenerator returned, result=%p",
-                      (void *)result);
-#else
-  fprintf(stderr, "[OnnxGenAI] Step 7f: OgaCreateGenerator returned\n");
-  fflush(stderr);
-#endif
+/**
+ * @brief Encode a prompt (and optional images) and create an empty generator
+ * for it on a loaded model.
+ *
+ * Multimodal models route the prompt through their processor, even when no
+ * image is given. Text-only models encode the prompt with the tokenizer.
+ *
+ * @param max_length Maximum total sequence length, or 0 for the value in
+ *        genai_config.json
+ * @param image_buffers If not NULL, in-memory images used instead of
+ *        image_paths
+ * @return true on success; on failure the error is left in g_error_buffer
+ */
+static bool create_request(LoadedModel *entry, const char *prompt,
+                           const char **image_paths, int32_t image_count,
+                           int32_t max_length, GenerationRequest &request,
+                           const ImageBuffers *image_buffers = nullptr) {
+  OgaResult *result = nullptr;
+
+  const bool has_buffers = image_buffers != nullptr && !image_buffers->data.empty();
+  if ((image_count > 0 || has_buffers) && entry->processor == nullptr) {
+    set_error("Model has no multimodal processor but images were provided");
+    return false;
+  }
+
+  if (entry->processor != nullptr) {
+    if (has_buffers) {
+      DEBUG_LOG("Loading %zu images from memory...", image_buffers->data.size());
+      result = OgaLoadImagesFromBuffers(
+          const_cast<const void **>(image_buffers->data.data()),
+          image_buffers->sizes.data(), image_buffers->data.size(),
+          &request.images);
+      if (check_oga_result(result, "Image loading failed") ||
+          request.images == nullptr) {
+        return false;
+      }
+    } else if (image_count > 0) {
+      DEBUG_LOG("Loading %d images...", image_count);
+      result = OgaCreateStringArrayFromStrings(
+          image_paths, static_cast<size_t>(image_count), &request.image_path_array);
+      if (check_oga_result(result, "String array creation failed") ||
+          request.image_path_array == nullptr) {
+        return false;
+      }
+      result = OgaLoadImages(request.image_path_array, &request.images);
+      if (check_oga_result(result, "Image loading failed") ||
+          request.images == nullptr) {
+        return false;
+      }
+    }
 
-  if (check_oga_result(result, "Generator creation failed") ||
-      generator == nullptr) {
-    DEBUG_ERROR("Generator creation failed - generator=%p", (void *)generator);
-    OgaDestroyGeneratorParams(params);
-    if (named_tensors)
-      OgaDestroyNamedTensors(named_tensors);
-    if (images)
-      OgaDestroyImages(images);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyMultiModalProcessor(processor);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    result = OgaProcessorProcessImages(entry->processor, prompt, request.images,
+                                       &request.named_tensors);
+    if (check_oga_result(result, "Multimodal processing failed") ||
+        request.named_tensors == nullptr) {
+      return false;
+    }
+  } else {
+    result = OgaCreateSequences(&request.input_sequences);
+    if (check_oga_result(result, "Sequences creation failed") ||
+        request.input_sequences == nullptr) {
+      return false;
+    }
+    result = OgaTokenizerEncode(entry->tokenizer, prompt, request.input_sequences);
+    if (check_oga_result(result, "Tokenization failed")) {
+      return false;
+    }
   }
-  DEBUG_LOG("Step 7g: Generator created successfully, generator=%p",
-            (void *)generator);
-
-  // Set input tensors from multimodal processor
-  DEBUG_LOG("Step 8: Setting input tensors...");
-  DEBUG_LOG("Step 8a: generator=%p, named_tensors=%p", (void *)generator, (void *)named_tensors);
-#ifdef __ANDROID__
-  // Force log flush before potentially crashing call
-  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
-                      "[DEBUG] Step 8b: About to call OgaGenerator_SetInputs...");
-#else
-  fprintf(stderr, "[OnnxGenAI] Step 8b: About to call OgaGenerator_SetInputs...\n");
-  fflush(stderr);
-#endif
-
-  result = OgaGenerator_SetInputs(generator, named_tensors);
 
-#ifdef __ANDROID__
-  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
-                      "[DEBUG] Step 8c: OgaGenerator_SetInputs returned, result=%p",
-                      (void *)result);
-#else
-  fprintf(stderr, "[OnnxGenAI] Step 8c: OgaGenerator_SetInputs returned\n");
-  fflush(stderr);
-#endif
+  return create_generator(entry, max_length, 0, request);
+}
 
-  if (check_oga_result(result, "Setting input tensors failed")) {
-    DEBUG_ERROR("Setting input tensors failed");
-    OgaDestroyGenerator(generator);
-    OgaDestroyGeneratorParams(params);
-    OgaDestroyNamedTensors(named_tensors);
-    if (images)
-      OgaDestroyImages(images);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyMultiModalProcessor(processor);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+/**
+ * @brief Feed the encoded prompt of a request created by create_request to
+ * its generator, which runs the prefill.
+ * @return true on success; on failure the error is left in g_error_buffer
+ */
+static bool prefill_request(LoadedModel *entry, GenerationRequest &request) {
+  OgaResult *result = nullptr;
+  if (request.named_tensors != nullptr) {
+    result = OgaGenerator_SetInputs(request.generator, request.named_tensors);
+    if (check_oga_result(result, "Setting input tensors failed")) {
+      return false;
+    }
+  } else {
+    result = OgaGenerator_AppendTokenSequences(request.generator,
+                                               request.input_sequences);
+    if (check_oga_result(result, "Setting input sequences failed")) {
+      return false;
+    }
   }
-  DEBUG_LOG("Step 8d: Input tensors set successfully");
 
-  // Create tokenizer stream for incremental decoding
-  DEBUG_LOG("Step 9: Creating tokenizer stream...");
-  OgaTokenizerStream *stream = nullptr;
-  result = OgaCreateTokenizerStream(tokenizer, &stream);
+  result = OgaCreateTokenizerStream(entry->tokenizer, &request.stream);
   if (check_oga_result(result, "Tokenizer stream creation failed") ||
-      stream == nullptr) {
-    DEBUG_ERROR("Tokenizer stream creation failed");
-    OgaDestroyGenerator(generator);
-    OgaDestroyGeneratorParams(params);
-    if (named_tensors)
-      OgaDestroyNamedTensors(named_tensors);
-    if (images)
-      OgaDestroyImages(images);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyMultiModalProcessor(processor);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+      request.stream == nullptr) {
+    return false;
   }
-  DEBUG_LOG("Step 9: Tokenizer stream created successfully");
 
-  // Generate tokens
-  DEBUG_LOG("Step 10: Starting token generation loop...");
-  std::string generated_text;
-  int generated_count = 0;
-  while (!OgaGenerator_IsDone(generator)) {
-    result = OgaGenerator_GenerateNextToken(generator);
+  return true;
+}
+
+/**
+ * @brief Create a generator for a prompt (and optional images) and run the
+ * prefill. See create_request for the parameters.
+ * @return true on success; on failure the error is left in g_error_buffer
+ */
+static bool prepare_generation(LoadedModel *entry, const char *prompt,
+                               const char **image_paths, int32_t image_count,
+                               int32_t max_length, GenerationRequest &request,
+                               const ImageBuffers *image_buffers = nullptr) {
+  return create_request(entry, prompt, image_paths, image_count, max_length,
+                        request, image_buffers) &&
+         prefill_request(entry, request);
+}
+
+/**
+ * @brief Run the token generation loop of a prepared request.
+ *
+ * @param on_text Called with each decoded text fragment; return false to stop
+ *        generating early.
+ * @param last_token If not NULL, receives the last generated token
+ * @param failed If not NULL, set to true when generation stopped on an error
+ *        (left in g_error_buffer)
+ * @return Number of generated tokens
+ */
+template <typename OnText>
+static int32_t run_generation_loop(GenerationRequest &request, OnText &&on_text,
+                                   int32_t *last_token = nullptr,
+                                   bool *failed = nullptr) {
+  int32_t generated_count = 0;
+  while (!OgaGenerator_IsDone(request.generator)) {
+    OgaResult *result = OgaGenerator_GenerateNextToken(request.generator);
     if (check_oga_result(result, "Generate next token failed")) {
       DEBUG_ERROR("Generate next token failed at token %d", generated_count);
+      if (failed)
+        *failed = true;
       break;
     }
 
-    // Get the last generated tokens
     const int32_t *tokens = nullptr;
     size_t token_count = 0;
-    result = OgaGenerator_GetNextTokens(generator, &tokens, &token_count);
+    result = OgaGenerator_GetNextTokens(request.generator, &tokens, &token_count);
     if (check_oga_result(result, "Get next tokens failed") || token_count == 0) {
       DEBUG_ERROR("Get next tokens failed at token %d", generated_count);
+      if (failed)
+        *failed = true;
       break;
     }
+    if (last_token)
+      *last_token = tokens[0];
 
     // Decode first token to text (batch size = 1)
     const char *token_text = nullptr;
-    result = OgaTokenizerStreamDecode(stream, tokens[0], &token_text);
+    result = OgaTokenizerStreamDecode(request.stream, tokens[0], &token_text);
+    generated_count++;
     if (!check_oga_result(result, "Token decode failed") &&
-        token_text != nullptr) {
-      generated_text += token_text;
+        token_text != nullptr && !on_text(token_text)) {
+      break;
     }
-    generated_count++;
-    
-    // Log progress every 50 tokens
+
     if (generated_count % 50 == 0) {
       DEBUG_LOG("Generated %d tokens so far...", generated_count);
     }
   }
-  DEBUG_LOG("Step 10: Generation complete. Total tokens: %d", generated_count);
 
-  // Cleanup
-  DEBUG_LOG("Step 11: Cleaning up resources...");
-  OgaDestroyTokenizerStream(stream);
-  OgaDestroyGenerator(generator);
+#if ONNX_DEBUG_LOG
+  // Totals over the generator's lifetime (a chat keeps counting across turns)
+  size_t proposed = 0, accepted = 0;
+  OgaResult *stats_result = OgaGenerator_GetSpeculativeDecodingStats(
+      request.generator, &proposed, &accepted);
+  if (stats_result != nullptr) {
+    OgaDestroyResult(stats_result);
+  } else if (proposed > 0) {
+    DEBUG_LOG("Speculative decoding accepted %zu of %zu draft tokens (%.0f%%)",
+              accepted, proposed, 100.0 * accepted / proposed);
+  }
+#endif
+  return generated_count;
+}
+
+/**
+ * @brief Run a complete generation on a model handle and return the text.
+ */
+static char *run_with_model(int64_t model_handle, const char *prompt,
+                            const char **image_paths, int32_t image_count,
+                            int32_t max_length,
+                            const ImageBuffers *image_buffers = nullptr) {
+  if (prompt == nullptr) {
+    DEBUG_ERROR("NULL prompt provided");
+    return error_result("NULL prompt provided");
+  }
+
+  if (image_count > 0 && image_paths == nullptr) {
+    DEBUG_ERROR("NULL image_paths with image_count > 0");
+    return error_result("NULL image_paths with image_count > 0");
+  }
+
+  LoadedModel *entry = acquire_model(model_handle);
+  if (entry == nullptr) {
+    DEBUG_ERROR("Invalid model handle: %lld", (long long)model_handle);
+    return error_result("Invalid model handle");
+  }
+
+  std::string generated_text;
+  {
+    GenerationRequest request;
+    if (!prepare_generation(entry, prompt, image_paths, image_count, max_length,
+                            request, image_buffers)) {
+      DEBUG_ERROR("Generation setup failed: %s", g_error_buffer.c_str());
+      release_model(entry);
+      return last_error_result();
+    }
+
+    int32_t generated_count = run_generation_loop(request, [&](const char *text) {
+      generated_text += text;
+      return true;
+    });
+    DEBUG_LOG("Generation complete. Total tokens: %d", generated_count);
+  }
+
+  release_model(entry);
+  return set_result(generated_text);
+}
+
+// =============================================================================
+// Streaming - posting decoded text to a Dart SendPort
+// =============================================================================
+
+namespace {
+// Dart_PostCObject resolved by init_dart_api_dl
+std::atomic<Dart_PostCObject_Type> g_post_cobject{nullptr};
+
+// Text decoded within this interval is posted as one message. Slow decoders
+// (mobile CPUs) post every token; fast ones avoid flooding the port.
+constexpr std::chrono::milliseconds kStreamFlushInterval{16};
+} // namespace
+
+/**
+ * @brief Post a [kind, text] message to a Dart SendPort.
+ * @return false if the port is closed or the Dart API is not initialized
+ */
+static bool post_stream_message(int64_t send_port, int32_t kind,
+                                const char *text) {
+  Dart_PostCObject_Type post = g_post_cobject.load();
+  if (post == nullptr) {
+    return false;
+  }
+
+  Dart_CObject kind_object;
+  kind_object.type = Dart_CObject_kInt32;
+  kind_object.value.as_int32 = kind;
+
+  Dart_CObject text_object;
+  text_object.type = Dart_CObject_kString;
+  text_object.value.as_string = text;
+
+  Dart_CObject *values[] = {&kind_object, &text_object};
+  Dart_CObject message;
+  message.type = Dart_CObject_kArray;
+  message.value.as_array.length = 2;
+  message.value.as_array.values = values;
+
+  // The message is copied before Dart_PostCObject returns
+  return post(send_port, &message);
+}
+
+// =============================================================================
+// Generation Pool - cancellable background generations
+// =============================================================================
+
+namespace {
+// Generations run concurrently on this many native threads; further requests
+// queue. Each generation already uses the ORT intra-op thread pool.
+constexpr size_t kGenerationWorkerCount = 2;
+
+/**
+ * @brief A generation submitted to the pool.
+ *
+ * Polled jobs accumulate their text; streamed jobs (send_port != 0) post it
+ * to Dart as it is decoded instead.
+ */
+struct GenerationJob {
+  int64_t id = 0;
+  LoadedModel *entry = nullptr; // one reference, released when the job ends
+  std::string prompt;
+  std::vector<std::string> image_paths;
+  int32_t max_length = 0;
+  int64_t send_port = ILLEGAL_PORT;
+
+  // Guards every field below. It is held around all generator calls except
+  // the prefill and GenerateNextToken, so a cancellation can terminate a
+  // running OrtSession::Run but never races the generator's other entry
+  // points (which throw once the session is terminated).
+  std::mutex mutex;
+  OgaGenerator *generator = nullptr;
+  bool cancelled = false;
+  int32_t status = kGenerationQueued;
+  std::string text;
+  std::string error;
+};
+
+/**
+ * @brief Fixed set of native threads that own and run GenerationJobs.
+ */
+class GenerationPool {
+public:
+  void Submit(std::shared_ptr<GenerationJob> job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (workers_.empty()) {
+      for (size_t i = 0; i < kGenerationWorkerCount; i++) {
+        workers_.emplace_back(&GenerationPool::WorkerLoop, this);
+      }
+    }
+    queue_.push_back(std::move(job));
+    cv_.notify_one();
+  }
+
+  /** Stop the workers once their current jobs finish. Queued jobs are dropped. */
+  void Shutdown() {
+    std::vector<std::thread> workers;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+      workers.swap(workers_);
+      cv_.notify_all();
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &job : queue_) {
+      release_model(job->entry);
+    }
+    queue_.clear();
+    stopping_ = false;
+  }
+
+private:
+  void WorkerLoop();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::shared_ptr<GenerationJob>> queue_;
+  std::vector<std::thread> workers_;
+  bool stopping_ = false;
+};
+
+// Live jobs by request id. Polled jobs leave when a final status is polled,
+// streamed jobs when they finish.
+std::unordered_map<int64_t, std::shared_ptr<GenerationJob>> g_jobs;
+std::mutex g_jobs_mutex;
+std::atomic<int64_t> g_next_job_id{1};
+
+// Intentionally leaked: worker threads must not be joined during static
+// destruction at process exit.
+GenerationPool &generation_pool() {
+  static GenerationPool *pool = new GenerationPool();
+  return *pool;
+}
+} // namespace
+
+/**
+ * @brief Run one job to completion on the calling worker thread.
+ */
+static void run_generation_job(GenerationJob &job) {
+  DEBUG_LOG("=== generation %lld START ===", (long long)job.id);
+  std::vector<const char *> image_ptrs;
+  for (const auto &path : job.image_paths) {
+    image_ptrs.push_back(path.c_str());
+  }
+  bool streaming = job.send_port != ILLEGAL_PORT;
+
+  GenerationRequest request;
+  bool prepared = create_request(job.entry, job.prompt.c_str(), image_ptrs.data(),
+                                 static_cast<int32_t>(image_ptrs.size()),
+                                 job.max_length, request);
+
+  // Published before the prefill, so cancel_generation can terminate it
+  std::unique_lock<std::mutex> lock(job.mutex);
+  if (prepared && !job.cancelled) {
+    job.generator = request.generator;
+    job.status = kGenerationRunning;
+    lock.unlock();
+    prepared = prefill_request(job.entry, request);
+    lock.lock();
+  }
+
+  if (!prepared || job.cancelled) {
+    job.generator = nullptr;
+    // A cancelled prefill fails with the session terminated error
+    if (job.cancelled) {
+      DEBUG_LOG("Generation %lld cancelled before its first token",
+                (long long)job.id);
+      job.status = kGenerationCancelled;
+      if (streaming)
+        post_stream_message(job.send_port, kStreamMessageCancelled, "");
+      return;
+    }
+    DEBUG_ERROR("Generation setup failed: %s", g_error_buffer.c_str());
+    job.status = kGenerationFailed;
+    job.error = g_error_buffer;
+    if (streaming)
+      post_stream_message(job.send_port, kStreamMessageError, job.error.c_str());
+    return;
+  }
+
+  std::string pending;
+  auto last_post = std::chrono::steady_clock::now() - kStreamFlushInterval;
+  int32_t generated_count = 0;
+  bool failed = false;
+
+  while (!job.cancelled && !OgaGenerator_IsDone(request.generator)) {
+    lock.unlock();
+    OgaResult *result = OgaGenerator_GenerateNextToken(request.generator);
+    lock.lock();
+    if (job.cancelled) {
+      if (result)
+        OgaDestroyResult(result);
+      break;
+    }
+    if (check_oga_result(result, "Generate next token failed")) {
+      DEBUG_ERROR("Generate next token failed at token %d", generated_count);
+      failed = true;
+      break;
+    }
+
+    const int32_t *tokens = nullptr;
+    size_t token_count = 0;
+    result = OgaGenerator_GetNextTokens(request.generator, &tokens, &token_count);
+    if (check_oga_result(result, "Get next tokens failed") || token_count == 0) {
+      DEBUG_ERROR("Get next tokens failed at token %d", generated_count);
+      failed = true;
+      break;
+    }
+
+    const char *token_text = nullptr;
+    result = OgaTokenizerStreamDecode(request.stream, tokens[0], &token_text);
+    generated_count++;
+    if (check_oga_result(result, "Token decode failed") || token_text == nullptr) {
+      continue;
+    }
+
+    if (!streaming) {
+      job.text += token_text;
+      continue;
+    }
+
+    pending += token_text;
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_post >= kStreamFlushInterval) {
+      if (!post_stream_message(job.send_port, kStreamMessageText, pending.c_str())) {
+        DEBUG_LOG("SendPort closed, cancelling generation %lld", (long long)job.id);
+        job.cancelled = true;
+      }
+      pending.clear();
+      last_post = now;
+    }
+  }
+
+  job.generator = nullptr;
+  if (job.cancelled) {
+    job.status = kGenerationCancelled;
+  } else if (failed) {
+    job.status = kGenerationFailed;
+    job.error = g_error_buffer;
+  } else {
+    job.status = kGenerationDone;
+  }
+  DEBUG_LOG("=== generation %lld END (status=%d, tokens=%d) ===",
+            (long long)job.id, job.status, generated_count);
+
+  if (streaming) {
+    if (!pending.empty() && job.status != kGenerationCancelled) {
+      post_stream_message(job.send_port, kStreamMessageText, pending.c_str());
+    }
+    switch (job.status) {
+    case kGenerationDone:
+      post_stream_message(job.send_port, kStreamMessageDone, "");
+      break;
+    case kGenerationCancelled:
+      post_stream_message(job.send_port, kStreamMessageCancelled, "");
+      break;
+    default:
+      post_stream_message(job.send_port, kStreamMessageError, job.error.c_str());
+      break;
+    }
+  }
+}
+
+void GenerationPool::WorkerLoop() {
+  while (true) {
+    std::shared_ptr<GenerationJob> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (stopping_) {
+        return;
+      }
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    bool skip;
+    {
+      std::lock_guard<std::mutex> lock(job->mutex);
+      skip = job->cancelled;
+      if (skip) {
+        job->status = kGenerationCancelled;
+        if (job->send_port != ILLEGAL_PORT)
+          post_stream_message(job->send_port, kStreamMessageCancelled, "");
+      }
+    }
+    if (!skip) {
+      run_generation_job(*job);
+    }
+
+    release_model(job->entry);
+    job->entry = nullptr;
+
+    // Nobody polls streamed jobs; forget them once finished
+    if (job->send_port != ILLEGAL_PORT) {
+      std::lock_guard<std::mutex> lock(g_jobs_mutex);
+      g_jobs.erase(job->id);
+    }
+  }
+}
+
+/**
+ * @brief Validate a request and queue it on the generation pool.
+ * @return The request id (> 0), or a negative error code
+ */
+static int64_t submit_generation(int64_t model_handle, const char *prompt,
+                                 const char **image_paths, int32_t image_count,
+                                 int32_t max_length, int64_t send_port) {
+  if (prompt == nullptr) {
+    DEBUG_ERROR("NULL prompt provided");
+    set_error("NULL prompt provided");
+    return -2;
+  }
+
+  if (image_count > 0 && image_paths == nullptr) {
+    DEBUG_ERROR("NULL image_paths with image_count > 0");
+    set_error("NULL image_paths with image_count > 0");
+    return -2;
+  }
+
+  // Copy the inputs: the caller frees them as soon as this returns
+  auto job = std::make_shared<GenerationJob>();
+  job->prompt = prompt;
+  job->max_length = max_length;
+  job->send_port = send_port;
+  for (int32_t i = 0; i < image_count; i++) {
+    if (image_paths[i] == nullptr) {
+      DEBUG_ERROR("NULL image path at index %d", i);
+      set_error("NULL image path in array");
+      return -2;
+    }
+    job->image_paths.emplace_back(image_paths[i]);
+  }
+
+  job->entry = acquire_model(model_handle);
+  if (job->entry == nullptr) {
+    DEBUG_ERROR("Invalid model handle: %lld", (long long)model_handle);
+    set_error("Invalid model handle");
+    return -3;
+  }
+
+  job->id = g_next_job_id.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> lock(g_jobs_mutex);
+    g_jobs[job->id] = job;
+  }
+
+  try {
+    generation_pool().Submit(job);
+  } catch (const std::system_error &e) {
+    DEBUG_ERROR("Failed to start generation workers: %s", e.what());
+    {
+      std::lock_guard<std::mutex> lock(g_jobs_mutex);
+      g_jobs.erase(job->id);
+    }
+    release_model(job->entry);
+    set_error(std::string("Failed to start generation workers: ") + e.what());
+    return -4;
+  }
+
+  DEBUG_LOG("Queued generation %lld", (long long)job->id);
+  return job->id;
+}
+
+// =============================================================================
+// Chat Sessions - generators kept alive between turns
+// =============================================================================
+
+namespace {
+/**
+ * @brief A conversation whose generator (and KV cache) outlives each turn.
+ *
+ * Each chat_send appends only the new message to the generator, so the
+ * history is never tokenized or prefilled again.
+ */
+struct ChatSession {
+  LoadedModel *entry = nullptr; // one reference, released with the chat
+  // Serializes chat_send and chat_rewind on this chat
+  std::mutex mutex;
+  // Owns the params and generator; the sequences and tokenizer stream are
+  // recreated for every turn
+  std::unique_ptr<GenerationRequest> request;
+  // Position at the start of each turn, so a turn can be rewound. Positions
+  // count evicted tokens too (see chat_position).
+  std::vector<size_t> turn_starts;
+  // Tokens kept at the start once older ones are evicted (0 = no eviction)
+  size_t attention_sink_size = 0;
+  // Last token of the previous reply, which the model has not run yet. It is
+  // appended in front of the next message so the history stays complete.
+  int32_t pending_token = 0;
+  bool has_pending_token = false;
+
+  ~ChatSession() {
+    request.reset(); // the generator must go before the model
+    if (entry)
+      release_model(entry);
+  }
+};
+
+// Open chats by id. A chat_send in progress keeps its chat alive after
+// chat_close removes it.
+std::unordered_map<int64_t, std::shared_ptr<ChatSession>> g_chats;
+std::mutex g_chats_mutex;
+std::atomic<int64_t> g_next_chat_id{1};
+} // namespace
+
+/**
+ * @brief Look up an open chat.
+ * @return The chat, or nullptr if the id is unknown
+ */
+static std::shared_ptr<ChatSession> find_chat(int64_t chat_id) {
+  std::lock_guard<std::mutex> lock(g_chats_mutex);
+  auto it = g_chats.find(chat_id);
+  return it != g_chats.end() ? it->second : nullptr;
+}
+
+/**
+ * @brief Number of tokens in a chat so far, evicted ones included.
+ *
+ * With attention sinks the generator evicts tokens after the sinks, so its
+ * sequence length alone doesn't identify a point in the conversation.
+ *
+ * @return The position, or SIZE_MAX with the error in g_error_buffer
+ */
+static size_t chat_position(ChatSession &chat) {
+  OgaGenerator *generator = chat.request->generator;
+  size_t evicted = 0;
+  OgaResult *result = OgaGenerator_GetEvictedTokenCount(generator, &evicted);
+  if (check_oga_result(result, "Getting evicted token count failed")) {
+    return SIZE_MAX;
+  }
+  return OgaGenerator_GetSequenceCount(generator, 0) + evicted;
+}
+
+/**
+ * @brief Rewind a chat's generator to a position from chat_position, keeping
+ *        g_error_buffer on failure.
+ */
+static bool rewind_chat(ChatSession &chat, size_t position) {
+  size_t evicted = 0;
+  OgaResult *result =
+      OgaGenerator_GetEvictedTokenCount(chat.request->generator, &evicted);
+  if (check_oga_result(result, "Getting evicted token count failed")) {
+    return false;
+  }
+
+  // Tokens after the sinks moved down by the evicted count; the evicted ones
+  // themselves are gone
+  size_t length = position;
+  if (position > chat.attention_sink_size) {
+    if (position < chat.attention_sink_size + evicted) {
+      set_error("Rewind failed: the position was evicted");
+      return false;
+    }
+    length = position - evicted;
+  }
+  result = OgaGenerator_RewindTo(chat.request->generator, length);
+  return !check_oga_result(result, "Rewind failed");
+}
+
+/**
+ * @brief Path of the file next to a saved generator state that holds what the
+ *        chat keeps outside the generator: the pending token and the turns.
+ */
+static std::string chat_file_path(const char *path) {
+  return std::string(path) + ".chat";
+}
+
+/**
+ * @brief Write the chat's own state to chat_file_path(path), keeping
+ *        g_error_buffer on failure.
+ */
+static bool write_chat_file(const ChatSession &chat, const char *path) {
+  const std::string chat_path = chat_file_path(path);
+  std::ofstream file(chat_path, std::ios::trunc);
+  file << chat.attention_sink_size << ' ' << (chat.has_pending_token ? 1 : 0)
+       << ' ' << chat.pending_token << ' ' << chat.turn_starts.size();
+  for (size_t start : chat.turn_starts)
+    file << ' ' << start;
+  file << '\n';
+  file.close();
+  if (!file) {
+    set_error("Could not write " + chat_path);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Read the chat's own state written by write_chat_file, keeping
+ *        g_error_buffer on failure. The turns must lie within position.
+ */
+static bool read_chat_file(ChatSession &chat, const char *path,
+                           size_t position) {
+  const std::string chat_path = chat_file_path(path);
+  std::ifstream file(chat_path);
+  size_t attention_sink_size = 0;
+  int has_pending_token = 0;
+  int32_t pending_token = 0;
+  size_t turn_count = 0;
+  file >> attention_sink_size >> has_pending_token >> pending_token >>
+      turn_count;
+  std::vector<size_t> turn_starts;
+  for (size_t i = 0; file && i < turn_count; i++) {
+    size_t start = 0;
+    file >> start;
+    turn_starts.push_back(start);
+  }
+  if (!file || turn_starts.size() != turn_count ||
+      !std::is_sorted(turn_starts.begin(), turn_starts.end()) ||
+      (!turn_starts.empty() && turn_starts.back() > position)) {
+    set_error("Could not read " + chat_path);
+    return false;
+  }
+  if (attention_sink_size != chat.attention_sink_size) {
+    set_error("The chat was saved with attention_sink_size " +
+              std::to_string(attention_sink_size));
+    return false;
+  }
+
+  chat.has_pending_token = has_pending_token != 0;
+  chat.pending_token = pending_token;
+  chat.turn_starts = std::move(turn_starts);
+  return true;
+}
+
+/**
+ * @brief Tokenize a chat message into the tokens to append to the generator.
+ *
+ * The pending last token of the previous reply goes first. The tokenizer's BOS token
+ * is only kept for the first turn.
+ *
+ * @return false on failure, with the error left in g_error_buffer
+ */
+static bool encode_chat_message(ChatSession &chat, const char *message,
+                                size_t sequence_length,
+                                std::vector<int32_t> &tokens) {
+  GenerationRequest &request = *chat.request;
+  if (request.input_sequences) {
+    OgaDestroySequences(request.input_sequences);
+    request.input_sequences = nullptr;
+  }
+  OgaResult *result = OgaCreateSequences(&request.input_sequences);
+  if (check_oga_result(result, "Sequences creation failed") ||
+      request.input_sequences == nullptr) {
+    return false;
+  }
+  result = OgaTokenizerEncode(chat.entry->tokenizer, message,
+                              request.input_sequences);
+  if (check_oga_result(result, "Tokenization failed")) {
+    return false;
+  }
+
+  const int32_t *data = OgaSequencesGetSequenceData(request.input_sequences, 0);
+  size_t count = OgaSequencesGetSequenceCount(request.input_sequences, 0);
+  if (sequence_length > 0 && count > 0) {
+    int32_t bos_token_id = 0;
+    result = OgaTokenizerGetBosTokenId(chat.entry->tokenizer, &bos_token_id);
+    if (result) {
+      OgaDestroyResult(result); // no BOS token to strip
+    } else if (data[0] == bos_token_id) {
+      data++;
+      count--;
+    }
+  }
+  if (count == 0) {
+    set_error("Message has no tokens");
+    return false;
+  }
+
+  tokens.clear();
+  if (chat.has_pending_token)
+    tokens.push_back(chat.pending_token);
+  tokens.insert(tokens.end(), data, data + count);
+  return true;
+}
+
+// =============================================================================
+// FFI Exported Functions
+// =============================================================================
+
+extern "C" {
+
+/**
+ * @brief Check if the native library and model can be loaded.
+ *
+ * Use this function to verify that:
+ * 1. The native library is properly linked
+ * 2. The model path is accessible
+ * 3. The model can be loaded successfully
+ *
+ * @param model_path Path to the ONNX GenAI model directory
+ * @return 0 on success, negative error codes on failure:
+ *         -1: NULL path provided
+ *         -2: Model creation failed
+ *         -3: Tokenizer creation failed
+ *         1: Model loaded and verified successfully
+ */
+FFI_PLUGIN_EXPORT int32_t check_native_health(const char *model_path) {
+  init_debug_features();
+  DEBUG_LOG("=== check_native_health START ===");
+  DEBUG_LOG("model_path: %s", model_path ? model_path : "NULL");
+
+  if (model_path == nullptr || strlen(model_path) == 0) {
+    DEBUG_ERROR("NULL or empty model_path provided");
+    return -1; // NULL or empty path
+  }
+
+  DEBUG_LOG("Step 1: Creating model...");
+  OgaModel *model = nullptr;
+  OgaResult *result = OgaCreateModel(model_path, &model);
+
+  if (check_oga_result(result, "Model creation failed") || model == nullptr) {
+    DEBUG_ERROR("Model creation failed");
+    return -2; // Model creation failed
+  }
+  DEBUG_LOG("Step 1: Model created successfully");
+
+  // Try to create a tokenizer to verify model integrity
+  DEBUG_LOG("Step 2: Creating tokenizer...");
+  OgaTokenizer *tokenizer = nullptr;
+  result = OgaCreateTokenizer(model, &tokenizer);
+
+  if (check_oga_result(result, "Tokenizer creation failed") ||
+      tokenizer == nullptr) {
+    DEBUG_ERROR("Tokenizer creation failed");
+    OgaDestroyModel(model);
+    return -3; // Tokenizer creation failed
+  }
+  DEBUG_LOG("Step 2: Tokenizer created successfully");
+
+  // Cleanup
+  DEBUG_LOG("Step 3: Cleaning up...");
+  OgaDestroyTokenizer(tokenizer);
+  OgaDestroyModel(model);
+  DEBUG_LOG("Step 3: Cleanup complete");
+  DEBUG_LOG("=== check_native_health END (success) ===");
+
+  return 1; // Success
+}
+
+/**
+ * @brief Run text-only inference with the model.
+ *
+ * WARNING: This is a long-running operation! Call from a background Isolate
+ * only.
+ *
+ * @param model_path Path to the ONNX GenAI model directory
+ * @param prompt The text prompt for generation
+ * @param max_length Maximum number of tokens to generate (0 for default)
+ * @return Generated text on success, error message starting with "ERROR:" on
+ * failure
+ */
+FFI_PLUGIN_EXPORT char *run_text_inference(const char *model_path,
+                                           const char *prompt,
+                                           int32_t max_length) {
+  DEBUG_LOG("=== run_text_inference START ===");
+  DEBUG_LOG("model_path: %s", model_path ? model_path : "NULL");
+  DEBUG_LOG("prompt length: %zu", prompt ? strlen(prompt) : 0);
+  DEBUG_LOG("max_length: %d", max_length);
+
+  if (model_path == nullptr || prompt == nullptr) {
+    DEBUG_ERROR("NULL model_path or prompt provided");
+    return error_result("NULL model_path or prompt provided");
+  }
+
+  // Create model
+  DEBUG_LOG("Step 1: Creating model...");
+  OgaModel *model = nullptr;
+  OgaResult *result = OgaCreateModel(model_path, &model);
+  if (check_oga_result(result, "Model creation failed") || model == nullptr) {
+    DEBUG_ERROR("Model creation failed");
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 1: Model created successfully");
+
+  // Create tokenizer
+  DEBUG_LOG("Step 2: Creating tokenizer...");
+  OgaTokenizer *tokenizer = nullptr;
+  result = OgaCreateTokenizer(model, &tokenizer);
+  if (check_oga_result(result, "Tokenizer creation failed") ||
+      tokenizer == nullptr) {
+    DEBUG_ERROR("Tokenizer creation failed");
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 2: Tokenizer created successfully");
+
+  // Create sequences container first, then encode the prompt
+  DEBUG_LOG("Step 3: Creating sequences and encoding prompt...");
+  OgaSequences *input_sequences = nullptr;
+  result = OgaCreateSequences(&input_sequences);
+  if (check_oga_result(result, "Sequences creation failed") ||
+      input_sequences == nullptr) {
+    DEBUG_ERROR("Sequences creation failed");
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+
+  result = OgaTokenizerEncode(tokenizer, prompt, input_sequences);
+  if (check_oga_result(result, "Tokenization failed")) {
+    DEBUG_ERROR("Tokenization failed");
+    OgaDestroySequences(input_sequences);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 3: Prompt encoded successfully");
+
+  // Create generator parameters
+  DEBUG_LOG("Step 4: Creating generator params...");
+  OgaGeneratorParams *params = nullptr;
+  result = OgaCreateGeneratorParams(model, &params);
+  if (check_oga_result(result, "Generator params creation failed") ||
+      params == nullptr) {
+    DEBUG_ERROR("Generator params creation failed");
+    OgaDestroySequences(input_sequences);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+
+  // Set max length if specified
+  if (max_length > 0) {
+    DEBUG_LOG("Setting max_length to %d", max_length);
+    OgaGeneratorParamsSetSearchNumber(params, "max_length",
+                                      static_cast<double>(max_length));
+  }
+  DEBUG_LOG("Step 4: Generator params created successfully");
+
+  // Create generator
+  DEBUG_LOG("Step 5: Creating generator...");
+  OgaGenerator *generator = nullptr;
+  result = OgaCreateGenerator(model, params, &generator);
+  if (check_oga_result(result, "Generator creation failed") ||
+      generator == nullptr) {
+    DEBUG_ERROR("Generator creation failed");
+    OgaDestroyGeneratorParams(params);
+    OgaDestroySequences(input_sequences);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 5: Generator created successfully");
+
+  // Append input sequences to generator
+  DEBUG_LOG("Step 6: Appending input sequences...");
+  result = OgaGenerator_AppendTokenSequences(generator, input_sequences);
+  if (check_oga_result(result, "Setting input sequences failed")) {
+    DEBUG_ERROR("Setting input sequences failed");
+    OgaDestroyGenerator(generator);
+    OgaDestroyGeneratorParams(params);
+    OgaDestroySequences(input_sequences);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 6: Input sequences appended successfully");
+
+  // Generate tokens
+  DEBUG_LOG("Step 7: Creating tokenizer stream...");
+  std::string generated_text;
+  OgaTokenizerStream *stream = nullptr;
+  result = OgaCreateTokenizerStream(tokenizer, &stream);
+  if (check_oga_result(result, "Tokenizer stream creation failed") ||
+      stream == nullptr) {
+    DEBUG_ERROR("Tokenizer stream creation failed");
+    OgaDestroyGenerator(generator);
+    OgaDestroyGeneratorParams(params);
+    OgaDestroySequences(input_sequences);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 7: Tokenizer stream created successfully");
+
+  DEBUG_LOG("Step 8: Starting token generation loop...");
+  int generated_count = 0;
+  while (!OgaGenerator_IsDone(generator)) {
+    result = OgaGenerator_GenerateNextToken(generator);
+    if (check_oga_result(result, "Generate next token failed")) {
+      DEBUG_ERROR("Generate next token failed at token %d", generated_count);
+      break;
+    }
+
+    // Get the last generated tokens
+    const int32_t *tokens = nullptr;
+    size_t token_count = 0;
+    result = OgaGenerator_GetNextTokens(generator, &tokens, &token_count);
+    if (check_oga_result(result, "Get next tokens failed") || token_count == 0) {
+      DEBUG_ERROR("Get next tokens failed at token %d", generated_count);
+      break;
+    }
+
+    // Decode first token to text (batch size = 1)
+    const char *token_text = nullptr;
+    result = OgaTokenizerStreamDecode(stream, tokens[0], &token_text);
+    if (!check_oga_result(result, "Token decode failed") &&
+        token_text != nullptr) {
+      generated_text += token_text;
+    }
+    generated_count++;
+    
+    // Log progress every 50 tokens
+    if (generated_count % 50 == 0) {
+      DEBUG_LOG("Generated %d tokens so far...", generated_count);
+    }
+  }
+  DEBUG_LOG("Step 8: Generation complete. Total tokens: %d", generated_count);
+
+  // Cleanup
+  DEBUG_LOG("Step 9: Cleaning up resources...");
+  OgaDestroyTokenizerStream(stream);
+  OgaDestroyGenerator(generator);
+  OgaDestroyGeneratorParams(params);
+  OgaDestroySequences(input_sequences);
+  OgaDestroyTokenizer(tokenizer);
+  OgaDestroyModel(model);
+  DEBUG_LOG("Step 9: Cleanup complete");
+  DEBUG_LOG("=== run_text_inference END ===");
+
+  return set_result(generated_text);
+}
+
+/**
+ * @brief Run multimodal inference with text and image.
+ *
+ * This function is specifically designed for vision-language models like
+ * Phi-3.5 Vision. It processes both the text prompt and image together for
+ * generation.
+ *
+ * WARNING: This is a long-running operation! Call from a background Isolate
+ * only.
+ *
+ * @param model_path Path to the ONNX GenAI model directory
+ * @param prompt The text prompt for generation
+ * @param image_path Path to the image file (JPEG, PNG, etc.)
+ * @return Generated text on success, error message starting with "ERROR:" on
+ * failure
+ */
+FFI_PLUGIN_EXPORT char *run_inference(const char *model_path,
+                                      const char *prompt,
+                                      const char *image_path) {
+  init_debug_features();
+  DEBUG_LOG("=== run_inference START ===");
+  DEBUG_LOG("model_path: %s", model_path ? model_path : "NULL");
+  DEBUG_LOG("prompt length: %zu", prompt ? strlen(prompt) : 0);
+  DEBUG_LOG("image_path: %s", image_path ? image_path : "NULL");
+
+  if (model_path == nullptr || prompt == nullptr) {
+    DEBUG_ERROR("NULL model_path or prompt provided");
+    return error_result("NULL model_path or prompt provided");
+  }
+
+  // Create model
+  DEBUG_LOG("Step 1: Creating model...");
+  OgaModel *model = nullptr;
+  OgaResult *result = OgaCreateModel(model_path, &model);
+  if (check_oga_result(result, "Model creation failed") || model == nullptr) {
+    DEBUG_ERROR("Model creation failed");
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 1: Model created successfully");
+
+  // Create multimodal processor
+  DEBUG_LOG("Step 2: Creating multimodal processor...");
+  OgaMultiModalProcessor *processor = nullptr;
+  result = OgaCreateMultiModalProcessor(model, &processor);
+  if (check_oga_result(result, "MultiModal processor creation failed") ||
+      processor == nullptr) {
+    DEBUG_ERROR("MultiModal processor creation failed");
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 2: MultiModal processor created successfully");
+
+  // Create tokenizer from model
+  DEBUG_LOG("Step 3: Creating tokenizer...");
+  OgaTokenizer *tokenizer = nullptr;
+  result = OgaCreateTokenizer(model, &tokenizer);
+  if (check_oga_result(result, "Tokenizer creation failed") ||
+      tokenizer == nullptr) {
+    DEBUG_ERROR("Tokenizer creation failed");
+    OgaDestroyMultiModalProcessor(processor);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 3: Tokenizer created successfully");
+
+  // Load image if provided
+  OgaImages *images = nullptr;
+  OgaNamedTensors *named_tensors = nullptr;
+
+  if (image_path != nullptr && strlen(image_path) > 0) {
+    DEBUG_LOG("Step 4: Loading image from: %s", image_path);
+    result = OgaLoadImage(image_path, &images);
+    if (check_oga_result(result, "Image loading failed") || images == nullptr) {
+      DEBUG_ERROR("Image loading failed");
+      OgaDestroyTokenizer(tokenizer);
+      OgaDestroyMultiModalProcessor(processor);
+      OgaDestroyModel(model);
+      return last_error_result();
+    }
+    DEBUG_LOG("Step 4: Image loaded successfully");
+  } else {
+    DEBUG_LOG("Step 4: No image provided, will process text-only through multimodal processor");
+  }
+
+  // Process through multimodal processor (required for vision models even for text-only)
+  DEBUG_LOG("Step 5: Processing prompt through multimodal processor (images=%p)...",
+            (void *)images);
+  result = OgaProcessorProcessImages(processor, prompt, images, &named_tensors);
+  if (check_oga_result(result, "Multimodal processing failed") ||
+      named_tensors == nullptr) {
+    DEBUG_ERROR("Multimodal processing failed");
+    if (images)
+      OgaDestroyImages(images);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyMultiModalProcessor(processor);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 5: Multimodal processing completed successfully");
+
+  // Create generator parameters
+  DEBUG_LOG("Step 6: Creating generator params...");
+  OgaGeneratorParams *params = nullptr;
+  result = OgaCreateGeneratorParams(model, &params);
+  if (check_oga_result(result, "Generator params creation failed") ||
+      params == nullptr) {
+    DEBUG_ERROR("Generator params creation failed");
+    if (named_tensors)
+      OgaDestroyNamedTensors(named_tensors);
+    if (images)
+      OgaDestroyImages(images);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyMultiModalProcessor(processor);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  
+  // Set max_length to limit memory usage for KV-cache
+  // Use 2048 tokens - must be larger than input prompt size (~954 tokens)
+  DEBUG_LOG("Step 6a: Setting max_length to 2048 to limit memory...");
+  result = OgaGeneratorParamsSetSearchNumber(params, "max_length", 2048.0);
+  if (result != nullptr) {
+    DEBUG_ERROR("Failed to set max_length: %s", OgaResultGetError(result));
+    OgaDestroyResult(result);
+    // Non-fatal, continue anyway
+  } else {
+    DEBUG_LOG("Step 6a: max_length set successfully");
+  }
+  
+  DEBUG_LOG("Step 6: Generator params created successfully");
+
+  // Create generator - this is often where multimodal models crash
+  // due to memory allocation or model graph initialization issues
+  OgaGenerator *generator = nullptr;
+  DEBUG_LOG("Step 7: Creating generator...");
+  DEBUG_LOG("Step 7a: Generator pointer address: %p", (void *)&generator);
+  DEBUG_LOG("Step 7b: Model pointer: %p", (void *)model);
+  DEBUG_LOG("Step 7c: Params pointer: %p", (void *)params);
+  DEBUG_LOG("Step 7d: named_tensors: %p, images: %p",
+            (void *)named_tensors, (void *)images);
+#ifdef __ANDROID__
+  // Force log flush before potentially crashing call
+  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
+                      "[DEBUG] Step 7e: About to call OgaCreateGenerator...");
+#else
+  fprintf(stderr, "[OnnxGenAI] Step 7e: About to call OgaCreateGenerator...\n");
+  fflush(stderr);
+#endif
+
+  result = OgaCreateGenerator(model, params, &generator);
+
+#ifdef __ANDROID__
+  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
+                      "[DEBUG] Step 7f: OgaCreateGenerator returned, result=%p",
+                      (void *)result);
+#else
+  fprintf(stderr, "[OnnxGenAI] Step 7f: OgaCreateGenerator returned\n");
+  fflush(stderr);
+#endif
+
+  if (check_oga_result(result, "Generator creation failed") ||
+      generator == nullptr) {
+    DEBUG_ERROR("Generator creation failed - generator=%p", (void *)generator);
+    OgaDestroyGeneratorParams(params);
+    if (named_tensors)
+      OgaDestroyNamedTensors(named_tensors);
+    if (images)
+      OgaDestroyImages(images);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyMultiModalProcessor(processor);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 7g: Generator created successfully, generator=%p",
+            (void *)generator);
+
+  // Set input tensors from multimodal processor
+  DEBUG_LOG("Step 8: Setting input tensors...");
+  DEBUG_LOG("Step 8a: generator=%p, named_tensors=%p", (void *)generator, (void *)named_tensors);
+#ifdef __ANDROID__
+  // Force log flush before potentially crashing call
+  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
+                      "[DEBUG] Step 8b: About to call OgaGenerator_SetInputs...");
+#else
+  fprintf(stderr, "[OnnxGenAI] Step 8b: About to call OgaGenerator_SetInputs...\n");
+  fflush(stderr);
+#endif
+
+  result = OgaGenerator_SetInputs(generator, named_tensors);
+
+#ifdef __ANDROID__
+  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
+                      "[DEBUG] Step 8c: OgaGenerator_SetInputs returned, result=%p",
+                      (void *)result);
+#else
+  fprintf(stderr, "[OnnxGenAI] Step 8c: OgaGenerator_SetInputs returned\n");
+  fflush(stderr);
+#endif
+
+  if (check_oga_result(result, "Setting input tensors failed")) {
+    DEBUG_ERROR("Setting input tensors failed");
+    OgaDestroyGenerator(generator);
+    OgaDestroyGeneratorParams(params);
+    OgaDestroyNamedTensors(named_tensors);
+    if (images)
+      OgaDestroyImages(images);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyMultiModalProcessor(processor);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 8d: Input tensors set successfully");
+
+  // Create tokenizer stream for incremental decoding
+  DEBUG_LOG("Step 9: Creating tokenizer stream...");
+  OgaTokenizerStream *stream = nullptr;
+  result = OgaCreateTokenizerStream(tokenizer, &stream);
+  if (check_oga_result(result, "Tokenizer stream creation failed") ||
+      stream == nullptr) {
+    DEBUG_ERROR("Tokenizer stream creation failed");
+    OgaDestroyGenerator(generator);
+    OgaDestroyGeneratorParams(params);
+    if (named_tensors)
+      OgaDestroyNamedTensors(named_tensors);
+    if (images)
+      OgaDestroyImages(images);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyMultiModalProcessor(processor);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 9: Tokenizer stream created successfully");
+
+  // Generate tokens
+  DEBUG_LOG("Step 10: Starting token generation loop...");
+  std::string generated_text;
+  int generated_count = 0;
+  while (!OgaGenerator_IsDone(generator)) {
+    result = OgaGenerator_GenerateNextToken(generator);
+    if (check_oga_result(result, "Generate next token failed")) {
+      DEBUG_ERROR("Generate next token failed at token %d", generated_count);
+      break;
+    }
+
+    // Get the last generated tokens
+    const int32_t *tokens = nullptr;
+    size_t token_count = 0;
+    result = OgaGenerator_GetNextTokens(generator, &tokens, &token_count);
+    if (check_oga_result(result, "Get next tokens failed") || token_count == 0) {
+      DEBUG_ERROR("Get next tokens failed at token %d", generated_count);
+      break;
+    }
+
+    // Decode first token to text (batch size = 1)
+    const char *token_text = nullptr;
+    result = OgaTokenizerStreamDecode(stream, tokens[0], &token_text);
+    if (!check_oga_result(result, "Token decode failed") &&
+        token_text != nullptr) {
+      generated_text += token_text;
+    }
+    generated_count++;
+    
+    // Log progress every 50 tokens
+    if (generated_count % 50 == 0) {
+      DEBUG_LOG("Generated %d tokens so far...", generated_count);
+    }
+  }
+  DEBUG_LOG("Step 10: Generation complete. Total tokens: %d", generated_count);
+
+  // Cleanup
+  DEBUG_LOG("Step 11: Cleaning up resources...");
+  OgaDestroyTokenizerStream(stream);
+  OgaDestroyGenerator(generator);
+  OgaDestroyGeneratorParams(params);
+  if (named_tensors)
+    OgaDestroyNamedTensors(named_tensors);
+  if (images)
+    OgaDestroyImages(images);
+  OgaDestroyTokenizer(tokenizer);
+  OgaDestroyMultiModalProcessor(processor);
+  OgaDestroyModel(model);
+  DEBUG_LOG("Step 11: Cleanup complete");
+  DEBUG_LOG("=== run_inference END ===");
+
+  return set_result(generated_text);
+}
+
+/**
+ * @brief Run multimodal inference with text and multiple images.
+ *
+ * This function is designed for vision-language models like Phi-3.5 Vision.
+ * It processes the text prompt along with multiple images for generation.
+ * The prompt should contain image placeholders like <|image_1|>, <|image_2|>,
+ * etc. matching the number of images provided.
+ *
+ * WARNING: This is a long-running operation! Call from a background Isolate
+ * only.
+ *
+ * @param model_path Path to the ONNX GenAI model directory
+ * @param prompt The text prompt for generation (with image placeholders)
+ * @param image_paths Array of paths to image files
+ * @param image_count Number of images in the array
+ * @return Generated text on success, error message starting with "ERROR:" on
+ * failure
+ */
+FFI_PLUGIN_EXPORT char *run_inference_multi(const char *model_path,
+                                            const char *prompt,
+                                            const char **image_paths,
+                                            int32_t image_count) {
+  init_debug_features();
+  DEBUG_LOG("=== run_inference_multi START ===");
+  DEBUG_LOG("model_path: %s", model_path ? model_path : "NULL");
+  DEBUG_LOG("prompt length: %zu", prompt ? strlen(prompt) : 0);
+  DEBUG_LOG("image_count: %d", image_count);
+  for (int i = 0; i < image_count && image_paths != nullptr; i++) {
+    DEBUG_LOG("image_paths[%d]: %s", i, image_paths[i] ? image_paths[i] : "NULL");
+  }
+
+  if (model_path == nullptr || prompt == nullptr) {
+    DEBUG_ERROR("NULL model_path or prompt provided");
+    return error_result("NULL model_path or prompt provided");
+  }
+
+  if (image_count > 0 && image_paths == nullptr) {
+    DEBUG_ERROR("image_paths is NULL but image_count > 0");
+    return error_result("image_paths is NULL but image_count > 0");
+  }
+
+  // Create model
+  DEBUG_LOG("Step 1: Creating model...");
+  OgaModel *model = nullptr;
+  OgaResult *result = OgaCreateModel(model_path, &model);
+  if (check_oga_result(result, "Model creation failed") || model == nullptr) {
+    DEBUG_ERROR("Model creation failed");
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 1: Model created successfully");
+
+  // Create multimodal processor
+  DEBUG_LOG("Step 2: Creating multimodal processor...");
+  OgaMultiModalProcessor *processor = nullptr;
+  result = OgaCreateMultiModalProcessor(model, &processor);
+  if (check_oga_result(result, "MultiModal processor creation failed") ||
+      processor == nullptr) {
+    DEBUG_ERROR("MultiModal processor creation failed");
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 2: MultiModal processor created successfully");
+
+  // Create tokenizer from model
+  DEBUG_LOG("Step 3: Creating tokenizer...");
+  OgaTokenizer *tokenizer = nullptr;
+  result = OgaCreateTokenizer(model, &tokenizer);
+  if (check_oga_result(result, "Tokenizer creation failed") ||
+      tokenizer == nullptr) {
+    DEBUG_ERROR("Tokenizer creation failed");
+    OgaDestroyMultiModalProcessor(processor);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 3: Tokenizer created successfully");
+
+  // Load images if provided
+  OgaImages *images = nullptr;
+  OgaNamedTensors *named_tensors = nullptr;
+  OgaStringArray *image_path_array = nullptr;
+
+  if (image_count > 0) {
+    // Create string array from image paths
+    DEBUG_LOG("Step 4: Creating string array from %d image paths...", image_count);
+    result = OgaCreateStringArrayFromStrings(image_paths,
+                                             static_cast<size_t>(image_count),
+                                             &image_path_array);
+    if (check_oga_result(result, "String array creation failed") ||
+        image_path_array == nullptr) {
+      DEBUG_ERROR("String array creation failed");
+      OgaDestroyTokenizer(tokenizer);
+      OgaDestroyMultiModalProcessor(processor);
+      OgaDestroyModel(model);
+      return last_error_result();
+    }
+    DEBUG_LOG("Step 4: String array created successfully");
+
+    // Load all images
+    DEBUG_LOG("Step 5: Loading %d images...", image_count);
+    result = OgaLoadImages(image_path_array, &images);
+    if (check_oga_result(result, "Image loading failed") || images == nullptr) {
+      DEBUG_ERROR("Image loading failed");
+      OgaDestroyStringArray(image_path_array);
+      OgaDestroyTokenizer(tokenizer);
+      OgaDestroyMultiModalProcessor(processor);
+      OgaDestroyModel(model);
+      return last_error_result();
+    }
+    DEBUG_LOG("Step 5: Images loaded successfully");
+  } else {
+    DEBUG_LOG("Step 4-5: No images provided, will process text-only through multimodal processor");
+  }
+
+  // Process through multimodal processor (required for vision models even for text-only)
+  DEBUG_LOG("Step 6: Processing prompt through multimodal processor (images=%p)...",
+            (void *)images);
+  result = OgaProcessorProcessImages(processor, prompt, images, &named_tensors);
+  if (check_oga_result(result, "Multimodal processing failed") ||
+      named_tensors == nullptr) {
+    DEBUG_ERROR("Multimodal processing failed");
+    if (images)
+      OgaDestroyImages(images);
+    if (image_path_array)
+      OgaDestroyStringArray(image_path_array);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyMultiModalProcessor(processor);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 6: Multimodal processing completed successfully");
+
+  // Create generator parameters
+  DEBUG_LOG("Step 7: Creating generator params...");
+  OgaGeneratorParams *params = nullptr;
+  result = OgaCreateGeneratorParams(model, &params);
+  if (check_oga_result(result, "Generator params creation failed") ||
+      params == nullptr) {
+    DEBUG_ERROR("Generator params creation failed");
+    if (named_tensors)
+      OgaDestroyNamedTensors(named_tensors);
+    if (images)
+      OgaDestroyImages(images);
+    if (image_path_array)
+      OgaDestroyStringArray(image_path_array);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyMultiModalProcessor(processor);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  
+  // Set max_length to limit memory usage for KV-cache
+  // Use 2048 tokens - must be larger than input prompt size (~954 tokens)
+  DEBUG_LOG("Step 7a: Setting max_length to 2048 to limit memory...");
+  result = OgaGeneratorParamsSetSearchNumber(params, "max_length", 2048.0);
+  if (result != nullptr) {
+    DEBUG_ERROR("Failed to set max_length: %s", OgaResultGetError(result));
+    OgaDestroyResult(result);
+    // Non-fatal, continue anyway
+  } else {
+    DEBUG_LOG("Step 7a: max_length set successfully");
+  }
+  
+  DEBUG_LOG("Step 7: Generator params created successfully");
+
+  // Create generator - this is often where multimodal models crash
+  // due to memory allocation or model graph initialization issues
+  OgaGenerator *generator = nullptr;
+  DEBUG_LOG("Step 8: Creating generator...");
+  DEBUG_LOG("Step 8a: Generator pointer address: %p", (void *)&generator);
+  DEBUG_LOG("Step 8b: Model pointer: %p", (void *)model);
+  DEBUG_LOG("Step 8c: Params pointer: %p", (void *)params);
+  DEBUG_LOG("Step 8d: named_tensors: %p, images: %p, image_count: %d",
+            (void *)named_tensors, (void *)images, image_count);
+#ifdef __ANDROID__
+  // Force log flush before potentially crashing call
+  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
+                      "[DEBUG] Step 8e: About to call OgaCreateGenerator...");
+#else
+  fprintf(stderr, "[OnnxGenAI] Step 8e: About to call OgaCreateGenerator...\n");
+  fflush(stderr);
+#endif
+
+  result = OgaCreateGenerator(model, params, &generator);
+
+#ifdef __ANDROID__
+  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
+                      "[DEBUG] Step 8f: OgaCreateGenerator returned, result=%p",
+                      (void *)result);
+#else
+  fprintf(stderr, "[OnnxGenAI] Step 8f: OgaCreateGenerator returned\n");
+  fflush(stderr);
+#endif
+
+  if (check_oga_result(result, "Generator creation failed") ||
+      generator == nullptr) {
+    DEBUG_ERROR("Generator creation failed - generator=%p", (void *)generator);
+    OgaDestroyGeneratorParams(params);
+    if (named_tensors)
+      OgaDestroyNamedTensors(named_tensors);
+    if (images)
+      OgaDestroyImages(images);
+    if (image_path_array)
+      OgaDestroyStringArray(image_path_array);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyMultiModalProcessor(processor);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 8g: Generator created successfully, generator=%p",
+            (void *)generator);
+
+  // Set input tensors from multimodal processor
+  DEBUG_LOG("Step 9: Setting input tensors...");
+  DEBUG_LOG("Step 9a: generator=%p, named_tensors=%p", (void *)generator, (void *)named_tensors);
+#ifdef __ANDROID__
+  // Force log flush before potentially crashing call
+  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
+                      "[DEBUG] Step 9b: About to call OgaGenerator_SetInputs...");
+#else
+  fprintf(stderr, "[OnnxGenAI] Step 9b: About to call OgaGenerator_SetInputs...\n");
+  fflush(stderr);
+#endif
+
+  result = OgaGenerator_SetInputs(generator, named_tensors);
+
+#ifdef __ANDROID__
+  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
+                      "[DEBUG] Step 9c: OgaGenerator_SetInputs returned, result=%p",
+                      (void *)result);
+#else
+  fprintf(stderr, "[OnnxGenAI] Step 9c: OgaGenerator_SetInputs returned\n");
+  fflush(stderr);
+#endif
+
+  if (check_oga_result(result, "Setting input tensors failed")) {
+    DEBUG_ERROR("Setting input tensors failed");
+    OgaDestroyGenerator(generator);
+    OgaDestroyGeneratorParams(params);
+    OgaDestroyNamedTensors(named_tensors);
+    if (images)
+      OgaDestroyImages(images);
+    if (image_path_array)
+      OgaDestroyStringArray(image_path_array);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyMultiModalProcessor(processor);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 9d: Input tensors set successfully");
+
+  // Create tokenizer stream for incremental decoding
+  DEBUG_LOG("Step 10: Creating tokenizer stream...");
+  OgaTokenizerStream *stream = nullptr;
+  result = OgaCreateTokenizerStream(tokenizer, &stream);
+  if (check_oga_result(result, "Tokenizer stream creation failed") ||
+      stream == nullptr) {
+    DEBUG_ERROR("Tokenizer stream creation failed");
+    OgaDestroyGenerator(generator);
+    OgaDestroyGeneratorParams(params);
+    if (named_tensors)
+      OgaDestroyNamedTensors(named_tensors);
+    if (images)
+      OgaDestroyImages(images);
+    if (image_path_array)
+      OgaDestroyStringArray(image_path_array);
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyMultiModalProcessor(processor);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 10: Tokenizer stream created successfully");
+
+  // Generate tokens
+  DEBUG_LOG("Step 11: Starting token generation loop...");
+  std::string generated_text;
+  int generated_count = 0;
+  while (!OgaGenerator_IsDone(generator)) {
+    result = OgaGenerator_GenerateNextToken(generator);
+    if (check_oga_result(result, "Generate next token failed")) {
+      DEBUG_ERROR("Generate next token failed at token %d", generated_count);
+      break;
+    }
+
+    // Get the last generated tokens
+    const int32_t *tokens = nullptr;
+    size_t token_count = 0;
+    result = OgaGenerator_GetNextTokens(generator, &tokens, &token_count);
+    if (check_oga_result(result, "Get next tokens failed") ||
+        token_count == 0) {
+      DEBUG_ERROR("Get next tokens failed at token %d", generated_count);
+      break;
+    }
+
+    // Decode first token to text (batch size = 1)
+    const char *token_text = nullptr;
+    result = OgaTokenizerStreamDecode(stream, tokens[0], &token_text);
+    if (!check_oga_result(result, "Token decode failed") &&
+        token_text != nullptr) {
+      generated_text += token_text;
+    }
+    generated_count++;
+    
+    // Log progress every 50 tokens
+    if (generated_count % 50 == 0) {
+      DEBUG_LOG("Generated %d tokens so far...", generated_count);
+    }
+  }
+  DEBUG_LOG("Step 11: Generation complete. Total tokens: %d", generated_count);
+
+  // Cleanup
+  DEBUG_LOG("Step 12: Cleaning up resources...");
+  OgaDestroyTokenizerStream(stream);
+  OgaDestroyGenerator(generator);
   OgaDestroyGeneratorParams(params);
   if (named_tensors)
     OgaDestroyNamedTensors(named_tensors);
   if (images)
     OgaDestroyImages(images);
+  if (image_path_array)
+    OgaDestroyStringArray(image_path_array);
   OgaDestroyTokenizer(tokenizer);
   OgaDestroyMultiModalProcessor(processor);
   OgaDestroyModel(model);
-  DEBUG_LOG("Step 11: Cleanup complete");
-  DEBUG_LOG("=== run_inference END ===");
+  DEBUG_LOG("Step 12: Cleanup complete");
+  DEBUG_LOG("=== run_inference_multi END ===");
+
+  return set_result(generated_text);
+}
+
+/**
+ * @brief Free any global resources held by the library.
+ *
+ * Call this when the application is shutting down or when the plugin
+ * is being unloaded to ensure proper cleanup.
+ */
+FFI_PLUGIN_EXPORT void shutdown_onnx_genai() {
+  {
+    std::lock_guard<std::mutex> lock(g_jobs_mutex);
+    for (auto &kv : g_jobs) {
+      std::lock_guard<std::mutex> job_lock(kv.second->mutex);
+      kv.second->cancelled = true;
+      if (kv.second->generator != nullptr) {
+        OgaResult *result = OgaGenerator_SetRuntimeOption(
+            kv.second->generator, "terminate_session", "1");
+        if (result)
+          OgaDestroyResult(result);
+      }
+    }
+  }
+  generation_pool().Shutdown();
+  {
+    std::lock_guard<std::mutex> lock(g_jobs_mutex);
+    g_jobs.clear();
+  }
+
+  {
+    // Destroyed outside the lock: each chat releases its model reference
+    std::unordered_map<int64_t, std::shared_ptr<ChatSession>> chats;
+    {
+      std::lock_guard<std::mutex> lock(g_chats_mutex);
+      chats.swap(g_chats);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(g_init_mutex);
+    g_shutdown_requested = true;
+  }
+
+  // Handles are invalid after shutdown, but a request running on another
+  // isolate (or a chat_send still holding its session) keeps its model until
+  // it releases it
+  bool models_in_use = false;
+  {
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    for (auto &kv : g_model_registry) {
+      LoadedModel *entry = kv.second;
+      entry->ref_count -= entry->handle_refs;
+      entry->handle_refs = 0;
+      if (entry->ref_count == 0) {
+        destroy_loaded_model(entry);
+      } else {
+        DEBUG_LOG("Model '%s' still in use by %d requests", entry->key.c_str(),
+                  entry->ref_count);
+        entry->orphaned = true;
+        g_orphaned_models++;
+      }
+    }
+    g_model_registry.clear();
+    // ONNX Runtime has to outlive the models requests still use, so
+    // release_model finishes the shutdown when the last one goes
+    models_in_use = g_orphaned_models > 0;
+  }
+
+  if (!models_in_use) {
+    shutdown_runtime();
+  }
+}
+
+/**
+ * @brief Get the library version string.
+ *
+ * @return Version string in format "major.minor.patch"
+ */
+FFI_PLUGIN_EXPORT const char *get_library_version() { return "0.3.0"; }
+
+// =============================================================================
+// Configuration API Implementation
+// =============================================================================
+
+/**
+ * @brief Create a configuration object from a model path.
+ */
+FFI_PLUGIN_EXPORT int64_t create_config(const char *model_path) {
+  init_debug_features();
+  DEBUG_LOG("=== create_config START ===");
+  DEBUG_LOG("model_path: %s", model_path ? model_path : "NULL");
+
+  if (model_path == nullptr || strlen(model_path) == 0) {
+    DEBUG_ERROR("NULL or empty model_path provided");
+    set_error("NULL or empty model_path provided");
+    return 0;
+  }
+
+  OgaConfig *config = nullptr;
+  OgaResult *result = OgaCreateConfig(model_path, &config);
+  
+  if (check_oga_result(result, "Config creation failed") || config == nullptr) {
+    DEBUG_ERROR("Config creation failed");
+    return 0;
+  }
+  
+  DEBUG_LOG("Config created successfully: %p", (void*)config);
+  {
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    g_config_keys[reinterpret_cast<int64_t>(config)] = model_path;
+  }
+  DEBUG_LOG("=== create_config END ===");
+  
+  return reinterpret_cast<int64_t>(config);
+}
+
+/**
+ * @brief Destroy a configuration object.
+ */
+FFI_PLUGIN_EXPORT void destroy_config(int64_t config_handle) {
+  DEBUG_LOG("=== destroy_config ===");
+  if (config_handle == 0) {
+    DEBUG_ERROR("NULL config handle");
+    return;
+  }
+  
+  {
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    g_config_keys.erase(config_handle);
+  }
+
+  OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
+  OgaDestroyConfig(config);
+  DEBUG_LOG("Config destroyed");
+}
+
+/**
+ * @brief Clear all execution providers from the config.
+ */
+FFI_PLUGIN_EXPORT int32_t config_clear_providers(int64_t config_handle) {
+  DEBUG_LOG("=== config_clear_providers ===");
+  if (config_handle == 0) {
+    DEBUG_ERROR("NULL config handle");
+    set_error("NULL config handle");
+    return -1;
+  }
+  
+  OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
+  OgaResult *result = OgaConfigClearProviders(config);
+  
+  if (check_oga_result(result, "Clear providers failed")) {
+    return -2;
+  }
+  append_config_key(config_handle, "clear");
+  
+  DEBUG_LOG("Providers cleared successfully");
+  return 1;
+}
+
+/**
+ * @brief Append an execution provider to the config.
+ */
+FFI_PLUGIN_EXPORT int32_t config_append_provider(int64_t config_handle,
+                                                  const char *provider_name) {
+  DEBUG_LOG("=== config_append_provider ===");
+  DEBUG_LOG("provider_name: %s", provider_name ? provider_name : "NULL");
+  
+  if (config_handle == 0) {
+    DEBUG_ERROR("NULL config handle");
+    set_error("NULL config handle");
+    return -1;
+  }
+  
+  if (provider_name == nullptr || strlen(provider_name) == 0) {
+    DEBUG_ERROR("NULL or empty provider name");
+    set_error("NULL or empty provider name");
+    return -2;
+  }
+  
+  OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
+  OgaResult *result = OgaConfigAppendProvider(config, provider_name);
+  
+  if (check_oga_result(result, "Append provider failed")) {
+    return -3;
+  }
+  append_config_key(config_handle, std::string("+") + provider_name);
+  
+  DEBUG_LOG("Provider '%s' appended successfully", provider_name);
+  return 1;
+}
 
-  return set_result(generated_text);
+/**
+ * @brief Set an option for a specific execution provider.
+ */
+FFI_PLUGIN_EXPORT int32_t config_set_provider_option(int64_t config_handle,
+                                                      const char *provider_name,
+                                                      const char *key,
+                                                      const char *value) {
+  DEBUG_LOG("=== config_set_provider_option ===");
+  DEBUG_LOG("provider: %s, key: %s, value: %s",
+            provider_name ? provider_name : "NULL",
+            key ? key : "NULL",
+            value ? value : "NULL");
+  
+  if (config_handle == 0) {
+    DEBUG_ERROR("NULL config handle");
+    set_error("NULL config handle");
+    return -1;
+  }
+  
+  if (provider_name == nullptr || key == nullptr || value == nullptr) {
+    DEBUG_ERROR("NULL parameter");
+    set_error("NULL parameter");
+    return -2;
+  }
+  
+  OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
+  OgaResult *result = OgaConfigSetProviderOption(config, provider_name, key, value);
+  
+  if (check_oga_result(result, "Set provider option failed")) {
+    return -3;
+  }
+  append_config_key(config_handle, std::string(provider_name) + "." + key + "=" + value);
+  
+  DEBUG_LOG("Option set successfully");
+  return 1;
 }
 
 /**
- * @brief Run multimodal inference with text and multiple images.
- *
- * This function is designed for vision-language models like Phi-3.5 Vision.
- * It processes the text prompt along with multiple images for generation.
- * The prompt should contain image placeholders like <|image_1|>, <|image_2|>,
- * etc. matching the number of images provided.
- *
- * WARNING: This is a long-running operation! Call from a background Isolate
- * only.
- *
- * @param model_path Path to the ONNX GenAI model directory
- * @param prompt The text prompt for generation (with image placeholders)
- * @param image_paths Array of paths to image files
- * @param image_count Number of images in the array
- * @return Generated text on success, error message starting with "ERROR:" on
- * failure
+ * @brief Quote a string as a JSON string literal.
  */
-FFI_PLUGIN_EXPORT const char *run_inference_multi(const char *model_path,
-                                                  const char *prompt,
-                                                  const char **image_paths,
-                                                  int32_t image_count) {
-  init_debug_features();
-  DEBUG_LOG("=== run_inference_multi START ===");
-  DEBUG_LOG("model_path: %s", model_path ? model_path : "NULL");
-  DEBUG_LOG("prompt length: %zu", prompt ? strlen(prompt) : 0);
-  DEBUG_LOG("image_count: %d", image_count);
-  for (int i = 0; i < image_count && image_paths != nullptr; i++) {
-    DEBUG_LOG("image_paths[%d]: %s", i, image_paths[i] ? image_paths[i] : "NULL");
+static std::string json_string(const char *text) {
+  std::string quoted = "\"";
+  for (const char *c = text; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      quoted += '\\';
+      quoted += *c;
+    } else if (static_cast<unsigned char>(*c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+      quoted += escaped;
+    } else {
+      quoted += *c;
+    }
   }
+  return quoted + "\"";
+}
 
-  if (model_path == nullptr || prompt == nullptr) {
-    DEBUG_ERROR("NULL model_path or prompt provided");
-    return set_error("NULL model_path or prompt provided");
+/**
+ * @brief Cache the optimized graphs of a config's model files in a directory.
+ */
+FFI_PLUGIN_EXPORT int32_t config_set_optimized_model_cache_dir(
+    int64_t config_handle, const char *cache_dir) {
+  DEBUG_LOG("=== config_set_optimized_model_cache_dir ===");
+  DEBUG_LOG("cache_dir: %s", cache_dir ? cache_dir : "NULL");
+
+  if (config_handle == 0) {
+    DEBUG_ERROR("NULL config handle");
+    set_error("NULL config handle");
+    return -1;
   }
 
-  if (image_count > 0 && image_paths == nullptr) {
-    DEBUG_ERROR("image_paths is NULL but image_count > 0");
-    return set_error("image_paths is NULL but image_count > 0");
+  if (cache_dir == nullptr) {
+    DEBUG_ERROR("NULL cache directory");
+    set_error("NULL cache directory");
+    return -2;
   }
 
-  // Create model
-  DEBUG_LOG("Step 1: Creating model...");
+  OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
+  const std::string overlay = "{\"model\": {\"optimized_model_cache_dir\": " +
+                              json_string(cache_dir) + "}}";
+  OgaResult *result = OgaConfigOverlay(config, overlay.c_str());
+  if (check_oga_result(result, "Setting optimized model cache failed")) {
+    return -3;
+  }
+  append_config_key(config_handle, std::string("optimized_cache=") + cache_dir);
+  return 1;
+}
+
+/**
+ * @brief Load the encoders of a config's model on demand.
+ */
+FFI_PLUGIN_EXPORT int32_t config_set_lazy_encoder_sessions(
+    int64_t config_handle, int32_t idle_timeout_ms) {
+  DEBUG_LOG("=== config_set_lazy_encoder_sessions ===");
+  DEBUG_LOG("idle_timeout_ms: %d", idle_timeout_ms);
+
+  if (config_handle == 0) {
+    DEBUG_ERROR("NULL config handle");
+    set_error("NULL config handle");
+    return -1;
+  }
+
+  if (idle_timeout_ms < -1) {
+    DEBUG_ERROR("Invalid idle timeout");
+    set_error("Idle timeout must be -1 or more");
+    return -2;
+  }
+
+  OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
+  const std::string overlay =
+      "{\"model\": {\"lazy_encoder_sessions\": true, "
+      "\"encoder_idle_timeout_ms\": " + std::to_string(idle_timeout_ms) + "}}";
+  OgaResult *result = OgaConfigOverlay(config, overlay.c_str());
+  if (check_oga_result(result, "Setting lazy encoder sessions failed")) {
+    return -3;
+  }
+  append_config_key(config_handle,
+                    "lazy_encoders=" + std::to_string(idle_timeout_ms));
+  return 1;
+}
+
+/**
+ * @brief Run inference using a pre-configured config.
+ */
+FFI_PLUGIN_EXPORT char *run_inference_with_config(int64_t config_handle,
+                                                   const char *prompt,
+                                                   const char *image_path) {
+  init_debug_features();
+  DEBUG_LOG("=== run_inference_with_config START ===");
+  DEBUG_LOG("config_handle: %lld", (long long)config_handle);
+  DEBUG_LOG("prompt length: %zu", prompt ? strlen(prompt) : 0);
+  DEBUG_LOG("image_path: %s", image_path ? image_path : "NULL");
+
+  if (config_handle == 0) {
+    DEBUG_ERROR("NULL config handle");
+    return error_result("NULL config handle");
+  }
+  
+  if (prompt == nullptr) {
+    DEBUG_ERROR("NULL prompt provided");
+    return error_result("NULL prompt provided");
+  }
+
+  OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
+
+  // Create model from config
+  DEBUG_LOG("Step 1: Creating model from config...");
   OgaModel *model = nullptr;
-  OgaResult *result = OgaCreateModel(model_path, &model);
-  if (check_oga_result(result, "Model creation failed") || model == nullptr) {
-    DEBUG_ERROR("Model creation failed");
-    return set_error(g_error_buffer);
+  OgaResult *result = OgaCreateModelFromConfig(config, &model);
+  if (check_oga_result(result, "Model creation from config failed") || model == nullptr) {
+    DEBUG_ERROR("Model creation from config failed");
+    return last_error_result();
   }
-  DEBUG_LOG("Step 1: Model created successfully");
+  DEBUG_LOG("Step 1: Model created successfully from config");
 
   // Create multimodal processor
   DEBUG_LOG("Step 2: Creating multimodal processor...");
@@ -772,7 +2633,7 @@ FFI_PLUGIN_EXPORT const char *run_inference_multi(const char *model_path,
       processor == nullptr) {
     DEBUG_ERROR("MultiModal processor creation failed");
     OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    return last_error_result();
   }
   DEBUG_LOG("Step 2: MultiModal processor created successfully");
 
@@ -785,67 +2646,46 @@ FFI_PLUGIN_EXPORT const char *run_inference_multi(const char *model_path,
     DEBUG_ERROR("Tokenizer creation failed");
     OgaDestroyMultiModalProcessor(processor);
     OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    return last_error_result();
   }
   DEBUG_LOG("Step 3: Tokenizer created successfully");
 
-  // Load images if provided
+  // Load image if provided
   OgaImages *images = nullptr;
   OgaNamedTensors *named_tensors = nullptr;
-  OgaStringArray *image_path_array = nullptr;
-
-  if (image_count > 0) {
-    // Create string array from image paths
-    DEBUG_LOG("Step 4: Creating string array from %d image paths...", image_count);
-    result = OgaCreateStringArrayFromStrings(image_paths,
-                                             static_cast<size_t>(image_count),
-                                             &image_path_array);
-    if (check_oga_result(result, "String array creation failed") ||
-        image_path_array == nullptr) {
-      DEBUG_ERROR("String array creation failed");
-      OgaDestroyTokenizer(tokenizer);
-      OgaDestroyMultiModalProcessor(processor);
-      OgaDestroyModel(model);
-      return set_error(g_error_buffer);
-    }
-    DEBUG_LOG("Step 4: String array created successfully");
 
-    // Load all images
-    DEBUG_LOG("Step 5: Loading %d images...", image_count);
-    result = OgaLoadImages(image_path_array, &images);
+  if (image_path != nullptr && strlen(image_path) > 0) {
+    DEBUG_LOG("Step 4: Loading image from: %s", image_path);
+    result = OgaLoadImage(image_path, &images);
     if (check_oga_result(result, "Image loading failed") || images == nullptr) {
       DEBUG_ERROR("Image loading failed");
-      OgaDestroyStringArray(image_path_array);
       OgaDestroyTokenizer(tokenizer);
       OgaDestroyMultiModalProcessor(processor);
       OgaDestroyModel(model);
-      return set_error(g_error_buffer);
+      return last_error_result();
     }
-    DEBUG_LOG("Step 5: Images loaded successfully");
+    DEBUG_LOG("Step 4: Image loaded successfully");
   } else {
-    DEBUG_LOG("Step 4-5: No images provided, will process text-only through multimodal processor");
+    DEBUG_LOG("Step 4: No image provided, will process text-only through multimodal processor");
   }
 
-  // Process through multimodal processor (required for vision models even for text-only)
-  DEBUG_LOG("Step 6: Processing prompt through multimodal processor (images=%p)...",
-            (void *)images);
+  // Process through multimodal processor
+  DEBUG_LOG("Step 5: Processing prompt through multimodal processor...");
   result = OgaProcessorProcessImages(processor, prompt, images, &named_tensors);
   if (check_oga_result(result, "Multimodal processing failed") ||
       named_tensors == nullptr) {
     DEBUG_ERROR("Multimodal processing failed");
     if (images)
       OgaDestroyImages(images);
-    if (image_path_array)
-      OgaDestroyStringArray(image_path_array);
     OgaDestroyTokenizer(tokenizer);
     OgaDestroyMultiModalProcessor(processor);
     OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    return last_error_result();
   }
-  DEBUG_LOG("Step 6: Multimodal processing completed successfully");
+  DEBUG_LOG("Step 5: Multimodal processing completed successfully");
 
   // Create generator parameters
-  DEBUG_LOG("Step 7: Creating generator params...");
+  DEBUG_LOG("Step 6: Creating generator params...");
   OgaGeneratorParams *params = nullptr;
   result = OgaCreateGeneratorParams(model, &params);
   if (check_oga_result(result, "Generator params creation failed") ||
@@ -855,116 +2695,63 @@ FFI_PLUGIN_EXPORT const char *run_inference_multi(const char *model_path,
       OgaDestroyNamedTensors(named_tensors);
     if (images)
       OgaDestroyImages(images);
-    if (image_path_array)
-      OgaDestroyStringArray(image_path_array);
     OgaDestroyTokenizer(tokenizer);
     OgaDestroyMultiModalProcessor(processor);
     OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    return last_error_result();
   }
   
-  // Set max_length to limit memory usage for KV-cache
-  // Use 2048 tokens - must be larger than input prompt size (~954 tokens)
-  DEBUG_LOG("Step 7a: Setting max_length to 2048 to limit memory...");
+  // Set max_length to limit memory usage
+  DEBUG_LOG("Step 6a: Setting max_length to 2048...");
   result = OgaGeneratorParamsSetSearchNumber(params, "max_length", 2048.0);
   if (result != nullptr) {
     DEBUG_ERROR("Failed to set max_length: %s", OgaResultGetError(result));
     OgaDestroyResult(result);
-    // Non-fatal, continue anyway
   } else {
-    DEBUG_LOG("Step 7a: max_length set successfully");
+    DEBUG_LOG("Step 6a: max_length set successfully");
   }
   
-  DEBUG_LOG("Step 7: Generator params created successfully");
+  DEBUG_LOG("Step 6: Generator params created successfully");
 
-  // Create generator - this is often where multimodal models crash
-  // due to memory allocation or model graph initialization issues
+  // Create generator
+  DEBUG_LOG("Step 7: Creating generator...");
   OgaGenerator *generator = nullptr;
-  DEBUG_LOG("Step 8: Creating generator...");
-  DEBUG_LOG("Step 8a: Generator pointer address: %p", (void *)&generator);
-  DEBUG_LOG("Step 8b: Model pointer: %p", (void *)model);
-  DEBUG_LOG("Step 8c: Params pointer: %p", (void *)params);
-  DEBUG_LOG("Step 8d: named_tensors: %p, images: %p, image_count: %d",
-            (void *)named_tensors, (void *)images, image_count);
-#ifdef __ANDROID__
-  // Force log flush before potentially crashing call
-  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
-                      "[DEBUG] Step 8e: About to call OgaCreateGenerator...");
-#else
-  fprintf(stderr, "[OnnxGenAI] Step 8e: About to call OgaCreateGenerator...\n");
-  fflush(stderr);
-#endif
-
   result = OgaCreateGenerator(model, params, &generator);
-
-#ifdef __ANDROID__
-  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
-                      "[DEBUG] Step 8f: OgaCreateGenerator returned, result=%p",
-                      (void *)result);
-#else
-  fprintf(stderr, "[OnnxGenAI] Step 8f: OgaCreateGenerator returned\n");
-  fflush(stderr);
-#endif
-
   if (check_oga_result(result, "Generator creation failed") ||
       generator == nullptr) {
-    DEBUG_ERROR("Generator creation failed - generator=%p", (void *)generator);
+    DEBUG_ERROR("Generator creation failed");
     OgaDestroyGeneratorParams(params);
     if (named_tensors)
       OgaDestroyNamedTensors(named_tensors);
     if (images)
       OgaDestroyImages(images);
-    if (image_path_array)
-      OgaDestroyStringArray(image_path_array);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyMultiModalProcessor(processor);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
-  }
-  DEBUG_LOG("Step 8g: Generator created successfully, generator=%p",
-            (void *)generator);
-
-  // Set input tensors from multimodal processor
-  DEBUG_LOG("Step 9: Setting input tensors...");
-  DEBUG_LOG("Step 9a: generator=%p, named_tensors=%p", (void *)generator, (void *)named_tensors);
-#ifdef __ANDROID__
-  // Force log flush before potentially crashing call
-  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
-                      "[DEBUG] Step 9b: About to call OgaGenerator_SetInputs...");
-#else
-  fprintf(stderr, "[OnnxGenAI] Step 9b: About to call OgaGenerator_SetInputs...\n");
-  fflush(stderr);
-#endif
-
-  result = OgaGenerator_SetInputs(generator, named_tensors);
-
-#ifdef __ANDROID__
-  __android_log_print(ANDROID_LOG_DEBUG, "OnnxGenAI",
-                      "[DEBUG] Step 9c: OgaGenerator_SetInputs returned, result=%p",
-                      (void *)result);
-#else
-  fprintf(stderr, "[OnnxGenAI] Step 9c: OgaGenerator_SetInputs returned\n");
-  fflush(stderr);
-#endif
+    OgaDestroyTokenizer(tokenizer);
+    OgaDestroyMultiModalProcessor(processor);
+    OgaDestroyModel(model);
+    return last_error_result();
+  }
+  DEBUG_LOG("Step 7: Generator created successfully");
 
+  // Set input tensors
+  DEBUG_LOG("Step 8: Setting input tensors...");
+  result = OgaGenerator_SetInputs(generator, named_tensors);
   if (check_oga_result(result, "Setting input tensors failed")) {
     DEBUG_ERROR("Setting input tensors failed");
     OgaDestroyGenerator(generator);
     OgaDestroyGeneratorParams(params);
-    OgaDestroyNamedTensors(named_tensors);
+    if (named_tensors)
+      OgaDestroyNamedTensors(named_tensors);
     if (images)
       OgaDestroyImages(images);
-    if (image_path_array)
-      OgaDestroyStringArray(image_path_array);
     OgaDestroyTokenizer(tokenizer);
     OgaDestroyMultiModalProcessor(processor);
     OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    return last_error_result();
   }
-  DEBUG_LOG("Step 9d: Input tensors set successfully");
+  DEBUG_LOG("Step 8: Input tensors set successfully");
 
-  // Create tokenizer stream for incremental decoding
-  DEBUG_LOG("Step 10: Creating tokenizer stream...");
+  // Create tokenizer stream
+  DEBUG_LOG("Step 9: Creating tokenizer stream...");
   OgaTokenizerStream *stream = nullptr;
   result = OgaCreateTokenizerStream(tokenizer, &stream);
   if (check_oga_result(result, "Tokenizer stream creation failed") ||
@@ -976,19 +2763,18 @@ FFI_PLUGIN_EXPORT const char *run_inference_multi(const char *model_path,
       OgaDestroyNamedTensors(named_tensors);
     if (images)
       OgaDestroyImages(images);
-    if (image_path_array)
-      OgaDestroyStringArray(image_path_array);
     OgaDestroyTokenizer(tokenizer);
     OgaDestroyMultiModalProcessor(processor);
     OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    return last_error_result();
   }
-  DEBUG_LOG("Step 10: Tokenizer stream created successfully");
+  DEBUG_LOG("Step 9: Tokenizer stream created successfully");
 
-  // Generate tokens
-  DEBUG_LOG("Step 11: Starting token generation loop...");
+  // Generation loop
+  DEBUG_LOG("Step 10: Starting token generation loop...");
   std::string generated_text;
   int generated_count = 0;
+
   while (!OgaGenerator_IsDone(generator)) {
     result = OgaGenerator_GenerateNextToken(generator);
     if (check_oga_result(result, "Generate next token failed")) {
@@ -996,7 +2782,6 @@ FFI_PLUGIN_EXPORT const char *run_inference_multi(const char *model_path,
       break;
     }
 
-    // Get the last generated tokens
     const int32_t *tokens = nullptr;
     size_t token_count = 0;
     result = OgaGenerator_GetNextTokens(generator, &tokens, &token_count);
@@ -1006,7 +2791,6 @@ FFI_PLUGIN_EXPORT const char *run_inference_multi(const char *model_path,
       break;
     }
 
-    // Decode first token to text (batch size = 1)
     const char *token_text = nullptr;
     result = OgaTokenizerStreamDecode(stream, tokens[0], &token_text);
     if (!check_oga_result(result, "Token decode failed") &&
@@ -1015,15 +2799,14 @@ FFI_PLUGIN_EXPORT const char *run_inference_multi(const char *model_path,
     }
     generated_count++;
     
-    // Log progress every 50 tokens
     if (generated_count % 50 == 0) {
       DEBUG_LOG("Generated %d tokens so far...", generated_count);
     }
   }
-  DEBUG_LOG("Step 11: Generation complete. Total tokens: %d", generated_count);
+  DEBUG_LOG("Step 10: Generation complete. Total tokens: %d", generated_count);
 
   // Cleanup
-  DEBUG_LOG("Step 12: Cleaning up resources...");
+  DEBUG_LOG("Step 11: Cleaning up resources...");
   OgaDestroyTokenizerStream(stream);
   OgaDestroyGenerator(generator);
   OgaDestroyGeneratorParams(params);
@@ -1031,194 +2814,41 @@ FFI_PLUGIN_EXPORT const char *run_inference_multi(const char *model_path,
     OgaDestroyNamedTensors(named_tensors);
   if (images)
     OgaDestroyImages(images);
-  if (image_path_array)
-    OgaDestroyStringArray(image_path_array);
   OgaDestroyTokenizer(tokenizer);
   OgaDestroyMultiModalProcessor(processor);
   OgaDestroyModel(model);
-  DEBUG_LOG("Step 12: Cleanup complete");
-  DEBUG_LOG("=== run_inference_multi END ===");
+  DEBUG_LOG("Step 11: Cleanup complete");
+  DEBUG_LOG("=== run_inference_with_config END ===");
 
   return set_result(generated_text);
 }
 
 /**
- * @brief Free any global resources held by the library.
- *
- * Call this when the application is shutting down or when the plugin
- * is being unloaded to ensure proper cleanup.
- */
-FFI_PLUGIN_EXPORT void shutdown_onnx_genai() {
-  std::lock_guard<std::mutex> lock(g_init_mutex);
-  if (g_initialized) {
-    OgaShutdown();
-    g_initialized = false;
-  }
-}
-
-/**
- * @brief Get the library version string.
- *
- * @return Version string in format "major.minor.patch"
- */
-FFI_PLUGIN_EXPORT const char *get_library_version() { return "0.3.0"; }
-
-// =============================================================================
-// Configuration API Implementation
-// =============================================================================
-
-/**
- * @brief Create a configuration object from a model path.
- */
-FFI_PLUGIN_EXPORT int64_t create_config(const char *model_path) {
-  init_debug_features();
-  DEBUG_LOG("=== create_config START ===");
-  DEBUG_LOG("model_path: %s", model_path ? model_path : "NULL");
-
-  if (model_path == nullptr || strlen(model_path) == 0) {
-    DEBUG_ERROR("NULL or empty model_path provided");
-    set_error("NULL or empty model_path provided");
-    return 0;
-  }
-
-  OgaConfig *config = nullptr;
-  OgaResult *result = OgaCreateConfig(model_path, &config);
-  
-  if (check_oga_result(result, "Config creation failed") || config == nullptr) {
-    DEBUG_ERROR("Config creation failed");
-    return 0;
-  }
-  
-  DEBUG_LOG("Config created successfully: %p", (void*)config);
-  DEBUG_LOG("=== create_config END ===");
-  
-  return reinterpret_cast<int64_t>(config);
-}
-
-/**
- * @brief Destroy a configuration object.
- */
-FFI_PLUGIN_EXPORT void destroy_config(int64_t config_handle) {
-  DEBUG_LOG("=== destroy_config ===");
-  if (config_handle == 0) {
-    DEBUG_ERROR("NULL config handle");
-    return;
-  }
-  
-  OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
-  OgaDestroyConfig(config);
-  DEBUG_LOG("Config destroyed");
-}
-
-/**
- * @brief Clear all execution providers from the config.
- */
-FFI_PLUGIN_EXPORT int32_t config_clear_providers(int64_t config_handle) {
-  DEBUG_LOG("=== config_clear_providers ===");
-  if (config_handle == 0) {
-    DEBUG_ERROR("NULL config handle");
-    set_error("NULL config handle");
-    return -1;
-  }
-  
-  OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
-  OgaResult *result = OgaConfigClearProviders(config);
-  
-  if (check_oga_result(result, "Clear providers failed")) {
-    return -2;
-  }
-  
-  DEBUG_LOG("Providers cleared successfully");
-  return 1;
-}
-
-/**
- * @brief Append an execution provider to the config.
- */
-FFI_PLUGIN_EXPORT int32_t config_append_provider(int64_t config_handle,
-                                                  const char *provider_name) {
-  DEBUG_LOG("=== config_append_provider ===");
-  DEBUG_LOG("provider_name: %s", provider_name ? provider_name : "NULL");
-  
-  if (config_handle == 0) {
-    DEBUG_ERROR("NULL config handle");
-    set_error("NULL config handle");
-    return -1;
-  }
-  
-  if (provider_name == nullptr || strlen(provider_name) == 0) {
-    DEBUG_ERROR("NULL or empty provider name");
-    set_error("NULL or empty provider name");
-    return -2;
-  }
-  
-  OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
-  OgaResult *result = OgaConfigAppendProvider(config, provider_name);
-  
-  if (check_oga_result(result, "Append provider failed")) {
-    return -3;
-  }
-  
-  DEBUG_LOG("Provider '%s' appended successfully", provider_name);
-  return 1;
-}
-
-/**
- * @brief Set an option for a specific execution provider.
- */
-FFI_PLUGIN_EXPORT int32_t config_set_provider_option(int64_t config_handle,
-                                                      const char *provider_name,
-                                                      const char *key,
-                                                      const char *value) {
-  DEBUG_LOG("=== config_set_provider_option ===");
-  DEBUG_LOG("provider: %s, key: %s, value: %s",
-            provider_name ? provider_name : "NULL",
-            key ? key : "NULL",
-            value ? value : "NULL");
-  
-  if (config_handle == 0) {
-    DEBUG_ERROR("NULL config handle");
-    set_error("NULL config handle");
-    return -1;
-  }
-  
-  if (provider_name == nullptr || key == nullptr || value == nullptr) {
-    DEBUG_ERROR("NULL parameter");
-    set_error("NULL parameter");
-    return -2;
-  }
-  
-  OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
-  OgaResult *result = OgaConfigSetProviderOption(config, provider_name, key, value);
-  
-  if (check_oga_result(result, "Set provider option failed")) {
-    return -3;
-  }
-  
-  DEBUG_LOG("Option set successfully");
-  return 1;
-}
-
-/**
- * @brief Run inference using a pre-configured config.
+ * @brief Run multi-image inference using a pre-configured config.
  */
-FFI_PLUGIN_EXPORT const char *run_inference_with_config(int64_t config_handle,
+FFI_PLUGIN_EXPORT char *run_inference_multi_with_config(int64_t config_handle,
                                                          const char *prompt,
-                                                         const char *image_path) {
+                                                         const char **image_paths,
+                                                         int32_t image_count) {
   init_debug_features();
-  DEBUG_LOG("=== run_inference_with_config START ===");
+  DEBUG_LOG("=== run_inference_multi_with_config START ===");
   DEBUG_LOG("config_handle: %lld", (long long)config_handle);
   DEBUG_LOG("prompt length: %zu", prompt ? strlen(prompt) : 0);
-  DEBUG_LOG("image_path: %s", image_path ? image_path : "NULL");
+  DEBUG_LOG("image_count: %d", image_count);
 
   if (config_handle == 0) {
     DEBUG_ERROR("NULL config handle");
-    return set_error("NULL config handle");
+    return error_result("NULL config handle");
   }
   
   if (prompt == nullptr) {
     DEBUG_ERROR("NULL prompt provided");
-    return set_error("NULL prompt provided");
+    return error_result("NULL prompt provided");
+  }
+
+  if (image_count > 0 && image_paths == nullptr) {
+    DEBUG_ERROR("NULL image_paths with image_count > 0");
+    return error_result("NULL image_paths with image_count > 0");
   }
 
   OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
@@ -1229,7 +2859,7 @@ FFI_PLUGIN_EXPORT const char *run_inference_with_config(int64_t config_handle,
   OgaResult *result = OgaCreateModelFromConfig(config, &model);
   if (check_oga_result(result, "Model creation from config failed") || model == nullptr) {
     DEBUG_ERROR("Model creation from config failed");
-    return set_error(g_error_buffer);
+    return last_error_result();
   }
   DEBUG_LOG("Step 1: Model created successfully from config");
 
@@ -1241,11 +2871,11 @@ FFI_PLUGIN_EXPORT const char *run_inference_with_config(int64_t config_handle,
       processor == nullptr) {
     DEBUG_ERROR("MultiModal processor creation failed");
     OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    return last_error_result();
   }
   DEBUG_LOG("Step 2: MultiModal processor created successfully");
 
-  // Create tokenizer from model
+  // Create tokenizer
   DEBUG_LOG("Step 3: Creating tokenizer...");
   OgaTokenizer *tokenizer = nullptr;
   result = OgaCreateTokenizer(model, &tokenizer);
@@ -1254,72 +2884,101 @@ FFI_PLUGIN_EXPORT const char *run_inference_with_config(int64_t config_handle,
     DEBUG_ERROR("Tokenizer creation failed");
     OgaDestroyMultiModalProcessor(processor);
     OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    return last_error_result();
   }
   DEBUG_LOG("Step 3: Tokenizer created successfully");
 
-  // Load image if provided
+  // Load images if provided
   OgaImages *images = nullptr;
-  OgaNamedTensors *named_tensors = nullptr;
+  OgaStringArray *image_path_array = nullptr;
+  
+  if (image_count > 0) {
+    DEBUG_LOG("Step 4: Loading %d images...", image_count);
+    
+    // Create string array for image paths
+    result = OgaCreateStringArray(&image_path_array);
+    if (check_oga_result(result, "String array creation failed") ||
+        image_path_array == nullptr) {
+      DEBUG_ERROR("String array creation failed");
+      OgaDestroyTokenizer(tokenizer);
+      OgaDestroyMultiModalProcessor(processor);
+      OgaDestroyModel(model);
+      return last_error_result();
+    }
 
-  if (image_path != nullptr && strlen(image_path) > 0) {
-    DEBUG_LOG("Step 4: Loading image from: %s", image_path);
-    result = OgaLoadImage(image_path, &images);
+    // Add each image path to the array
+    for (int i = 0; i < image_count; i++) {
+      DEBUG_LOG("  Adding image %d: %s", i + 1, image_paths[i] ? image_paths[i] : "NULL");
+      if (image_paths[i] == nullptr) {
+        DEBUG_ERROR("NULL image path at index %d", i);
+        OgaDestroyStringArray(image_path_array);
+        OgaDestroyTokenizer(tokenizer);
+        OgaDestroyMultiModalProcessor(processor);
+        OgaDestroyModel(model);
+        return error_result("NULL image path in array");
+      }
+      result = OgaStringArrayAddString(image_path_array, image_paths[i]);
+      if (check_oga_result(result, "Add image path failed")) {
+        DEBUG_ERROR("Failed to add image path at index %d", i);
+        OgaDestroyStringArray(image_path_array);
+        OgaDestroyTokenizer(tokenizer);
+        OgaDestroyMultiModalProcessor(processor);
+        OgaDestroyModel(model);
+        return last_error_result();
+      }
+    }
+
+    // Load all images
+    result = OgaLoadImages(image_path_array, &images);
     if (check_oga_result(result, "Image loading failed") || images == nullptr) {
-      DEBUG_ERROR("Image loading failed");
+      DEBUG_ERROR("Failed to load images");
+      OgaDestroyStringArray(image_path_array);
       OgaDestroyTokenizer(tokenizer);
       OgaDestroyMultiModalProcessor(processor);
       OgaDestroyModel(model);
-      return set_error(g_error_buffer);
+      return last_error_result();
     }
-    DEBUG_LOG("Step 4: Image loaded successfully");
+    DEBUG_LOG("Step 4: All images loaded successfully");
   } else {
-    DEBUG_LOG("Step 4: No image provided, will process text-only through multimodal processor");
+    DEBUG_LOG("Step 4: No images - text-only inference");
   }
 
-  // Process through multimodal processor
-  DEBUG_LOG("Step 5: Processing prompt through multimodal processor...");
+  // Process prompt and images
+  DEBUG_LOG("Step 5: Processing prompt and images...");
+  OgaNamedTensors *named_tensors = nullptr;
   result = OgaProcessorProcessImages(processor, prompt, images, &named_tensors);
-  if (check_oga_result(result, "Multimodal processing failed") ||
+  if (check_oga_result(result, "Processing failed") ||
       named_tensors == nullptr) {
-    DEBUG_ERROR("Multimodal processing failed");
+    DEBUG_ERROR("Processing failed");
     if (images)
       OgaDestroyImages(images);
+    if (image_path_array)
+      OgaDestroyStringArray(image_path_array);
     OgaDestroyTokenizer(tokenizer);
     OgaDestroyMultiModalProcessor(processor);
     OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    return last_error_result();
   }
-  DEBUG_LOG("Step 5: Multimodal processing completed successfully");
+  DEBUG_LOG("Step 5: Processing complete");
 
-  // Create generator parameters
+  // Create generator params
   DEBUG_LOG("Step 6: Creating generator params...");
   OgaGeneratorParams *params = nullptr;
   result = OgaCreateGeneratorParams(model, &params);
   if (check_oga_result(result, "Generator params creation failed") ||
       params == nullptr) {
     DEBUG_ERROR("Generator params creation failed");
-    if (named_tensors)
-      OgaDestroyNamedTensors(named_tensors);
+    OgaDestroyNamedTensors(named_tensors);
     if (images)
       OgaDestroyImages(images);
+    if (image_path_array)
+      OgaDestroyStringArray(image_path_array);
     OgaDestroyTokenizer(tokenizer);
     OgaDestroyMultiModalProcessor(processor);
     OgaDestroyModel(model);
-    return set_error(g_error_buffer);
-  }
-  
-  // Set max_length to limit memory usage
-  DEBUG_LOG("Step 6a: Setting max_length to 2048...");
-  result = OgaGeneratorParamsSetSearchNumber(params, "max_length", 2048.0);
-  if (result != nullptr) {
-    DEBUG_ERROR("Failed to set max_length: %s", OgaResultGetError(result));
-    OgaDestroyResult(result);
-  } else {
-    DEBUG_LOG("Step 6a: max_length set successfully");
+    return last_error_result();
   }
-  
-  DEBUG_LOG("Step 6: Generator params created successfully");
+  DEBUG_LOG("Step 6: Generator params created");
 
   // Create generator
   DEBUG_LOG("Step 7: Creating generator...");
@@ -1329,16 +2988,17 @@ FFI_PLUGIN_EXPORT const char *run_inference_with_config(int64_t config_handle,
       generator == nullptr) {
     DEBUG_ERROR("Generator creation failed");
     OgaDestroyGeneratorParams(params);
-    if (named_tensors)
-      OgaDestroyNamedTensors(named_tensors);
+    OgaDestroyNamedTensors(named_tensors);
     if (images)
       OgaDestroyImages(images);
+    if (image_path_array)
+      OgaDestroyStringArray(image_path_array);
     OgaDestroyTokenizer(tokenizer);
     OgaDestroyMultiModalProcessor(processor);
     OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    return last_error_result();
   }
-  DEBUG_LOG("Step 7: Generator created successfully");
+  DEBUG_LOG("Step 7: Generator created");
 
   // Set input tensors
   DEBUG_LOG("Step 8: Setting input tensors...");
@@ -1347,16 +3007,17 @@ FFI_PLUGIN_EXPORT const char *run_inference_with_config(int64_t config_handle,
     DEBUG_ERROR("Setting input tensors failed");
     OgaDestroyGenerator(generator);
     OgaDestroyGeneratorParams(params);
-    if (named_tensors)
-      OgaDestroyNamedTensors(named_tensors);
+    OgaDestroyNamedTensors(named_tensors);
     if (images)
       OgaDestroyImages(images);
+    if (image_path_array)
+      OgaDestroyStringArray(image_path_array);
     OgaDestroyTokenizer(tokenizer);
     OgaDestroyMultiModalProcessor(processor);
     OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    return last_error_result();
   }
-  DEBUG_LOG("Step 8: Input tensors set successfully");
+  DEBUG_LOG("Step 8: Input tensors set");
 
   // Create tokenizer stream
   DEBUG_LOG("Step 9: Creating tokenizer stream...");
@@ -1367,16 +3028,17 @@ FFI_PLUGIN_EXPORT const char *run_inference_with_config(int64_t config_handle,
     DEBUG_ERROR("Tokenizer stream creation failed");
     OgaDestroyGenerator(generator);
     OgaDestroyGeneratorParams(params);
-    if (named_tensors)
-      OgaDestroyNamedTensors(named_tensors);
+    OgaDestroyNamedTensors(named_tensors);
     if (images)
       OgaDestroyImages(images);
+    if (image_path_array)
+      OgaDestroyStringArray(image_path_array);
     OgaDestroyTokenizer(tokenizer);
     OgaDestroyMultiModalProcessor(processor);
     OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+    return last_error_result();
   }
-  DEBUG_LOG("Step 9: Tokenizer stream created successfully");
+  DEBUG_LOG("Step 9: Tokenizer stream created");
 
   // Generation loop
   DEBUG_LOG("Step 10: Starting token generation loop...");
@@ -1418,290 +3080,719 @@ FFI_PLUGIN_EXPORT const char *run_inference_with_config(int64_t config_handle,
   OgaDestroyTokenizerStream(stream);
   OgaDestroyGenerator(generator);
   OgaDestroyGeneratorParams(params);
-  if (named_tensors)
-    OgaDestroyNamedTensors(named_tensors);
+  OgaDestroyNamedTensors(named_tensors);
   if (images)
     OgaDestroyImages(images);
+  if (image_path_array)
+    OgaDestroyStringArray(image_path_array);
   OgaDestroyTokenizer(tokenizer);
   OgaDestroyMultiModalProcessor(processor);
   OgaDestroyModel(model);
   DEBUG_LOG("Step 11: Cleanup complete");
-  DEBUG_LOG("=== run_inference_with_config END ===");
+  DEBUG_LOG("=== run_inference_multi_with_config END ===");
 
   return set_result(generated_text);
 }
 
+// =============================================================================
+// Model Handle API Implementation
+// =============================================================================
+
+/**
+ * @brief Load (or reuse) the model described by a config.
+ */
+FFI_PLUGIN_EXPORT int64_t load_model(int64_t config_handle) {
+  init_debug_features();
+  DEBUG_LOG("=== load_model START ===");
+  DEBUG_LOG("config_handle: %lld", (long long)config_handle);
+
+  if (config_handle == 0) {
+    DEBUG_ERROR("NULL config handle");
+    set_error("NULL config handle");
+    return 0;
+  }
+
+  std::string key;
+  {
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    auto config_it = g_config_keys.find(config_handle);
+    if (config_it == g_config_keys.end()) {
+      DEBUG_ERROR("Unknown config handle");
+      set_error("Unknown config handle");
+      return 0;
+    }
+    key = config_it->second;
+
+    auto model_it = g_model_registry.find(key);
+    if (model_it != g_model_registry.end()) {
+      model_it->second->ref_count++;
+      model_it->second->handle_refs++;
+      DEBUG_LOG("Reusing loaded model '%s' (refs=%d)", key.c_str(),
+                model_it->second->ref_count);
+      return reinterpret_cast<int64_t>(model_it->second);
+    }
+  }
+
+  // Load outside the lock: this takes seconds for large models
+  DEBUG_LOG("Step 1: Creating model from config...");
+  OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
+  auto *entry = new LoadedModel();
+  entry->key = key;
+  OgaResult *result = OgaCreateModelFromConfig(config, &entry->model);
+  if (check_oga_result(result, "Model creation from config failed") ||
+      entry->model == nullptr) {
+    DEBUG_ERROR("Model creation from config failed");
+    destroy_loaded_model(entry);
+    return 0;
+  }
+
+  DEBUG_LOG("Step 2: Creating tokenizer...");
+  result = OgaCreateTokenizer(entry->model, &entry->tokenizer);
+  if (check_oga_result(result, "Tokenizer creation failed") ||
+      entry->tokenizer == nullptr) {
+    DEBUG_ERROR("Tokenizer creation failed");
+    destroy_loaded_model(entry);
+    return 0;
+  }
+
+  // Text-only models have no processor; prompts are then tokenized directly
+  DEBUG_LOG("Step 3: Creating multimodal processor...");
+  result = OgaCreateMultiModalProcessor(entry->model, &entry->processor);
+  if (result != nullptr) {
+    DEBUG_LOG("Step 3: No multimodal processor (%s), using tokenizer only",
+              OgaResultGetError(result));
+    OgaDestroyResult(result);
+    entry->processor = nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(g_registry_mutex);
+  auto model_it = g_model_registry.find(key);
+  if (model_it != g_model_registry.end()) {
+    // Another thread loaded the same config meanwhile; keep its instance
+    destroy_loaded_model(entry);
+    entry = model_it->second;
+  } else {
+    g_model_registry[key] = entry;
+  }
+  entry->ref_count++;
+  entry->handle_refs++;
+  DEBUG_LOG("=== load_model END (refs=%d) ===", entry->ref_count);
+  return reinterpret_cast<int64_t>(entry);
+}
+
+/**
+ * @brief Release a model handle returned by load_model.
+ */
+FFI_PLUGIN_EXPORT int32_t unload_model(int64_t model_handle) {
+  DEBUG_LOG("=== unload_model ===");
+  LoadedModel *entry = acquire_model(model_handle);
+  if (entry == nullptr) {
+    DEBUG_ERROR("Invalid model handle: %lld", (long long)model_handle);
+    set_error("Invalid model handle");
+    return -1;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    entry->handle_refs--;
+  }
+  release_model(entry); // reference taken above
+  release_model(entry); // reference owned by load_model
+  return 1;
+}
+
+/**
+ * @brief Set the prefix KV cache budget used by later requests on a model.
+ */
+FFI_PLUGIN_EXPORT int32_t set_prefix_cache_size(int64_t model_handle,
+                                                int64_t max_bytes) {
+  DEBUG_LOG("=== set_prefix_cache_size ===");
+  if (max_bytes < 0) {
+    set_error("Prefix cache size must not be negative");
+    return -2;
+  }
+
+  LoadedModel *entry = acquire_model(model_handle);
+  if (entry == nullptr) {
+    DEBUG_ERROR("Invalid model handle: %lld", (long long)model_handle);
+    set_error("Invalid model handle");
+    return -1;
+  }
+
+  entry->prefix_cache_bytes = max_bytes;
+  DEBUG_LOG("Prefix cache size of '%s' set to %lld bytes", entry->key.c_str(),
+            (long long)max_bytes);
+  release_model(entry);
+  return 1;
+}
+
+/**
+ * @brief Set the prompt lookup decoding used by later requests on a model.
+ */
+FFI_PLUGIN_EXPORT int32_t set_prompt_lookup(int64_t model_handle,
+                                            int32_t ngram_size,
+                                            int32_t num_speculative_tokens) {
+  DEBUG_LOG("=== set_prompt_lookup ===");
+  if (ngram_size < 0 || num_speculative_tokens < 0) {
+    set_error("Prompt lookup settings must not be negative");
+    return -2;
+  }
+
+  LoadedModel *entry = acquire_model(model_handle);
+  if (entry == nullptr) {
+    DEBUG_ERROR("Invalid model handle: %lld", (long long)model_handle);
+    set_error("Invalid model handle");
+    return -1;
+  }
+
+  entry->prompt_lookup_ngram_size = ngram_size;
+  entry->num_speculative_tokens = num_speculative_tokens;
+  DEBUG_LOG("Prompt lookup of '%s' set to %d-grams, %d tokens",
+            entry->key.c_str(), ngram_size, num_speculative_tokens);
+  release_model(entry);
+  return 1;
+}
+
+/**
+ * @brief Set the image features cache budget used by later requests on a model.
+ */
+FFI_PLUGIN_EXPORT int32_t set_image_cache_size(int64_t model_handle,
+                                               int64_t max_bytes) {
+  DEBUG_LOG("=== set_image_cache_size ===");
+  if (max_bytes < 0) {
+    set_error("Image cache size must not be negative");
+    return -2;
+  }
+
+  LoadedModel *entry = acquire_model(model_handle);
+  if (entry == nullptr) {
+    DEBUG_ERROR("Invalid model handle: %lld", (long long)model_handle);
+    set_error("Invalid model handle");
+    return -1;
+  }
+
+  entry->image_features_cache_bytes = max_bytes;
+  DEBUG_LOG("Image cache size of '%s' set to %lld bytes", entry->key.c_str(),
+            (long long)max_bytes);
+  release_model(entry);
+  return 1;
+}
+
+/**
+ * @brief Release the encoders of a model that no request is using.
+ */
+FFI_PLUGIN_EXPORT int32_t release_idle_sessions(int64_t model_handle) {
+  DEBUG_LOG("=== release_idle_sessions ===");
+  LoadedModel *entry = acquire_model(model_handle);
+  if (entry == nullptr) {
+    DEBUG_ERROR("Invalid model handle: %lld", (long long)model_handle);
+    set_error("Invalid model handle");
+    return -1;
+  }
+
+  size_t released = 0;
+  OgaResult *result = OgaModelReleaseIdleSessions(entry->model, &released);
+  release_model(entry);
+  if (check_oga_result(result, "Releasing idle sessions failed")) {
+    return -2;
+  }
+  DEBUG_LOG("Released %zu idle sessions", released);
+  return static_cast<int32_t>(released);
+}
+
+/**
+ * @brief Run inference on a loaded model with an optional image.
+ */
+FFI_PLUGIN_EXPORT char *run_inference_with_model(int64_t model_handle,
+                                                  const char *prompt,
+                                                  const char *image_path,
+                                                  int32_t max_length) {
+  init_debug_features();
+  DEBUG_LOG("=== run_inference_with_model ===");
+  bool has_image = image_path != nullptr && strlen(image_path) > 0;
+  return run_with_model(model_handle, prompt, has_image ? &image_path : nullptr,
+                        has_image ? 1 : 0, max_length);
+}
+
+/**
+ * @brief Run inference on a loaded model with multiple images.
+ */
+FFI_PLUGIN_EXPORT char *run_inference_multi_with_model(int64_t model_handle,
+                                                        const char *prompt,
+                                                        const char **image_paths,
+                                                        int32_t image_count,
+                                                        int32_t max_length) {
+  init_debug_features();
+  DEBUG_LOG("=== run_inference_multi_with_model (images=%d) ===", image_count);
+  return run_with_model(model_handle, prompt, image_paths, image_count, max_length);
+}
+
+/**
+ * @brief Run inference on a loaded model with encoded images in memory.
+ */
+FFI_PLUGIN_EXPORT char *run_inference_with_image_buffers(
+    int64_t model_handle, const char *prompt, const uint8_t **image_data,
+    const int64_t *image_sizes, int32_t image_count, int32_t max_length) {
+  init_debug_features();
+  DEBUG_LOG("=== run_inference_with_image_buffers (images=%d) ===", image_count);
+
+  if (image_count <= 0 || image_data == nullptr || image_sizes == nullptr) {
+    DEBUG_ERROR("No image buffers provided");
+    return error_result("No image buffers provided");
+  }
+
+  ImageBuffers buffers;
+  for (int32_t i = 0; i < image_count; i++) {
+    if (image_data[i] == nullptr || image_sizes[i] <= 0) {
+      DEBUG_ERROR("Image buffer %d is empty", i);
+      return error_result("Image buffer " + std::to_string(i) + " is empty");
+    }
+    buffers.data.push_back(image_data[i]);
+    buffers.sizes.push_back(static_cast<size_t>(image_sizes[i]));
+  }
+  return run_with_model(model_handle, prompt, nullptr, 0, max_length, &buffers);
+}
+
+/**
+ * @brief Run inference on a loaded model with one image of raw RGBA pixels.
+ */
+FFI_PLUGIN_EXPORT char *run_inference_with_rgba(int64_t model_handle,
+                                                const char *prompt,
+                                                const uint8_t *pixels,
+                                                int32_t width, int32_t height,
+                                                int32_t stride,
+                                                int32_t max_length) {
+  init_debug_features();
+  DEBUG_LOG("=== run_inference_with_rgba (%dx%d, stride %d) ===", width, height,
+            stride);
+
+  if (stride == 0)
+    stride = width * 4;
+  if (pixels == nullptr || width <= 0 || height <= 0 || stride < width * 4) {
+    DEBUG_ERROR("Invalid RGBA image");
+    return error_result("Invalid RGBA image: pixels must not be NULL, width "
+                        "and height must be positive and stride at least "
+                        "width * 4");
+  }
+
+  const std::vector<uint8_t> png =
+      encode_rgba_as_png(pixels, width, height, stride);
+  ImageBuffers buffers;
+  buffers.data.push_back(png.data());
+  buffers.sizes.push_back(png.size());
+  return run_with_model(model_handle, prompt, nullptr, 0, max_length, &buffers);
+}
+
+/**
+ * @brief Run text-only inference on a loaded model.
+ */
+FFI_PLUGIN_EXPORT char *run_text_inference_with_model(int64_t model_handle,
+                                                       const char *prompt,
+                                                       int32_t max_length) {
+  init_debug_features();
+  DEBUG_LOG("=== run_text_inference_with_model ===");
+  return run_with_model(model_handle, prompt, nullptr, 0, max_length);
+}
+
+// =============================================================================
+// Streaming API Implementation
+// =============================================================================
+
+/**
+ * @brief Initialize the Dart native API used to post to SendPorts.
+ */
+FFI_PLUGIN_EXPORT intptr_t init_dart_api_dl(void *data) {
+  const DartApi *dart_api = static_cast<const DartApi *>(data);
+  if (dart_api == nullptr || dart_api->major != DART_API_DL_MAJOR_VERSION) {
+    DEBUG_ERROR("Incompatible Dart API DL version");
+    set_error("Incompatible Dart API DL version");
+    return -1;
+  }
+
+  for (const DartApiEntry *it = dart_api->functions; it->name != nullptr; it++) {
+    if (strcmp(it->name, "Dart_PostCObject") == 0) {
+      g_post_cobject.store(reinterpret_cast<Dart_PostCObject_Type>(it->function));
+      return 0;
+    }
+  }
+
+  DEBUG_ERROR("Dart_PostCObject not found in Dart API DL");
+  set_error("Dart_PostCObject not found in Dart API DL");
+  return -1;
+}
+
+/**
+ * @brief Start a generation on the pool that streams text to a SendPort.
+ */
+FFI_PLUGIN_EXPORT int64_t stream_inference_with_model(int64_t model_handle,
+                                                       const char *prompt,
+                                                       const char **image_paths,
+                                                       int32_t image_count,
+                                                       int32_t max_length,
+                                                       int64_t send_port) {
+  init_debug_features();
+  DEBUG_LOG("=== stream_inference_with_model (images=%d) ===", image_count);
+
+  if (g_post_cobject.load() == nullptr) {
+    DEBUG_ERROR("Dart API DL not initialized");
+    set_error("Dart API DL not initialized, call init_dart_api_dl first");
+    return -1;
+  }
+
+  if (send_port == ILLEGAL_PORT) {
+    DEBUG_ERROR("NULL send port provided");
+    set_error("NULL send port provided");
+    return -2;
+  }
+
+  return submit_generation(model_handle, prompt, image_paths, image_count,
+                           max_length, send_port);
+}
+
+// =============================================================================
+// Background Generation API Implementation
+// =============================================================================
+
+/**
+ * @brief Queue a generation on the native worker pool.
+ */
+FFI_PLUGIN_EXPORT int64_t start_generation(int64_t model_handle,
+                                           const char *prompt,
+                                           const char **image_paths,
+                                           int32_t image_count,
+                                           int32_t max_length) {
+  init_debug_features();
+  DEBUG_LOG("=== start_generation (images=%d) ===", image_count);
+  return submit_generation(model_handle, prompt, image_paths, image_count,
+                           max_length, ILLEGAL_PORT);
+}
+
+/**
+ * @brief Cancel a queued or running generation.
+ */
+FFI_PLUGIN_EXPORT int32_t cancel_generation(int64_t request_id) {
+  DEBUG_LOG("=== cancel_generation %lld ===", (long long)request_id);
+  std::shared_ptr<GenerationJob> job;
+  {
+    std::lock_guard<std::mutex> lock(g_jobs_mutex);
+    auto it = g_jobs.find(request_id);
+    if (it != g_jobs.end()) {
+      job = it->second;
+    }
+  }
+  if (!job) {
+    set_error("Unknown generation request");
+    return -1;
+  }
+
+  std::lock_guard<std::mutex> lock(job->mutex);
+  job->cancelled = true;
+  if (job->generator != nullptr) {
+    // Makes the OrtSession::Run in flight (the prefill or a decode step)
+    // fail, which run_generation_job reports as cancelled. The generator
+    // is published before the prefill starts.
+    OgaResult *result =
+        OgaGenerator_SetRuntimeOption(job->generator, "terminate_session", "1");
+    if (check_oga_result(result, "Terminate session failed")) {
+      DEBUG_ERROR("%s", g_error_buffer.c_str());
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Get the status and text of a generation started with start_generation.
+ */
+FFI_PLUGIN_EXPORT char *poll_generation(int64_t request_id,
+                                        int32_t *out_status) {
+  std::shared_ptr<GenerationJob> job;
+  {
+    std::lock_guard<std::mutex> lock(g_jobs_mutex);
+    auto it = g_jobs.find(request_id);
+    if (it != g_jobs.end() && it->second->send_port == ILLEGAL_PORT) {
+      job = it->second;
+    }
+  }
+  if (!job) {
+    if (out_status)
+      *out_status = kGenerationUnknown;
+    return error_result("Unknown generation request");
+  }
+
+  int32_t status;
+  std::string text;
+  {
+    std::lock_guard<std::mutex> lock(job->mutex);
+    status = job->status;
+    text = status == kGenerationFailed ? job->error : job->text;
+  }
+
+  if (status != kGenerationQueued && status != kGenerationRunning) {
+    std::lock_guard<std::mutex> lock(g_jobs_mutex);
+    g_jobs.erase(request_id);
+  }
+
+  if (out_status)
+    *out_status = status;
+  if (status == kGenerationFailed) {
+    g_error_buffer = text; // set_error ran on the worker thread
+  }
+  return set_result(text);
+}
+
+// =============================================================================
+// Chat Session API Implementation
+// =============================================================================
+
+/**
+ * @brief Open a chat on a loaded model.
+ */
+FFI_PLUGIN_EXPORT int64_t chat_open(int64_t model_handle, int32_t max_length,
+                                    int32_t attention_sink_size) {
+  init_debug_features();
+  DEBUG_LOG("=== chat_open ===");
+  auto chat = std::make_shared<ChatSession>();
+  chat->entry = acquire_model(model_handle);
+  if (chat->entry == nullptr) {
+    DEBUG_ERROR("Invalid model handle: %lld", (long long)model_handle);
+    set_error("Invalid model handle");
+    return -1;
+  }
+
+  chat->request = std::make_unique<GenerationRequest>();
+  chat->attention_sink_size =
+      static_cast<size_t>(std::max<int32_t>(attention_sink_size, 0));
+  if (!create_generator(chat->entry, max_length, attention_sink_size,
+                        *chat->request)) {
+    DEBUG_ERROR("Chat setup failed: %s", g_error_buffer.c_str());
+    return -2;
+  }
+
+  const int64_t chat_id = g_next_chat_id.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> lock(g_chats_mutex);
+    g_chats[chat_id] = std::move(chat);
+  }
+  DEBUG_LOG("Opened chat %lld", (long long)chat_id);
+  return chat_id;
+}
+
 /**
- * @brief Run multi-image inference using a pre-configured config.
+ * @brief Append a message to a chat and generate the reply.
  */
-FFI_PLUGIN_EXPORT const char *run_inference_multi_with_config(int64_t config_handle,
-                                                               const char *prompt,
-                                                               const char **image_paths,
-                                                               int32_t image_count) {
-  init_debug_features();
-  DEBUG_LOG("=== run_inference_multi_with_config START ===");
-  DEBUG_LOG("config_handle: %lld", (long long)config_handle);
-  DEBUG_LOG("prompt length: %zu", prompt ? strlen(prompt) : 0);
-  DEBUG_LOG("image_count: %d", image_count);
-
-  if (config_handle == 0) {
-    DEBUG_ERROR("NULL config handle");
-    return set_error("NULL config handle");
-  }
-  
-  if (prompt == nullptr) {
-    DEBUG_ERROR("NULL prompt provided");
-    return set_error("NULL prompt provided");
+FFI_PLUGIN_EXPORT char *chat_send(int64_t chat_id, const char *message,
+                                  int32_t max_new_tokens) {
+  DEBUG_LOG("=== chat_send %lld ===", (long long)chat_id);
+  if (message == nullptr) {
+    DEBUG_ERROR("NULL message provided");
+    return error_result("NULL message provided");
   }
 
-  if (image_count > 0 && image_paths == nullptr) {
-    DEBUG_ERROR("NULL image_paths with image_count > 0");
-    return set_error("NULL image_paths with image_count > 0");
+  std::shared_ptr<ChatSession> chat = find_chat(chat_id);
+  if (!chat) {
+    return error_result("Unknown chat session");
   }
 
-  OgaConfig *config = reinterpret_cast<OgaConfig*>(config_handle);
-
-  // Create model from config
-  DEBUG_LOG("Step 1: Creating model from config...");
-  OgaModel *model = nullptr;
-  OgaResult *result = OgaCreateModelFromConfig(config, &model);
-  if (check_oga_result(result, "Model creation from config failed") || model == nullptr) {
-    DEBUG_ERROR("Model creation from config failed");
-    return set_error(g_error_buffer);
+  std::lock_guard<std::mutex> lock(chat->mutex);
+  GenerationRequest &request = *chat->request;
+  const size_t turn_length = chat_position(*chat);
+  if (turn_length == SIZE_MAX) {
+    return last_error_result();
   }
-  DEBUG_LOG("Step 1: Model created successfully from config");
 
-  // Create multimodal processor
-  DEBUG_LOG("Step 2: Creating multimodal processor...");
-  OgaMultiModalProcessor *processor = nullptr;
-  result = OgaCreateMultiModalProcessor(model, &processor);
-  if (check_oga_result(result, "MultiModal processor creation failed") ||
-      processor == nullptr) {
-    DEBUG_ERROR("MultiModal processor creation failed");
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+  std::vector<int32_t> tokens;
+  if (!encode_chat_message(*chat, message, turn_length, tokens)) {
+    return last_error_result();
   }
-  DEBUG_LOG("Step 2: MultiModal processor created successfully");
 
-  // Create tokenizer
-  DEBUG_LOG("Step 3: Creating tokenizer...");
-  OgaTokenizer *tokenizer = nullptr;
-  result = OgaCreateTokenizer(model, &tokenizer);
-  if (check_oga_result(result, "Tokenizer creation failed") ||
-      tokenizer == nullptr) {
-    DEBUG_ERROR("Tokenizer creation failed");
-    OgaDestroyMultiModalProcessor(processor);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+  if (request.stream) {
+    OgaDestroyTokenizerStream(request.stream);
+    request.stream = nullptr;
   }
-  DEBUG_LOG("Step 3: Tokenizer created successfully");
-
-  // Load images if provided
-  OgaImages *images = nullptr;
-  OgaStringArray *image_path_array = nullptr;
-  
-  if (image_count > 0) {
-    DEBUG_LOG("Step 4: Loading %d images...", image_count);
-    
-    // Create string array for image paths
-    result = OgaCreateStringArray(&image_path_array);
-    if (check_oga_result(result, "String array creation failed") ||
-        image_path_array == nullptr) {
-      DEBUG_ERROR("String array creation failed");
-      OgaDestroyTokenizer(tokenizer);
-      OgaDestroyMultiModalProcessor(processor);
-      OgaDestroyModel(model);
-      return set_error(g_error_buffer);
+  OgaResult *result = OgaCreateTokenizerStream(chat->entry->tokenizer, &request.stream);
+  if (check_oga_result(result, "Tokenizer stream creation failed") ||
+      request.stream == nullptr) {
+    return last_error_result();
+  }
+
+  result = OgaGenerator_AppendTokens(request.generator, tokens.data(), tokens.size());
+  if (check_oga_result(result, "Appending message failed")) {
+    std::string error = g_error_buffer;
+    rewind_chat(*chat, turn_length); // the tokens may be appended without their KV cache
+    g_error_buffer = std::move(error); // the error to report, not the rewind's
+    return last_error_result();
+  }
+  DEBUG_LOG("Chat %lld: appended %zu tokens to %zu", (long long)chat_id,
+            tokens.size(), turn_length);
+
+  const size_t reply_start = turn_length + tokens.size();
+  std::string reply;
+  int32_t last_token = 0;
+  bool failed = false;
+  int32_t generated_count = run_generation_loop(
+      request,
+      [&](const char *text) {
+        reply += text;
+        return max_new_tokens <= 0 ||
+               chat_position(*chat) - reply_start <
+                   static_cast<size_t>(max_new_tokens);
+      },
+      &last_token, &failed);
+
+  if (failed) {
+    // Drop the whole turn: the generator state after a failed run is unusable
+    std::string error = g_error_buffer;
+    rewind_chat(*chat, turn_length);
+    g_error_buffer = std::move(error);
+    return last_error_result();
+  }
+
+  chat->turn_starts.push_back(turn_length + (chat->has_pending_token ? 1 : 0));
+  chat->has_pending_token = false;
+
+  // The model has not run the last generated token yet. An EOS is never added
+  // to the sequence; any other token (max_new_tokens or max_length reached)
+  // is taken back out so both go in front of the next message.
+  size_t reply_end = chat_position(*chat);
+  if (generated_count > 0) {
+    if (reply_end == reply_start + generated_count &&
+        rewind_chat(*chat, reply_end - 1)) {
+      reply_end--;
     }
-
-    // Add each image path to the array
-    for (int i = 0; i < image_count; i++) {
-      DEBUG_LOG("  Adding image %d: %s", i + 1, image_paths[i] ? image_paths[i] : "NULL");
-      if (image_paths[i] == nullptr) {
-        DEBUG_ERROR("NULL image path at index %d", i);
-        OgaDestroyStringArray(image_path_array);
-        OgaDestroyTokenizer(tokenizer);
-        OgaDestroyMultiModalProcessor(processor);
-        OgaDestroyModel(model);
-        return set_error("NULL image path in array");
-      }
-      result = OgaStringArrayAddString(image_path_array, image_paths[i]);
-      if (check_oga_result(result, "Add image path failed")) {
-        DEBUG_ERROR("Failed to add image path at index %d", i);
-        OgaDestroyStringArray(image_path_array);
-        OgaDestroyTokenizer(tokenizer);
-        OgaDestroyMultiModalProcessor(processor);
-        OgaDestroyModel(model);
-        return set_error(g_error_buffer);
-      }
+    if (reply_end < reply_start + generated_count) {
+      chat->pending_token = last_token;
+      chat->has_pending_token = true;
     }
+  }
+  DEBUG_LOG("Chat %lld: generated %d tokens, length %zu", (long long)chat_id,
+            generated_count, reply_end);
+  return set_result(reply);
+}
 
-    // Load all images
-    result = OgaLoadImages(image_path_array, &images);
-    if (check_oga_result(result, "Image loading failed") || images == nullptr) {
-      DEBUG_ERROR("Failed to load images");
-      OgaDestroyStringArray(image_path_array);
-      OgaDestroyTokenizer(tokenizer);
-      OgaDestroyMultiModalProcessor(processor);
-      OgaDestroyModel(model);
-      return set_error(g_error_buffer);
-    }
-    DEBUG_LOG("Step 4: All images loaded successfully");
-  } else {
-    DEBUG_LOG("Step 4: No images - text-only inference");
+/**
+ * @brief Save a chat to a file and the chat file next to it.
+ */
+FFI_PLUGIN_EXPORT int32_t chat_save(int64_t chat_id, const char *path) {
+  DEBUG_LOG("=== chat_save %lld ===", (long long)chat_id);
+  if (path == nullptr) {
+    set_error("NULL path provided");
+    return -2;
+  }
+  std::shared_ptr<ChatSession> chat = find_chat(chat_id);
+  if (!chat) {
+    set_error("Unknown chat session");
+    return -1;
   }
 
-  // Process prompt and images
-  DEBUG_LOG("Step 5: Processing prompt and images...");
-  OgaNamedTensors *named_tensors = nullptr;
-  result = OgaProcessorProcessImages(processor, prompt, images, &named_tensors);
-  if (check_oga_result(result, "Processing failed") ||
-      named_tensors == nullptr) {
-    DEBUG_ERROR("Processing failed");
-    if (images)
-      OgaDestroyImages(images);
-    if (image_path_array)
-      OgaDestroyStringArray(image_path_array);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyMultiModalProcessor(processor);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+  std::lock_guard<std::mutex> lock(chat->mutex);
+  OgaResult *result = OgaGenerator_SaveState(chat->request->generator, path);
+  if (check_oga_result(result, "Saving chat failed") ||
+      !write_chat_file(*chat, path)) {
+    DEBUG_ERROR("%s", g_error_buffer.c_str());
+    return -2;
   }
-  DEBUG_LOG("Step 5: Processing complete");
+  return 1;
+}
 
-  // Create generator params
-  DEBUG_LOG("Step 6: Creating generator params...");
-  OgaGeneratorParams *params = nullptr;
-  result = OgaCreateGeneratorParams(model, &params);
-  if (check_oga_result(result, "Generator params creation failed") ||
-      params == nullptr) {
-    DEBUG_ERROR("Generator params creation failed");
-    OgaDestroyNamedTensors(named_tensors);
-    if (images)
-      OgaDestroyImages(images);
-    if (image_path_array)
-      OgaDestroyStringArray(image_path_array);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyMultiModalProcessor(processor);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+/**
+ * @brief Open a chat that continues from a file written by chat_save.
+ */
+FFI_PLUGIN_EXPORT int64_t chat_restore(int64_t model_handle, const char *path,
+                                       int32_t max_length,
+                                       int32_t attention_sink_size) {
+  init_debug_features();
+  DEBUG_LOG("=== chat_restore %s ===", path ? path : "NULL");
+  if (path == nullptr) {
+    set_error("NULL path provided");
+    return -3;
+  }
+  auto chat = std::make_shared<ChatSession>();
+  chat->entry = acquire_model(model_handle);
+  if (chat->entry == nullptr) {
+    DEBUG_ERROR("Invalid model handle: %lld", (long long)model_handle);
+    set_error("Invalid model handle");
+    return -1;
   }
-  DEBUG_LOG("Step 6: Generator params created");
 
-  // Create generator
-  DEBUG_LOG("Step 7: Creating generator...");
-  OgaGenerator *generator = nullptr;
-  result = OgaCreateGenerator(model, params, &generator);
-  if (check_oga_result(result, "Generator creation failed") ||
-      generator == nullptr) {
-    DEBUG_ERROR("Generator creation failed");
-    OgaDestroyGeneratorParams(params);
-    OgaDestroyNamedTensors(named_tensors);
-    if (images)
-      OgaDestroyImages(images);
-    if (image_path_array)
-      OgaDestroyStringArray(image_path_array);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyMultiModalProcessor(processor);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+  chat->request = std::make_unique<GenerationRequest>();
+  chat->attention_sink_size =
+      static_cast<size_t>(std::max<int32_t>(attention_sink_size, 0));
+  if (!create_generator(chat->entry, max_length, attention_sink_size,
+                        *chat->request)) {
+    DEBUG_ERROR("Chat setup failed: %s", g_error_buffer.c_str());
+    return -2;
   }
-  DEBUG_LOG("Step 7: Generator created");
 
-  // Set input tensors
-  DEBUG_LOG("Step 8: Setting input tensors...");
-  result = OgaGenerator_SetInputs(generator, named_tensors);
-  if (check_oga_result(result, "Setting input tensors failed")) {
-    DEBUG_ERROR("Setting input tensors failed");
-    OgaDestroyGenerator(generator);
-    OgaDestroyGeneratorParams(params);
-    OgaDestroyNamedTensors(named_tensors);
-    if (images)
-      OgaDestroyImages(images);
-    if (image_path_array)
-      OgaDestroyStringArray(image_path_array);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyMultiModalProcessor(processor);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+  OgaResult *result = OgaGenerator_LoadState(chat->request->generator, path);
+  if (check_oga_result(result, "Restoring chat failed")) {
+    DEBUG_ERROR("%s", g_error_buffer.c_str());
+    return -3;
+  }
+  const size_t position = chat_position(*chat);
+  if (position == SIZE_MAX || !read_chat_file(*chat, path, position)) {
+    DEBUG_ERROR("%s", g_error_buffer.c_str());
+    return -3;
   }
-  DEBUG_LOG("Step 8: Input tensors set");
 
-  // Create tokenizer stream
-  DEBUG_LOG("Step 9: Creating tokenizer stream...");
-  OgaTokenizerStream *stream = nullptr;
-  result = OgaCreateTokenizerStream(tokenizer, &stream);
-  if (check_oga_result(result, "Tokenizer stream creation failed") ||
-      stream == nullptr) {
-    DEBUG_ERROR("Tokenizer stream creation failed");
-    OgaDestroyGenerator(generator);
-    OgaDestroyGeneratorParams(params);
-    OgaDestroyNamedTensors(named_tensors);
-    if (images)
-      OgaDestroyImages(images);
-    if (image_path_array)
-      OgaDestroyStringArray(image_path_array);
-    OgaDestroyTokenizer(tokenizer);
-    OgaDestroyMultiModalProcessor(processor);
-    OgaDestroyModel(model);
-    return set_error(g_error_buffer);
+  const int64_t chat_id = g_next_chat_id.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> lock(g_chats_mutex);
+    g_chats[chat_id] = std::move(chat);
   }
-  DEBUG_LOG("Step 9: Tokenizer stream created");
+  DEBUG_LOG("Restored chat %lld at position %zu", (long long)chat_id, position);
+  return chat_id;
+}
 
-  // Generation loop
-  DEBUG_LOG("Step 10: Starting token generation loop...");
-  std::string generated_text;
-  int generated_count = 0;
+/**
+ * @brief Drop a turn and every turn after it from a chat.
+ */
+FFI_PLUGIN_EXPORT int32_t chat_rewind(int64_t chat_id, int32_t turn) {
+  DEBUG_LOG("=== chat_rewind %lld to turn %d ===", (long long)chat_id, turn);
+  std::shared_ptr<ChatSession> chat = find_chat(chat_id);
+  if (!chat) {
+    set_error("Unknown chat session");
+    return -1;
+  }
 
-  while (!OgaGenerator_IsDone(generator)) {
-    result = OgaGenerator_GenerateNextToken(generator);
-    if (check_oga_result(result, "Generate next token failed")) {
-      DEBUG_ERROR("Generate next token failed at token %d", generated_count);
-      break;
-    }
+  std::lock_guard<std::mutex> lock(chat->mutex);
+  if (turn < 0 || static_cast<size_t>(turn) >= chat->turn_starts.size()) {
+    set_error("Turn " + std::to_string(turn) + " does not exist");
+    return -2;
+  }
 
-    const int32_t *tokens = nullptr;
-    size_t token_count = 0;
-    result = OgaGenerator_GetNextTokens(generator, &tokens, &token_count);
-    if (check_oga_result(result, "Get next tokens failed") ||
-        token_count == 0) {
-      DEBUG_ERROR("Get next tokens failed at token %d", generated_count);
-      break;
-    }
+  if (!rewind_chat(*chat, chat->turn_starts[turn])) {
+    DEBUG_ERROR("%s", g_error_buffer.c_str());
+    return -3;
+  }
+  chat->turn_starts.resize(turn);
+  chat->has_pending_token = false; // the previous reply's last token starts the turn
+  return 1;
+}
 
-    const char *token_text = nullptr;
-    result = OgaTokenizerStreamDecode(stream, tokens[0], &token_text);
-    if (!check_oga_result(result, "Token decode failed") &&
-        token_text != nullptr) {
-      generated_text += token_text;
-    }
-    generated_count++;
-    
-    if (generated_count % 50 == 0) {
-      DEBUG_LOG("Generated %d tokens so far...", generated_count);
+/**
+ * @brief Close a chat and release its generator.
+ */
+FFI_PLUGIN_EXPORT int32_t chat_close(int64_t chat_id) {
+  DEBUG_LOG("=== chat_close %lld ===", (long long)chat_id);
+  std::shared_ptr<ChatSession> chat;
+  {
+    std::lock_guard<std::mutex> lock(g_chats_mutex);
+    auto it = g_chats.find(chat_id);
+    if (it == g_chats.end()) {
+      set_error("Unknown chat session");
+      return -1;
     }
+    chat = std::move(it->second);
+    g_chats.erase(it);
   }
-  DEBUG_LOG("Step 10: Generation complete. Total tokens: %d", generated_count);
-
-  // Cleanup
-  DEBUG_LOG("Step 11: Cleaning up resources...");
-  OgaDestroyTokenizerStream(stream);
-  OgaDestroyGenerator(generator);
-  OgaDestroyGeneratorParams(params);
-  OgaDestroyNamedTensors(named_tensors);
-  if (images)
-    OgaDestroyImages(images);
-  if (image_path_array)
-    OgaDestroyStringArray(image_path_array);
-  OgaDestroyTokenizer(tokenizer);
-  OgaDestroyMultiModalProcessor(processor);
-  OgaDestroyModel(model);
-  DEBUG_LOG("Step 11: Cleanup complete");
-  DEBUG_LOG("=== run_inference_multi_with_config END ===");
-
-  return set_result(generated_text);
+  return 1; // destroyed here, or when a chat_send in progress returns
 }
 
+/**
+ * @brief Release a string returned by an inference or poll function.
+ */
+FFI_PLUGIN_EXPORT void free_result(char *result) { std::free(result); }
+
 /**
  * @brief Get the last error message.
  */
@@ -55,6 +55,10 @@ FFI_PLUGIN_EXPORT const char *get_library_version();
 /**
  * @brief Shutdown the ONNX GenAI library and free global resources.
  * Call this when the application is shutting down.
+ *
+ * Model handles are invalid afterwards. A model that a request on another
+ * isolate is still using is freed when that request finishes, and ONNX
+ * Runtime itself shuts down once the last such model is freed.
  */
 FFI_PLUGIN_EXPORT void shutdown_onnx_genai();
 
@@ -77,12 +81,11 @@ FFI_PLUGIN_EXPORT void shutdown_onnx_genai();
  * @param image_path Path to the image file (JPEG, PNG, etc.), or NULL for
  * text-only
  * @return Generated text on success, or error message prefixed with "ERROR:" on
- * failure The returned string is valid until the next call from the same
- * thread.
+ * failure. The caller owns the string and must release it with free_result.
  */
-FFI_PLUGIN_EXPORT const char *run_inference(const char *model_path,
-                                            const char *prompt,
-                                            const char *image_path);
+FFI_PLUGIN_EXPORT char *run_inference(const char *model_path,
+                                      const char *prompt,
+                                      const char *image_path);
 
 /**
  * @brief Run multimodal inference with text and multiple images.
@@ -100,12 +103,12 @@ FFI_PLUGIN_EXPORT const char *run_inference(const char *model_path,
  * @param image_paths Array of paths to image files (JPEG, PNG, etc.)
  * @param image_count Number of images in the array
  * @return Generated text on success, or error message prefixed with "ERROR:" on
- * failure
+ * failure. Release with free_result.
  */
-FFI_PLUGIN_EXPORT const char *run_inference_multi(const char *model_path,
-                                                  const char *prompt,
-                                                  const char **image_paths,
-                                                  int32_t image_count);
+FFI_PLUGIN_EXPORT char *run_inference_multi(const char *model_path,
+                                            const char *prompt,
+                                            const char **image_paths,
+                                            int32_t image_count);
 
 /**
  * @brief Run text-only inference with the model.
@@ -119,11 +122,11 @@ FFI_PLUGIN_EXPORT const char *run_inference_multi(const char *model_path,
  * @param prompt The text prompt for generation
  * @param max_length Maximum number of tokens to generate (0 for model default)
  * @return Generated text on success, or error message prefixed with "ERROR:" on
- * failure
+ * failure. Release with free_result.
  */
-FFI_PLUGIN_EXPORT const char *run_text_inference(const char *model_path,
-                                                 const char *prompt,
-                                                 int32_t max_length);
+FFI_PLUGIN_EXPORT char *run_text_inference(const char *model_path,
+                                           const char *prompt,
+                                           int32_t max_length);
 
 // =============================================================================
 // Configuration API - Runtime Session Options
@@ -191,6 +194,44 @@ FFI_PLUGIN_EXPORT int32_t config_set_provider_option(int64_t config_handle,
                                                       const char *key,
                                                       const char *value);
 
+/**
+ * @brief Cache the graphs ONNX Runtime optimizes when loading the model.
+ *
+ * The first load writes each optimized model file (decoder, embedding,
+ * vision, ...) with its prepacked weights to cache_dir; later loads read it
+ * instead of optimizing again, which is a large part of a cold start. An
+ * entry is rewritten when the model file, the providers or their options
+ * change. Providers that compile the graph (QNN, NNAPI, CoreML) are not
+ * cached. The entries are about as large as the model.
+ *
+ * @param config_handle Handle returned by create_config
+ * @param cache_dir Existing directory for the cache (relative paths are
+ *        relative to the model directory), or "" to disable the cache
+ * @return 1 on success, negative on failure
+ */
+FFI_PLUGIN_EXPORT int32_t config_set_optimized_model_cache_dir(
+    int64_t config_handle, const char *cache_dir);
+
+/**
+ * @brief Load the vision and speech encoders of a multimodal model on demand.
+ *
+ * The encoders are read once when the model loads, to learn their inputs and
+ * outputs, and then released. The first prompt with images or audio loads
+ * them again, so text-only chats don't keep their weights in memory. Use
+ * release_idle_sessions to free them again, for example when the app gets a
+ * memory warning.
+ *
+ * Models without encoders ignore it.
+ *
+ * @param config_handle Handle returned by create_config
+ * @param idle_timeout_ms Time in milliseconds after their last use when the
+ *        encoders are released again, 0 to release them as soon as no request
+ *        uses them, or -1 to keep them until release_idle_sessions
+ * @return 1 on success, negative on failure
+ */
+FFI_PLUGIN_EXPORT int32_t config_set_lazy_encoder_sessions(
+    int64_t config_handle, int32_t idle_timeout_ms);
+
 /**
  * @brief Run inference using a pre-configured config.
  *
@@ -203,10 +244,11 @@ FFI_PLUGIN_EXPORT int32_t config_set_provider_option(int64_t config_handle,
  * @param prompt The text prompt for generation
  * @param image_path Path to image file, or NULL for text-only
  * @return Generated text on success, or error message prefixed with "ERROR:"
+ *         on failure. Release with free_result.
  */
-FFI_PLUGIN_EXPORT const char *run_inference_with_config(int64_t config_handle,
-                                                         const char *prompt,
-                                                         const char *image_path);
+FFI_PLUGIN_EXPORT char *run_inference_with_config(int64_t config_handle,
+                                                   const char *prompt,
+                                                   const char *image_path);
 
 /**
  * @brief Run multi-image inference using a pre-configured config.
@@ -223,15 +265,473 @@ FFI_PLUGIN_EXPORT const char *run_inference_with_config(int64_t config_handle,
  * @param image_paths Array of paths to image files
  * @param image_count Number of images in the array
  * @return Generated text on success, or error message prefixed with "ERROR:"
+ *         on failure. Release with free_result.
+ */
+FFI_PLUGIN_EXPORT char *run_inference_multi_with_config(int64_t config_handle,
+                                                         const char *prompt,
+                                                         const char **image_paths,
+                                                         int32_t image_count);
+
+// =============================================================================
+// Model Handle API - Persistent Models
+// =============================================================================
+
+/**
+ * @brief Load the model described by a config and keep it resident.
+ *
+ * The model, its tokenizer and (for multimodal models) its processor are
+ * created once and shared by every request made with the returned handle.
+ * Loading a config with the same model path and provider settings again
+ * returns the same handle and increments its reference count.
+ *
+ * The config may be destroyed once the model is loaded.
+ *
+ * WARNING: This is a LONG-RUNNING operation on first load!
+ * MUST be called from a background Dart Isolate.
+ *
+ * @param config_handle Handle returned by create_config
+ * @return Opaque model handle, or 0 on failure (see get_last_error)
+ */
+FFI_PLUGIN_EXPORT int64_t load_model(int64_t config_handle);
+
+/**
+ * @brief Release a model handle returned by load_model.
+ *
+ * The model is destroyed when its last reference is released. Requests that
+ * are still running keep the model alive until they finish.
+ *
+ * @param model_handle Handle returned by load_model
+ * @return 1 on success, negative on failure
+ */
+FFI_PLUGIN_EXPORT int32_t unload_model(int64_t model_handle);
+
+/**
+ * @brief Let later requests on a model reuse the KV cache of earlier ones.
+ *
+ * When a generation finishes, the model keeps the KV cache of its prompt and
+ * reply. A later prompt that starts with the same tokens, such as the next turn
+ * of a chat that resends the history, only prefills the tokens after the
+ * shared part. Entries are evicted least recently used first to stay within
+ * max_bytes and are freed when the model is unloaded.
+ *
+ * Applies to text-only decoder models on CPU and CUDA without a LoRA adapter;
+ * other models ignore it.
+ *
+ * @param model_handle Handle returned by load_model
+ * @param max_bytes Memory budget for cached KV entries, or 0 to use the
+ *        search.prefix_cache_bytes value of genai_config.json (off by default)
+ * @return 1 on success, negative on failure
+ */
+FFI_PLUGIN_EXPORT int32_t set_prefix_cache_size(int64_t model_handle,
+                                                int64_t max_bytes);
+
+/**
+ * @brief Speed up greedy generation on a model by copying from its prompt.
+ *
+ * Before each step, the last tokens of the sequence are looked up in the
+ * prompt and the output so far. The tokens that followed the longest match
+ * are checked by the model in a single run, and every one it would have chosen
+ * itself is accepted at once. Summaries, code edits and answers that quote the
+ * prompt copy long spans and generate several tokens per run. The output is the
+ * same as without it, and it needs no extra weights.
+ *
+ * Applies to greedy search without repetition, frequency or presence
+ * penalties on text-only decoder models on CPU; other generators ignore it.
+ *
+ * @param model_handle Handle returned by load_model
+ * @param ngram_size Longest match to look up (3 works well), or 0 to use the
+ *        search.prompt_lookup_ngram_size value of genai_config.json (off by
+ *        default)
+ * @param num_speculative_tokens Tokens checked per run, or 0 to use the
+ *        search.num_speculative_tokens value of genai_config.json (4 by default)
+ * @return 1 on success, negative on failure
+ */
+FFI_PLUGIN_EXPORT int32_t set_prompt_lookup(int64_t model_handle,
+                                            int32_t ngram_size,
+                                            int32_t num_speculative_tokens);
+
+/**
+ * @brief Let later requests on a model reuse the vision output of earlier ones.
+ *
+ * After the vision model encodes the images of a prompt, the model keeps its
+ * output keyed by a hash of the processed images. A later prompt with the same
+ * images, such as a follow-up question about one photo, copies it instead of
+ * running the vision model again. Entries are evicted least recently used
+ * first to stay within max_bytes and are freed when the model is unloaded.
+ *
+ * Applies to multimodal models with a vision model; other models ignore it.
+ *
+ * @param model_handle Handle returned by load_model
+ * @param max_bytes Memory budget for cached image features, or 0 to use the
+ *        search.image_features_cache_bytes value of genai_config.json (off by
+ *        default)
+ * @return 1 on success, negative on failure
+ */
+FFI_PLUGIN_EXPORT int32_t set_image_cache_size(int64_t model_handle,
+                                               int64_t max_bytes);
+
+/**
+ * @brief Free the memory of the encoders of a model that no request is using.
+ *
+ * Releases the vision and speech encoders of a model loaded with
+ * config_set_lazy_encoder_sessions; the next prompt with images or audio loads
+ * them again. Call it under memory pressure.
+ *
+ * @param model_handle Handle returned by load_model
+ * @return The number of encoders released (0 if none was loaded), negative on
+ *         failure
+ */
+FFI_PLUGIN_EXPORT int32_t release_idle_sessions(int64_t model_handle);
+
+/**
+ * @brief Run inference on a loaded model with an optional image.
+ *
+ * WARNING: This is a LONG-RUNNING operation!
+ * MUST be called from a background Dart Isolate.
+ *
+ * @param model_handle Handle returned by load_model
+ * @param prompt The text prompt for generation
+ * @param image_path Path to image file, or NULL for text-only
+ * @param max_length Maximum sequence length (0 for the genai_config.json value)
+ * @return Generated text on success, or error message prefixed with "ERROR:"
+ *         on failure. Release with free_result.
+ */
+FFI_PLUGIN_EXPORT char *run_inference_with_model(int64_t model_handle,
+                                                  const char *prompt,
+                                                  const char *image_path,
+                                                  int32_t max_length);
+
+/**
+ * @brief Run multi-image inference on a loaded model.
+ *
+ * The prompt should contain image placeholders like <|image_1|>, <|image_2|>,
+ * etc. matching the number of images provided.
+ *
+ * WARNING: This is a LONG-RUNNING operation!
+ * MUST be called from a background Dart Isolate.
+ *
+ * @param model_handle Handle returned by load_model
+ * @param prompt The text prompt for generation (with image placeholders)
+ * @param image_paths Array of paths to image files
+ * @param image_count Number of images in the array
+ * @param max_length Maximum sequence length (0 for the genai_config.json value)
+ * @return Generated text on success, or error message prefixed with "ERROR:"
+ *         on failure. Release with free_result.
+ */
+FFI_PLUGIN_EXPORT char *run_inference_multi_with_model(int64_t model_handle,
+                                                        const char *prompt,
+                                                        const char **image_paths,
+                                                        int32_t image_count,
+                                                        int32_t max_length);
+
+/**
+ * @brief Run inference on a loaded model with encoded images in memory.
+ *
+ * Takes JPEG, PNG or any other format the image loader decodes, for example
+ * downloaded images or camera frames the platform already encoded, without
+ * writing them to a file first. The buffers are only read during the call.
+ *
+ * WARNING: This is a LONG-RUNNING operation!
+ * MUST be called from a background Dart Isolate.
+ *
+ * @param model_handle Handle returned by load_model
+ * @param prompt The text prompt for generation (with image placeholders)
+ * @param image_data Array of encoded images
+ * @param image_sizes Size in bytes of each encoded image
+ * @param image_count Number of images in the arrays
+ * @param max_length Maximum sequence length (0 for the genai_config.json value)
+ * @return Generated text on success, or error message prefixed with "ERROR:"
+ *         on failure. Release with free_result.
+ */
+FFI_PLUGIN_EXPORT char *run_inference_with_image_buffers(
+    int64_t model_handle, const char *prompt, const uint8_t **image_data,
+    const int64_t *image_sizes, int32_t image_count, int32_t max_length);
+
+/**
+ * @brief Run inference on a loaded model with one image of raw RGBA pixels.
+ *
+ * For camera frames and decoded bitmaps: the pixels are passed on losslessly
+ * in an uncompressed container instead of being JPEG encoded, written to a
+ * file, read back and decoded. The alpha channel is ignored.
+ *
+ * WARNING: This is a LONG-RUNNING operation!
+ * MUST be called from a background Dart Isolate.
+ *
+ * @param model_handle Handle returned by load_model
+ * @param prompt The text prompt for generation (with an image placeholder)
+ * @param pixels Rows of width RGBA pixels, 8 bits per channel
+ * @param width Image width in pixels
+ * @param height Image height in pixels
+ * @param stride Bytes from the start of one row to the next, or 0 for
+ *        width * 4
+ * @param max_length Maximum sequence length (0 for the genai_config.json value)
+ * @return Generated text on success, or error message prefixed with "ERROR:"
+ *         on failure. Release with free_result.
+ */
+FFI_PLUGIN_EXPORT char *run_inference_with_rgba(int64_t model_handle,
+                                                const char *prompt,
+                                                const uint8_t *pixels,
+                                                int32_t width, int32_t height,
+                                                int32_t stride,
+                                                int32_t max_length);
+
+/**
+ * @brief Run text-only inference on a loaded model.
+ *
+ * WARNING: This is a LONG-RUNNING operation!
+ * MUST be called from a background Dart Isolate.
+ *
+ * @param model_handle Handle returned by load_model
+ * @param prompt The text prompt for generation
+ * @param max_length Maximum sequence length (0 for the genai_config.json value)
+ * @return Generated text on success, or error message prefixed with "ERROR:"
+ *         on failure. Release with free_result.
+ */
+FFI_PLUGIN_EXPORT char *run_text_inference_with_model(int64_t model_handle,
+                                                       const char *prompt,
+                                                       int32_t max_length);
+
+// =============================================================================
+// Streaming API - Token-by-token output via Dart SendPort
+// =============================================================================
+
+/** Message kinds posted to a streaming SendPort as a [kind, text] list. */
+enum {
+  kStreamMessageText = 0,      ///< text: newly decoded fragment(s)
+  kStreamMessageDone = 1,      ///< generation finished; text is empty
+  kStreamMessageError = 2,     ///< generation failed; text is the error message
+  kStreamMessageCancelled = 3, ///< generation was cancelled; text is empty
+};
+
+/**
+ * @brief Initialize the Dart native API for posting to SendPorts.
+ *
+ * Must be called once with `NativeApi.initializeApiDLData` before starting
+ * any stream.
+ *
+ * @param data Value of `NativeApi.initializeApiDLData`
+ * @return 0 on success, -1 if the Dart API is incompatible
+ */
+FFI_PLUGIN_EXPORT intptr_t init_dart_api_dl(void *data);
+
+/**
+ * @brief Stream inference on a loaded model to a Dart SendPort.
+ *
+ * Generation runs on the native worker pool (see start_generation); this
+ * call returns immediately and is safe to make from the main UI isolate.
+ * Decoded text is posted as [kStreamMessageText, fragment] as soon as it is
+ * available (fragments decoded in quick succession are batched). The stream
+ * ends with exactly one [kStreamMessageDone, ""], [kStreamMessageError,
+ * message] or [kStreamMessageCancelled, ""]. Closing the receiving port or
+ * calling cancel_generation stops the generation.
+ *
+ * @param model_handle Handle returned by load_model
+ * @param prompt The text prompt for generation
+ * @param image_paths Array of paths to image files, or NULL
+ * @param image_count Number of images in the array
+ * @param max_length Maximum sequence length (0 for the genai_config.json value)
+ * @param send_port Native port of the Dart SendPort receiving the text
+ * @return Request id (> 0) for cancel_generation, negative on failure
+ */
+FFI_PLUGIN_EXPORT int64_t stream_inference_with_model(int64_t model_handle,
+                                                       const char *prompt,
+                                                       const char **image_paths,
+                                                       int32_t image_count,
+                                                       int32_t max_length,
+                                                       int64_t send_port);
+
+// =============================================================================
+// Background Generation API - Non-blocking, cancellable requests
+// =============================================================================
+
+/** Status of a generation reported by poll_generation. */
+enum {
+  kGenerationUnknown = -2,  ///< no such request (or its final status was polled)
+  kGenerationFailed = -1,   ///< failed; poll_generation returns the error
+  kGenerationQueued = 0,    ///< waiting for a free worker
+  kGenerationRunning = 1,   ///< generating
+  kGenerationDone = 2,      ///< finished normally
+  kGenerationCancelled = 3, ///< stopped by cancel_generation
+};
+
+/**
+ * @brief Queue a generation on the native worker pool.
+ *
+ * Returns immediately; a small pool of native threads owns and runs the
+ * generator, so no Dart isolate is blocked. Use poll_generation to read the
+ * progress and cancel_generation to abort it.
+ *
+ * @param model_handle Handle returned by load_model
+ * @param prompt The text prompt for generation
+ * @param image_paths Array of paths to image files, or NULL
+ * @param image_count Number of images in the array
+ * @param max_length Maximum sequence length (0 for the genai_config.json value)
+ * @return Request id (> 0), negative on failure
+ */
+FFI_PLUGIN_EXPORT int64_t start_generation(int64_t model_handle,
+                                           const char *prompt,
+                                           const char **image_paths,
+                                           int32_t image_count,
+                                           int32_t max_length);
+
+/**
+ * @brief Cancel a queued or running generation.
+ *
+ * Sets the session's terminate flag, so an in-flight model run (including a
+ * long prompt prefill) aborts instead of finishing. Works for requests from
+ * both start_generation and stream_inference_with_model.
+ *
+ * @param request_id Id returned by start_generation or stream_inference_with_model
+ * @return 1 if the request was found, -1 otherwise
+ */
+FFI_PLUGIN_EXPORT int32_t cancel_generation(int64_t request_id);
+
+/**
+ * @brief Read the status and text of a generation started with start_generation.
+ *
+ * Safe to call from the main UI isolate. Once a final status (done,
+ * cancelled or failed) has been returned, the request is released and
+ * further polls report kGenerationUnknown.
+ *
+ * @param request_id Id returned by start_generation
+ * @param out_status Receives one of the kGeneration* status values
+ * @return Text generated so far, or the error message prefixed with "ERROR:"
+ *         when failed or unknown. Release with free_result.
+ */
+FFI_PLUGIN_EXPORT char *poll_generation(int64_t request_id,
+                                        int32_t *out_status);
+
+// =============================================================================
+// Chat Session API - Multi-turn conversations without re-prefill
+// =============================================================================
+
+/**
+ * @brief Open a chat that keeps its generator and KV cache between turns.
+ *
+ * Each chat_send appends only the new message, so a turn costs as much as the
+ * message instead of the whole history. Chats are text-only and need a model
+ * whose KV cache supports continuous decoding (CPU or CUDA).
+ *
+ * @param model_handle Handle returned by load_model. The chat keeps the model
+ *        loaded until it is closed.
+ * @param max_length Maximum length of the whole conversation in tokens (0 for
+ *        the genai_config.json value)
+ * @param attention_sink_size 0 to end the chat at max_length. Otherwise the
+ *        chat goes on past it: this many tokens at the start (the system
+ *        prompt) are kept and the oldest tokens after them are evicted.
+ *        Turns whose start was evicted can't be rewound anymore. Needs a CPU
+ *        model; RoPE models need decoder.rotary_embedding in
+ *        genai_config.json.
+ * @return Chat id (> 0), negative on failure:
+ *         -1: Invalid model handle
+ *         -2: Generator creation failed (see get_last_error)
+ */
+FFI_PLUGIN_EXPORT int64_t chat_open(int64_t model_handle, int32_t max_length,
+                                    int32_t attention_sink_size);
+
+/**
+ * @brief Append a message to a chat and generate the reply.
+ *
+ * The message is tokenized as is, so it should already be formatted with the
+ * model's chat template: whatever the template puts after the previous
+ * reply's EOS token, the user turn and the assistant prefix. The tokenizer's
+ * BOS token is only kept on the first turn.
+ *
+ * A failed turn leaves the chat as it was before the call.
+ *
+ * WARNING: This is a LONG-RUNNING operation!
+ * MUST be called from a background Dart Isolate.
+ *
+ * @param chat_id Id returned by chat_open
+ * @param message Text to append (templated user turn)
+ * @param max_new_tokens Maximum number of reply tokens (0 for no limit other
+ *        than max_length)
+ * @return Reply text on success, or error message prefixed with "ERROR:" on
+ *         failure. Release with free_result.
+ */
+FFI_PLUGIN_EXPORT char *chat_send(int64_t chat_id, const char *message,
+                                  int32_t max_new_tokens);
+
+/**
+ * @brief Drop a turn and every later turn from a chat.
+ *
+ * The KV cache is rewound to the start of the turn, so regenerating a reply
+ * (sending the same message again) or editing a message (sending a new one)
+ * only runs the tokens from that turn on.
+ *
+ * @param chat_id Id returned by chat_open
+ * @param turn Zero-based index of the first chat_send to drop
+ * @return 1 on success, negative on failure:
+ *         -1: Unknown chat
+ *         -2: No such turn
+ *         -3: Rewind failed, e.g. the turn was evicted (see get_last_error)
+ */
+FFI_PLUGIN_EXPORT int32_t chat_rewind(int64_t chat_id, int32_t turn);
+
+/**
+ * @brief Save a chat so chat_restore can continue it later, e.g. after the
+ *        app was killed.
+ *
+ * Writes the generator's state (tokens, sampling state and KV cache) to path
+ * and the chat's turns to path + ".chat". Restoring then only runs the last
+ * token instead of prefilling the whole history again. The file holds the raw
+ * KV cache, so it is about as large as the cache of the conversation.
+ *
+ * @param chat_id Id returned by chat_open or chat_restore
+ * @param path File to write; replaced only once the new state is complete
+ * @return 1 on success, negative on failure:
+ *         -1: Unknown chat
+ *         -2: Saving failed (see get_last_error)
+ */
+FFI_PLUGIN_EXPORT int32_t chat_save(int64_t chat_id, const char *path);
+
+/**
+ * @brief Open a chat that continues from a file written by chat_save.
+ *
+ * The model must be the one the chat was saved with. A KV cache that doesn't
+ * fit the generator (e.g. another device) is recomputed from the tokens.
+ *
+ * WARNING: This can be a LONG-RUNNING operation!
+ * MUST be called from a background Dart Isolate.
+ *
+ * @param model_handle Handle returned by load_model
+ * @param path File written by chat_save
+ * @param max_length As for chat_open; must fit the saved conversation
+ * @param attention_sink_size As for chat_open; must match the saved chat
+ * @return Chat id (> 0), negative on failure:
+ *         -1: Invalid model handle
+ *         -2: Generator creation failed (see get_last_error)
+ *         -3: Restoring failed (see get_last_error)
+ */
+FFI_PLUGIN_EXPORT int64_t chat_restore(int64_t model_handle, const char *path,
+                                       int32_t max_length,
+                                       int32_t attention_sink_size);
+
+/**
+ * @brief Close a chat and release its generator and model reference.
+ *
+ * A chat_send still running on another thread keeps the chat alive until it
+ * returns.
+ *
+ * @param chat_id Id returned by chat_open
+ * @return 1 on success, -1 if the chat is unknown
+ */
+FFI_PLUGIN_EXPORT int32_t chat_close(int64_t chat_id);
+
+/**
+ * @brief Release a string returned by an inference or poll function.
+ *
+ * Every run_* and poll_generation result is a separate allocation owned by
+ * the caller, so requests on different threads never share a buffer.
+ *
+ * @param result String to release (NULL is ignored)
  */
-FFI_PLUGIN_EXPORT const char *run_inference_multi_with_config(int64_t config_handle,
-                                                               const char *prompt,
-                                                               const char **image_paths,
-                                                               int32_t image_count);
+FFI_PLUGIN_EXPORT void free_result(char *result);
 
 /**
- * @brief Get the last error message.
- * @return Error message string, or empty string if no error
+ * @brief Get the last error message set on the calling thread.
+ * @return Error message string, or empty string if no error. Valid until the
+ *         next failing call on the same thread.
  */
 FFI_PLUGIN_EXPORT const char *get_last_error();
 
@@ -0,0 +1,95 @@
+/**
+ * @file dart_native_port.h
+ * @brief Minimal subset of the Dart native messaging API (dynamic linking).
+ *
+ * Declares only what the bridge needs to post messages to a Dart SendPort
+ * from native threads: the Dart_CObject message layout from the SDK's
+ * dart_native_api.h and the function table handed over by
+ * `NativeApi.initializeApiDLData` (see the SDK's dart_api_dl.h). The layouts
+ * must stay binary compatible with the Dart SDK; DL API major version 2.
+ */
+
+#ifndef DART_NATIVE_PORT_H
+#define DART_NATIVE_PORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DART_API_DL_MAJOR_VERSION 2
+
+typedef int64_t Dart_Port;
+
+#define ILLEGAL_PORT ((Dart_Port)0)
+
+typedef enum {
+  Dart_CObject_kNull = 0,
+  Dart_CObject_kBool,
+  Dart_CObject_kInt32,
+  Dart_CObject_kInt64,
+  Dart_CObject_kDouble,
+  Dart_CObject_kString,
+  Dart_CObject_kArray,
+  Dart_CObject_kTypedData,
+  Dart_CObject_kExternalTypedData,
+  Dart_CObject_kSendPort,
+  Dart_CObject_kCapability,
+  Dart_CObject_kNativePointer,
+  Dart_CObject_kUnsupported,
+  Dart_CObject_kUnmodifiableExternalTypedData,
+  Dart_CObject_kNumberOfTypes
+} Dart_CObject_Type;
+
+typedef struct _Dart_CObject {
+  Dart_CObject_Type type;
+  union {
+    bool as_bool;
+    int32_t as_int32;
+    int64_t as_int64;
+    double as_double;
+    const char *as_string;
+    struct {
+      Dart_Port id;
+      Dart_Port origin_id;
+    } as_send_port;
+    struct {
+      int64_t id;
+    } as_capability;
+    struct {
+      intptr_t length;
+      struct _Dart_CObject **values;
+    } as_array;
+    // Typed data variants are never posted by the bridge; reserve their size
+    struct {
+      int32_t type;
+      intptr_t length;
+      void *data;
+      void *peer;
+      void *callback;
+    } as_external_typed_data;
+  } value;
+} Dart_CObject;
+
+typedef bool (*Dart_PostCObject_Type)(Dart_Port port_id, Dart_CObject *message);
+
+/** One named entry of the DL function table. */
+typedef struct {
+  const char *name;
+  void (*function)(void);
+} DartApiEntry;
+
+/** Layout of the data behind `NativeApi.initializeApiDLData`. */
+typedef struct {
+  const int major;
+  const int minor;
+  const DartApiEntry *const functions;
+} DartApi;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DART_NATIVE_PORT_H